@@ -20,6 +20,7 @@ Array class
     :toctree: generated/
 
     Array.show
+    Array.arrayfactor
 
 ULAarray class
 ==============
@@ -46,6 +47,24 @@ AntArray class
     AntArray.xyztok
     AntArray.weights
 
+Precoder and Combiner
+=====================
+
+.. autosummary::
+    :toctree: generated/
+
+    Precoder.arrayfactor
+    Combiner.arrayfactor
+
+Array factor
+============
+
+.. autosummary::
+    :toctree: generated/
+
+    afchunk
+    afsep
+
 
 """
 class TXRU(object):
@@ -118,6 +137,64 @@ class Array(ant.Pattern):
         ax.set_zlabel('Z axis')
         return(fig,ax)
 
+    def arrayfactor(self, w=[], th=[], ph=[], grid=True, chunk=[]):
+        """ array factor for a batch of weights
+
+        Parameters
+        ----------
+
+        w  : np.array
+            Nb x Na x Nf batch of weights (default self.w)
+            or list [wx,wy,wz] of per axis weights (Nb x Ni x Nf) of a
+            uniform array
+        th : np.array
+            theta (default self.theta)
+        ph : np.array
+            phi (default self.phi)
+        grid : boolean
+            th x ph grid or list of directions
+        chunk : int
+            number of directions per chunk (afchunk)
+
+        Returns
+        -------
+
+        F : np.array
+            Nt x Np x Nb x Nf if grid else Nd x Nb x Nf
+
+        Notes
+        -----
+
+        Uniform arrays (self.separable) use afsep and the other ones afchunk,
+        neither of them forms the Nd x Na x Nf phase array.
+
+        """
+        if len(th) == 0:
+            th = self.theta
+            ph = self.phi
+            grid = self.grid
+        if grid:
+            sx = np.sin(th[:,None])*np.cos(ph[None,:])
+            sy = np.sin(th[:,None])*np.sin(ph[None,:])
+            sz = np.cos(th[:,None])*np.ones(len(ph))[None,:]
+            s = np.vstack((sx.ravel(),sy.ravel(),sz.ravel())).T
+        else:
+            s = np.vstack((np.sin(th)*np.cos(ph),
+                           np.sin(th)*np.sin(ph),
+                           np.cos(th))).T
+        if len(w) == 0:
+            w = self.w
+        if getattr(self,'separable',False):
+            F = afsep(self.N, self.dm, self.T, w, s, self.fGHz, chunk=chunk)
+        else:
+            p = self.p.reshape(3,-1)
+            if w.ndim != 3:
+                w = w.reshape(p.shape[1],-1)
+            F = afchunk(p, w, s, self.fGHz, chunk=chunk)
+        if grid:
+            F = F.reshape(len(th),len(ph),F.shape[1],F.shape[2])
+        return(F)
+
 class ULArray(Array):
     """ Uniform Linear Array
 
@@ -165,6 +242,8 @@ class ULArray(Array):
         self.dm = np.array(kwargs.pop('dm'))
         self.T = kwargs.pop('T')
         self.mode = kwargs.pop('mode')
+        # positions on a regular grid (see afsep)
+        self.separable = (self.mode == 'step')
 
         # self.Na = np.prod(self.N)
         p = kwargs.pop('p')
@@ -315,10 +394,13 @@ class AntArray(Array, ant.Antenna):
         # Uniform Array
         # p is obtained from ULArray
         #
+        self.separable = False
         if self.tarr == 'UA':
             if kwargs['p'] == []:
                 UA = ULArray(N = self.N, dm = self.dm , w = self.w)
                 p = UA.p
+                self.T = UA.T
+                self.separable = (self.array == []) and (np.prod(self.N[3:]) == 1)
             else:
                 p = kwargs['p']
 
@@ -368,8 +450,18 @@ class AntArray(Array, ant.Antenna):
         # s : space (3)
         # a : antennas
         # d : directions
+        if self.separable:
+            # product of the steering vectors along the array axes
+            # (ik = ix Ny Nz + iy Nz + iz)
+            W = np.ones((1,u.shape[1],len(k)))
+            for i in range(3):
+                n = np.arange(self.N[i]) - (self.N[i]-1)/2.
+                c = self.dm[i]*np.einsum('s,sd->d',self.T[:,i],u)
+                e = np.exp(1j*k[None,None,:]*c[None,:,None]*n[:,None,None])
+                W = (W[:,None,...]*e[None,...]).reshape(-1,e.shape[1],e.shape[2])
+            return(W)
         # (space,antenna) (space,directions) -> (antenna,directions)
-        up = np.einsum('sa,sd->ad',self.p,u)
+        up = np.einsum('sa,sd->ad',self.p.reshape(3,-1),u)
         W  = np.exp(1j*k[None,None,:]*up[...,None])
         return(W)
 
@@ -390,7 +482,7 @@ class AntArray(Array, ant.Antenna):
         return(st)
 
 class Precoder(AntArray):
-    def __init__(self,Fhs,Fbh,Fht):
+    def __init__(self,Fhs,Fbh,Ftb,**kwargs):
         """ Precoder from IQ stream to transmit antennas
 
         Fhs : Nrfchain (h)  x Nstream (s) x f  (stream -> rfchain) 
@@ -411,11 +503,14 @@ class Precoder(AntArray):
         >>> ub = np.random.randint(0,Nb,Nh)
         >>> Fbh[ub,np.arange(Nh)]=1
 
+        kwargs are passed to AntArray
+
         """
+        AntArray.__init__(self,**kwargs)
         # check dimensions validity 
         assert(Fhs.shape[0]==Fbh.shape[1])
         assert(Fbh.shape[0]==Ftb.shape[1])
-        assert(Ftb.shape[0]==self.p[1])
+        assert(Ftb.shape[0]==np.prod(self.p.shape[1:]))
         #
         #  s : stream axis 
         #  h : rfchain axis
@@ -435,18 +530,37 @@ class Precoder(AntArray):
         # from IQ streams to antennas 
         self.Fts = np.einsum('tbf,bsf->tsf',Ftb,self.Fbs)
 
+    def arrayfactor(self,**kwargs):
+        """ array factor of the Nstream precoders in one call
+
+        Returns
+        -------
+
+        F : np.array (... x Nstream x Nf)
+
+        See Also
+        --------
+
+        Array.arrayfactor
+
+        """
+        return AntArray.arrayfactor(self,w=np.rollaxis(self.Fts,1),**kwargs)
+
 
 class Combiner(AntArray):
-    def __init__(self,Wbr,Whb,Wsh):
+    def __init__(self,Wbr,Whb,Wsh,**kwargs):
         """ Combiner from receive antennas to IQ streams
 
         Wbr : Nbeam (b) x Nr (r)        (receive antennas - beams )  
         Whb : Nrfchain (h) x Nbeam (b)  (beams -> rfchain ) 
         Wsh : Nstream (s) x Nrfchain (rfchain -> stream )  
 
+        kwargs are passed to AntArray
+
         """
+        AntArray.__init__(self,**kwargs)
         # check dimensions validity 
-        assert(Wbr.shape[1]==self.p[1])
+        assert(Wbr.shape[1]==np.prod(self.p.shape[1:]))
         assert(Wbr.shape[0]==Whb.shape[1])
         assert(Whb.shape[0]==Wsh.shape[1])
         #
@@ -470,6 +584,149 @@ class Combiner(AntArray):
         # s x r x f 
         self.Wsr = np.einsum('shf,hrf->srf',Wsh,self.Whr)
 
+    def arrayfactor(self,**kwargs):
+        """ array factor of the Nstream combiners in one call
+
+        Returns
+        -------
+
+        F : np.array (... x Nstream x Nf)
+
+        See Also
+        --------
+
+        Array.arrayfactor
+
+        """
+        return AntArray.arrayfactor(self,w=self.Wsr,**kwargs)
+
+def afchunk(p, w, s, fGHz, chunk=[]):
+    """ array factor by chunks of directions
+
+    Parameters
+    ----------
+
+    p : np.array (3 x Na)
+        element positions (meters)
+    w : np.array (Nb x Na x Nf) or (Na x Nf)
+        batch of Nb weight vectors (the frequency axis can be 1)
+    s : np.array (Nd x 3)
+        unit vectors of the directions
+    fGHz : np.array (Nf)
+    chunk : int
+        number of directions per chunk (default : 2**20 phase terms)
+
+    Returns
+    -------
+
+    F : np.array (Nd x Nb x Nf)
+        F[d,b,f] = sum_a w[b,a,f] exp(1j k_f s_d.p_a)
+
+    Notes
+    -----
+
+    For each chunk of directions and each frequency the phase terms
+    (chunk x Na) are multiplied by the weights of all the beams in a
+    single matrix product.
+
+    """
+    if w.ndim == 2:
+        w = w[None,...]
+    Nb, Na, Nfw = w.shape
+    Nd = s.shape[0]
+    Nf = len(fGHz)
+    k = 2*np.pi*fGHz/0.3
+    if chunk == []:
+        chunk = max(1,int(2**20/Na))
+    F = np.empty((Nd,Nb,Nf),dtype=complex)
+    for i in range(0,Nd,chunk):
+        u = slice(i,i+chunk)
+        # chunk x Na
+        sp = np.dot(s[u],p)
+        for f in range(Nf):
+            E = np.exp(1j*k[f]*sp)
+            F[u,:,f] = np.dot(E,w[:,:,min(f,Nfw-1)].T)
+    return(F)
+
+def afsep(N, dm, T, w, s, fGHz, chunk=[]):
+    """ array factor of a uniform array by separable contraction
+
+    Parameters
+    ----------
+
+    N : list
+        [Nx,Ny,Nz]
+    dm : list
+        [dx,dy,dz] inter element distances (meters)
+    T : np.array (3 x 3)
+        basis of the array axes
+    w : np.array (Nb x Na x Nf) or (Na x Nf) with Na = Nx Ny Nz
+        batch of weights (ik = ix Ny Nz + iy Nz + iz)
+        or list [wx,wy,wz] of per axis weights (Nb x Ni x Nf)
+    s : np.array (Nd x 3)
+        unit vectors of the directions
+    fGHz : np.array (Nf)
+    chunk : int
+        number of directions per chunk
+
+    Returns
+    -------
+
+    F : np.array (Nd x Nb x Nf)
+
+    Notes
+    -----
+
+    The phase term of element (ix,iy,iz) is the product of 3 uniform
+    linear array terms, only Nd x (Nx+Ny+Nz) x Nf exponentials are
+    evaluated. Per axis weights give the product of the 3 ULA factors,
+    other weights are contracted along x, y and z in turn.
+
+    """
+    N = [int(n) for n in N[0:3]]
+    Nf = len(fGHz)
+    Nd = s.shape[0]
+    k = 2*np.pi*fGHz/0.3
+
+    def ula(i, u):
+        # Nd x Ni x Nf
+        n = np.arange(N[i]) - (N[i]-1)/2.
+        c = dm[i]*np.dot(s[u],T[:,i])
+        return np.exp(1j*k[None,None,:]*c[:,None,None]*n[None,:,None])
+
+    if type(w) == list:
+        F = 1
+        for i in range(3):
+            wi = w[i]
+            if wi.ndim == 2:
+                wi = wi[None,...]
+            wi = wi*np.ones(Nf)[None,None,:]
+            F = F*np.einsum('bnf,dnf->dbf',wi,ula(i,slice(0,Nd)))
+        return(F)
+
+    if w.ndim == 2:
+        w = w[None,...]
+    Nb = w.shape[0]
+    Nfw = w.shape[2]
+    W = w.reshape(Nb,N[0],N[1],N[2],Nfw)
+    if chunk == []:
+        chunk = max(1,int(2**20/(Nb*N[1]*N[2])))
+    F = np.empty((Nd,Nb,Nf),dtype=complex)
+    for j in range(0,Nd,chunk):
+        u = slice(j,j+chunk)
+        ex = ula(0,u)
+        ey = ula(1,u)
+        ez = ula(2,u)
+        for f in range(Nf):
+            Wf = W[...,min(f,Nfw-1)]
+            # contraction along x : (d x Nx) (Nx x Nb Ny Nz)
+            A = np.dot(ex[:,:,f],np.rollaxis(Wf,1).reshape(N[0],-1))
+            A = A.reshape(-1,Nb,N[1],N[2])
+            # along y and z
+            A = np.einsum('dy,dbyz->dbz',ey[:,:,f],A)
+            F[u,:,f] = np.einsum('dz,dbz->db',ez[:,:,f],A)
+    return(F)
+
 def k2xyz(ik, sh):
     """
 
@@ -35,6 +35,8 @@ Pattern Class
     Pattern.eval
     Pattern.gain
     Pattern.radF
+    Pattern.tabulate
+    Pattern.tabinterp
 
 Pattern Functions
 =================
@@ -136,6 +138,7 @@ Miscellaneous  functions
     forcesympol
     compdiag
     show3D
+    gridinterp
 
 
 """
@@ -146,6 +149,7 @@ import glob
 import re
 import pdb
 import sys
+import hashlib
 if sys.version_info.major==2:
     import PIL.Image as Image
     try:
@@ -333,8 +337,12 @@ class Pattern(PyLayers):
 
         #
         # evaluation of the specific Pattern__p function 
+        # or interpolation in the table (see tabulate)
         #
-        Ft,Fp = eval('self._Pattern__p'+self.typ)(param=self.param)
+        if getattr(self,'tabulated',False) and (self.typ!='azel'):
+            Ft,Fp = self.tabinterp()
+        else:
+            Ft,Fp = eval('self._Pattern__p'+self.typ)(param=self.param)
         if kwargs['inplace']:
             self.Ft = Ft
             self.Fp = Fp
@@ -353,6 +361,222 @@ class Pattern(PyLayers):
         if self.evaluated:
             ssh(self,L,dsf)
 
+    def tabulate(self,fGHz=[],tol=1e-3,nth=19,nph=36,nmax=2**20,save=True):
+        """ sample the pattern once for tabulated evaluation
+
+        Parameters
+        ----------
+
+        fGHz : np.array
+            tabulated frequencies (default self.fGHz)
+        tol : float
+            maximum interpolation error relative to max |F|
+        nth : int
+            initial number of theta samples
+        nph : int
+            initial number of phi samples
+        nmax : int
+            maximum number of directions of the table
+        save : boolean
+            save the table in the antenna directory
+
+        Returns
+        -------
+
+        err : float
+            relative interpolation error of the table
+
+        Notes
+        -----
+
+        Ft and Fp are sampled on a regular grid theta in [0,pi] x phi in
+        [0,2pi[. The grid is refined by 2 along both angles until the
+        bicubic interpolation from the coarse grid reproduces the fine
+        grid samples within tol, for all the frequencies.
+
+        The table is saved as <antenna>_<hash>.tab.npz (complex64) in the
+        antenna directory, the hash being built from the pattern type,
+        parameters, frequencies and tol, and from the content of the
+        pattern files (see _tabfile). A later call with the same
+        arguments and unchanged files reads it back instead of sampling
+        the pattern.
+
+        Once tabulated, eval interpolates the table (gridinterp) for the
+        tabulated frequencies. Set self.tabulated = False to come back to
+        the direct evaluation.
+
+        Examples
+        --------
+
+        >>> from pylayers.antprop.antenna import *
+        >>> A = Antenna('Gauss',fGHz=np.array([2.4,5.2]))
+        >>> err = A.tabulate(tol=1e-3,save=False)
+        >>> A.eval(th=np.array([1.5]),ph=np.array([0.1]),grid=False)
+
+        """
+        if fGHz == []:
+            fGHz = self.fGHz
+        fGHz = np.array(fGHz,dtype=float).ravel()
+
+        filetab = self._tabfile(fGHz,tol)
+
+        if os.path.isfile(filetab):
+            d = np.load(filetab)
+            self.tab = {k:d[k] for k in ['theta','phi','fGHz','Ft','Fp','err']}
+            d.close()
+            self.tabulated = True
+            return float(self.tab['err'])
+
+        # the evaluation state is restored after sampling
+        lstate = ['theta','phi','grid','nth','nph','fGHz','nf','full_evaluated']
+        state = {k:getattr(self,k) for k in lstate if hasattr(self,k)}
+        self.tabulated = False
+
+        kwargs = {'fGHz':fGHz,'grid':True,'inplace':False}
+        F0 = self.eval(nth=nth,nph=nph,**kwargs)
+        while True:
+            theta0 = np.linspace(0,np.pi,nth)
+            phi0 = np.linspace(0,2*np.pi,nph,endpoint=False)
+            nth = 2*nth - 1
+            nph = 2*nph
+            F1 = self.eval(nth=nth,nph=nph,**kwargs)
+            # interpolation of the coarse table on the fine grid
+            th = np.kron(self.theta,np.ones(nph))
+            ph = np.kron(np.ones(nth),self.phi)
+            Fi = gridinterp(theta0,phi0,F0,th,ph)
+            Fmax = max(np.max(np.abs(F1[0])),np.max(np.abs(F1[1])),1e-15)
+            err = max([np.max(np.abs(Fi[k].reshape(F1[k].shape)-F1[k])) for k in range(2)])/Fmax
+            if (err <= tol) or (4*nth*nph > nmax):
+                break
+            F0 = F1
+
+        self.tab = {'theta':self.theta,
+                    'phi':self.phi,
+                    'fGHz':fGHz,
+                    'Ft':F1[0].astype(np.complex64),
+                    'Fp':F1[1].astype(np.complex64),
+                    'err':np.array(err)}
+
+        for k in state:
+            setattr(self,k,state[k])
+        self.tabulated = True
+
+        if save:
+            np.savez(filetab,**self.tab)
+
+        return err
+
+    def _sourcefiles(self):
+        """ files the pattern is read from
+
+        Returns
+        -------
+
+        lfile : list
+            long names of the existing pattern files (empty for an
+            analytical pattern)
+
+        """
+        lshort = []
+        if getattr(self,'fromfile',False):
+            if isinstance(self._filename,list):
+                lf = self._filename
+            else:
+                lf = [self._filename]
+            for d in [getattr(self,'_directory','ant'),pstruc['DIRANT']]:
+                for f in lf:
+                    lshort.append((f,d))
+                    lshort.append((f.split('.')[0]+'.'+self.typ,d))
+        if self.typ == 'cst':
+            param = getattr(self,'param',{})
+            d = param.get('directory','')
+            for f in param.get('fGHz',[]):
+                if ((int(f*10))%10)==0:
+                    sf = str(int(f))
+                else:
+                    sf = str(f)
+                lshort.append(('E_port'+str(param.get('p',2))+'_f'+sf+'GHz.txt',d))
+                lshort.append(('E_port'+str(param.get('p',2))+'_f'+sf+'Ghz.txt',d))
+        lfile = []
+        for f,d in lshort:
+            filename = pyu.getlong(f,d)
+            if os.path.isfile(filename) and (filename not in lfile):
+                lfile.append(filename)
+        return lfile
+
+    def _tabfile(self,fGHz,tol):
+        """ file name of the table of tabulate
+
+        Parameters
+        ----------
+
+        fGHz : np.array
+        tol : float
+
+        Returns
+        -------
+
+        filetab : string
+            long name <antenna>_<hash>.tab.npz in the antenna directory
+
+        Notes
+        -----
+
+        The hash depends on the pattern type, parameters, frequencies and
+        tol, and on the content of the pattern files (_sourcefiles), so
+        that an edited file does not reuse the table of the former one.
+
+        """
+        if isinstance(self._filename,str):
+            name = os.path.splitext(os.path.basename(self._filename))[0]
+        else:
+            name = self.typ
+        param = getattr(self,'param',{})
+        key = self.typ + str(sorted(param.items())) + str(fGHz.tolist()) + str(tol)
+        m = hashlib.md5(key)
+        for filename in self._sourcefiles():
+            fd = open(filename,'rb')
+            m.update(fd.read())
+            fd.close()
+        _filetab = name + '_' + m.hexdigest()[:8] + '.tab.npz'
+        return pyu.getlong(_filetab,pstruc['DIRANT'])
+
+    def tabinterp(self):
+        """ interpolate the table of tabulate at (self.theta,self.phi)
+
+        Returns
+        -------
+
+        Ft , Fp : np.array
+            (Nt x Np x Nf) if self.grid else (Ndir x Nf)
+
+        Notes
+        -----
+
+        Frequencies which are not in the table are evaluated directly
+        with the pattern function.
+
+        """
+        tab = self.tab
+        kf = np.array([np.where(np.abs(tab['fGHz']-f)<1e-9)[0][0]
+                       if np.any(np.abs(tab['fGHz']-f)<1e-9) else -1
+                       for f in self.fGHz])
+        if np.any(kf<0):
+            return eval('self._Pattern__p'+self.typ)(param=self.param)
+
+        if self.grid:
+            th = np.kron(self.theta,np.ones(self.nph))
+            ph = np.kron(np.ones(self.nth),self.phi)
+        else:
+            th = self.theta
+            ph = self.phi
+        Ft, Fp = gridinterp(tab['theta'],tab['phi'],
+                            (tab['Ft'][...,kf],tab['Fp'][...,kf]),th,ph)
+        if self.grid:
+            Ft = Ft.reshape(self.nth,self.nph,self.nf)
+            Fp = Fp.reshape(self.nth,self.nph,self.nf)
+        return Ft, Fp
+
     def __pOmni(self,**kwargs):
         """  omnidirectional pattern
 
@@ -1117,13 +1341,6 @@ class Pattern(PyLayers):
         assert hasattr(self,'C'),'no spherical coefficient'
         assert hasattr(self.C.Br,'s3'),'no shape 3 coeff in vsh'
 
-        if self.grid:
-            theta = np.kron(self.theta, np.ones(self.nph))
-            phi = np.kron(np.ones(self.nth),self.phi)
-        else:
-            theta = self.theta
-            phi = self.phi
-
         Br  = self.C.Br.s3
         lBr = self.C.Br.ind3[:, 0]
         mBr = self.C.Br.ind3[:, 1]
@@ -1136,18 +1353,12 @@ class Pattern(PyLayers):
         M = mBr.max()
 
         # vector spherical harmonics basis functions
+        if self.grid:
+            V, W = VWgrid(lBr, mBr, self.theta, self.phi)
+        else:
+            V, W = VW(lBr, mBr, self.theta, self.phi)
 
-        # V, W = VW(lBr, mBr, theta, phi)
-        V, W = VW(lBr, mBr, theta, phi)
-        Fth = np.dot(Br, np.real(V.T)) - \
-              np.dot(Bi, np.imag(V.T)) + \
-              np.dot(Ci, np.real(W.T)) + \
-              np.dot(Cr, np.imag(W.T))
-
-        Fph = -np.dot(Cr, np.real(V.T)) + \
-               np.dot(Ci, np.imag(V.T)) + \
-               np.dot(Bi, np.real(W.T)) + \
-               np.dot(Br, np.imag(W.T))
+        Fth, Fph = VWsynth(Br, Bi, Cr, Ci, V, W)
 
         # here Nf x Nd
 
@@ -1524,13 +1735,6 @@ class Pattern(PyLayers):
             w = self.w.reshape(Np,lshw[-1])
         else:
             w = self.w
-        # s : Nd x 3
-        # p : 3 x Np
-        #
-        # sdotp : Nd x Np
-
-        sdotp  = np.dot(self.s,p)   # s . p
-        
         for a in self.la:
             if not self.grid:
                 a.eval(grid=self.grid,ph=self.phi,th=self.theta)
@@ -1579,31 +1783,44 @@ class Pattern(PyLayers):
         #if len(.w.shape)==3:
         #    self.wp   = self.wp[None,:,:,:]
 
-        # aFT :  Nd x Np x Nf
-        # E   :  Nd x Np x Nf
-
-        E    = np.exp(1j*k[None,None,:]*sdotp[:,:,None])
-
-        #
-        # wp  : Np x Nf 
-        # Fp  : Nd x Np x Nf
-        # Ft  : Nd x Np x Nf
-        #
-        Ft = wp[None,...]*aFt*E
-        Fp = wp[None,...]*aFp*E
-
         if self.grid:
         #
-        # Integrate over the Np points (axis =1)
+        # Integrate over the Np points
         # only if self.grid
+        # same element pattern : F = aF x array factor
+        # AF  : Nd x 1 x Nf
         # Fp  : Nd x Nf
         # Ft  : Nd x Nf
         #
-            Ft = np.sum(Ft,axis=1)
-            Fp = np.sum(Fp,axis=1)
+            from pylayers.antprop.aarray import afchunk, afsep
+            if getattr(self,'separable',False):
+                AF = afsep(self.N,self.dm,self.T,wp,self.s,self.fGHz)
+            else:
+                AF = afchunk(p,wp,self.s,self.fGHz)
+            Ft = aFt[:,0,:]*AF[:,0,:]
+            Fp = aFp[:,0,:]*AF[:,0,:]
             sh = Ft.shape
             Ft = Ft.reshape(self.nth,self.nph,sh[1])
             Fp = Fp.reshape(self.nth,self.nph,sh[1])
+        else:
+            # s : Nd x 3
+            # p : 3 x Np
+            #
+            # sdotp : Nd x Np
+            sdotp  = np.dot(self.s,p)   # s . p
+
+            # aFT :  Nd x Np x Nf
+            # E   :  Nd x Np x Nf
+
+            E    = np.exp(1j*k[None,None,:]*sdotp[:,:,None])
+
+            #
+            # wp  : Np x Nf 
+            # Fp  : Nd x Np x Nf
+            # Ft  : Nd x Np x Nf
+            #
+            Ft = wp[None,...]*aFt*E
+            Fp = wp[None,...]*aFp*E
 
         return Ft,Fp
 
@@ -2083,6 +2300,8 @@ class Antenna(Pattern):
         self.full_evaluated = False
 
         if self.fromfile:
+            # directory of the pattern files (see _sourcefiles)
+            self._directory = kwargs['directory']
             if isinstance(typ,str):
                 self._filename = typ
                 if self.ext == 'vsh3':
@@ -3845,7 +4064,7 @@ class Antenna(Pattern):
 
         x = -np.cos(theta)
 
-        Pmm1n, Pmp1n = AFLegendre3(L, M, x)
+        Pmm1n, Pmp1n = AFLegendrec(L, M, x, f=AFLegendre3)
         ind = index_vsh(L, M)
 
         l = ind[:, 0]
@@ -3853,53 +4072,20 @@ class Antenna(Pattern):
 
         V, W = VW2(l, m, x, phi, Pmm1n, Pmp1n)  # K2 x Ndir
 
-        # Fth , Fph are Nf x Ndir
+        #
+        # energy of each coefficient summed over frequencies and
+        # directions : |B(f)|^2 |V(dir)|^2 is separable
+        #
+        st = np.sin(theta)[:,None]
+        Vr2 = np.sum(np.real(V)**2*st,axis=0)
+        Vi2 = np.sum(np.imag(V)**2*st,axis=0)
+        Wr2 = np.sum(np.real(W)**2*st,axis=0)
+        Wi2 = np.sum(np.imag(W)**2*st,axis=0)
 
-        tEBr = []
-        tEBi = []
-        tECr = []
-        tECi = []
-
-        for k in range(K2):
-            BrVr = np.dot(Br[:,k].reshape(Nf,1),
-                          np.real(V.T)[k,:].reshape(1,Ndir))
-            BiVi = np.dot(Bi[:,k].reshape(Nf,1),
-                          np.imag(V.T)[k,:].reshape(1,Ndir))
-            CiWr = np.dot(Ci[:,k].reshape(Nf,1),
-                          np.real(W.T)[k,:].reshape(1,Ndir))
-            CrWi = np.dot(Cr[:,k].reshape(Nf,1),
-                          np.imag(W.T)[k,:].reshape(1,Ndir))
-
-            CrVr = np.dot(Cr[:,k].reshape(Nf,1),
-                          np.real(V.T)[k,:].reshape(1,Ndir))
-            CiVi = np.dot(Ci[:,k].reshape(Nf,1),
-                          np.imag(V.T)[k,:].reshape(1,Ndir))
-            BiWr = np.dot(Bi[:,k].reshape(Nf,1),
-                          np.real(W.T)[k,:].reshape(1,Ndir))
-            BrWi = np.dot(Br[:,k].reshape(Nf,1),
-                          np.imag(W.T)[k,:].reshape(1,Ndir))
-
-            EBr = np.sum(BrVr*np.conj(BrVr)*np.sin(theta)) + \
-                  np.sum(BrWi*np.conj(BrWi)*np.sin(theta))
-
-            EBi = np.sum(BiVi*np.conj(BiVi)*np.sin(theta)) + \
-                  np.sum(BiWr*np.conj(BiWr)*np.sin(theta))
-
-            ECr = np.sum(CrWi*np.conj(CrWi)*np.sin(theta)) + \
-                + np.sum(CrVr*np.conj(CrVr)*np.sin(theta))
-
-            ECi = np.sum(CiWr*np.conj(CiWr)*np.sin(theta)) + \
-                + np.sum(CiVi*np.conj(CiVi)*np.sin(theta))
-
-            tEBr.append(EBr)
-            tEBi.append(EBi)
-            tECr.append(ECr)
-            tECi.append(ECi)
-
-        #Fth = np.dot(Br, np.real(V.T)) - np.dot(Bi, np.imag(V.T)) + \
-        #      np.dot(Ci, np.real(W.T)) + np.dot(Cr, np.imag(W.T))
-        #Fph = -np.dot(Cr, np.real(V.T)) + np.dot(Ci, np.imag(V.T)) + \
-        #      np.dot(Bi, np.real(W.T)) + np.dot(Br, np.imag(W.T))
+        tEBr = np.sum(np.abs(Br)**2,axis=0)*(Vr2+Wi2)
+        tEBi = np.sum(np.abs(Bi)**2,axis=0)*(Vi2+Wr2)
+        tECr = np.sum(np.abs(Cr)**2,axis=0)*(Wi2+Vr2)
+        tECi = np.sum(np.abs(Ci)**2,axis=0)*(Wr2+Vi2)
 
         return np.array(tEBr),np.array(tEBi),np.array(tECr),np.array(tECi)
 
@@ -3944,7 +4130,7 @@ class Antenna(Pattern):
 
         x = -np.cos(theta)
 
-        Pmm1n, Pmp1n = AFLegendre3(L, M, x)
+        Pmm1n, Pmp1n = AFLegendrec(L, M, x, f=AFLegendre3)
         ind = index_vsh(L, M)
 
         l = ind[:, 0]
@@ -3953,11 +4139,7 @@ class Antenna(Pattern):
         V, W = VW2(l, m, x, phi, Pmm1n, Pmp1n)  # K2 x Ndir
 
         # Fth , Fph are Nf x Ndir
-        Fth = np.dot(Br, np.real(V.T)) - np.dot(Bi, np.imag(V.T)) + \
-              np.dot(Ci, np.real(W.T)) + np.dot(Cr, np.imag(W.T))
-
-        Fph = -np.dot(Cr, np.real(V.T)) + np.dot(Ci, np.imag(V.T)) + \
-              np.dot(Bi, np.real(W.T)) + np.dot(Br, np.imag(W.T))
+        Fth, Fph = VWsynth(Br, Bi, Cr, Ci, V, W)
 
         if self.grid:
             Nf = len(self.fGHz)
@@ -3995,10 +4177,6 @@ class Antenna(Pattern):
 
         if typ =='vsh' :
 
-            if self.grid:
-                theta = np.kron(theta, np.ones(self.nph))
-                phi = np.kron(np.ones(self.nth),phi)
-
             Br = self.C.Br.s2
             Bi = self.C.Bi.s2
             Cr = self.C.Cr.s2
@@ -4007,27 +4185,18 @@ class Antenna(Pattern):
             N = self.C.Br.N2
             M = self.C.Br.M2
 
-            #print "N,M",N,M
-            #
-            # The - sign is necessary to get the good reconstruction
-            #     deduced from observation
-            #     May be it comes from a different definition of theta in SPHEREPACK
-            x = -np.cos(theta)
-
-            Pmm1n, Pmp1n = AFLegendre3(N, M, x)
             ind = index_vsh(N, M)
 
             n = ind[:, 0]
             m = ind[:, 1]
 
-            #~ V, W = VW(n, m, x, phi, Pmm1n, Pmp1n)
-            V, W = VW(n, m, x, phi)
-
+            # VW takes theta (x = -cos(theta) is evaluated inside)
+            if self.grid:
+                V, W = VWgrid(n, m, theta, phi)
+            else:
+                V, W = VW(n, m, theta, phi)
 
-            Fth = np.dot(Br, np.real(V.T)) - np.dot(Bi, np.imag(V.T)) + \
-                np.dot(Ci, np.real(W.T)) + np.dot(Cr, np.imag(W.T))
-            Fph = -np.dot(Cr, np.real(V.T)) + np.dot(Ci, np.imag(V.T)) + \
-                np.dot(Bi, np.real(W.T)) + np.dot(Br, np.imag(W.T))
+            Fth, Fph = VWsynth(Br, Bi, Cr, Ci, V, W)
 
             if self.grid:
                 Fth = Fth.reshape(self.nf, self.nth, self.nph)
@@ -4130,6 +4299,8 @@ class Antenna(Pattern):
             #self.phi = phi[None,:]
             self.theta = theta
             self.phi = phi
+            thetag = theta
+            phig = phi
             theta = np.kron(theta, np.ones(Np))
             phi = np.kron(np.ones(Nt),phi)
 
@@ -4150,17 +4321,12 @@ class Antenna(Pattern):
             M = mBr.max()
 
             # vector spherical harmonics basis functions
-            V, W = VW(lBr, mBr, theta, phi)
-
-            Fth = np.dot(Br, np.real(V.T)) - \
-                  np.dot(Bi, np.imag(V.T)) + \
-                  np.dot(Ci, np.real(W.T)) + \
-                  np.dot(Cr, np.imag(W.T))
+            if self.grid:
+                V, W = VWgrid(lBr, mBr, thetag, phig)
+            else:
+                V, W = VW(lBr, mBr, theta, phi)
 
-            Fph = -np.dot(Cr, np.real(V.T)) + \
-                   np.dot(Ci, np.imag(V.T)) + \
-                   np.dot(Bi, np.real(W.T)) + \
-                   np.dot(Br, np.imag(W.T))
+            Fth, Fph = VWsynth(Br, Bi, Cr, Ci, V, W)
 
             if self.grid:
 
@@ -5506,6 +5672,71 @@ def _dirmax(G,th,ph):
     hl = np.cross(sl,el)
     return GdBmax,theta_max,phi_max,(hl,sl,el)
 
+def gridinterp(theta,phi,lF,th,ph):
+    """ bicubic interpolation of patterns sampled on a regular grid
+
+    Parameters
+    ----------
+
+    theta : np.array (Nt)
+        regular samples of [0,pi]
+    phi : np.array (Np)
+        regular samples of [0,2pi[
+    lF : list of np.array (Nt x Np x Nf)
+        sampled patterns
+    th : np.array (Nd)
+    ph : np.array (Nd)
+        directions
+
+    Returns
+    -------
+
+    lFi : list of np.array (Nd x Nf)
+
+    Notes
+    -----
+
+    Catmull-Rom cubic convolution along theta and phi (4 x 4 samples per
+    direction). phi is periodic and theta is clamped at the poles.
+
+    See Also
+    --------
+
+    Pattern.tabulate
+
+    """
+    Nt = len(theta)
+    Np = len(phi)
+    dth = theta[1]-theta[0]
+    dph = 2*np.pi/Np
+
+    u = (np.clip(th,theta[0],theta[-1])-theta[0])/dth
+    it = np.minimum(np.floor(u).astype(int),Nt-2)
+    t = u - it
+    v = np.mod(ph-phi[0],2*np.pi)/dph
+    ip = np.floor(v).astype(int)
+    p = v - ip
+
+    def w(t):
+        t2 = t*t
+        t3 = t2*t
+        return [0.5*(-t3+2*t2-t),
+                0.5*(3*t3-5*t2+2),
+                0.5*(-3*t3+4*t2+t),
+                0.5*(t3-t2)]
+
+    wt = w(t)
+    wp = w(p)
+    lFi = [0 for F in lF]
+    for a in range(4):
+        ia = np.clip(it+a-1,0,Nt-1)
+        for b in range(4):
+            ib = np.mod(ip+b-1,Np)
+            wab = (wt[a]*wp[b])[:,None]
+            for k,F in enumerate(lF):
+                lFi[k] = lFi[k] + wab*F[ia,ib]
+    return lFi
+
 def F0(nu,sigma):
     """ F0 function for horn antenna pattern 
     
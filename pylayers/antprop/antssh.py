@@ -54,16 +54,9 @@ def SSHFunc(L, theta,phi):
 
     l = np.arange(0,1+L).reshape(1,(1+L))
     m = np.arange(0,1+L).reshape(((1+L),1))
-    # normalize the associated Legendre polynoms
-    NRM = np.sqrt((2*l+1)*factorial(l-abs(m))/(4*np.pi*factorial(l+abs(m))))
-    NRM = NRM.reshape((1+L,1+L,1))
-    # compute the associated Legendre polynoms part Plm(cos(theta))
-    ll = l.reshape(1,(1+L),1)
-    mm = m.reshape(((1+L),1,1))
-    x  = np.cos(theta).reshape((1,1, len(theta)))
-    PLM = sp.special.lpmv(mm,ll,x)
-    # Normalize
-    NPLM = NRM*PLM
+    # normalized associated Legendre polynoms part Plm(cos(theta))
+    x  = np.cos(theta)
+    NPLM = Legendre(L,L,x)[1:L+2]/np.sqrt(2*np.pi)
     NPLM = NPLM.reshape((1+L,1+L,len(theta),1))
     # compute the exp(j*m*phi) part
     PHI = phi.reshape((1,len(phi)))
@@ -110,16 +103,9 @@ def SSHFunc2(L, theta,phi):
     nray = len(theta)
     l = np.arange(0,1+L).reshape(1,(1+L))
     m = np.arange(0,1+L).reshape(((1+L),1))
-    # normalize the associated legendre polynoms
-    NRM = np.sqrt((2*l+1)*factorial(l-abs(m))/(4*np.pi*factorial(l+abs(m))))
-    NRM = NRM.reshape((1+L,1+L,1))
-    # compute the associated legendre polynoms part Plm(cos(theta))
-    ll = l.reshape(1,(1+L),1)
-    mm = m.reshape(((1+L),1,1))
-    x  = np.cos(theta).reshape((1,1, nray))
-    PLM = sp.special.lpmv(mm,ll,x)
-    # Normalize
-    NPLM = NRM*PLM
+    # normalized associated legendre polynoms part Plm(cos(theta))
+    x  = np.cos(theta)
+    NPLM = Legendre(L,L,x)[1:L+2]/np.sqrt(2*np.pi)
     NPLM = NPLM.reshape((1+L,1+L,nray))
     # compute the exp(j*m*phi) part
     PHI = phi.reshape((1,nray))
@@ -55,6 +55,7 @@ Tchannel
     Tchannel.apply
     Tchannel.applywav
     Tchannel.getcir
+    Tchannel.gencir
     Tchannel.get_cir
     Tchannel.chantap
     Tchannel.baseband
@@ -174,6 +175,65 @@ try:
 except:
     print('h5py is not installed: Ctilde(object cannot be saved)')
 
+
+def _nufft1(c,x,N,msp=12,R=2):
+    """ type 1 non uniform fft on the N first non negative frequencies
+
+    Parameters
+    ----------
+
+    c : np.array (r x P)
+        complex amplitudes of r non uniform points for P channels
+    x : np.array (r,)
+        positions of the points (cycles per frequency sample)
+    N : int
+        number of frequency samples
+    msp : int
+        half width of the gaussian spreading kernel (grid samples)
+    R : int
+        oversampling factor
+
+    Returns
+    -------
+
+    F : np.array (P x N)
+        F[p,k] = sum_r c[r,p] exp(-2j pi k x[r])
+
+    Notes
+    -----
+
+    Gaussian gridding (Greengard and Lee, SIAM Review 2004) : the points
+    are spread on a grid of R*N samples which is Fourier transformed and
+    deconvolved from the gaussian. The cost is O(r msp + N log N) and the
+    r x N product is never formed. msp=12, R=2 gives a relative error
+    close to 1e-12.
+
+    """
+    r, P = c.shape
+    Mr = R*N
+    K0 = N//2
+    tau = np.pi*msp/(N*N*R*(R-0.5))
+    theta = 2*np.pi*np.mod(x,1)
+    # modes k = kp + K0 with kp in [-K0,N-K0[
+    c = c*np.exp(-1j*K0*theta)[:,None]
+    h = 2*np.pi/Mr
+    m0 = np.floor(theta/h).astype(int)
+    off = np.arange(P)*Mr
+    gr = np.zeros(P*Mr)
+    gi = np.zeros(P*Mr)
+    for l in range(-msp+1,msp+1):
+        m = m0 + l
+        w = np.exp(-(theta-m*h)**2/(4*tau))
+        u = (np.mod(m,Mr)[:,None]+off[None,:]).ravel()
+        wc = (w[:,None]*c).ravel()
+        gr += np.bincount(u,weights=wc.real,minlength=P*Mr)
+        gi += np.bincount(u,weights=wc.imag,minlength=P*Mr)
+    g = (gr+1j*gi).reshape(P,Mr)
+    Ft = fft.fft(g,axis=1)/Mr
+    kp = np.arange(N)-K0
+    F = np.sqrt(np.pi/tau)*np.exp(kp*kp*tau)[None,:]*Ft[:,np.mod(kp,Mr)]
+    return F
+
 class AFPchannel(bs.FUsignal):
     """ Angular Frequency Profile channel
 
@@ -2872,7 +2932,7 @@ class Tchannel(bs.FUsignal):
         return rir
 
 
-    def getcir(self,BWGHz=1,Nf=40000,fftshift=False):
+    def getcir(self,BWGHz=1,Nf=40000,fftshift=False,method='nufft',chunk=[]):
         """ get the channel impulse response
 
         Parameters
@@ -2881,35 +2941,129 @@ class Tchannel(bs.FUsignal):
         BWGHz : Bandwidth 
         Nf    : Number of frequency points
         fftshift : boolean 
+        method : string
+            'nufft' : the rays are gridded in frequency with a non uniform
+                      fft, then transformed back in time
+            'bin'   : the amplitude of each ray is added to its nearest
+                      delay bin (O(r+Nf), exact when the delays are
+                      multiple of the time step)
+            'dense' : rays x nr x nt x Nf delay-frequency product,
+                      evaluated by chunk of rays
+        chunk : int
+            number of rays of a chunk for the 'dense' method
+            (default : 2**22 elements)
+
+        Notes
+        -----
+
+        The 'nufft' and 'bin' methods use the first frequency of self.y.
+        If self.y has Nf frequency points the 'dense' method is used.
 
         See Also
         --------
 
         pylayers.simul.link.DLink.plt_cir
+        pylayers.antprop.channel.Tchannel.gencir
+
+        """
+        tauns, cir = self._cir(self.y,BWGHz=BWGHz,Nf=Nf,fftshift=fftshift,
+                               method=method,chunk=chunk)
+        cir = bs.TUsignal(x=tauns,y=cir)
+
+        return(cir)
+
+    def gencir(self,BWGHz=1,Nf=40000,fftshift=False,method='nufft'):
+        """ generator of the channel impulse responses of each antenna pair
+
+        Parameters
+        ----------
+
+        BWGHz : Bandwidth 
+        Nf    : Number of frequency points
+        fftshift : boolean 
+        method : string
+            see getcir
+
+        Returns
+        -------
+
+        (ir,it,cir) : receiver index, transmitter index and TUsignal
+            of the impulse response (Nf samples) of the pair
+
+        Notes
+        -----
+
+        Only one impulse response is held in memory at a time, which
+        allows to write large MIMO responses to disk pair by pair.
+
+        Examples
+        --------
+
+        >>> for ir,it,cir in H.gencir(BWGHz=5,Nf=10000): # doctest: +SKIP
+        ...     np.save('cir_'+str(ir)+'_'+str(it),cir.y) # doctest: +SKIP
+
+        """
+        nr = self.y.shape[1]
+        nt = self.y.shape[2]
+        for ir in range(nr):
+            for it in range(nt):
+                tauns, cir = self._cir(self.y[:,ir:ir+1,it:it+1,:],
+                                       BWGHz=BWGHz,Nf=Nf,fftshift=fftshift,
+                                       method=method)
+                yield ir, it, bs.TUsignal(x=tauns,y=cir[0,0,:])
+
+    def _cir(self,y,BWGHz=1,Nf=40000,fftshift=False,method='nufft',chunk=[]):
+        """ impulse response of y (r x nr x nt x f)
+
+        Returns
+        -------
+
+        tauns : np.array (Nf)
+        cir : np.array (nr x nt x Nf)
 
         """
         fGHz  = np.linspace(0,BWGHz,Nf)
         dfGHz = fGHz[1]-fGHz[0]
         tauns = np.linspace(0,1/dfGHz,Nf)
-        # E : r x nr x nt x f 
-        E    = np.exp(-2*1j*np.pi*self.taud[:,None,None,None]*fGHz[None,None,None,:])
-        # self.y : r x nr x nt x f 
-        if self.y.shape[3]==E.shape[3]:
-            H    = np.sum(E*self.y,axis=0)
+        nr = y.shape[1]
+        nt = y.shape[2]
+        if (y.shape[3]==Nf) and (Nf>1):
+            method = 'dense'
+        if method=='dense':
+            if chunk==[]:
+                chunk = max(1,int(2**22/(nr*nt*Nf)))
+            H = np.zeros((nr,nt,Nf),dtype=complex)
+            for k in range(0,len(self.taud),chunk):
+                u = slice(k,k+chunk)
+                # E : chunk x nr x nt x f 
+                E = np.exp(-2*1j*np.pi*self.taud[u,None,None,None]*fGHz[None,None,None,:])
+                # y : r x nr x nt x f 
+                if (y.shape[3]==Nf) or (y.shape[3]==1):
+                    H += np.sum(E*y[u],axis=0)
+                else:
+                    H += np.sum(E*y[u,:,:,0][:,:,:,None],axis=0)
+            # back in time - last axis is frequency (axis=2) 
+            cir  = np.fft.ifft(H,axis=2)
         else:
-            if self.y.shape[3]==1:
-                H    = np.sum(E*self.y,axis=0)
+            # delay of the rays in frequency samples
+            x = self.taud*dfGHz
+            c = y[:,:,:,0].reshape(len(x),nr*nt)
+            if method=='nufft':
+                H = _nufft1(c,x,Nf).reshape(nr,nt,Nf)
+                cir  = np.fft.ifft(H,axis=2)
+            elif method=='bin':
+                n = np.mod(np.round(x*Nf).astype(int),Nf)
+                u = (n[:,None]+Nf*np.arange(nr*nt)[None,:]).ravel()
+                cr = np.bincount(u,weights=c.real.ravel(),minlength=nr*nt*Nf)
+                ci = np.bincount(u,weights=c.imag.ravel(),minlength=nr*nt*Nf)
+                cir = (cr+1j*ci).reshape(nr,nt,Nf)
             else:
-                H    = np.sum(E*self.y[:,:,:,0][:,:,:,None],axis=0)
-        # back in time - last axis is frequency (axis=2) 
-        cir  = np.fft.ifft(H,axis=2)
+                raise NameError('getcir : unknown method '+method)
         if fftshift:
             cir = np.fft.fftshift(cir,axes=2)
             tauns = np.linspace(-Nf/(2*BWGHz),Nf/(2*BWGHz)-1/BWGHz,Nf)
 
-        cir = bs.TUsignal(x=tauns,y=cir)
-
-        return(cir)
+        return tauns, cir
 
     def get_cir(self,Wgam=[]):
         """ get Channel impulse response of the channel 
@@ -4714,16 +4868,24 @@ class Ctilde(PyLayers):
             file name of h5py file Link format
         grpname  : int
             groupname in filenameh5
+        ifreq : slice
+            frequency sub band to load (default : whole band)
+
+        Notes
+        -----
 
+        ifreq allows to read back by frequency chunks a wide band
+        channel written by Rays.eval(...,filenameh5=,grpname=)
 
         """
 
+        ifreq = kwargs.get('ifreq',slice(None))
         filename=pyu.getlong(filenameh5,pstruc['DIRLNK'])
         try:
             fh5=h5py.File(filename,'r')
             f = fh5['Ct/'+grpname]
 
-            self.fGHz = f['fGHz'][:]
+            self.fGHz = f['fGHz'][ifreq]
             self.tang = f['tang'][:]
             self.rang = f['rang'][:]
             self.tauk = f['tauk'][:]
@@ -4731,10 +4893,10 @@ class Ctilde(PyLayers):
             self.Ta = f['Ta'][:]
             self.Tb = f['Tb'][:]
 
-            Ctt = f['Ctt_y'][:]
-            Cpp = f['Cpp_y'][:]
-            Ctp = f['Ctp_y'][:]
-            Cpt = f['Cpt_y'][:]
+            Ctt = f['Ctt_y'][:,ifreq]
+            Cpp = f['Cpp_y'][:,ifreq]
+            Ctp = f['Ctp_y'][:,ifreq]
+            Cpt = f['Cpt_y'][:,ifreq]
 
             self.Ctt = bs.FUsignal(self.fGHz, Ctt)
             self.Ctp = bs.FUsignal(self.fGHz, Ctp)
@@ -8,6 +8,7 @@ Class Coverage
 
     Coverage.creategrid
     Coverage.cover
+    Coverage.coverap
     Coverage.sinr
     Coverage.best
     Coverage.show
@@ -34,6 +35,8 @@ import ConfigParser
 import pdb
 import doctest
 from itertools import product
+import multiprocessing as mp
+import h5py
 try:
     from mayavi import mlab
     from tvtk.tools import visual
@@ -41,6 +44,9 @@ try:
 except:
     print 'mayavi not installed'
 
+# coverage shared with the forked workers of Coverage.cover
+_C_run = None
+
 
 class Coverage(PyLayers):
     """ Handle Layout Coverage
@@ -276,7 +282,7 @@ class Coverage(PyLayers):
             except:
                 pass
 
-    def cover(self,sinr=True,snr=True,best=True):
+    def cover(self,sinr=True,snr=True,best=True,nproc=0,maps=True,fileh5=''):
         """ run the coverage calculation
 
         Parameters
@@ -285,6 +291,15 @@ class Coverage(PyLayers):
         sinr : boolean
         snr  : boolean
         best : boolean
+        nproc : int
+            number of processes evaluating the access points concurrently
+            (0 : sequential, -1 : all the cpu)
+        maps : boolean
+            keep the (nf x ng x na) maps of every access point. If False
+            only the running reductions over the access points are kept
+        fileh5 : string
+            if not '' the maps of each access point are streamed to this
+            h5 file (output directory) as soon as they are evaluated
 
         Examples
         --------
@@ -320,6 +335,19 @@ class Coverage(PyLayers):
         + snro : SNR polar o (H)
         + snrp : SNR polar p (H)
 
+        Whatever maps, the following (nf x ng) reductions over the access
+        points are updated as each access point is evaluated :
+
+        + CmWtoto, CmWtotp : total received power (mW)
+        + CmWbesto, CmWbestp : best received power (mW)
+        + CmWseco, CmWsecp : second best received power (mW)
+        + ibesto, ibestp : index of the best server
+        + snrbesto, snrbestp, sinrbesto, sinrbestp : SNR and SINR of the
+          best server
+
+        With maps=False, CmWo, snro, sinro and bestsvo (and p) are the best
+        server maps with a single access point axis so that show(a=-1) works.
+
         See Also
         --------
 
@@ -327,6 +355,7 @@ class Coverage(PyLayers):
         pylayers.antprop.loss.PL
 
         """
+        global _C_run
         #
         # select active AP
         #
@@ -363,104 +392,179 @@ class Coverage(PyLayers):
         # Evaluate Noise Power (in dBm)
         self.pndbm = np.array(10*np.log10(PnW)+30)
 
-        #lchan = map(lambda x: self.dap[x]['chan'],lap)
-        #apchan = zip(self.dap.keys(),lchan)
-        #self.bmhz = np.array(map(lambda x: self.dap[x[0]].s.chan[x[1][0]]['BMHz']*len(x[1]),apchan))
-
         self.ptdbm = self.ptdbm.T
         self.pndbm = self.pndbm.T
-        # creating all links
-        # all grid to all ap 
-        #
         if len(self.pndbm.shape ) == 0:
             self.ptdbm = self.ptdbm.reshape(1,1)
             self.pndbm = self.pndbm.reshape(1,1)
 
-        p = product(range(self.ng),lactiveAP)
-        #
-        # pa : access point
-        # pg : grid point
-        #
-        # 1 x na
-
-        for k in p:
-            pg = self.grid[k[0],:]
-            pa = np.array(self.dap[k[1]]['p'])
-            # exemple with 3 AP 
-            # 321 0
-            # 321 1
-            # 321 2
-            # 322 0
-            try:
-                self.pa = np.vstack((self.pa,pa))
-            except:
-                self.pa = pa
-            try:
-                self.pg = np.vstack((self.pg,pg))
-            except:
-                self.pg = pg
-
-        self.pa = self.pa.T
-        shpa = self.pa.shape
-        shpg = self.pg.shape
-
-        if shpa[0] != 3:
-            self.pa = np.vstack((self.pa,np.ones(shpa[1])))
-        self.pg = self.pg.T
-        self.pg = np.vstack((self.pg,self.zgrid*np.ones(shpg[0])))
-        
-        self.nf = len(self.fGHz)
-
+        self.lactiveAP = lactiveAP
         # retrieving dimensions along the 3 axis
         na = len(lactiveAP)
         self.na = na
         ng = self.ng
+        self.nf = len(self.fGHz)
         nf = self.nf
-        
-        for k,iap in enumerate(self.dap):
-            # select only one access point
-            u = na*np.arange(0,ng,1).astype('int')+k
-            if self.dap[iap]['on']:
-                pt = self.pa[:,u]
-                pr = self.pg[:,u]
-                azoffset = self.dap[iap]['phideg']*np.pi/180.
-                self.dap[iap].A.eval(fGHz=self.fGHz,pt=pt,pr=pr,azoffset=azoffset)
-                
-                gain = (self.dap[iap].A.G).T
-                #pdb.set_trace()
-                # to handle omnidirectional antenna (nf,1,1)
-                if gain.shape[1]==1:
-                    gain = np.repeat(gain,ng,axis=1)
+
+        #
+        # pa : access points (3 x na)
+        # pg : grid points (3 x ng)
+        #
+        self.pa = np.array([self.dap[iap]['p'] for iap in lactiveAP],dtype=float).T
+        if self.pa.shape[0] != 3:
+            self.pa = np.vstack((self.pa,np.ones(na)))
+        self.pg = np.vstack((self.grid.T,self.zgrid*np.ones(ng)))
+
+        lmaps = ['CmWo','CmWp','Lwo','Lwp','Edo','Edp','freespace']
+        for k in lmaps + ['snro','snrp','sinro','sinrp','bestsvo','bestsvp']:
+            if hasattr(self,k):
+                delattr(self,k)
+        if maps:
+            for k in lmaps:
+                setattr(self,k,np.empty((nf,ng,na)))
+
+        # running reductions over the access points
+        for pol in ['o','p']:
+            setattr(self,'CmWtot'+pol,np.zeros((nf,ng)))
+            setattr(self,'CmWbest'+pol,np.zeros((nf,ng)))
+            setattr(self,'CmWsec'+pol,np.zeros((nf,ng)))
+            setattr(self,'ibest'+pol,-np.ones((nf,ng),dtype=int))
+
+        if fileh5 != '':
+            fh5 = h5py.File(pyu.getlong(fileh5,pstruc['DIRLNK']),'w')
+        else:
+            fh5 = None
+
+        try:
+            if nproc < 0:
+                nproc = mp.cpu_count()
+            if (nproc > 1) and (na > 1):
+                # workers are forked and inherit the coverage
+                _C_run = self
+                pool = mp.Pool(min(nproc,na))
                 try:
-                    tgain = np.dstack((tgain,gain[:,:,None]))
-                except:
-                    tgain = gain[:,:,None]
-        
-        #Lwo,Lwp,Edo,Edp = loss.Losst(self.L,self.fGHz,self.pa,self.pg,dB=False)
-        Lwo,Lwp,Edo,Edp = loss.Losst(self.L,self.fGHz,self.pa,self.pg,dB=False)
-        
-        self.Lwo = Lwo.reshape(nf,ng,na)
-        self.Edo = Edo.reshape(nf,ng,na)
-        self.Lwp = Lwp.reshape(nf,ng,na)
-        self.Edp = Edp.reshape(nf,ng,na)
+                    for k,d in pool.imap_unordered(_coverap_func,range(na)):
+                        self._coverreduce(k,d,maps,fh5)
+                finally:
+                    pool.close()
+                    pool.join()
+                    _C_run = None
+            else:
+                for k in range(na):
+                    self._coverreduce(k,self.coverap(lactiveAP[k]),maps,fh5)
+        finally:
+            if fh5 is not None:
+                fh5.close()
+
+        # best server SNR and SINR from the reductions
+        NmW = 10**(self.pndbm.ravel()/10.)
+        for pol in ['o','p']:
+            bst = getattr(self,'CmWbest'+pol)
+            tot = getattr(self,'CmWtot'+pol)
+            Nb = NmW[np.maximum(getattr(self,'ibest'+pol),0)]
+            setattr(self,'snrbest'+pol,bst/Nb)
+            setattr(self,'sinrbest'+pol,bst/(tot-bst+Nb))
+
+        if maps:
+            if snr:
+                self.evsnr()
+            if sinr:
+                self.evsinr()
+            if best:
+                self.evbestsv()
+        else:
+            # best server maps with a single access point axis
+            for pol in ['o','p']:
+                setattr(self,'CmW'+pol,getattr(self,'CmWbest'+pol)[:,:,None])
+                setattr(self,'snr'+pol,getattr(self,'snrbest'+pol)[:,:,None])
+                setattr(self,'sinr'+pol,getattr(self,'sinrbest'+pol)[:,:,None])
+                setattr(self,'bestsv'+pol,getattr(self,'ibest'+pol)[:,:,None]+1)
+
+    def coverap(self,iap):
+        """ coverage of a single access point
 
-        freespace = loss.PL(self.fGHz,self.pa,self.pg,dB=False)
-        self.freespace = freespace.reshape(nf,ng,na)
+        Parameters
+        ----------
+
+        iap : key of the access point in self.dap
+
+        Returns
+        -------
+
+        d : dict of (nf x ng) arrays
+            'CmWo','CmWp' : received power (mW)
+            'Lwo','Lwp' : wall losses (linear scale)
+            'Edo','Edp' : excess delays (ns)
+            'freespace' : free space loss (linear scale)
+
+        Notes
+        -----
+
+        self.fGHz and self.pg are set by cover.
+
+        """
+        ng = self.ng
+        pa = np.array(self.dap[iap]['p'],dtype=float)
+        if len(pa) != 3:
+            pa = np.hstack((pa,1.))
+        pt = np.outer(pa,np.ones(ng))
+        pr = self.pg
+        azoffset = self.dap[iap]['phideg']*np.pi/180.
+        self.dap[iap].A.eval(fGHz=self.fGHz,pt=pt,pr=pr,azoffset=azoffset)
+
+        gain = (self.dap[iap].A.G).T
+        # to handle omnidirectional antenna (nf,1,1)
+        if gain.shape[1]==1:
+            gain = np.repeat(gain,ng,axis=1)
+
+        Lwo,Lwp,Edo,Edp = loss.Losst(self.L,self.fGHz,pt,pr,dB=False)
+        freespace = loss.PL(self.fGHz,pt,pr,dB=False)
 
         # transmitting power
-        # f x g x a
+        ptmW = 10**(np.array(self.dap[iap]['PtdBm'],dtype=float)/10.)
 
-        # CmW : Received Power coverage in mW
-        self.CmWo = 10**(self.ptdbm[np.newaxis,...]/10.)*self.Lwo*self.freespace*tgain
-        self.CmWp = 10**(self.ptdbm[np.newaxis,...]/10.)*self.Lwp*self.freespace*tgain
+        d = {'CmWo':ptmW*Lwo*freespace*gain,
+             'CmWp':ptmW*Lwp*freespace*gain,
+             'Lwo':Lwo,
+             'Lwp':Lwp,
+             'Edo':Edo,
+             'Edp':Edp,
+             'freespace':freespace}
+        return d
 
+    def _coverreduce(self,k,d,maps,fh5):
+        """ add the maps of access point k to the reductions
 
-        if snr:
-            self.evsnr()
-        if sinr:
-            self.evsinr()
-        if best:
-            self.evbestsv()
+        Parameters
+        ----------
+
+        k : int
+            index of the access point in self.lactiveAP
+        d : dict
+            output of coverap
+        maps : boolean
+            store the maps in the (nf x ng x na) arrays
+        fh5 : h5py.File or None
+
+        """
+        for pol in ['o','p']:
+            C = d['CmW'+pol]
+            tot = getattr(self,'CmWtot'+pol)
+            bst = getattr(self,'CmWbest'+pol)
+            sec = getattr(self,'CmWsec'+pol)
+            ib = getattr(self,'ibest'+pol)
+            tot += C
+            better = C > bst
+            sec[...] = np.where(better,bst,np.maximum(sec,C))
+            bst[better] = C[better]
+            ib[better] = k
+        if maps:
+            for key in d:
+                getattr(self,key)[:,:,k] = d[key]
+        if fh5 is not None:
+            grp = fh5.create_group(str(self.lactiveAP[k]))
+            for key in d:
+                grp.create_dataset(key,data=d[key])
 
     def evsnr(self):
         """ calculates signal to noise ratio
@@ -476,18 +580,13 @@ class Coverage(PyLayers):
 
         """
 
-        # na : number of access point
-        na = self.na
-
-        # U : 1 x 1 x na x na
-        U = (np.ones((na,na))-np.eye(na))[np.newaxis,np.newaxis,:,:]
-
         # CmWo : received power in mW orthogonal polarization
         # CmWp : received power in mW parallel polarization
+        # the interference of an access point is the total power
+        # minus its own power
 
-        ImWo = np.einsum('ijkl,ijl->ijk',U,self.CmWo)
-        ImWp = np.einsum('ijkl,ijl->ijk',U,self.CmWp)
-
+        ImWo = np.sum(self.CmWo,axis=2)[:,:,None] - self.CmWo
+        ImWp = np.sum(self.CmWp,axis=2)[:,:,None] - self.CmWp
 
         NmW = 10**(self.pndbm/10.)[np.newaxis,:]
 
@@ -507,18 +606,13 @@ class Coverage(PyLayers):
         ng = self.ng
         nf = self.nf
         # find best server regions
-        Vo = self.CmWo
-        Vp = self.CmWp
-        self.bestsvo = np.empty(nf*ng*na).reshape(nf,ng,na)
-        self.bestsvp = np.empty(nf*ng*na).reshape(nf,ng,na)
-        for kf in range(nf):
-            MaxVo = np.max(Vo[kf,:,:],axis=1)
-            MaxVp = np.max(Vp[kf,:,:],axis=1)
-            for ka in range(na):
-                uo = np.where(Vo[kf,:,ka]==MaxVo)
-                up = np.where(Vp[kf,:,ka]==MaxVp)
-                self.bestsvo[kf,uo,ka]=ka+1
-                self.bestsvp[kf,up,ka]=ka+1
+        self.bestsvo = np.zeros((nf,ng,na))
+        self.bestsvp = np.zeros((nf,ng,na))
+        uf, ug = np.mgrid[0:nf,0:ng]
+        ibo = np.argmax(self.CmWo,axis=2)
+        ibp = np.argmax(self.CmWp,axis=2)
+        self.bestsvo[uf,ug,ibo] = ibo+1
+        self.bestsvp[uf,ug,ibp] = ibp+1
 
 
 #    def showEd(self,polar='o',**kwargs):
@@ -831,12 +925,12 @@ class Coverage(PyLayers):
             if kwargs['db']:
                 U = 10*np.log10(U)
 
-        D = np.sqrt(np.sum((self.pa-self.pg)*(self.pa-self.pg),axis=0))
+        # distance grid - access point (ng x na)
+        D = np.sqrt(np.sum((self.pg[:,:,None]-self.pa[:,None,:])**2,axis=0))
         if kwargs['a']<>-1:
-            D = D.reshape(self.ng,self.na)
             ax.semilogx(D[:,kwargs['a']],U,'.',color=kwargs['col'],label=kwargs['label'])
         else:
-            ax.semilogx(D,U,'.',color=kwargs['col'],label=kwargs['label'])
+            ax.semilogx(D.reshape(self.ng*self.na),U,'.',color=kwargs['col'],label=kwargs['label'])
 
         return fig,ax
 
@@ -934,7 +1028,7 @@ class Coverage(PyLayers):
 
         if typ=='best':
             title = title + 'Best server'+' fc = '+str(self.fGHz[f])+' GHz'+ ' polar : '+polar
-            for ka in range(self.na):
+            for ka in range(self.bestsvp.shape[2]):
                 if polar=='p':
                     bestsv =  self.bestsvp[f,:,ka]
                 if polar=='o':    
@@ -1137,6 +1231,10 @@ class Coverage(PyLayers):
 
 
 
+def _coverap_func(k):
+    """ worker of Coverage.cover (the Coverage is in _C_run)
+    """
+    return k, _C_run.coverap(_C_run.lactiveAP[k])
+
 if (__name__ == "__main__"):
     doctest.testmod()
-
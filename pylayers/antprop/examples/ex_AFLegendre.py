@@ -2,30 +2,31 @@ from pylayers.antprop.spharm import AFLegendre, AFLegendre2, AFLegendre3, VW,VW2
 import numpy as np
 import time
 
+#
+# AFLegendre2 is the lpmn reference, AFLegendre and AFLegendre3 use the
+# Legendre recurrence
+#
+for L in [10,45,89]:
+    M = L
+    x = np.arange(-1,1,0.001)
 
-L = 10
-M = 10
-ind = index_vsh(L, M)
-l = ind[:, 0]
-m = ind[:, 1]
-x = np.arange(0,1,0.001)
-phi = np.linspace(0,2*np.pi,len(x))
+    tic = time.time()
+    Pmm1l, Pmp1l = AFLegendre2(L,M,x)
+    toc = time.time()
+    t2 = toc-tic
 
-#tic = time.clock()
-Pmm1l, Pmp1l = AFLegendre2(L,M,x)
-#toc = time.clock()
-#print toc -tic 
-
-#tic = time.clock()
-Pmm1n, Pmp1n = AFLegendre(L,M,x)
-#toc = time.clock()
-#print toc-tic 
-P, Q = AFLegendre3(L,M,x)
-
-d1 = Pmm1l - Pmm1n
-d2 = Pmp1l - Pmp1n
-d3 = Pmm1l - P
-d4 = Pmp1l - Q
-print d1,d2,d3,d4
+    tic = time.time()
+    Pmm1n, Pmp1n = AFLegendre(L,M,x)
+    toc = time.time()
+    t1 = toc-tic
 
+    P, Q = AFLegendre3(L,M,x)
 
+    d1 = np.nanmax(abs(Pmm1l - Pmm1n))
+    d2 = np.nanmax(abs(Pmp1l - Pmp1n))
+    d3 = np.nanmax(abs(Pmm1n - P))
+    d4 = np.nanmax(abs(Pmp1n - Q))
+    print 'L = ',L
+    print 'lpmn (s) : ',t2,' recurrence (s) : ',t1
+    print 'max difference : ',d1,d2,d3,d4
+    print 'nan in lpmn reference : ',np.sum(np.isnan(Pmm1l))
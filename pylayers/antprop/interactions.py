@@ -311,6 +311,8 @@ class Interactions(Inter,dict):
         self['D'] = []
         self.evaluated = False
         self.nimax = 0
+        # number of angles of the slab lookup tables (0 : no table)
+        self.nthlut = 0
 
     def add(self, li):
         """ add a list of interactions
@@ -374,9 +376,12 @@ class Interactions(Inter,dict):
         Notes
         -----
 
-        self.I : np.shape(self.I) = (self.nf,self.nimax,2,2)
+        self.I : np.shape(self.I) = (self.nf,self.nimax,3,3)
             with self.nf :  number of frequences
             self.nimax : the total number of interactions ( of all rays)
+            A new array is allocated at each call, arrays obtained from
+            a previous call (e.g. a previous frequency chunk of
+            Rays.eval) are left unchanged
         self.sout :
             distance from one interaction to the next one
         self.si0 :
@@ -385,6 +390,9 @@ class Interactions(Inter,dict):
             alpha as described in JFL Thesis
         self.gamma :
             !! gamma**2 !!! (squared included) as described
+        self.nthlut :
+            if > 0, R and T coefficients are interpolated in the slab
+            lookup tables (Slab.lut) with nthlut incidence angles
 
         """
 
@@ -393,6 +401,7 @@ class Interactions(Inter,dict):
 
         # f x i x 2 x 2
 
+        nthlut = getattr(self,'nthlut',0)
         self.fGHz = fGHz
         self.nf = len(fGHz)
 
@@ -425,7 +434,7 @@ class Interactions(Inter,dict):
         # evaluate R and fill I
         if len(self.R.data)!=0:
             #try:
-            self.I[:, self.R.idx, :, :] = self.R.eval(fGHz=fGHz)
+            self.I[:, self.R.idx, :, :] = self.R.eval(fGHz=fGHz,nthlut=nthlut)
             self.sout[self.R.idx] = self.R.sout
             self.si0[self.R.idx] = self.R.si0
             self.alpha[self.R.idx] = self.R.alpha
@@ -436,7 +445,7 @@ class Interactions(Inter,dict):
         # evaluate T and fill I
         if len(self.T.data)!=0:
             #try:
-            self.I[:, self.T.idx, :, :] = self.T.eval(fGHz=fGHz)
+            self.I[:, self.T.idx, :, :] = self.T.eval(fGHz=fGHz,nthlut=nthlut)
             self.sout[self.T.idx] = self.T.sout
             self.si0[self.T.idx] = self.T.si0
             self.alpha[self.T.idx] = self.T.alpha
@@ -636,13 +645,16 @@ class IntR(Inter):
         s = 'number of R interactions :' + str(np.shape(self.data)[0])
         return s    
 
-    def eval(self,fGHz=np.array([2.4])):
+    def eval(self,fGHz=np.array([2.4]),nthlut=0):
         """ evaluation of reflexion interactions
 
         Parameters
         ----------
 
         fGHz : np.array (,Nf)
+        nthlut : int
+            if > 0, interpolate in the slab lookup tables (Slab.evallut)
+            of nthlut angles instead of calling Slab.eval
 
 
         Returns
@@ -719,12 +731,16 @@ class IntR(Inter):
                     # find the index of angles which satisfied the data
                     #if m not in self.slab:
                     #    m = m.lower()
-                    self.slab[m].eval(fGHz=fGHz, theta=ut, RT='R')
+                    if nthlut > 0:
+                        Rm = self.slab[m].evallut(fGHz=fGHz, theta=ut, nth=nthlut, RT='R')
+                    else:
+                        self.slab[m].eval(fGHz=fGHz, theta=ut, RT='R')
+                        Rm = self.slab[m].R
                     try:
-                        R = np.concatenate((R, self.slab[m].R), axis=1)
+                        R = np.concatenate((R, Rm), axis=1)
                         mapp.extend(self.dusl[m])
                     except:
-                        R = self.slab[m].R
+                        R = Rm
                         mapp.extend(self.dusl[m])
 
             # replace in correct order the reflexion coeff
@@ -765,9 +781,17 @@ class IntT(Inter):
         s = 'number of T interaction :' + str(np.shape(self.data)[0])
         return(s)
 
-    def eval(self,fGHz=np.array([2.4])):
+    def eval(self,fGHz=np.array([2.4]),nthlut=0):
         """ evaluate transmission
 
+        Parameters
+        ----------
+
+        fGHz : np.array (,Nf)
+        nthlut : int
+            if > 0, interpolate in the slab lookup tables (Slab.evallut)
+            of nthlut angles instead of calling Slab.eval
+
         Examples
         --------
 
@@ -846,13 +870,17 @@ class IntT(Inter):
                         gamma = g
 
                     # find the index of angles which satisfied the data
-                    self.slab[m].eval(fGHz=fGHz, theta=ut, RT='T', compensate=True)
+                    if nthlut > 0:
+                        Tm = self.slab[m].evallut(fGHz=fGHz, theta=ut, nth=nthlut, RT='T', compensate=True)
+                    else:
+                        self.slab[m].eval(fGHz=fGHz, theta=ut, RT='T', compensate=True)
+                        Tm = self.slab[m].T
 
                     try:
-                        T = np.concatenate((T, self.slab[m].T), axis=1)
+                        T = np.concatenate((T, Tm), axis=1)
                         mapp.extend(self.dusl[m])
                     except:
-                        T = self.slab[m].T
+                        T = Tm
                         mapp.extend(self.dusl[m])
             # replace in proper order the Transmission coeff
             self.A[:, np.array((mapp)), 1:, 1:] = T
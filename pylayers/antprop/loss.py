@@ -776,7 +776,7 @@ def PL(fGHz,pts,p,n=2.0,dB=True,d0=1):
 
     return(PL)
 
-def Losst(L,fGHz,p1,p2,dB=True):
+def Losst(L,fGHz,p1,p2,dB=True,chunk=[],dtheta=0):
     """  calculate Losses between links p1 p2
 
     Parameters
@@ -786,10 +786,17 @@ def Losst(L,fGHz,p1,p2,dB=True):
     fGHz : np.array
            frequency GHz
     p1 : source points
-        (2 x Np1) array or (2,) array
+        (3 x Np1) array or (3,) array
     p2 : observation point
-        (2 x Np2) array or (2,) array
+        (3 x Np2) array or (3,) array
     dB : boolean
+    chunk : int
+        number of links processed at once (default : chosen from the
+        number of segments of L to bound the memory)
+    dtheta : float
+        if > 0 each slab is evaluated once on a grid of incidence angles
+        of step dtheta (radians) which is linearly interpolated. If 0
+        (default) the slabs are evaluated on the exact angles.
 
     Examples
     --------
@@ -814,6 +821,14 @@ def Losst(L,fGHz,p1,p2,dB=True):
         >>> cb.set_label('dB')
         >>> plt.show()
 
+    Notes
+    -----
+
+    The links are processed by chunks. In each chunk the crossed segments
+    are grouped by slab, each slab is evaluated once on the distinct
+    incidence angles of the group and the losses are summed per link
+    with np.bincount.
+
     See Also
     --------
 
@@ -837,72 +852,106 @@ def Losst(L,fGHz,p1,p2,dB=True):
     if (len(sh1)<2) & (len(sh2)<2):
         Nlink = 1
 
-    # determine incidence angles on segment crossing p1-p2 segment
-    #data = L.angleonlink(p1,p2)
-    data = L.angleonlink3(p1,p2)
-    
-    # as many slabs as segments and subsegments
-    us    = data['s'] 
-    slabs = np.array([ L.Gs.node[x]['name'] for x in us ])
-
-
-
-
-
-    #slabs = L.sla[us]
-    check = np.where(slabs=='')
+    if chunk == []:
+        # angleonlink3 handles (chunk x number of segments) arrays
+        chunk = max(1,int(2**22/max(len(L.tsg),1)))
+
+    Nf = len(fGHz)
+    LossWallo = np.zeros((Nf,Nlink))
+    LossWallp = np.zeros((Nf,Nlink))
+    EdWallo = np.zeros((Nf,Nlink))
+    EdWallp = np.zeros((Nf,Nlink))
+
+    # segment number -> slab name
+    dname = {}
+    # slab name -> (lo,lp,do,dp) on the angle grid (dtheta > 0)
+    dtab = {}
+    if dtheta > 0:
+        ng = int(np.ceil((np.pi/2)/dtheta))+1
+        # grazing incidence excluded
+        thg = np.minimum(np.arange(ng)*dtheta,np.pi/2-1e-6)
+
+    for i0 in range(0,Nlink,chunk):
+        i1 = min(i0+chunk,Nlink)
+        nc = i1 - i0
+        if (len(sh1)>1) and (sh1[1]==Nlink):
+            q1 = p1[:,i0:i1]
+        else:
+            q1 = p1
+        if (len(sh2)>1) and (sh2[1]==Nlink):
+            q2 = p2[:,i0:i1]
+        else:
+            q2 = p2
+
+        # determine incidence angles on segment crossing p1-p2 segment
+        data = L.angleonlink3(q1,q2)
+        if len(data) == 0:
+            continue
+
+        # as many slabs as segments and subsegments
+        useg, iseg = np.unique(data['s'],return_inverse=True)
+        for x in useg:
+            if x not in dname:
+                dname[x] = L.Gs.node[x]['name']
+        slabs = np.array([dname[x] for x in useg])[iseg]
+
+        Nint = len(data)
+        lo = np.zeros((Nf,Nint))
+        lp = np.zeros((Nf,Nint))
+        do = np.zeros(Nint)
+        dp = np.zeros(Nint)
+
+        cslab = list(np.unique(slabs))
+        # As segment numbering is not necessarily contiguous
+        # there exist void string '' in slabs
+        for slname in ['','AIR','_AIR']:
+            if slname in cslab:
+                cslab.remove(slname)
+
+        for slname in cslab:
+            # u index of the intersections with slab slname
+            u = np.nonzero(slabs==slname)[0]
+            a = data['a'][u].astype(float)
+            if dtheta > 0:
+                if slname not in dtab:
+                    lko,lkp = L.sl[slname].losst(fGHz,thg)
+                    dko,dkp = L.sl[slname].excess_grdelay(theta=thg)
+                    dtab[slname] = (lko,lkp,dko,dkp)
+                lko,lkp,dko,dkp = dtab[slname]
+                a = np.minimum(a,thg[-1])
+                j = np.minimum((a/dtheta).astype(int),ng-2)
+                w = (a-thg[j])/(thg[j+1]-thg[j])
+                lo[:,u] = lko[:,j]*(1-w) + lko[:,j+1]*w
+                lp[:,u] = lkp[:,j]*(1-w) + lkp[:,j+1]*w
+                do[u] = dko[j]*(1-w) + dko[j+1]*w
+                dp[u] = dkp[j]*(1-w) + dkp[j+1]*w
+            else:
+                # distinct angles of slab slname
+                ua, ia = np.unique(a,return_inverse=True)
+                #
+                # calculate Loss for slab slname
+                #
+                lko,lkp  = L.sl[slname].losst(fGHz,ua)
+                #
+                # calculate Excess delay for slab slname
+                #
+                dko,dkp  = L.sl[slname].excess_grdelay(theta=ua)
+                lo[:,u] = lko[:,ia]
+                lp[:,u] = lkp[:,ia]
+                do[u] = dko[ia]
+                dp[u] = dkp[ia]
 
-    #
-    # As segment numbering is not necessarily contiguous 
-    # there exist void string '' in slabs
-    cslab = list(np.unique(slabs))
-    if '' in cslab:
-        cslab.remove('')
-    if 'AIR' in cslab:
-        cslab.remove('AIR')
-    if '_AIR' in cslab:
-        cslab.remove('_AIR')
-
-
-    LossWallo = np.zeros((len(fGHz),Nlink))
-    LossWallp = np.zeros((len(fGHz),Nlink))
-    EdWallo = np.zeros((len(fGHz),Nlink))
-    EdWallp = np.zeros((len(fGHz),Nlink))
-    
-    for slname in cslab:
-        # u index of slabs of name slname
-        # data['a'][u] angle
-        # data['s'][u] segment number including subsegment
-        u = np.nonzero(np.array(slabs)==slname)[0]
-        #
-        # calculate Loss for slab slname
-        #
-        lko,lkp  = L.sl[slname].losst(fGHz,data['a'][u])
         #
-        # calculate Excess delay for slab slname
+        # sum contribution of slabs of a same link
         #
-        do , dp  = L.sl[slname].excess_grdelay(theta=data['a'][u])
-        # data['i'][u] links number
-        indexu = data['i'][u]
-        # reduce to involved links
-        involved_links, indices = np.unique(indexu,return_index=True)
-        indicep = np.hstack((indices[1:],np.array([len(indexu)])))
-        # range on involved links
-        irange = np.arange(len(involved_links))
-        #
-        # sum contribution of slab of a same link
-        #
-        Wallo = np.array(map(lambda x: np.sum(lko[:,indices[x]:indicep[x]],axis=1),irange)).T
-        Wallp = np.array(map(lambda x: np.sum(lkp[:,indices[x]:indicep[x]],axis=1),irange)).T
-
-        Edo = np.array(map(lambda x: np.sum(do[indices[x]:indicep[x]]),irange)).T
-        Edp = np.array(map(lambda x: np.sum(dp[indices[x]:indicep[x]]),irange)).T
-
-        LossWallo[:,involved_links] = LossWallo[:,involved_links] + Wallo
-        LossWallp[:,involved_links] = LossWallp[:,involved_links] + Wallp
-
-        EdWallo[:,involved_links] = EdWallo[:,involved_links] + Edo
-        EdWallp[:,involved_links] = EdWallp[:,involved_links] + Edp
+        il = data['i']
+        for f in range(Nf):
+            LossWallo[f,i0:i1] += np.bincount(il,weights=lo[f],minlength=nc)
+            LossWallp[f,i0:i1] += np.bincount(il,weights=lp[f],minlength=nc)
+        Edo = np.bincount(il,weights=do,minlength=nc)
+        Edp = np.bincount(il,weights=dp,minlength=nc)
+        EdWallo[:,i0:i1] += Edo[None,:]
+        EdWallp[:,i0:i1] += Edp[None,:]
 
 
     # Managing Ceil / Floor transmission
@@ -17,10 +17,17 @@ This modules contains Rays class
     Rays.extract
     Rays.mirror
     Rays.to3D
+    Rays._to3Dgroup
     Rays.locbas
+    Rays._locbas_parallel
     Rays.fillinter
+    Rays.flatten
+    Rays.flat
     Rays.length
     Rays.eval
+    Rays._evalchunk
+    Rays._raytab
+    Rays._workspace
     Rays.ray
     Rays.typ
     Rays.info
@@ -65,6 +72,11 @@ from pylayers.gis.layout import Layout
 import pylayers.signal.bsignal as bs
 import shapely.geometry as shg
 import h5py
+import multiprocessing as mp
+
+# shared state of the Rays.to3D / Rays.locbas workers
+# (see _to3D_func and _locbas_func)
+_R_run = None
 
 
 class Rays(PyLayers, dict):
@@ -123,6 +135,13 @@ class Rays(PyLayers, dict):
     Once the interaction are informed the field along rays can
     be evaluated via the **eval** method
     """
+    # flat store (see Rays.flatten)
+    # (key,dm) : the group array is (... x k+dm x r)
+    # or (... x r) if dm is None
+    _flatkeys = [('pt',2),('sig',2),('si',1),('vsi',1),('theta',0),('norm',0),
+                 ('rays',0),('B',1),('dis',None),('aod',None),('aoa',None),
+                 ('rayidx',None)]
+
     def __init__(self, pTx, pRx):
         """ object constructor
 
@@ -228,7 +247,7 @@ class Rays(PyLayers, dict):
         try:
             f=h5py.File(filenameh5,'w')
             # keys not saved as attribute of h5py file
-            notattr = ['I','B','B0','delays','dis']
+            notattr = ['I','B','B0','delays','dis','F','_ws']
             for a in self.__dict__.keys():
                 if a not in notattr:
                     f.attrs[a]=getattr(self,a)
@@ -335,7 +354,7 @@ class Rays(PyLayers, dict):
                     print 'ray2/'+grpname +'already exists in '+filenameh5
                 f = fh5['ray2/'+grpname]
              # keys not saved as attribute of h5py file
-            notattr = ['I','B','B0','dis']
+            notattr = ['I','B','B0','dis','F','_ws']
             for a in self.__dict__.keys():
                 if a not in notattr:
                     f.attrs[a]=getattr(self,a)  
@@ -821,7 +840,7 @@ class Rays(PyLayers, dict):
 
         return(d)
 
-    def to3D(self, L, H=3, N=1, rmoutceilR=True):
+    def to3D(self, L, H=3, N=1, rmoutceilR=True, parallel=False, nproc=0):
         """ transform 2D ray to 3D ray
 
         Parameters
@@ -838,12 +857,27 @@ class Rays(PyLayers, dict):
         rmoutceilR : bool
             Remove ceil reflexions in cycles (Gt nodes) 
             with indoor=False attribute 
+        parallel : bool
+            dispatch chunks of rays over a pool of processes
+        nproc : int
+            number of processes (0 : all cores)
 
         Returns
         -------
 
         r3d : Rays
 
+        Notes
+        -----
+
+        In parallel mode each 2D group is split in chunks of rays which
+        are extended (Rays._to3Dgroup) by forked worker processes. The
+        chunks are gathered back in ray order, the result is the same as
+        in serial mode.
+
+        A ray with a zero length segment raises a ValueError, in both
+        modes.
+
         See Also
         --------
 
@@ -927,337 +961,44 @@ class Rays(PyLayers, dict):
         #             2) sort
         #             3) coordinates as a function of parameter
         #
-        for k in self:   # for all interaction group k
-            # k = int(k)
-            # Number of rays in interaction group k
-            Nrayk = np.shape(self[k]['alpha'])[1]
-
-            # get  2D horizontal parameterization
-            a1 = self[k]['alpha']
-
-            #if (k==1):
-            #    pdb.set_trace()
-            # get  2D signature
-            sig = self[k]['sig']
-            #print "signatures 2D ",sig
-            #print "----"
-            sigsave = copy.copy(sig)
-            # add parameterization of tx and rx (0,1)
-            a1 = np.concatenate((np.zeros((1, Nrayk)), a1, np.ones((1, Nrayk))))
-            # reshape signature in adding tx and rx
-            
-            if sig.shape[0]!=0:
-                sig = np.hstack((np.zeros((2, 1, Nrayk), dtype=int),
-                             sig,
-                             np.zeros((2, 1, Nrayk), dtype=int)))  # add signature of Tx and Rx (0,0))
-            else:
-                sig = np.hstack((np.zeros((2, 1, Nrayk), dtype=int),
-                                 np.zeros((2, 1, Nrayk), dtype=int)))
-            # broadcast tx and rx
-            Tx = tx.reshape(3, 1, 1)*np.ones((1, 1, Nrayk))
-            Rx = rx.reshape(3, 1, 1)*np.ones((1, 1, Nrayk))
-
-            if k!=0:
-                # pte is the sequence of point in 3D ndim =3   ( ndim x k x Nrayk)
-                pte = self[k]['pt']
-                # ndim x k+2 x Nrayk
-                pte = np.hstack((Tx, pte, Rx))
-            else:
-                 pte = np.hstack((Tx, Rx))
-            for l in d:                     # for each vertical pattern (C,F,CF,FC,....)
-                #print k,l,d[l]
-                Nint = len(d[l])            # number of additional interaction
-                #if ((k==1) & (l==5.0)):print
-                if Nint > 0:                # if new interaction ==> need extension
-                    # a1e : extended horizontal+vertical parameterization
-                    a1e = np.concatenate((a1, d[l].reshape(len(d[l]), 1)*
-                                          np.ones((1, Nrayk))))
-                    # get sorted indices
-                    ks = np.argsort(a1e, axis=0)
-                    # a1es : extended sorted horizontal + vertical parameterization
-                    a1es = np.sort(a1e, axis=0)
-
-                    # #### Check if it exists the same parameter value in the horizontal plane
-                    # #### and the vertical plane. Move parameter if so.
-
-                    da1es = np.diff(a1es,axis=0)
-                    pda1es = np.where(da1es<1e-10)
-                    a1es[pda1es]=a1es[pda1es]-1e-3
-
-
-                    # prepare an extended sequence of points ( ndim x  (Nint+k+2) x Nrayk )
-                    ptee = np.hstack((pte, np.zeros((3, Nint, Nrayk))))
-
-                    #
-                    # Boolean ceil/floor detector
-                    #
-                    # u is 4 (floor interaction )
-                    #      5 (ceil interaction )
-                    #  depending on the vertical pattern l.
-                    #
-                    #  l <0 corresponds to last reflexion on floor
-                    #  l >0 corresponds to last reflexion on ceil
-                    #
-                    # u =0 (floor) or 1 (ceil)
-                    # if l < 0:
-                    #     u = np.mod(range(Nint), 2)
-                    # else:
-                    #     u = 1 - np.mod(range(Nint), 2)
-
-
-                    if l < 0 and Nint%2 ==1: # l<0 Nint odd
-                        u = np.mod(range(Nint), 2)
-
-                    elif l > 0 and Nint%2 ==1: # l>0 Nint odd
-                        u = 1 - np.mod(range(Nint), 2)
-
-
-                    elif l < 0 and Nint%2 ==0: # l<0 Nint even
-                        u = 1 - np.mod(range(Nint), 2)
-
-                    elif l > 0 and Nint%2 ==0: # l>0 Nint even
-                        u = np.mod(range(Nint), 2)
-                    
-                    #
-                    u = u + 4
-                    #
-                    # At that point we introduce the signature of the new
-                    # introduced points on the ceil and/or floor.
-                    #
-                    # A signature is composed of two lines
-                    # esigs sup line : interaction number
-                    # esigi inf line : interaction type
-                    #
-                    esigs = np.zeros((1, Nint, Nrayk), dtype=int)
-                    esigi = u.reshape(1, Nint, 1)* np.ones((1, 1, Nrayk), dtype=int)
-                    # esig : extension of the signature
-                    esig = np.vstack((esigs, esigi))
-                    # sige : signature extended  ( 2 x (Nint+k+2) x Nrayk )
-                    sige = np.hstack((sig, esig))
-
-                    #
-                    # 2 x (Nint+k+2) x Nrayk
-                    #
-                    # sort extended sequence of points
-                    # and extended sequence of signatures with the sorting
-                    # index ks obtained from argsort of merge parametization
-                    #
-                    # sequence of extended sorted points
-                    #
-                    ptees = ptee[:, ks, range(Nrayk)]
-                    siges = sige[:, ks, range(Nrayk)]
-
-                    # extended and sorted signature
-                    iint_f, iray_f = np.where(siges[ 1, :] == 4)  # floor interaction
-                    iint_c, iray_c = np.where(siges[ 1, :] == 5)  # ceil interaction
-                    #print siges
-                    #
-                    # find the list of the previous and next point around the
-                    # new ceil or floor point. The case of successive ceil or
-                    # floor reflexion make
-                    #
-                    # Tous les points prcdents qui ne sont pas des Ceils ou
-                    # des floors et tous les points suivants qui ne sont pas
-                    # des points de rflexion ceil ou floor
-                    #
-                    # Afin de tenir compte du rayon et du groupe d'interactions
-                    # concerne, il faut passer un tuple qui concatene la valeur
-                    # de l'indice d'interaction floor ou ceil et l'indice de
-                    # rayons du groupe associe (d'ou le zip)
-                    #
-                    # Cette sequence d'instruction fixe le bug #133
-                    #
-                    # Antrieurement il y avait une hypothese de succession
-                    # immediate d'un point 2D renseigne.
-                    #
-                    try:
-                        iintm_f = map(lambda x : np.where( (siges[1,0:x[0],x[1]]!=4) & (siges[1,0:x[0],x[1]]!=5))[0][-1], zip(iint_f,iray_f))
-                        iintp_f = map(lambda x : np.where( (siges[1,x[0]:,x[1]]!=4) & (siges[1,x[0]:,x[1]]!=5))[0][0]+x[0], zip(iint_f,iray_f))
-                        iintm_c = map(lambda x : np.where( (siges[1,0:x[0],x[1]]!=4) & (siges[1,0:x[0],x[1]]!=5))[0][-1], zip(iint_c,iray_c))
-                        iintp_c = map(lambda x : np.where( (siges[1,x[0]:,x[1]]!=4) & (siges[1,x[0]:,x[1]]!=5))[0][0]+x[0], zip(iint_c,iray_c))
-                    except:
-                        pdb.set_trace()
-
-                    # Update coordinate in the horizontal plane
-                    #
-                    #
-                    # The new interaction ceil or floor has no coordinates in
-                    # the horizontal plane.
-                    # Those coordinates are evaluated first by finding a sub
-                    # parameterization of the point with respect to the two
-                    # known adjascent interaction point j-1 and j+1 (Thales)
-                    #
-
-                    #iintm_f = iint_f - 1
-                    #iintp_f = iint_f + 1
-
-                    #iintm_c = iint_c - 1
-                    #iintp_c = iint_c + 1
-
-
-                    #
-                    # If there are floor points
-                    #
-                    if len(iint_f)>0:
-                        a1esm_f = a1es[iintm_f, iray_f]
-                        a1esc_f = a1es[iint_f, iray_f]
-                        a1esp_f = a1es[iintp_f, iray_f]
-
-
-                        pteesm_f = ptees[0:2, iintm_f, iray_f]
-                        pteesp_f = ptees[0:2, iintp_f, iray_f]
-
-                        coeff_f = (a1esc_f-a1esm_f)/(a1esp_f-a1esm_f)
-                        ptees[0:2, iint_f, iray_f] = pteesm_f + coeff_f*(pteesp_f-pteesm_f)
-
-                    #
-                    # If there are ceil points
-                    #
-                    if len(iint_c)>0:
-                        a1esm_c = a1es[iintm_c, iray_c]
-                        a1esc_c = a1es[iint_c, iray_c]
-                        a1esp_c = a1es[iintp_c, iray_c]
-
-                        pteesm_c = ptees[0:2, iintm_c, iray_c]
-                        pteesp_c = ptees[0:2, iintp_c, iray_c]
-
-                        coeff_c = (a1esc_c-a1esm_c)/(a1esp_c-a1esm_c)
-                        ptees[0:2, iint_c, iray_c] = pteesm_c + coeff_c*(pteesp_c-pteesm_c)
-
-                    if H != 0:
-                        z  = np.mod(l+a1es*(rx[2]-l), 2*H)
-                        pz = np.where(z > H)
-                        z[pz] = 2*H-z[pz]
-                        ptees[2, :] = z
-                    # case where ceil reflection are inhibited
-                    elif H==0 : 
-                        z  = abs(l+a1es*(rx[2]-l))
-                        # pz = np.where(z > H)
-                        # z[pz] = 2*H-z[pz]
-                        ptees[2, :] = z
-
-                # recopy old 2D parameterization (no extension)
-                else:
-                    a1es = a1
-                    ks = np.argsort(a1es, axis=0)
-                    ptees = pte
-                    # fixing bug
-                    siges = copy.copy(sig)
-                    #print siges
-
-                #---------------------------------
-                # handling multi segment (iso segments)
-                #    Height of reflexion interaction
-                #    Height of diffraction interaction
-                #---------------------------------
-                #
-                #   ptes (3 x i+2 x r )
-                if len(L.lsss)>0:
-                    #
-                    # lsss : list of sub segments ( iso segments siges)
-                    # lnss : list of diffaction point involving 
-
-                    lsss = np.array(L.lsss)
-                    lnss = np.array(L.lnss)
-
-                    # array of structure element (nstr) with TxRx extension  (nstr=0)
-                    anstr = siges[0,:,:]
-                    # type of interaction
-                    typi = siges[1,:,:]
-
-                    # lss : list of subsegments in the current signature 
-                    #
-                    # scalability : avoid a loop over all the subsegments in lsss
-                    #
-                    lss = [ x for x in lsss if x in anstr.ravel()]
-                    
-                    ray_to_delete = []
-                    for s in lss: 
-                        u  = np.where(anstr==s)
-                        if len(u)>0:
-                            zs = ptees[2,u[0],u[1]]
-                            zinterval = L.Gs.node[s]['z']
-                            unot_in_interval = ~((zs<=zinterval[1]) & (zs>=zinterval[0]))
-                            ray_to_delete.extend(u[1][unot_in_interval])
-                            
-                    # lns : list of diffraction points in the current signature 
-                    #       with involving multi segments (iso)
-                    # scalability : avoid a loop over all the points in lnss
-                    #
-                    lns = [ x for x in lnss if x in anstr.ravel()]
-                    
-                    #
-                    # loop over multi diffraction points
-                    #
-                
-                    for npt in lns: 
-                        # diffraction cornet in espoo.lay
-                        #if npt==-225:
-                        #    import ipdb 
-                        #    ipdb.set_trace()
-
-                        u  = np.where(anstr==npt)
-                        if len(u)>0:
-                           # height of the diffraction point 
-                            zp = ptees[2,u[0],u[1]]
-
-                            #
-                            # At which couple of segments belongs this height ? 
-                            # get_diffslab function answers that question
-                            #
-
-                            ltu_seg,ltu_slab = L.get_diffslab(npt,zp)
-
-                            #
-                            # delete rays where diffraction point is connected to  
-                            # 2 AIR segments
-                            # 
-
-                            [ray_to_delete.append(u[1][i]) for i in range(len(zp)) 
-                            if ((ltu_slab[i][0]=='AIR') & (ltu_slab[i][1]=='AIR'))]
-                            # #zinterval = L.Gs.node[s]['z']
-                            # # if (zs<=zinterval[1]) & (zs>=zinterval[0]):
-                            # if ((tu_slab[0]!='AIR') & (tu_slab[1]!='AIR')):
-                            #     #print(npt , zp)
-                            #     pass
-                            # else: 
-                            #     ray_to_delete.append(u[1][0])
-                    
-                    # # nstr : structure number
-                    # nstr  = np.delete(nstr,ray_to_delete,axis=1)
-                    # typi : type of interaction 
-                    typi  = np.delete(typi,ray_to_delete,axis=1)
-                    # 3d sequence of points
-                    ptees = np.delete(ptees,ray_to_delete,axis=2)
-                    # extended (floor/ceil) signature
-                    siges = np.delete(siges,ray_to_delete,axis=2)
-                    
-                if rmoutceilR:
-                    # 1 determine Ceil reflexion index
-                    # uc (inter x ray)
-                    uc = np.where(siges[1,:,:]==5)
-                    ptc = ptees[:,uc[0],uc[1]]
-                    if len(uc[0]) !=0:
-                        P = shg.MultiPoint(ptc[:2,:].T)
-                        # to determine the cycle where ceil reflexions append
-                        # uinter(nb pt x nb cycles)
-                        mapnode=L.Gt.nodes()
-                        uinter = np.array([[L.Gt.node[x]['polyg'].contains(p) for x in mapnode if x>0] for p in P])
-                        # import ipdb
-                        # ipdb.set_trace()
-                        #[plt.scatter(p.xy[0],p.xy[1],c='r') for up,p in enumerate(P) if uinter[0,up]]
-                        #[ plt.scatter(p.xy[0],p.xy[1],c='r') for up,p in enumerate(P) if uinter[0,up]]
-                        # find points are indoor/outdoor cycles
-                        upt,ucy = np.where(uinter)
-                        uout = np.where([not L.Gt.node[mapnode[u+1]]['indoor'] for u in ucy])[0] #ucy+1 is to manage cycle 0
-                        # 3 remove ceil reflexions of outdoor cycles
-                        if len(uout)>0:
-                        
-                            ptees = np.delete(ptees,uc[1][uout],axis=2)
-                            siges = np.delete(siges,uc[1][uout],axis=2)
-                            sigsave = np.delete(sigsave,uc[1][uout],axis=2)
+        # for all interaction group k
+        #    for all type of 3D rays (Rays._to3Dgroup)
+        #
+        lk = self.keys()
+        if parallel:
+            if nproc == 0:
+                nproc = mp.cpu_count()
+            lnb = [ np.shape(self[k]['alpha'])[1] for k in lk ]
+            chunk = max(1,int(np.ceil(sum(lnb)/(4.*nproc))))
+            largs = []
+            for k,nb in zip(lk,lnb):
+                largs.extend([ (k,r0,min(r0+chunk,nb)) for r0 in range(0,max(nb,1),chunk) ])
+            global _R_run
+            _R_run = (self,L,d,H,rmoutceilR)
+            pool = mp.Pool(min(nproc,len(largs)))
+            try:
+                lres = pool.map(_to3D_func,largs,chunksize=1)
+            finally:
+                pool.close()
+                pool.join()
+                _R_run = None
+            # gather the chunks of each group in ray order
+            dres = {}
+            for a,res in zip(largs,lres):
+                dres.setdefault(a[0],[]).append(res)
+            lgroup = []
+            for k in lk:
+                lc = dres[k]
+                lgroup.append([ (lc[0][il][0],
+                                 np.dstack([ c[il][1] for c in lc ]),
+                                 np.dstack([ c[il][2] for c in lc ]),
+                                 np.dstack([ c[il][3] for c in lc ]))
+                                for il in range(len(lc[0])) ])
+        else:
+            lgroup = [ self._to3Dgroup(L, k, d, H=H, rmoutceilR=rmoutceilR) for k in lk ]
 
-                
+        for k,lres in zip(lk,lgroup):
+            for Nint,ptees,siges,sigsave in lres:
                 if r3d.has_key(k+Nint):
             
                     r3d[k+Nint]['pt']  = np.dstack((r3d[k+Nint]['pt'], ptees))
@@ -1269,11 +1010,6 @@ class Rays(PyLayers, dict):
                         r3d[k+Nint]['pt'] = ptees
                         r3d[k+Nint]['sig'] = siges
                         r3d[k+Nint]['sig2d'] = [sigsave]
-                # ax=plt.gca()
-                # uu = np.where(ptees[2,...]==3.0)
-                # ax.plot(ptees[0,uu[0],uu[1]],ptees[1,uu[0],uu[1]],'ok')
-                # import ipdb
-                # ipdb.set_trace()
         #
         # Add Line Of Sight ray information
         #   pt =  [tx,rx]
@@ -1314,14 +1050,8 @@ class Rays(PyLayers, dict):
             v = r3d[k]['pt'][:, 1:, :]-r3d[k]['pt'][:, 0:-1, :]
             lsi = np.sqrt(np.sum(v*v, axis=0))
             rlength = np.sum(lsi,axis=0)
-            if (lsi.any()==0):
-                pdb.set_trace()
             if not (lsi.all()>0):
-                pdb.set_trace()
-            #assert(lsi.all()>0)
-
-            if (len(np.where(lsi==0.))==0) :
-                pdb.set_trace()
+                raise ValueError('Rays.to3D : zero length ray segment in group '+str(k))
 
             #
             # sort rays w.r.t their length
@@ -1351,6 +1081,381 @@ class Rays(PyLayers, dict):
         r3d.filename = L._filename.split('.')[0] + '_' + str(r3d.nray)
         return(r3d)
 
+    def _to3Dgroup(self, L, k, d, H=3, rmoutceilR=True, r0=0, r1=None):
+        """ 3D rays of a 2D interaction group
+
+        Parameters
+        ----------
+
+        L : Layout object
+        k : int
+            2D interaction group
+        d : dict
+            vertical patterns (see Rays.mirror)
+        H : float
+            ceil height
+        rmoutceilR : bool
+        r0 : int
+        r1 : int
+            rays r0:r1 of the group (default all)
+
+        Returns
+        -------
+
+        lres : list
+            (Nint,ptees,siges,sigsave) for each vertical pattern of d,
+            the rays of the 2D group extended with Nint ceil/floor
+            interactions
+
+        Notes
+        -----
+
+        Rays are processed independently, the rays of a group can be
+        split in chunks (see Rays.to3D parallel mode).
+
+        """
+        tx = self.pTx
+        rx = self.pRx
+
+        # k = int(k)
+        # Number of rays in interaction group k
+        if r1 is None:
+            r1 = np.shape(self[k]['alpha'])[1]
+        Nrayk = r1 - r0
+
+        # get  2D horizontal parameterization
+        a1 = self[k]['alpha'][:, r0:r1]
+
+        #if (k==1):
+        #    pdb.set_trace()
+        # get  2D signature
+        sig = self[k]['sig'][:, :, r0:r1]
+        #print "signatures 2D ",sig
+        #print "----"
+        sigsave = copy.copy(sig)
+        # add parameterization of tx and rx (0,1)
+        a1 = np.concatenate((np.zeros((1, Nrayk)), a1, np.ones((1, Nrayk))))
+        # reshape signature in adding tx and rx
+        
+        if sig.shape[0]!=0:
+            sig = np.hstack((np.zeros((2, 1, Nrayk), dtype=int),
+                         sig,
+                         np.zeros((2, 1, Nrayk), dtype=int)))  # add signature of Tx and Rx (0,0))
+        else:
+            sig = np.hstack((np.zeros((2, 1, Nrayk), dtype=int),
+                             np.zeros((2, 1, Nrayk), dtype=int)))
+        # broadcast tx and rx
+        Tx = tx.reshape(3, 1, 1)*np.ones((1, 1, Nrayk))
+        Rx = rx.reshape(3, 1, 1)*np.ones((1, 1, Nrayk))
+
+        if k!=0:
+            # pte is the sequence of point in 3D ndim =3   ( ndim x k x Nrayk)
+            pte = self[k]['pt'][:, :, r0:r1]
+            # ndim x k+2 x Nrayk
+            pte = np.hstack((Tx, pte, Rx))
+        else:
+             pte = np.hstack((Tx, Rx))
+
+        lres = []
+        for l in d:                     # for each vertical pattern (C,F,CF,FC,....)
+            #print k,l,d[l]
+            Nint = len(d[l])            # number of additional interaction
+            #if ((k==1) & (l==5.0)):print
+            if Nint > 0:                # if new interaction ==> need extension
+                # a1e : extended horizontal+vertical parameterization
+                a1e = np.concatenate((a1, d[l].reshape(len(d[l]), 1)*
+                                      np.ones((1, Nrayk))))
+                # get sorted indices
+                ks = np.argsort(a1e, axis=0)
+                # a1es : extended sorted horizontal + vertical parameterization
+                a1es = np.sort(a1e, axis=0)
+
+                # #### Check if it exists the same parameter value in the horizontal plane
+                # #### and the vertical plane. Move parameter if so.
+
+                da1es = np.diff(a1es,axis=0)
+                pda1es = np.where(da1es<1e-10)
+                a1es[pda1es]=a1es[pda1es]-1e-3
+
+
+                # prepare an extended sequence of points ( ndim x  (Nint+k+2) x Nrayk )
+                ptee = np.hstack((pte, np.zeros((3, Nint, Nrayk))))
+
+                #
+                # Boolean ceil/floor detector
+                #
+                # u is 4 (floor interaction )
+                #      5 (ceil interaction )
+                #  depending on the vertical pattern l.
+                #
+                #  l <0 corresponds to last reflexion on floor
+                #  l >0 corresponds to last reflexion on ceil
+                #
+                # u =0 (floor) or 1 (ceil)
+                # if l < 0:
+                #     u = np.mod(range(Nint), 2)
+                # else:
+                #     u = 1 - np.mod(range(Nint), 2)
+
+
+                if l < 0 and Nint%2 ==1: # l<0 Nint odd
+                    u = np.mod(range(Nint), 2)
+
+                elif l > 0 and Nint%2 ==1: # l>0 Nint odd
+                    u = 1 - np.mod(range(Nint), 2)
+
+
+                elif l < 0 and Nint%2 ==0: # l<0 Nint even
+                    u = 1 - np.mod(range(Nint), 2)
+
+                elif l > 0 and Nint%2 ==0: # l>0 Nint even
+                    u = np.mod(range(Nint), 2)
+                
+                #
+                u = u + 4
+                #
+                # At that point we introduce the signature of the new
+                # introduced points on the ceil and/or floor.
+                #
+                # A signature is composed of two lines
+                # esigs sup line : interaction number
+                # esigi inf line : interaction type
+                #
+                esigs = np.zeros((1, Nint, Nrayk), dtype=int)
+                esigi = u.reshape(1, Nint, 1)* np.ones((1, 1, Nrayk), dtype=int)
+                # esig : extension of the signature
+                esig = np.vstack((esigs, esigi))
+                # sige : signature extended  ( 2 x (Nint+k+2) x Nrayk )
+                sige = np.hstack((sig, esig))
+
+                #
+                # 2 x (Nint+k+2) x Nrayk
+                #
+                # sort extended sequence of points
+                # and extended sequence of signatures with the sorting
+                # index ks obtained from argsort of merge parametization
+                #
+                # sequence of extended sorted points
+                #
+                ptees = ptee[:, ks, range(Nrayk)]
+                siges = sige[:, ks, range(Nrayk)]
+
+                # extended and sorted signature
+                iint_f, iray_f = np.where(siges[ 1, :] == 4)  # floor interaction
+                iint_c, iray_c = np.where(siges[ 1, :] == 5)  # ceil interaction
+                #print siges
+                #
+                # find the list of the previous and next point around the
+                # new ceil or floor point. The case of successive ceil or
+                # floor reflexion make
+                #
+                # Tous les points prcdents qui ne sont pas des Ceils ou
+                # des floors et tous les points suivants qui ne sont pas
+                # des points de rflexion ceil ou floor
+                #
+                # Afin de tenir compte du rayon et du groupe d'interactions
+                # concerne, il faut passer un tuple qui concatene la valeur
+                # de l'indice d'interaction floor ou ceil et l'indice de
+                # rayons du groupe associe (d'ou le zip)
+                #
+                # Cette sequence d'instruction fixe le bug #133
+                #
+                # Antrieurement il y avait une hypothese de succession
+                # immediate d'un point 2D renseigne.
+                #
+                iintm_f = map(lambda x : np.where( (siges[1,0:x[0],x[1]]!=4) & (siges[1,0:x[0],x[1]]!=5))[0][-1], zip(iint_f,iray_f))
+                iintp_f = map(lambda x : np.where( (siges[1,x[0]:,x[1]]!=4) & (siges[1,x[0]:,x[1]]!=5))[0][0]+x[0], zip(iint_f,iray_f))
+                iintm_c = map(lambda x : np.where( (siges[1,0:x[0],x[1]]!=4) & (siges[1,0:x[0],x[1]]!=5))[0][-1], zip(iint_c,iray_c))
+                iintp_c = map(lambda x : np.where( (siges[1,x[0]:,x[1]]!=4) & (siges[1,x[0]:,x[1]]!=5))[0][0]+x[0], zip(iint_c,iray_c))
+
+                # Update coordinate in the horizontal plane
+                #
+                #
+                # The new interaction ceil or floor has no coordinates in
+                # the horizontal plane.
+                # Those coordinates are evaluated first by finding a sub
+                # parameterization of the point with respect to the two
+                # known adjascent interaction point j-1 and j+1 (Thales)
+                #
+
+                #iintm_f = iint_f - 1
+                #iintp_f = iint_f + 1
+
+                #iintm_c = iint_c - 1
+                #iintp_c = iint_c + 1
+
+
+                #
+                # If there are floor points
+                #
+                if len(iint_f)>0:
+                    a1esm_f = a1es[iintm_f, iray_f]
+                    a1esc_f = a1es[iint_f, iray_f]
+                    a1esp_f = a1es[iintp_f, iray_f]
+
+
+                    pteesm_f = ptees[0:2, iintm_f, iray_f]
+                    pteesp_f = ptees[0:2, iintp_f, iray_f]
+
+                    coeff_f = (a1esc_f-a1esm_f)/(a1esp_f-a1esm_f)
+                    ptees[0:2, iint_f, iray_f] = pteesm_f + coeff_f*(pteesp_f-pteesm_f)
+
+                #
+                # If there are ceil points
+                #
+                if len(iint_c)>0:
+                    a1esm_c = a1es[iintm_c, iray_c]
+                    a1esc_c = a1es[iint_c, iray_c]
+                    a1esp_c = a1es[iintp_c, iray_c]
+
+                    pteesm_c = ptees[0:2, iintm_c, iray_c]
+                    pteesp_c = ptees[0:2, iintp_c, iray_c]
+
+                    coeff_c = (a1esc_c-a1esm_c)/(a1esp_c-a1esm_c)
+                    ptees[0:2, iint_c, iray_c] = pteesm_c + coeff_c*(pteesp_c-pteesm_c)
+
+                if H != 0:
+                    z  = np.mod(l+a1es*(rx[2]-l), 2*H)
+                    pz = np.where(z > H)
+                    z[pz] = 2*H-z[pz]
+                    ptees[2, :] = z
+                # case where ceil reflection are inhibited
+                elif H==0 : 
+                    z  = abs(l+a1es*(rx[2]-l))
+                    # pz = np.where(z > H)
+                    # z[pz] = 2*H-z[pz]
+                    ptees[2, :] = z
+
+            # recopy old 2D parameterization (no extension)
+            else:
+                a1es = a1
+                ks = np.argsort(a1es, axis=0)
+                ptees = pte
+                # fixing bug
+                siges = copy.copy(sig)
+                #print siges
+
+            #---------------------------------
+            # handling multi segment (iso segments)
+            #    Height of reflexion interaction
+            #    Height of diffraction interaction
+            #---------------------------------
+            #
+            #   ptes (3 x i+2 x r )
+            if len(L.lsss)>0:
+                #
+                # lsss : list of sub segments ( iso segments siges)
+                # lnss : list of diffaction point involving 
+
+                lsss = np.array(L.lsss)
+                lnss = np.array(L.lnss)
+
+                # array of structure element (nstr) with TxRx extension  (nstr=0)
+                anstr = siges[0,:,:]
+                # type of interaction
+                typi = siges[1,:,:]
+
+                # lss : list of subsegments in the current signature 
+                #
+                # scalability : avoid a loop over all the subsegments in lsss
+                #
+                lss = [ x for x in lsss if x in anstr.ravel()]
+                
+                ray_to_delete = []
+                for s in lss: 
+                    u  = np.where(anstr==s)
+                    if len(u)>0:
+                        zs = ptees[2,u[0],u[1]]
+                        zinterval = L.Gs.node[s]['z']
+                        unot_in_interval = ~((zs<=zinterval[1]) & (zs>=zinterval[0]))
+                        ray_to_delete.extend(u[1][unot_in_interval])
+                        
+                # lns : list of diffraction points in the current signature 
+                #       with involving multi segments (iso)
+                # scalability : avoid a loop over all the points in lnss
+                #
+                lns = [ x for x in lnss if x in anstr.ravel()]
+                
+                #
+                # loop over multi diffraction points
+                #
+            
+                for npt in lns: 
+                    # diffraction cornet in espoo.lay
+                    #if npt==-225:
+                    #    import ipdb 
+                    #    ipdb.set_trace()
+
+                    u  = np.where(anstr==npt)
+                    if len(u)>0:
+                       # height of the diffraction point 
+                        zp = ptees[2,u[0],u[1]]
+
+                        #
+                        # At which couple of segments belongs this height ? 
+                        # get_diffslab function answers that question
+                        #
+
+                        ltu_seg,ltu_slab = L.get_diffslab(npt,zp)
+
+                        #
+                        # delete rays where diffraction point is connected to  
+                        # 2 AIR segments
+                        # 
+
+                        [ray_to_delete.append(u[1][i]) for i in range(len(zp)) 
+                        if ((ltu_slab[i][0]=='AIR') & (ltu_slab[i][1]=='AIR'))]
+                        # #zinterval = L.Gs.node[s]['z']
+                        # # if (zs<=zinterval[1]) & (zs>=zinterval[0]):
+                        # if ((tu_slab[0]!='AIR') & (tu_slab[1]!='AIR')):
+                        #     #print(npt , zp)
+                        #     pass
+                        # else: 
+                        #     ray_to_delete.append(u[1][0])
+                
+                # # nstr : structure number
+                # nstr  = np.delete(nstr,ray_to_delete,axis=1)
+                # typi : type of interaction 
+                typi  = np.delete(typi,ray_to_delete,axis=1)
+                # 3d sequence of points
+                ptees = np.delete(ptees,ray_to_delete,axis=2)
+                # extended (floor/ceil) signature
+                siges = np.delete(siges,ray_to_delete,axis=2)
+                
+            if rmoutceilR:
+                # 1 determine Ceil reflexion index
+                # uc (inter x ray)
+                uc = np.where(siges[1,:,:]==5)
+                ptc = ptees[:,uc[0],uc[1]]
+                if len(uc[0]) !=0:
+                    P = shg.MultiPoint(ptc[:2,:].T)
+                    # to determine the cycle where ceil reflexions append
+                    # uinter(nb pt x nb cycles)
+                    mapnode=L.Gt.nodes()
+                    uinter = np.array([[L.Gt.node[x]['polyg'].contains(p) for x in mapnode if x>0] for p in P])
+                    # import ipdb
+                    # ipdb.set_trace()
+                    #[plt.scatter(p.xy[0],p.xy[1],c='r') for up,p in enumerate(P) if uinter[0,up]]
+                    #[ plt.scatter(p.xy[0],p.xy[1],c='r') for up,p in enumerate(P) if uinter[0,up]]
+                    # find points are indoor/outdoor cycles
+                    upt,ucy = np.where(uinter)
+                    uout = np.where([not L.Gt.node[mapnode[u+1]]['indoor'] for u in ucy])[0] #ucy+1 is to manage cycle 0
+                    # 3 remove ceil reflexions of outdoor cycles
+                    if len(uout)>0:
+                    
+                        ptees = np.delete(ptees,uc[1][uout],axis=2)
+                        siges = np.delete(siges,uc[1][uout],axis=2)
+                        sigsave = np.delete(sigsave,uc[1][uout],axis=2)
+
+            
+            lres.append((Nint,ptees,siges,sigsave))
+            # ax=plt.gca()
+            # uu = np.where(ptees[2,...]==3.0)
+            # ax.plot(ptees[0,uu[0],uu[1]],ptees[1,uu[0],uu[1]],'ok')
+            # import ipdb
+            # ipdb.set_trace()
+        return(lres)
+
     def length(self,typ=2):
         """ calculate length of rays
 
@@ -1380,13 +1485,18 @@ class Rays(PyLayers, dict):
         for ir in self:
             print self[ik]['si']
 
-    def locbas(self, L):
+    def locbas(self, L, parallel=False, nproc=0):
         """ calculate ray local bas
 
         Parameters
         ----------
 
         L : Layout
+        parallel : bool
+            dispatch chunks of rays over a pool of processes
+            (see Rays._locbas_parallel)
+        nproc : int
+            number of processes (0 : all cores)
 
 
         Notes
@@ -1395,6 +1505,8 @@ class Rays(PyLayers, dict):
        
 
         """
+        if parallel:
+            return(self._locbas_parallel(L, nproc=nproc))
 
         #
         # extract normal in np.array
@@ -1499,7 +1611,7 @@ class Rays(PyLayers, dict):
 
                 normcheck = np.sum(self[k]['norm']*self[k]['norm'],axis=0)
 
-                assert normcheck.all()>0.99,pdb.set_trace()
+                assert normcheck.all()>0.99,'Rays.locbas : non unitary normal in group '+str(k)
 
 
 
@@ -1738,12 +1850,20 @@ class Rays(PyLayers, dict):
 
                     self[k]['diffidx'] = idx[udiff[0],udiff[1]]
                     # get tail head position of seg associated to diff point
-                    lair = L.name['AIR'] + L.name['_AIR']
-                    aseg = map(lambda x : filter(lambda y : y not in lair,
-                                         nx.neighbors(L.Gs,x)),
-                                         diffupt)
-                    #manage flat angle : diffraction by flat segment e.g. door limitation)
-                    [aseg[ix].extend(x) for ix,x in enumerate(aseg) if len(x)==1]
+                    # (wedge faces stored by Layout._diffarrays, a flat
+                    # angle gives the same segment twice)
+                    ifa = L.diffindex(diffupt)
+                    if (ifa < 0).any():
+                        raise NameError('Rays.eval: points '
+                                        + str(np.unique(diffupt[ifa < 0]))
+                                        + ' are not diffraction points')
+                    aseg = L.diffface[ifa]
+                    if (aseg < 0).any():
+                        u = np.unique(diffupt[(aseg < 0).any(axis=1)])
+                        raise NameError('Rays.eval: no wedge face (non air'
+                                        ' segment) for diffraction points '
+                                        + str(u))
+                    aseg = aseg.tolist()
                     # get points positions
                     #pdb.set_trace()
                     pts = np.array(map(lambda x : L.seg2pts([x[0],x[1]]),aseg))
@@ -1955,8 +2075,297 @@ class Rays(PyLayers, dict):
                 self.raypt = 1
                 self._ray2nbi = ze
         self._luw = np.unique(luw).tolist()
+        # flat store and compatibility view
+        self.flatten()
         self.isbased=True
 
+    def _subgroup(self, k, r0, r1):
+        """ rays r0:r1 of the interaction group k
+
+        Parameters
+        ----------
+
+        k : int
+        r0 : int
+        r1 : int
+
+        Returns
+        -------
+
+        g : dict
+            per ray arrays of self[k] restricted to rays r0:r1
+
+        """
+        nb = int(np.ravel(self[k]['nbrays'])[0])
+        g = {}
+        for key,a in self[k].items():
+            if key == 'nbrays':
+                g[key] = r1 - r0
+            elif (isinstance(a,np.ndarray) and (a.ndim > 0) and (a.shape[-1] == nb)
+                  and (key not in ['nstrwall','nstrswall','diffvect','diffidx'])):
+                g[key] = a[..., r0:r1]
+        return(g)
+
+    def _locbas_parallel(self, L, nproc=0):
+        """ parallel version of Rays.locbas
+
+        Parameters
+        ----------
+
+        L : Layout
+        nproc : int
+            number of processes (0 : all cores)
+
+        Notes
+        -----
+
+        The interaction groups are split in chunks of rays, the local
+        bases of each chunk are evaluated by Rays.locbas in a forked
+        worker process. Chunks are merged back in ray order, then the
+        interaction indices (rays, diffidx) are numbered as in the serial
+        version. nstrwall and nstrswall, which are sorted by interaction
+        first, are reordered accordingly.
+
+        """
+        if nproc == 0:
+            nproc = mp.cpu_count()
+
+        # LOS ray (serial)
+        if self.los:
+            r = Rays(self.pTx,self.pRx)
+            r.los = True
+            r.is3D = self.is3D
+            r[0] = self[0]
+            r.locbas(L)
+            self[0] = r[0]
+
+        lk = [ k for k in sorted(self.keys()) if k != 0 ]
+        lnb = [ int(np.ravel(self[k]['nbrays'])[0]) for k in lk ]
+        chunk = max(1,int(np.ceil(sum(lnb)/(4.*nproc))))
+        largs = []
+        for k,nb in zip(lk,lnb):
+            largs.extend([ (k,r0,min(r0+chunk,nb)) for r0 in range(0,max(nb,1),chunk) ])
+
+        lres = []
+        if largs != []:
+            global _R_run
+            _R_run = (self,L)
+            pool = mp.Pool(min(nproc,len(largs)))
+            try:
+                lres = pool.map(_locbas_func,largs,chunksize=1)
+            finally:
+                pool.close()
+                pool.join()
+                _R_run = None
+
+        dres = {}
+        luw = []
+        for a,(g,luwc) in zip(largs,lres):
+            dres.setdefault(a[0],[]).append(g)
+            luw.extend(luwc)
+
+        if self.los:
+            idxts = 1
+            nbrayt = 1
+            l2nbi = [np.array([0])]
+        else:
+            idxts = 0
+            nbrayt = 0
+            l2nbi = []
+
+        diffkey = ['diffvect','diffidx','diffslabs']
+        for k in lk:
+            lg = dres[k]
+            G = dict(self[k])
+            for key in diffkey:
+                G.pop(key,None)
+            for key in lg[0]:
+                if key in ['rays','nbrays','rayidx','nstrwall','nstrswall']+diffkey:
+                    pass
+                else:
+                    G[key] = np.concatenate([ g[key] for g in lg ],axis=-1)
+            # walls are sorted by (interaction,ray)
+            li = []
+            lj = []
+            o = 0
+            for g in lg:
+                it = g['sig'][1,1:-1,:]
+                uw = np.where((it == 2) | (it == 3))
+                li.append(uw[0])
+                lj.append(uw[1]+o)
+                o = o + it.shape[1]
+            u = np.lexsort((np.hstack(lj),np.hstack(li)))
+            for key in ['nstrwall','nstrswall']:
+                G[key] = np.hstack([ g[key] for g in lg ])[u]
+            # diffraction interactions are sorted by (ray,interaction)
+            lgd = [ g for g in lg if g.has_key('diffvect') ]
+            if lgd != []:
+                G['diffvect'] = np.concatenate([ g['diffvect'] for g in lgd ],axis=-1)
+                G['diffslabs'] = reduce(lambda x,y: x+y,[ g['diffslabs'] for g in lgd ])
+
+            # interaction index
+            ityp = G['sig'][1,1:-1,:]
+            idx = idxts + np.arange(ityp.size).reshape(np.shape(ityp),order='F')
+            idxts = idxts + idx.size
+            nbray = np.shape(idx)[1]
+            G['rays'] = idx
+            G['nbrays'] = nbray
+            G['rayidx'] = nbrayt + np.arange(nbray)
+            nbrayt = nbrayt + nbray
+            if lgd != []:
+                Z = np.where(ityp.T==1)
+                G['diffidx'] = idx[Z[1],Z[0]]
+            l2nbi.append(k*np.ones(nbray,dtype=int))
+            self[k] = G
+
+        self._ray2nbi = np.hstack(l2nbi+[np.array([],dtype=int)])
+        self.raypt = nbrayt
+        self._luw = np.unique(luw).tolist()
+        self.flatten()
+        self.isbased=True
+
+    def flatten(self):
+        """ build the flat ray store
+
+        Notes
+        -----
+
+        self.F is a structure of arrays gathering all the rays having
+        at least one interaction (LOS excepted), group after group
+        (increasing number of interactions) in ray index order.
+
+        F['nint'] : (,r) number of interactions of each ray
+        F['off']  : (,r+1) interaction offset of each ray
+        F[key]    : for (key,dm) in Rays._flatkeys
+            a group array of shape (... x k+dm x r) is stored ragged as
+            (... x (off[-1]+dm*r)) with the k+dm values of a ray
+            contiguous (those of ray fr start at off[fr]+dm*fr), a group
+            array of shape (... x r) (dm is None) is stored as (... x r)
+
+        Interaction indices (F['rays']) are contiguous in this order.
+
+        Compatibility view : after flattening, self[k][key] are views
+        of the flat buffers, so that existing code indexing the groups
+        works unchanged. An array which is re-assigned in a group is no
+        longer shared with self.F, call flatten again in that case
+        (fillinter does it when Rays._isflat is False).
+
+        Keys whose shape does not fit in one of the groups are not
+        flattened.
+
+        See Also
+        --------
+
+        pylayers.antprop.rays.Rays.flat
+
+        """
+        lk = [ k for k in sorted(self.keys()) if k != 0 ]
+        # nbrays is a (1,) array when loaded from hdf5
+        lnb = [ int(np.ravel(self[k]['nbrays'])[0]) for k in lk ]
+        F = {}
+        F['nint'] = np.hstack([ k*np.ones(nb,dtype=int) for k,nb in zip(lk,lnb) ]
+                              + [np.array([],dtype=int)])
+        F['off'] = np.hstack(([0],np.cumsum(F['nint']))).astype(int)
+
+        for key,dm in self._flatkeys:
+            la = []
+            for k,nb in zip(lk,lnb):
+                a = self[k].get(key,None)
+                if (not isinstance(a,np.ndarray)) or (a.ndim < 1) or (a.shape[-1] != nb):
+                    break
+                if dm is None:
+                    la.append(a)
+                else:
+                    if (a.ndim < 2) or (a.shape[-2] != k+dm):
+                        break
+                    # ... x m x r -> ... x (r*m)
+                    la.append(np.swapaxes(a,-1,-2).reshape(a.shape[:-2]+(nb*(k+dm),)))
+            else:
+                if la != []:
+                    F[key] = np.concatenate(la,axis=-1)
+
+        #
+        # compatibility view
+        #
+        for key,dm in self._flatkeys:
+            if key in F:
+                o = 0
+                for k,nb in zip(lk,lnb):
+                    if dm is None:
+                        self[k][key] = F[key][...,o:o+nb]
+                        o = o + nb
+                    else:
+                        m = k + dm
+                        a = F[key][...,o:o+m*nb]
+                        self[k][key] = a.reshape(a.shape[:-1]+(nb,m)).swapaxes(-1,-2)
+                        o = o + m*nb
+
+        self.F = F
+
+    def _isflat(self):
+        """ check that the flat store is up to date with the groups
+
+        Returns
+        -------
+
+        boolean
+            True if self.F exists, has the rays of the current groups
+            and each flattened group array is still a view of self.F
+
+        See Also
+        --------
+
+        pylayers.antprop.rays.Rays.flatten
+
+        """
+        if not hasattr(self,'F'):
+            return False
+        F = self.F
+        lk = [ k for k in sorted(self.keys()) if k != 0 ]
+        lnb = [ int(np.ravel(self[k]['nbrays'])[0]) for k in lk ]
+        nint = np.hstack([ k*np.ones(nb,dtype=int) for k,nb in zip(lk,lnb) ]
+                         + [np.array([],dtype=int)])
+        if not np.array_equal(nint,F['nint']):
+            return False
+        for key,dm in self._flatkeys:
+            la = [ self[k].get(key,None) for k in lk ]
+            if key in F:
+                for a in la:
+                    if ((not isinstance(a,np.ndarray)) or
+                        (not np.may_share_memory(a,F[key]))):
+                        return False
+            elif (la != []) and all([ isinstance(a,np.ndarray) for a in la ]):
+                # key added to the groups after flattening
+                return False
+        return True
+
+    def flat(self,key,ir):
+        """ get the data of a ray from the flat store
+
+        Parameters
+        ----------
+
+        key : string
+            flat key (see Rays._flatkeys)
+        ir : int
+            ray index (not LOS)
+
+        Returns
+        -------
+
+        a : np.array
+            (... x k+dm) or (...) if key is not ragged
+
+        """
+        F = self.F
+        fr = np.where(F['rayidx']==ir)[0][0]
+        dm = dict(self._flatkeys)[key]
+        if dm is None:
+            return(F[key][...,fr])
+        o0 = F['off'][fr] + dm*fr
+        o1 = F['off'][fr+1] + dm*(fr+1)
+        return(F[key][...,o0:o1])
+
     def fillinter(self,L,append=False):
         """  fill ray interactions
 
@@ -2052,242 +2461,308 @@ class Rays(PyLayers, dict):
         # diffraction wedge list
         dw = np.array(())
 
-        # loop on group of interactions
-        for k in self:
-
-            if k !=0:
-
-                uR = uT = uD = uRf = uRc = 0.
+        # LOS Interaction
+        if self.los:
+            ze = np.array([0])
+            B.stack(data=np.eye(3)[np.newaxis,:,:], idx=ze)
+            B0.stack(data=np.eye(3)[np.newaxis,:,:],idx=ze)
+
+        # all the other rays are processed at once from the flat store
+        if not self._isflat():
+            self.flatten()
+        F = self.F
+        nint = F['nint']
+
+        if len(nint) > 0:
+
+            nr = len(nint)
+            ni = F['off'][-1]
+
+            # ray of each interaction : ,i
+            ray = np.repeat(np.arange(nr), nint)
+            # position of the interactions in sig (k+2 values per ray)
+            usig = np.arange(ni) + 2*ray + 1
+            # position of the interactions in si and B (k+1 values per ray)
+            usi = np.arange(ni) + ray
+            # position of the first basis of the rays in B
+            ub0 = F['off'][:-1] + np.arange(nr)
+
+            # structure number (segment or point) : ,i
+            nstrf = F['sig'][0, usig]
+            # interaction type : ,i
+            itypf = F['sig'][1, usig]
+            # theta : ,i
+            thetaf = F['theta']
+            # distance in / distance out : ,i
+            s_inf = F['si'][usi]
+            s_outf = F['si'][usi+1]
+            # interaction index : ,i
+            idxf = F['rays']
 
-                # structure number (segment or point)
-                # nstr : i x r
-                nstr = self[k]['sig'][0, 1:-1, :]
+            #
+            # F['B'] 3 x 3 x (i+r)
+            #
+            # first unitary matrix (3x3xr)
+            b0 = F['B'][:, :, ub0]
+            # other unitary matrices (3x3xi)
+            b = F['B'][:, :, usi+1]
+
+            # seek for interactions position
+            ################################
+
+            uD  = np.where((itypf == 1))[0]
+            uR  = np.where((itypf == 2))[0]
+            uT  = np.where((itypf == 3))[0]
+            uRf = np.where((itypf == 4))[0]
+            uRc = np.where((itypf == 5))[0]
+
+            # assign floor and ceil slab
+            ############################
+
+            slT = [ L.Gs.node[x]['name'] for x in nstrf[uT] ]
+            slR = [ L.Gs.node[x]['name'] for x in nstrf[uR] ]
+
+            # WARNING
+            # in future versions floor and ceil could be different for each cycle.
+            # this information would be directly obtained from L.Gs
+            # then the two following lines would have to be modified
+
+            slRf = np.array(['FLOOR']*len(uRf))
+            slRc = np.array(['CEIL']*len(uRc))
+
+            # Fill the used slab
+            #####################
+
+            tsl = np.hstack((tsl, slT))
+            rsl = np.hstack((rsl, slR, slRf, slRc))
+
+            # Basis
+            # Warning
+            # -------
+            # B.idx refers to an interaction index
+            # whereas B0.idx refers to a ray number
+
+            B.stack(data=b.T, idx=idxf)
+            B0.stack(data=b0.T,idx=F['rayidx'])
+
+            ### Reflexion
+            ############
+            ### wall reflexion
+            #(theta, s_in,s_out)
+
+            R.stack(data=np.array((thetaf[uR], s_inf[uR], s_outf[uR])).T,
+                    idx=idxf[uR])
+            # floor reflexion
+            R.stack(data=np.array((thetaf[uRf], s_inf[uRf], s_outf[uRf])).T,
+                    idx=idxf[uRf])
+            # ceil reflexion
+            R.stack(data=np.array((thetaf[uRc], s_inf[uRc], s_outf[uRc])).T,
+                    idx=idxf[uRc])
+
+            # Transmision
+            ############
+            # (theta, s_in,s_out)
+
+            T.stack(data=np.array((thetaf[uT], s_inf[uT], s_outf[uT])).T, idx=idxf[uT])
+
+            ###
+            #Diffraction
+            #phi0,phi,si,sd,N,mat0,matN,beta
+            #
+            # self[k]['diffvect'] = ((phi0,phi,beta,N) x (nb_rayxnb_interactions)   )
+            # si and so are stacked at the end of diffvect
+            # data =  (6 x (nb_rayxnb_interactions) )
+            # ((phi0,phi,beta,N,sin,sout) x (nb_rayxnb_interactions) )
+            #
+            # groups are in the same order as in the flat store
 
-                # ityp : i x r
-                ityp = self[k]['sig'][1, 1:-1, :]
+            lk = [ k for k in sorted(self.keys()) if (k != 0) and self[k].has_key('diffvect') ]
+            if lk != []:
+                dw = np.hstack([ self[k]['diffslabs'] for k in lk ])
+                dvec = np.hstack([ self[k]['diffvect'] for k in lk ])
+                dix = np.hstack([ self[k]['diffidx'] for k in lk ])
+                data = np.vstack((dvec,s_inf[uD],s_outf[uD]))
+                D.stack(data=data.T,idx=dix)
 
-                # theta : i x r   ( related to interactions )
-                theta = self[k]['theta']
+        T.create_dusl(tsl)
+        R.create_dusl(rsl)
+        D.create_dusl(dw)
+        # create interactions structure
+        self.I = I
+        self.I.add([T, R, D])
+        # create rotation base B
+        self.B = B
+        # create rotation base B0
+        self.B0 = B0
 
-                # (i+1) x r
-                si = self[k]['si']
-                # distance in
-                s_in = si[0:-1,:]
-                # distance in
-                s_out = si[1:,:]
-                
-                if self[k].has_key('diffvect'):
+        self.filled = True
 
-                    dvec = self[k]['diffvect']
-                    ldsl = self[k]['diffslabs']
-                    dix = self[k]['diffidx']
+    def _workspace(self,nr,nf):
+        """ get work buffers of Rays.eval
 
+        Parameters
+        ----------
 
-                ## flatten information
-                ######################
+        nr : int
+            number of rays
+        nf : int
+            number of frequency points
 
-                # flatten nstr (1 dimension)
-                # size1 = i x r
-                size1 = nstr.size
+        Returns
+        -------
 
-                # flatten ityp (method faster than np.ravel() )
-                nstrf = np.reshape(nstr,size1,order='F')
-                itypf = ityp.reshape(size1,order='F')
-                thetaf = theta.reshape(size1,order='F')
-                #sif = si[0, :, :].reshape(si[0, :, :].size)
+        ws : dict
+            'Z','T','G' complex arrays (>=nr x >=nf x 3 x 3)
+            'Ct' complex array (>=nray x >=nf x 3 x 3)
+            'Bi' array (>=nr x 3 x 3) of the dtype of the bases
 
-                # ## index creation / already done in rays.locbas
-                # ##################
-                # # create index for retrieving interactions
+        Notes
+        -----
 
-                # # integer offset : total size idx
+        The buffers are kept in self._ws and reused from one call
+        to another as long as they are large enough.
 
-                # idxts = idxts + idx.size
+        """
+        ws = getattr(self,'_ws',{})
+        dtype = self.B.data.dtype
+        if ((ws == {}) or (ws['Z'].shape[0] < nr) or (ws['Z'].shape[1] < nf)
+            or (ws['Ct'].shape[0] < self.nray) or (ws['Bi'].dtype != dtype)):
+            if ws != {}:
+                nr = max(nr,ws['Z'].shape[0])
+                nf = max(nf,ws['Z'].shape[1])
+            ws = {}
+            for k in ['Z','T','G']:
+                ws[k] = np.empty((nr,nf,3,3),dtype=complex)
+            ws['Ct'] = np.empty((self.nray,nf,3,3),dtype=complex)
+            ws['Bi'] = np.empty((nr,3,3),dtype=dtype)
+            self._ws = ws
+        return ws
+
+    def _raytab(self,ib):
+        """ table of interactions of rays sorted by decreasing length
 
-                # idx = idxts + np.arange(ityp.size).reshape(np.shape(ityp),order='F')
+        Parameters
+        ----------
 
-                # nbray = np.shape(idx)[1]
+        ib : list
+            list of interaction groups (0 excluded)
 
-                # self[k]['rays'] = idx
-                # self[k]['nbrays'] = nbray
-                # self[k]['rayidx'] = nbrayt + np.arange(nbray)
-                # # create a numpy array to relate the ray index to its corresponding
-                # # number of interactions
+        Returns
+        -------
 
-                # # _ray2nbi = np.ones((nbray))
+        perm : np.array (nr)
+            ray index
+        tab : np.array (nr x lmax)
+            interaction index of the rays (0 padded)
+        nact : np.array (lmax)
+            number of rays having more than i interactions
 
-                # #try:
-                # #    self._ray2nbi=np.hstack((self._ray2nbi,_ray2nbi))
-                # #except:
-                # #    self._ray2nbi=_ray2nbi
+        Notes
+        -----
 
-                # #self._ray2nbi[self[k]['rayidx']]  = k
-                # nbrayt = nbrayt + nbray
-                # #self.raypt = self.raypt + self[k]['nbrays']
+        As rays are sorted by decreasing number of interactions the rays
+        still involved at step i of the chain product are the nact[i]
+        first rays. The table is gathered from the flat store self.F.
 
-                idxf = self[k]['rays'].reshape(self[k]['rays'].size,order='F')
-                #  (i+1)xr
-                # 
+        """
+        F = self.F
+        nint = F['nint']
+        o = np.where(np.in1d(nint,[ l for l in ib if l != 0 ]))[0]
+        if len(o) == 0:
+            return np.array([],dtype=int),np.zeros((0,0),dtype=int),np.array([],dtype=int)
+        o = o[np.argsort(-nint[o],kind='mergesort')]
+        n = nint[o]
+        nr = len(o)
+        lmax = n[0]
+        # (row,col) of each interaction in tab
+        row = np.repeat(np.arange(nr),n)
+        col = np.arange(np.sum(n)) - np.repeat(np.cumsum(n)-n,n)
+        tab = np.zeros((nr,lmax),dtype=int)
+        tab[row,col] = F['rays'][np.repeat(F['off'][o],n)+col]
+        perm = F['rayidx'][o]
+        nact = np.sum(n[:,None]>np.arange(lmax)[None,:],axis=0)
+        return perm,tab,nact
+
+    def _evalchunk(self,fGHz,perm,tab,nact):
+        """ field evaluation of rays on a frequency chunk
 
-                size2 = si[:, :].size
-                nbray = self[k]['nbrays']
+        Parameters
+        ----------
 
-                #  ,(i+1)xr
-                # sif = si[:, :].reshape(size2,order='F') # TO BE REMOVE
-                s_inf = s_in[:, :].reshape(ityp.size,order='F')
-                s_outf = s_out[:, :].reshape(ityp.size,order='F')
+        fGHz : array
+            frequency in GHz (chunk)
+        perm : np.array
+        tab : np.array
+        nact : np.array
+            see Rays._raytab
 
-                # 2x2,(i+1)xr
+        Returns
+        -------
 
-                #
-                # self[k]['B'] 3 x 3 x i x r
-                #
-                # first unitary matrix (3x3xr)
-                b0 = self[k]['B'][:,:,0,:]
-                # first unitary matrix 1:
-                # dimension i and r are merged
-                try:
-                    b  = self[k]['B'][:,:,1:,:].reshape(3, 3, size2-nbray,order='F')
-                except:
-                    pdb.set_trace()
+        Ct : np.array (nray x nf x 3 x 3)
+            view on the work buffer self._ws['Ct'], overwritten by the
+            next call
 
+        """
+        # evaluation of all interactions
+        #
+        # core calculation of all interactions is done here
+        #
+        self.I.eval(fGHz)
 
-                ## find used slab
-                ##################
-                # find slab type for the rnstr
-                # nstrf is a number of slab
-                # this is a problem for handling subsegment
-                #
-                
-                # seek for interactions position
-                ################################
+        #nf : number of frequency point
+        nf = self.I.nf
 
-                uD  = np.where((itypf == 1))[0]
-                uR  = np.where((itypf == 2))[0]
-                uT  = np.where((itypf == 3))[0]
-                uRf = np.where((itypf == 4))[0]
-                uRc = np.where((itypf == 5))[0]
-
-                # assign floor and ceil slab
-                ############################
-
-                slT = [ L.Gs.node[x]['name'] for x in nstrf[uT] ]
-                slR = [ L.Gs.node[x]['name'] for x in nstrf[uR] ]
-
-                # WARNING
-                # in future versions floor and ceil could be different for each cycle.
-                # this information would be directly obtained from L.Gs
-                # then the two following lines would have to be modified
-
-                slRf = np.array(['FLOOR']*len(uRf))
-                slRc = np.array(['CEIL']*len(uRc))
-
-
-                # Fill the used slab
-                #####################
-
-                tsl = np.hstack((tsl, slT))
-                rsl = np.hstack((rsl, slR, slRf, slRc))
-                if self[k].has_key('diffvect'): 
-                    dw = np.hstack((dw,self[k]['diffslabs'])) 
-    ##            for s in uslv:
-    ##
-    ##                T.dusl[s]=np.hstack((T.dusl[s],len(T.idx) + np.where(sl[uT]==s)[0]))
-    ##                R.dusl[s]=np.hstack((R.dusl[s],len(R.idx) + np.where(sl[uR]==s)[0]))
-    ##            R.dusl['FLOOR']=np.hstack((R.dusl['FLOOR'],len(R.idx)+len(uR) + np.where(sl[uRf]=='FLOOR')[0]))
-    # R.dusl['CEIL']=np.hstack((R.dusl['CEIL'],len(R.idx)+len(uR)+len(uRf) +
-    # np.where(sl[uRc]=='CEIL')[0]))
-
-                # Basis
-                # Hugr issue with B index
-                # Friedman version Bs was entering in the index
-                # maybe B can have the same index that interactions
-                # but this must be managed when evaluation of CIR is made
-
-                # BU 10/4/2013
-                # .. todo:  This is no longer idxf the good index
-                # why the transposition b is first 2x2x(i+1)xr
-                #                             idxf is (ixr)
-                #
-                # need to check how B is used in eval()
-                #
-                # Warning
-                # -------
-                # B.idx refers to an interaction index
-                # whereas B0.idx refers to a ray number
-                # B.stack(data=b.T, idx=idxf)
-                # B0.stack(data=b0.T,idx=self[k]['rayidx'])
-
-                B.stack(data=b.T, idx=idxf)
-                B0.stack(data=b0.T,idx=self[k]['rayidx'])
-                ### Reflexion
-                ############
-                ### wall reflexion
-                #(theta, s_in,s_out)
-
-                R.stack(data=np.array((thetaf[uR], s_inf[uR], s_outf[uR])).T,
-                        idx=idxf[uR])
-                # floor reflexion
-                R.stack(data=np.array((thetaf[uRf], s_inf[uRf], s_outf[uRf])).T,
-                        idx=idxf[uRf])
-                # ceil reflexion
-                R.stack(data=np.array((thetaf[uRc], s_inf[uRc], s_outf[uRc])).T,
-                        idx=idxf[uRc])
-
-                # R.stack(data=np.array((thetaf[uR], sif[uR], sif[uR+1])).T,
-                #         idx=idxf[uR])
-                # # floor reflexion
-                # R.stack(data=np.array((thetaf[uRf], sif[uRf], sif[uRf+1])).T,
-                #         idx=idxf[uRf])
-                # # ceil reflexion
-                # R.stack(data=np.array((thetaf[uRc], sif[uRc], sif[uRc+1])).T,
-                #         idx=idxf[uRc])
-
-                ### sl[idxf[uT]]
-                # Transmision
-                ############
-                # (theta, s_in,s_out)
-                # T.stack(data=np.array((thetaf[uT], sif[uT], sif[uT+1])).T, idx=idxf[uT])
-                T.stack(data=np.array((thetaf[uT], s_inf[uT], s_outf[uT])).T, idx=idxf[uT])
-
-                ###
-                #Diffraction
-                #phi0,phi,si,sd,N,mat0,matN,beta
-                # 
-
-                if self[k].has_key('diffvect'): 
-                    # self[k]['diffvect'] = ((phi0,phi,beta,N) x (nb_rayxnb_interactions)   )
-                    #si and so are stacked at the end of self[k]['diffvect'] 
-                    #as well:
-                    #data =  (6 x (nb_rayxnb_interactions) )
-                    # ((phi0,phi,beta,N,sin,sout) x (nb_rayxnb_interactions) )
-                    data = np.vstack((self[k]['diffvect'],s_inf[uD],s_outf[uD]))
-                    D.stack(data=data.T,idx=self[k]['diffidx'])#idxf[uD])
-
-            elif self.los:
-                ze = np.array([0])
-                #self[k]['rays'] = np.array(([[0]]))
-                #self[k]['nbrays'] = 1
-                #self[k]['rayidx'] = ze
-                #self.raypt = 1
-                #self._ray2nbi=ze
-                B.stack(data=np.eye(3)[np.newaxis,:,:], idx=ze)
-                B0.stack(data=np.eye(3)[np.newaxis,:,:],idx=ze)
+        nr = len(perm)
+        ws = self._workspace(nr,nf)
+
+        # Ct : r x f x 3 x 3
+        Ct = ws['Ct'][:self.nray,:nf]
+        Ct[:] = 0
+
+        if nr > 0:
+            Z = ws['Z'][:nr,:nf]
+            T = ws['T'][:nr,:nf]
+            G = ws['G'][:nr,:nf]
+            Bi = ws['Bi']
+            # transposed bases : n x 1 x 3 x 3 (view)
+            Bt = Bi.swapaxes(1,2)[:,None,:,:]
+            # interactions : i x f x 3 x 3 (view)
+            II = self.I.I.swapaxes(0,1)
+            # first basis B0 (frequency independent)
+            np.take(self.B0.data,perm,axis=0,out=Bi[:nr])
+            Z[:] = Bt[:nr]
+            #
+            #  ##########################
+            #  ## B  # I  # B  # I  # B #
+            #  ##########################
+            #
+            #  Z(i+1) = B_i (A_i Z(i))
+            #
+            #  Z accumulates the chain of all the rays, only its n
+            #  first rows are updated at step i (G and T are scratch)
+            #
+            for i,n in enumerate(nact):
+                np.take(II,tab[:n,i],axis=0,out=G[:n])
+                np.take(self.B.data,tab[:n,i],axis=0,out=Bi[:n])
+                np.matmul(Bt[:n],G[:n],out=T[:n])
+                np.matmul(T[:n],Z[:n],out=G[:n])
+                Z[:n] = G[:n]
+            # attenuation due to distance
+            # will be removed once the divergence factor will be implemented
+            Z *= 1./self.dis[perm][:,None,None,None]
+            Ct[perm] = Z
 
-        T.create_dusl(tsl)
-        R.create_dusl(rsl)
-        D.create_dusl(dw)
-        # create interactions structure
-        self.I = I
-        self.I.add([T, R, D])
-        # create rotation base B
-        self.B = B
-        # create rotation base B0
-        self.B0 = B0
+        #
+        # true LOS when no interaction
+        #
+        if self.los:
+            # Fris
+            Ct[0,:, :, :] = np.eye(3,3)[None,:,:]*1./(self[0]['dis'][0])
 
-        self.filled = True
+        return(Ct)
 
-    def eval(self,fGHz=np.array([2.4]),ib=[]):
+    def eval(self,fGHz=np.array([2.4]),ib=[],nfc=0,Cn=None,filenameh5='',grpname=''):
         """  field evaluation of rays  
 
         Parameters
@@ -2296,36 +2771,55 @@ class Rays(PyLayers, dict):
         fGHz : array
             frequency in GHz 
         ib : list of interactions block
+        nfc : int
+            number of frequency points evaluated at once (0 : whole band)
+        Cn : Ctilde
+            preallocated output (nray x nf components), filled in place
+        filenameh5 : string
+            if not '', the channel is written frequency chunk by
+            frequency chunk in the Ct/grpname group of this Link file
+            (DIRLNK) instead of being kept in memory
+        grpname : string
+            group name in filenameh5
 
-        """
+        Returns
+        -------
 
-        #print 'Rays evaluation'
+        Cn : Ctilde
+            if filenameh5 is given the 4 channel components are not loaded
+            (None), use Cn._loadh5(filenameh5,grpname,ifreq=...)
 
-        self.fGHz=fGHz
+        Notes
+        -----
 
-        # evaluation of all interactions
-        #
-        # core calculation of all interactions is done here
-        #
-        
-        self.I.eval(fGHz)
+        For a ray with l interactions
 
-        # if np.isnan(self.I.I).any():
-        #     pdb.set_trace()
-        # evaluation of base B  (2x2)
-        # B and B0 do no depend on frequency
-        # just an axis extension (np.newaxis)
-        #pdb.set_trace()
+        Ct = B_{l-1} A_{l-1} ... B_0 A_0 B0  / dis
+
+        where A_i are the interaction matrices (self.I.I) and B_i the
+        local bases (self.B, self.B0) transposed.
+
+        All the rays, whatever their number of interactions, and all the
+        frequencies are processed together: the chain is evaluated step by
+        step, at step i only the rays having more than i interactions are
+        updated (rays are sorted by decreasing length). Products are done
+        with np.matmul in work buffers (see Rays._workspace) which are
+        reused from one call to the other.
+
+        With nfc > 0 the band is processed by chunks of nfc points
+        (Rays._evalchunk) : interactions and work buffers then only
+        scale with nfc, and each chunk is written in the output (Cn
+        or hdf5 file) before the next one is evaluated. self.I then
+        only holds the last chunk.
 
-        # 1 x i x 3 x 3
-        B  = self.B.data[np.newaxis,...]
-        B  = B.swapaxes(2,3)
-        # 1 x r x 3 x 3
-        B0 = self.B0.data[np.newaxis,...]
-        B0  = B0.swapaxes(2,3)
+        """
+
+        #print 'Rays evaluation'
 
-        # Ct : f x r x 3 x 3
-        Ct = np.zeros((self.I.nf, self.nray, 3, 3), dtype=complex)
+        self.fGHz=fGHz
+        nf = len(fGHz)
+        if (nfc <= 0) or (nfc > nf):
+            nfc = nf
 
         # delays : ,r
         self.delays = np.zeros((self.nray))
@@ -2333,192 +2827,87 @@ class Rays(PyLayers, dict):
         # dis : ,r
         self.dis = np.zeros((self.nray))
 
-        #nf : number of frequency point
-        nf = self.I.nf
-
         aod= np.empty((2,self.nray))
         aoa= np.empty((2,self.nray))
         # loop on interaction blocks
         if ib==[]:
             ib=self.keys()
-        
-        # loop over group of interactions
-        for l in ib:
-            # ir : ray index
 
+        for l in ib:
             ir = self[l]['rayidx']
             aoa[:,ir]=self[l]['aoa']
             aod[:,ir]=self[l]['aod']
             if l != 0:
-                # l stands for the number of interactions
-                r = self[l]['nbrays']
-                # reshape in order to have a 1D list of index
-                # reshape ray index
-                rrl = self[l]['rays'].reshape(r*l,order='F')
-                # get the corresponding evaluated interactions
-                #
-                # reshape error can be tricky to debug.
-                #
-                # f , r , l , 2 , 2
-                A = self.I.I[:, rrl, :, :].reshape(self.I.nf, r, l, 3, 3)
-                # get the corresponding unitary matrix B
-                # 1 , r , l , 2 , 2
-                #Bl = B[:, rrl, :, :].reshape(self.I.nf, r, l, 2, 2,order='F')
-                Bl = B[:, rrl, :, :].reshape(1, r, l, 3, 3)
-                # get the first unitary matrix B0l
-                B0l = B0[:,ir,:, :]
-                # get alpha
-                # alpha = self.I.alpha[rrl].reshape(r, l,order='F')
-                # # get gamma
-                # gamma = self.I.gamma[rrl].reshape(r, l,order='F')
-                # # get si0
-                # si0 = self.I.si0[rrl].reshape(r, l,order='F')
-                # # get sout
-                # sout = self.I.sout[rrl].reshape(r, l,order='F')
-
-                try:
-                    del Z
-                except:
-                    pass
-
-
-                #print "\nrays",ir
-                #print "-----------------------"
-                ## loop on all the interactions of ray with l interactions
-                for i in range(0, l):
-
-
-    ############################################
-    ##                # Divergence factor D
-    ###                 not yet implementented
-    ############################################
-    #                if i == 0:
-    #                    D0=1./si0[:,1]
-    #                    rho1=si0[:,1]*alpha[:,i]
-    #                    rho2=si0[:,1]*alpha[:,i]*gamma[:,i]
-    #                    D=np.sqrt(
-    #                     ( (rho1 ) / (rho1 + sout[:,i]) )
-    #                     *( (rho2) / (rho2 + sout[:,i])))
-    #                    D=D*D0
-    #                    rho1=rho1+(sout[:,i]*alpha[:,i])
-    #                    rho2=rho2+(sout[:,i]*alpha[:,i]*gamma[:,i])
-
-    ##                     gerer le loss
-    #                    if np.isnan(D).any():
-    #                        p=np.nonzero(np.isnan(D))[0]
-    #                        D[p]=1./sout[p,1]
-    #                else :
-    #                    D=np.sqrt(
-    #                     ( (rho1 ) / (rho1 + sout[:,i]) )
-    #                     *( (rho2) / (rho2 + sout[:,i])))
-
-    #                    rho1=rho1+(sout[:,i]*alpha[:,i])
-    #                    rho2=rho2+(sout[:,i]*alpha[:,i]*gamma[:,i])
-    ############################################
-
-                    #  A0  (X dot Y)
-                    #  |    |     |
-                    #  v    v     v
-                    ##########################
-                    ## B  # I  # B  # I  # B #
-                    ##########################
-                    #      \_____/   \______/
-                    #         |         |
-                    #       Atmp(i)   Atmp(i+1)
-                    #
-                    # Z=Atmp(i) dot Atmp(i+1)
-
-                    #X = A [:, :, i, :, :]
-                    #Y = Bl[:, :, i, :, :]
-                    # pdb.set_trace()
-                    if i == 0:
-                    ## First Basis added
-                        Atmp = A[:, :, i, :, :]
-                        B00 = B0l[:, :,  :, :]
-                        Z = np.sum(Atmp[..., :, :, np.newaxis]
-                                  *B00[..., np.newaxis, :, :], axis=-2)
-                    else:
-                        Atmp = A[:, :, i, :, :]
-                        BB = Bl[:, :, i-1, :, :]
-                        Ztmp = np.sum(Atmp[..., :, :, np.newaxis]
-                                  *BB[..., np.newaxis, :, :], axis=-2)
-
-
-                        Z = np.sum(Ztmp[..., :, :, np.newaxis]
-                                  *Z[..., np.newaxis, :, :], axis=-2)
-
-                    if i == l-1:
-                        BB = Bl[:, :, i, :, :]
-                        Z = np.sum(BB[..., :, :, np.newaxis]
-                                  *Z[..., np.newaxis, :, :], axis=-2)
-
-
-                # fill the C tilde MDA
-
-                Ct[:,ir, :, :] = Z[:, :, :, :]
-
-                # delay computation:
-                # sum the distance from antenna to first interaction si0
-                # and the sum of all outgoing segments
-                #self[l]['dis'] = self.I.si0[self[l]['rays'][0,:]] \
-                #        + np.sum(self.I.sout[self[l]['rays']], axis=0)
-                # attenuation due to distance
-                # will be removed once the divergence factor will be implemented
-                #
-                Ct[:,ir, :, :] = Ct[:, ir, :, :]*1./(self[l]['dis'][np.newaxis, :, np.newaxis, np.newaxis])
                 self.delays[ir] = self[l]['dis']/0.3
                 self.dis[ir] = self[l]['dis']
-        #
-        # true LOS when no interaction
-        #
+
         if self.los:
-            Ct[:,0, :, :]= np.eye(3,3)[None,None,:,:]
-            #self[0]['dis'] = self[0]['si'][0]
-            # Fris
-            Ct[:,0, :, :] = Ct[:,0, :, :]*1./(self[0]['dis'][None, :, None, None])
             self.delays[0] = self[0]['dis']/0.3
             self.dis[0] = self[0]['dis']
 
+        perm,tab,nact = self._raytab(ib)
 
-        # To be corrected in a future version
         #
-        #  Ct : nf , Nray , theta , phi 
+        # Construction of the Ctilde propagation channel structure
         #
-        #  to 
+        if not isinstance(Cn,Ctilde):
+            Cn = Ctilde()
+
         #
         #  Ct : Nray x nf , theta , phi 
         #
-        Ct = np.swapaxes(Ct, 1, 0)
-
-        #c11 = Ct[:,:,0,0]
-        #c12 = Ct[:,:,0,1]
-        #c21 = Ct[:,:,1,0]
-        #c22 = Ct[:,:,1,1]
-        
-        c11 = Ct[:,:,1,1]
-        c12 = Ct[:,:,1,2]
-        c21 = Ct[:,:,2,1]
-        c22 = Ct[:,:,2,2]
-
-
-        #
-        # Construction of the Ctilde propagation channel structure
+        #  Ctt : Ct[:,:,1,1]  Ctp : Ct[:,:,1,2]
+        #  Cpt : Ct[:,:,2,1]  Cpp : Ct[:,:,2,2]
         #
-        Cn = Ctilde()
-
-        # Cn.Cpp = bs.FUsignal(self.I.fGHz, c11)
-        # Cn.Cpt = bs.FUsignal(self.I.fGHz, c12)
-        # Cn.Ctp = bs.FUsignal(self.I.fGHz, c21)
-        # Cn.Ctt = bs.FUsignal(self.I.fGHz, c22)
-        Cn.Ctt = bs.FUsignal(self.I.fGHz, c11)
-        Cn.Ctp = bs.FUsignal(self.I.fGHz, c12)
-        Cn.Cpt = bs.FUsignal(self.I.fGHz, c21)
-        Cn.Cpp = bs.FUsignal(self.I.fGHz, c22)
-
-        Cn.nfreq = self.I.nf
+        lC = ['Ctt','Ctp','Cpt','Cpp']
+        lij = [(1,1),(1,2),(2,1),(2,2)]
+        if filenameh5 != '':
+            filename = pyu.getlong(filenameh5,pstruc['DIRLNK'])
+            fh5 = h5py.File(filename,'a')
+            try:
+                if not 'Ct' in fh5.keys():
+                    fh5.create_group('Ct')
+                if grpname in fh5['Ct'].keys():
+                    del fh5['Ct'][grpname]
+                f = fh5['Ct'].create_group(grpname)
+                lout = [ f.create_dataset(c+'_y',shape=(self.nray,nf),dtype=complex)
+                         for c in lC ]
+                for k0 in range(0,nf,nfc):
+                    Ct = self._evalchunk(fGHz[k0:k0+nfc],perm,tab,nact)
+                    for o,(i,j) in zip(lout,lij):
+                        o[:,k0:k0+nfc] = Ct[:,:,i,j]
+                    del Ct
+                f.create_dataset('Ta',data=Cn.Ta)
+                f.create_dataset('Tb',data=Cn.Tb)
+                f.create_dataset('tang',data=aod.T)
+                f.create_dataset('rang',data=np.hstack([np.pi-aoa.T[:,[0]],aoa.T[:,[1]]-np.pi]))
+                f.create_dataset('tauk',data=self.delays)
+                f.create_dataset('fGHz',data=fGHz)
+                fh5.close()
+            except:
+                fh5.close()
+                raise NameError('Rays.eval: issue when writting h5py file')
+            for c in lC:
+                setattr(Cn,c,None)
+        else:
+            shC = (self.nray,nf)
+            for c in lC:
+                C = getattr(Cn,c)
+                if not (isinstance(C,bs.FUsignal) and (C.y.shape == shC)):
+                    setattr(Cn,c,bs.FUsignal(fGHz,np.zeros(shC,dtype=complex)))
+                else:
+                    C.x = fGHz.astype(float)
+            lout = [ getattr(Cn,c).y for c in lC ]
+            for k0 in range(0,nf,nfc):
+                Ct = self._evalchunk(fGHz[k0:k0+nfc],perm,tab,nact)
+                for o,(i,j) in zip(lout,lij):
+                    o[:,k0:k0+nfc] = Ct[:,:,i,j]
+                del Ct
+
+        Cn.nfreq = nf
         Cn.nray = self.nray
         Cn.tauk = self.delays
-        Cn.fGHz = self.I.fGHz
+        Cn.fGHz = fGHz
         # r x 2
         Cn.tang = aod.T
         Cn.tangl = aod.T
@@ -2664,7 +3053,7 @@ class Rays(PyLayers, dict):
             interaction block number
         """
         i = self._ray2nbi[r]
-        return 
+        return(i)
 
     def ray2iidx(self,ir):
         """ Get interactions index of a given ray
@@ -3315,5 +3704,48 @@ class Rays(PyLayers, dict):
             return(filename)
 
 
+def _to3D_func(args):
+    """ worker function of Rays.to3D in parallel mode
+
+    Parameters
+    ----------
+
+    args : tuple
+        (k,r0,r1) interaction group and chunk of rays
+
+    Notes
+    -----
+
+    The 2D Rays, the Layout and the vertical patterns are read from the
+    module global _R_run which is set before the pool is forked.
+
+    """
+    R,L,d,H,rmoutceilR = _R_run
+    k,r0,r1 = args
+    return(R._to3Dgroup(L, k, d, H=H, rmoutceilR=rmoutceilR, r0=r0, r1=r1))
+
+def _locbas_func(args):
+    """ worker function of Rays.locbas in parallel mode
+
+    Parameters
+    ----------
+
+    args : tuple
+        (k,r0,r1) interaction group and chunk of rays
+
+    Returns
+    -------
+
+    (g,luw) : group k of the chunk after locbas, list of used wedges
+
+    """
+    R,L = _R_run
+    k,r0,r1 = args
+    r = Rays(R.pTx,R.pRx)
+    r.is3D = R.is3D
+    r[k] = R._subgroup(k, r0, r1)
+    r.locbas(L)
+    return((r[k],r._luw))
+
 if __name__ == "__main__":
     doctest.testmod()
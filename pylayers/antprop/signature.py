@@ -22,6 +22,11 @@ Class Signatures
     Signatures.exist
     Signatures.dido
     Signatures.run
+    Signatures.run_multi
+    Signatures._explore
+    Signatures._gather
+    Signatures._sigsource
+    Signatures._sigsource_csr
     Signatures.meta
     Signatures.lineofcycle
     Signatures.cones
@@ -33,6 +38,18 @@ Class Signatures
     Signatures.image
     Signatures.image2
 
+Class SigStore
+==============
+
+.. autosummary::
+    :toctree: generated/
+
+    SigStore.__init__
+    SigStore.key
+    SigStore.get
+    SigStore.put
+    SigStore.delete
+
 Class Signature
 ===============
 
@@ -61,12 +78,17 @@ Utility functions
 
     showsig
     gidl
+    coneratio
+    _sigsource_func
     frontline
     edgeout2
     edgeout
 
 """
 import doctest
+import os
+import hashlib
+import contextlib
 import numpy as np
 #import scipy as sp
 import scipy.linalg as la
@@ -89,11 +111,19 @@ import pylayers.util.plotutil as plu
 from pylayers.antprop.rays import Rays
 from pylayers.util.project import *
 import heapq
+import multiprocessing as mp
+try:
+    import fcntl
+except:
+    fcntl = None
 import shapely.geometry as sh
 import shapely.ops as sho
 from tqdm import tqdm
 #from numba import autojit
 
+# shared state of Signatures.run workers (see _sigsource_func)
+_Si_run = None
+
 
 def plot_lines(ax, ob, color = []):
     """
@@ -195,6 +225,108 @@ def gidl(g):
     gr.pos=dpos
     return(gr)
 
+def coneratio(tahe0,tahe_,th_mirror):
+    """ ratio of a mirrored segment seen through a cone
+
+    Parameters
+    ----------
+
+    tahe0 : np.array (2x2)
+        tail head of the first segment of the cone
+    tahe_ : np.array (2x2)
+        tail head of the last segment of the cone
+    th_mirror : np.array (2x2)
+        tail head of the mirrored segment to test
+
+    Returns
+    -------
+
+    ratio : float
+        part of the cone aperture intercepted by th_mirror
+
+    See Also
+    --------
+
+    pylayers.antprop.signature.Signatures._sigsource
+
+    """
+    pta0 = tahe0[0]
+    phe0 = tahe0[1]
+    pta_ = tahe_[0]
+    phe_ = tahe_[1]
+
+    connected = False
+    if (pta0==pta_).all():
+        apex = pta0
+        connected = True
+        v0 = phe0-apex
+        v_ = phe_-apex
+    elif (pta0==phe_).all():
+        apex = pta0
+        connected = True
+        v0 = phe0-apex
+        v_ = pta_-apex
+    elif (phe0==pta_).all():
+        apex = phe0
+        connected = True
+        v0 = pta0-apex
+        v_ = phe_-apex
+    elif (phe0==phe_).all():
+        apex = phe0
+        connected = True
+        v0 = pta0-apex
+        v_ = pta_-apex
+
+    if not connected:
+        if not (geu.ccw(pta0,phe0,phe_) ^
+                geu.ccw(phe0,phe_,pta_) ):
+            vr = (pta0,phe_)
+            vl = (phe0,pta_)
+        else:  # twisted case
+            vr = (pta0,pta_)
+            vl = (phe0,phe_)
+        vr_n = (vr[1]-vr[0])/np.linalg.norm(vr[1]-vr[0])
+        vl_n = (vl[1]-vl[0])/np.linalg.norm(vl[1]-vl[0])
+        vrdotvl = np.dot(vr_n,vl_n)
+        angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.0))
+        if angle_cone!=0:
+            # apex calculation
+            a0u = np.dot(pta0,vr_n)
+            a0v = np.dot(pta0,vl_n)
+            b0u = np.dot(phe0,vr_n)
+            b0v = np.dot(phe0,vl_n)
+            kb  = ((b0v-a0v)-vrdotvl*(b0u-a0u))/(vrdotvl*vrdotvl-1)
+            apex = phe0 + kb*vl_n
+    else:
+        v0n = v0/np.linalg.norm(v0)
+        v_n = v_/np.linalg.norm(v_)
+        sign = np.sign(np.cross(v_n,v0n))
+        if sign>0:
+            vr_n = -v0n
+            vl_n = v_n
+        else:
+            vr_n = v_n
+            vl_n = -v0n
+        vrdotvl = np.dot(vr_n,vl_n)
+        angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.))
+
+    if angle_cone == 0:
+        return 0
+
+    if np.allclose(th_mirror[0],apex) or np.allclose(th_mirror[1],apex):
+        return 1.
+
+    al = np.arctan2(vl_n[1],vl_n[0])
+    ar = np.arctan2(vr_n[1],vr_n[0])
+    wseg0 = th_mirror[0] - apex
+    wseg1 = th_mirror[1] - apex
+    wseg0_n = wseg0/np.linalg.norm(wseg0)
+    wseg1_n = wseg1/np.linalg.norm(wseg1)
+    aseg0 = np.arctan2(wseg0_n[1],wseg0_n[0])
+    aseg1 = np.arctan2(wseg1_n[1],wseg1_n[0])
+    I = geu.angle_intersection2(al,ar,aseg0,aseg1)
+    return I/angle_cone
+
 def shLtmp(L):
     seg_connect = {x:L.Gs.edge[x].keys() for x in L.Gs.nodes() if x >0}
 
@@ -1151,6 +1283,10 @@ class Signatures(PyLayers,dict):
             activate diffraction 
         threshold : float 
             for reducing calculation time
+        parallel : boolean
+            distribute the exploration over several processes (False)
+        nproc : int
+            number of worker processes (0 : all cores)
 
 
         Returns
@@ -1174,9 +1310,11 @@ class Signatures(PyLayers,dict):
                     'bt' : True,
                     'progress': True,
                     'diffraction' : True,
-                    'animation' : False
+                    'animation' : False,
+                    'parallel' : False,
+                    'nproc' : 0
                     }
-        selv.cpt = 0 
+        self.cpt = 0
         for k in defaults:
             if k not in kwargs:
                 kwargs[k] = defaults[k] 
@@ -1194,6 +1332,8 @@ class Signatures(PyLayers,dict):
         progress = kwargs['progress'] 
         diffraction = kwargs['diffraction']
         animation = kwargs['animation'] 
+        parallel = kwargs['parallel']
+        nproc = kwargs['nproc']
 
         self.filename = self.L._filename.split('.')[0] +'_' + str(self.source) +'_' + str(self.target) +'_' + str(self.cutoff) +'.sig'
         #
@@ -1227,571 +1367,1020 @@ class Signatures(PyLayers,dict):
         Gi = self.L.Gi
         Gi.pos = self.L.Gi.pos
         #
+        # The frozen CSR form of Gi (L.Gicsr) is used when available.
+        #
+        bcsr = hasattr(self.L,'Gicsr') and (not animation)
+        #
         # remove diffractions from Gi
         #
-        if not diffraction:
+        if (not diffraction) and (not bcsr):
             Gi = gidl(Gi)
 
-        # initialize dout dictionnary
-        dout = {}
-
-        # progresss stuff...
-        lmax = len(lis)*len(lit)
-        pe = 0
-        tic = time.time()
-        tic0 = tic
-        #for interaction source  in list of source interactions
-
-        bvisu = False
-        # signature counter
-        cptsig = 0
-
+        fig = []
+        ax = []
         if animation:
             fig,ax = self.L.showG('s',aw=1)
             ax.plot(self.L.Gt.pos[self.source][0],self.L.Gt.pos[self.source][1],'ob')
             ax.plot(self.L.Gt.pos[self.target][0],self.L.Gt.pos[self.target][1],'or')
-        #
-        # Loop over all interactions seen from the source
-        #
-        # us : loop counter
-        # s  : interaction tuple
-        # s[0] : point (<0) or segment (>0)a
-        # pts : list of neighbour nodes from s[0]
-        # tahe : segment extremities or point coordinates (repeated twice)
-        lhash = []
-        
-        if progress :
-            pbar = tqdm(total=100,desc='Signatures')
 
-        for us,s in enumerate(lis):
-            if progress:
-                pbar.update(100./(1.*len(lis)))
+        # source interactions and target mask as indices of L.Gicsr
+        if bcsr:
+            lid = self._csrid(lis+lit)
+            blit = np.zeros((len(self.L.Gicsr['typ']),1),dtype=bool)
+            blit[lid[len(lis):],0] = True
+            largs = lid[:len(lis)]
+            ctx = (blit,nD,nR,nT,bt,diffraction,[self.target])
+        else:
+            largs = list(enumerate(lis))
+            ctx = (Gi,lit,lair,nD,nR,nT,bt)
+
+        lres = self._explore(largs,bcsr,ctx,
+                             parallel = parallel and (not animation),
+                             nproc = nproc,
+                             progress = progress,
+                             animation = animation,
+                             fig = fig,
+                             ax = ax)
+
+        self._gather(lres,[self])
+
+    def run_multi(self,ltarget,**kwargs):
+        """ get signatures from the source cycle to several target cycles
+
+        Parameters
+        ----------
+
+        ltarget : list
+            list of target cycles
+        cutoff : int
+            limit the exploration of all_simple_path
+        bt : boolean
+            backtrace (allow to visit already visited nodes in simple path algorithm)
+        progress : boolean
+            display the time passed in the loop
+        diffraction : boolean
+            activate diffraction
+        threshold : float
+            for reducing calculation time
+        parallel : boolean
+            distribute the exploration over several processes (False)
+        nproc : int
+            number of worker processes (0 : all cores)
+
+        Returns
+        -------
+
+        dSi : dict
+            keys : target cycle
+            values : Signatures from self.source to the target cycle
 
+        Notes
+        -----
+
+        The tree of interactions is expanded once from the source, each
+        target cycle collects the sequences ending on one of its
+        interactions. For each target the result is the same as
+        Signatures(L,source,target).run(**kwargs).
+
+        Examples
+        --------
+
+        >>> from pylayers.gis.layout import *
+        >>> from pylayers.antprop.signature import *
+        >>> L = Layout('defstr.ini')
+        >>> L.build()
+        >>> Si = Signatures(L,1,1)
+        >>> dSi = Si.run_multi([1,2],cutoff=3)
+
+        See Also
+        --------
+
+        pylayers.antprop.signature.Signatures.run
+
+        """
+        defaults = {'cutoff' : 2,
+                    'threshold':0.1,
+                    'nD':1,
+                    'nR':10,
+                    'nT':10,
+                    'bt' : True,
+                    'progress': True,
+                    'diffraction' : True,
+                    'parallel' : False,
+                    'nproc' : 0
+                    }
+        self.cpt = 0
+        for k in defaults:
+            if k not in kwargs:
+                kwargs[k] = defaults[k]
+
+        self.cutoff = kwargs['cutoff']
+        if 'threshold' not in kwargs:
+            kwargs['threshold'] = self.threshold
+        else:
+            self.threshold=kwargs['threshold']
+        diffraction = kwargs['diffraction']
+
+        if not hasattr(self.L,'Gicsr'):
+            self.L.buildGicsr()
+
+        # unique targets keeping the order
+        ltarget = [ x for ix,x in enumerate(ltarget) if x not in ltarget[:ix] ]
+
+        # list of interactions visible from source
+        lisR,lisT,lisD = self.L.intercy(self.source,typ='source')
+        if diffraction:
+            lis  = lisT + lisR + lisD
+        else:
+            lis  = lisT + lisR
 
-            if s[0]>0:
-                pts = self.L.Gs[s[0]].keys()
-                tahe = [np.array([self.L.Gs.pos[pts[0]],self.L.Gs.pos[pts[1]]])]
+        # target mask : column it for target ltarget[it]
+        llit = []
+        for target in ltarget:
+            litR,litT,litD = self.L.intercy(target,typ='target')
+            if diffraction:
+                llit.append(litT + litR + litD)
             else:
-                tahe = [np.array([self.L.Gs.pos[s[0]],self.L.Gs.pos[s[0]]])]
+                llit.append(litT + litR)
+        lid = self._csrid(lis+sum(llit,[]))
+        largs = lid[:len(lis)]
+        blit = np.zeros((len(self.L.Gicsr['typ']),len(ltarget)),dtype=bool)
+        o = len(lis)
+        for it,lit in enumerate(llit):
+            blit[lid[o:o+len(lit)],it] = True
+            o = o + len(lit)
+
+        ctx = (blit,kwargs['nD'],kwargs['nR'],kwargs['nT'],kwargs['bt'],
+               diffraction,ltarget)
+        lres = self._explore(largs,True,ctx,
+                             parallel = kwargs['parallel'],
+                             nproc = kwargs['nproc'],
+                             progress = kwargs['progress'])
+
+        lSi = [ Signatures(self.L,self.source,target,
+                           cutoff=self.cutoff,
+                           threshold=self.threshold) for target in ltarget ]
+        self._gather(lres,lSi)
+        for Si in lSi:
+            Si.cpt = self.cpt
+
+        return dict(zip(ltarget,lSi))
+
+    def _csrid(self,lint):
+        """ indices of interactions in L.Gicsr
 
-            # R is a list which contains reflexion matrices (Sn) and translation matrices(vn)
-            # for interaction mirroring 
-            # R=[[S0,v0],[S1,v1],...]
+        Parameters
+        ----------
 
-            R = [(np.eye(2),np.array([0,0]))]
-            
-            # initialize visited list sequence with the first intercation s
-
-            visited = [s]
-           
-            # if 
-            #   + s is in target interaction list 
-            # or
-            #   + arrival cycle is equal to target cycle
-            # then stack a new signature in self[len(typ)] 
-            # 
-            # TODO : It concerns self[1] : only one interaction (i.e several single reflection or diffraction)
-            if (s in lit) or (s[-1]==self.target):
-                anstr = np.array(map(lambda x: x[0],visited))
-                typ  = np.array(map(lambda x: len(x),visited))
-                assert(len(typ)==1)
+        lint : list
+            list of interactions of Gi
+
+        Returns
+        -------
+
+        lid : list
+            index in L.Gicsr of each interaction of lint
+
+        Notes
+        -----
+
+        An interaction of Gi which is not in L.Gicsr means that Gicsr is
+        out of date, it is then rebuilt from Gi. An error is raised if the
+        interaction is not in Gi either.
+
+        """
+        lmiss = [ x for x in lint if x not in self.L.Gicsr_id ]
+        if lmiss != []:
+            self.L.buildGicsr()
+            lmiss = [ x for x in lint if x not in self.L.Gicsr_id ]
+            if lmiss != []:
+                raise NameError('Signatures : interactions '+str(lmiss[:5])+
+                                ' are not in Gi, rebuild the layout')
+        dno = self.L.Gicsr_id
+        return [ dno[x] for x in lint ]
+
+    def _explore(self,largs,bcsr,ctx,parallel=False,nproc=0,progress=False,**kwargs):
+        """ explore the trees rooted on each source interaction
+
+        Parameters
+        ----------
+
+        largs : list
+            source interactions, index in L.Gicsr if bcsr else tuple (us,s)
+        bcsr : boolean
+            use Signatures._sigsource_csr instead of Signatures._sigsource
+        ctx : tuple
+            arguments shared by all the roots
+        parallel : boolean
+            dispatch the roots over a pool of processes
+        nproc : int
+            number of processes (0 : all cores)
+        progress : boolean
+            display a progress bar (serial mode)
+        kwargs :
+            passed to Signatures._sigsource (animation)
+
+        Returns
+        -------
+
+        lres : list
+            list of (lsig,nexp) in the order of largs
+
+        Notes
+        -----
+
+        Each interaction seen from the source is the root of an independent
+        tree exploration. In parallel mode the roots are dispatched over
+        forked worker processes which inherit the layout and its graphs
+        read-only (copy on write), only the found signatures are sent back.
+
+        """
+        if parallel and (len(largs)>1):
+            if nproc == 0:
+                nproc = mp.cpu_count()
+            global _Si_run
+            _Si_run = (self,bcsr)+tuple(ctx)
+            pool = mp.Pool(min(nproc,len(largs)))
+            try:
+                lres = pool.map(_sigsource_func,largs,chunksize=1)
+            finally:
+                pool.close()
+                pool.join()
+                _Si_run = None
+        else:
+            if progress :
+                pbar = tqdm(total=100,desc='Signatures')
+            lres = []
+            for a in largs:
+                if progress:
+                    pbar.update(100./(1.*len(largs)))
+                if bcsr:
+                    lres.append(self._sigsource_csr(a,*ctx))
+                else:
+                    lres.append(self._sigsource(a[0],a[1],*ctx,**kwargs))
+        return lres
+
+    def _gather(self,lres,lSi):
+        """ gather the signatures found from each source interaction
+
+        Parameters
+        ----------
+
+        lres : list
+            list of (lsig,nexp) in the order of the source interactions
+        lSi : list
+            list of Signatures, lSi[itarget] receives the signatures of
+            target itarget
+
+        Notes
+        -----
+
+        Same ordering and same unicity criterion as the serial search
+
+        """
+        lhash = set([])
+        for lsig,nexp in lres:
+            self.cpt += nexp
+            for it,sig,ratio in lsig:
+                Si = lSi[it]
+                k = sig.shape[1]
+                if k > 1:
+                    sighash = (it,hash(str(sig)))
+                    if sighash in lhash:
+                        continue
+                    lhash.add(sighash)
                 try:
-                    self[len(typ)] = np.vstack((self[len(typ)],anstr,typ))
-                    self.ratio[len(typ)] = np.append(self.ratio[len(typ)],1.)
+                    Si[k] = np.vstack((Si[k],sig))
+                    Si.ratio[k] = np.append(Si.ratio[k],ratio)
                 except:
-                    self[len(typ)] = np.vstack((anstr,typ))
-                    self.ratio[len(typ)] = np.array([1.])
-                # update signature counter
-                cptsig +=1
-            # stack is a list of iterators
-            #
-            #
-            stack = [iter(Gi[s])]
-            # air walls do not intervene in the number of transmission (cutoff criteria) 
-            # lawp is the list of airwall position in visited sequence
-            # handle the case of the first segment which can be an airwall
-            # 
-            if len(s)==3:
-                nseg = s[0]
-                if ((self.L.Gs.node[nseg]['name']=='_AIR') or 
-                   (self.L.Gs.node[nseg]['name']=='AIR')):
-                    lawp = [1]
-                else:
-                    lawp = [0]
+                    Si[k] = np.vstack((sig))
+                    Si.ratio[k] = np.array([ratio])
+
+    def _sigsource(self,us,s,Gi,lit,lair,nD,nR,nT,bt,animation=False,fig=[],ax=[]):
+        """ explore the tree of interactions rooted on one source interaction
+
+        Parameters
+        ----------
+
+        us : int
+            index of the source interaction (used for animation file names)
+        s : tuple
+            source interaction
+        Gi : nx.DiGraph
+            graph of interactions
+        lit : list
+            list of interactions seen from the target cycle
+        lair : list
+            list of airwall segments
+        nD : int
+            maximum number of diffractions
+        nR : int
+            maximum number of reflections
+        nT : int
+            maximum number of transmissions
+        bt : boolean
+            allow to visit already visited nodes
+
+        Returns
+        -------
+
+        lsig : list
+            list of tuple (0,sig,ratio) in order of discovery
+        nexp : int
+            number of explored interactions
+
+        See Also
+        --------
+
+        pylayers.antprop.signature.Signatures.run
+
+        """
+        lsig = []
+        lhash = []
+        nexp = 0
+        bvisu = False
+        #
+        # s[0] : point (<0) or segment (>0)
+        # pts : list of neighbour nodes from s[0]
+        # tahe : segment extremities or point coordinates (repeated twice)
+        #
+        if s[0]>0:
+            pts = self.L.Gs[s[0]].keys()
+            tahe = [np.array([self.L.Gs.pos[pts[0]],self.L.Gs.pos[pts[1]]])]
+        else:
+            tahe = [np.array([self.L.Gs.pos[s[0]],self.L.Gs.pos[s[0]]])]
+
+        # R is a list which contains reflexion matrices (Sn) and translation matrices(vn)
+        # for interaction mirroring 
+        # R=[[S0,v0],[S1,v1],...]
+
+        R = [(np.eye(2),np.array([0,0]))]
+        
+        # initialize visited list sequence with the first intercation s
+
+        visited = [s]
+       
+        # if 
+        #   + s is in target interaction list 
+        # or
+        #   + arrival cycle is equal to target cycle
+        # then stack a new signature in self[len(typ)] 
+        # 
+        # TODO : It concerns self[1] : only one interaction (i.e several single reflection or diffraction)
+        if (s in lit) or (s[-1]==self.target):
+            anstr = np.array(map(lambda x: x[0],visited))
+            typ  = np.array(map(lambda x: len(x),visited))
+            assert(len(typ)==1)
+            lsig.append((0,np.vstack((anstr,typ)),1.))
+        # stack is a list of iterators
+        #
+        #
+        stack = [iter(Gi[s])]
+        # air walls do not intervene in the number of transmission (cutoff criteria) 
+        # lawp is the list of airwall position in visited sequence
+        # handle the case of the first segment which can be an airwall
+        # 
+        if len(s)==3:
+            nseg = s[0]
+            if ((self.L.Gs.node[nseg]['name']=='_AIR') or 
+               (self.L.Gs.node[nseg]['name']=='AIR')):
+                lawp = [1]
             else:
                 lawp = [0]
-            # while the stack of iterators is not void
-            cpt = 0
-            while stack: #
-                # iter_on_interactions is the last iterator in the stack
-                iter_on_interactions = stack[-1]
-                # next interaction child
-                interaction = next(iter_on_interactions, None)
-                #print visited
-                #if ((visited ==[(6236,74,91),(-213,)]) and (interaction==(-1002,))):
-                #    print interaction 
-                #    pdb.set_trace()
-                #if (visited ==[(6236,74,91),(-213,),(6248,99,111)]):
-                #if (visited ==[(6236,74,91),(-213,),(6248,99,111),(6287,111,118)]):
-                    #pdb.set_trace()
-                #    import ipdb
-                # cond1 : there is no more interactions
-                # continue if True
-                cond1 = not(interaction is None)
-                # cond2 : enable reverberation
-                #     interaction has not been visited yet 
-                #     or 
-                #     bt : True (allow reentrance) (unconditionnaly)  
-                # continue if True
-                #cond2 = (interaction in visited) and bt (old) 
-                cond2 = not (interaction in visited) or bt
-                # cond3 : test the cutoff condition not get to the limit
-                # continue if True
-                cond3 = not(len(visited) > (self.cutoff + sum(lawp)))
-                uD = [ k for k in range(len(visited)) if len(visited[k])==1 ]
-                uR = [ k for k in range(len(visited)) if len(visited[k])==2 ]
-                uT = [ k for k in range(len(visited)) if len(visited[k])==3 ]
-                if cond1:
-                    condD = True
-                    condR = True 
-                    condT = True 
-                    if ((len(interaction)==1) and (len(uD)==nD)):
-                        condD = False 
-                    if ((len(interaction)==2) and (len(uR)==nR)):
-                        condR = False 
-                    if ((len(interaction)==3) and (len(uT)==nT)):
-                        condT = False 
+        else:
+            lawp = [0]
+        # while the stack of iterators is not void
+        cpt = 0
+        while stack: #
+            # iter_on_interactions is the last iterator in the stack
+            iter_on_interactions = stack[-1]
+            # next interaction child
+            interaction = next(iter_on_interactions, None)
+            #print visited
+            #if ((visited ==[(6236,74,91),(-213,)]) and (interaction==(-1002,))):
+            #    print interaction 
+            #    pdb.set_trace()
+            #if (visited ==[(6236,74,91),(-213,),(6248,99,111)]):
+            #if (visited ==[(6236,74,91),(-213,),(6248,99,111),(6287,111,118)]):
+                #pdb.set_trace()
+            #    import ipdb
+            # cond1 : there is no more interactions
+            # continue if True
+            cond1 = not(interaction is None)
+            # cond2 : enable reverberation
+            #     interaction has not been visited yet 
+            #     or 
+            #     bt : True (allow reentrance) (unconditionnaly)  
+            # continue if True
+            #cond2 = (interaction in visited) and bt (old) 
+            cond2 = not (interaction in visited) or bt
+            # cond3 : test the cutoff condition not get to the limit
+            # continue if True
+            cond3 = not(len(visited) > (self.cutoff + sum(lawp)))
+            uD = [ k for k in range(len(visited)) if len(visited[k])==1 ]
+            uR = [ k for k in range(len(visited)) if len(visited[k])==2 ]
+            uT = [ k for k in range(len(visited)) if len(visited[k])==3 ]
+            if cond1:
+                condD = True
+                condR = True 
+                condT = True 
+                if ((len(interaction)==1) and (len(uD)==nD)):
+                    condD = False 
+                if ((len(interaction)==2) and (len(uR)==nR)):
+                    condR = False 
+                if ((len(interaction)==3) and (len(uT)==nT)):
+                    condT = False 
 
-                #
-                #  animation 
-                #
-                if animation :
-                    cpt = cpt+1
-                    edge=zip(visited[:-1],visited[1:])
-                    N = nx.draw_networkx_nodes(Gi,pos=Gi.pos,
-                            nodelist=visited,labels={},
-                            node_size=15,ax=ax,fig=fig)
-                    E = nx.draw_networkx_edges(Gi,pos=Gi.pos,
-                            edgelist=edge,labels={},width=0.1,
-                            arrows=False,ax=ax,fig=fig)
-
-                    plt.savefig('./figure/' +str(us) +'_' + str(cpt) +'.png')
-                    try:
-                        ax.collections.remove(N)
-                    except:
-                        pass
-                    try:
-                        ax.collections.remove(E)
-                    except:
+            #
+            #  animation 
+            #
+            if animation :
+                cpt = cpt+1
+                edge=zip(visited[:-1],visited[1:])
+                N = nx.draw_networkx_nodes(Gi,pos=Gi.pos,
+                        nodelist=visited,labels={},
+                        node_size=15,ax=ax,fig=fig)
+                E = nx.draw_networkx_edges(Gi,pos=Gi.pos,
+                        edgelist=edge,labels={},width=0.1,
+                        arrows=False,ax=ax,fig=fig)
+
+                plt.savefig('./figure/' +str(us) +'_' + str(cpt) +'.png')
+                try:
+                    ax.collections.remove(N)
+                except:
+                    pass
+                try:
+                    ax.collections.remove(E)
+                except:
+                    pass
+
+            if (cond1 and cond2 and cond3):
+                if (condD and condR and condT):
+                    visited.append(interaction)
+                    nexp+=1
+                    #print(visited)
+                    # [(44,2,7),(62,7,15),(21,15),(62,15,7),(44,7,2),(16,2)]
+                    # if visited ==[(6236,74,91),(141,91)]:
+                    #     import ipdb
+                    #     ipdb.set_trace()
+
+
+                    # update list of airwalls
+                    if interaction[0] in lair:
+                        lawp.append(1)
+                    else:
+                        lawp.append(0)
+
+                    # update number of useful segments
+                    # if there is airwall in visited
+                    nstr = interaction[0]
+                    #
+                    #
+                    #
+                    # Testing the type of interaction at rank -2 
+                    # R is a list which contains a rotation matrix 
+                    # and a translation vector for doing the mirroring 
+                    # operation
+
+                    # diffraction (retrieve a point)
+                    if len(visited[-2]) == 1:
+                        #th = self.L.Gs.pos[nstr]
+                        R.append((np.eye(2),np.array([0,0])))
+                    elif len(visited[-2])==2:
+                        # 
+                        # Avant dernier poitnt est une reflection 
+                        #
+                        nseg_points = self.L.Gs[visited[-2][0]].keys()
+                        ta_seg = np.array(self.L.Gs.pos[nseg_points[0]])
+                        he_seg = np.array(self.L.Gs.pos[nseg_points[1]])
+                        #
+                        # get reflection matrix from segment visited[-2]  
+                        #
+                        R.append(geu.axmat(ta_seg,he_seg))
+                        # direct order
+                        #R.append(geu.axmat(tahe[-1][0],tahe[-1][1]))
+                    # transmission do nothing 
+                    else : 
                         pass
+                    # current interaction is of segment type
+                    if (nstr>0):
+                        nseg_points = self.L.Gs[nstr].keys()
+                        th = np.array([self.L.Gs.pos[nseg_points[0]],
+                                       self.L.Gs.pos[nseg_points[1]]])
+                    else:
+                        th = self.L.Gs.pos[nstr]
+                        th = np.array([th,th])
 
-                if (cond1 and cond2 and cond3):
-                    if (condD and condR and condT):
-                        visited.append(interaction)
-                        self.cpt+=1
-                        #print(visited)
-                        # [(44,2,7),(62,7,15),(21,15),(62,15,7),(44,7,2),(16,2)]
-                        # if visited ==[(6236,74,91),(141,91)]:
-                        #     import ipdb
-                        #     ipdb.set_trace()
+                    # current interaction is of point type (diffraction)
+                    # apply current chain of symmetries
+                    #
+                    # th   is the current segment tail-head coordinates
+                    # tahe is a list of well mirrored tail-head coordinates
+                    
+                        #tahe.append(a)
+                    #if ((visited[0]==(104,23,17)) and (visited[1]==(1,17))):
+                    #    print("th (avant mirror)",th)
+                    ik = 1
+                    r = R[-ik]
+                    #
+                    # mirroring th until the previous point  
+                    # 
+                    th_mirror = copy.copy(th)
+                    while np.any(r[0]!=np.eye(2)):     
+                        th_mirror = np.einsum('ki,ij->kj',th_mirror,r[0])+r[1]
+                        ik = ik + 1
+                        r  = R[-ik]
+
+                    # if at least 2 interactions
+                    # or previous point is a diffraction 
+
+                    if (len(tahe)<2) or (len(visited[-2])==1) or (len(visited[-1])==1):
+                        ratio = 1.0 
+                    else:
+                        # Determine the origin of the cone 
+                        # either the transmitter (ilast =0) 
+                        # or the last diffraction point (ilast=udiff[-1] ) 
+                        udiff = [ k for k in range(len(visited)) if len(visited[k])==1 ]
+                        if udiff==[]:
+                            ilast = 0
+                        else:
+                            ilast=udiff[-1]
 
+                        pta0 = tahe[ilast][0]   # tail first segment  (last difraction)
+                        phe0 = tahe[ilast][1]   # head first segment
 
-                        # update list of airwalls
-                        if interaction[0] in lair:
-                            lawp.append(1)
-                        else:
-                            lawp.append(0)
+                        pta_ = tahe[-1][0]  # tail last segment
+                        phe_ = tahe[-1][1]  # head last segment 
 
-                        # update number of useful segments
-                        # if there is airwall in visited
-                        nstr = interaction[0]
                         #
+                        # Calculates the left and right vector of the cone 
                         #
+                        #  vl left vector 
+                        #  vr right vector 
                         #
-                        # Testing the type of interaction at rank -2 
-                        # R is a list which contains a rotation matrix 
-                        # and a translation vector for doing the mirroring 
-                        # operation
-
-                        # diffraction (retrieve a point)
-                        if len(visited[-2]) == 1:
-                            #th = self.L.Gs.pos[nstr]
-                            R.append((np.eye(2),np.array([0,0])))
-                        elif len(visited[-2])==2:
-                            # 
-                            # Avant dernier poitnt est une reflection 
-                            #
-                            nseg_points = self.L.Gs[visited[-2][0]].keys()
-                            ta_seg = np.array(self.L.Gs.pos[nseg_points[0]])
-                            he_seg = np.array(self.L.Gs.pos[nseg_points[1]])
-                            #
-                            # get reflection matrix from segment visited[-2]  
-                            #
-                            R.append(geu.axmat(ta_seg,he_seg))
-                            # direct order
-                            #R.append(geu.axmat(tahe[-1][0],tahe[-1][1]))
-                        # transmission do nothing 
-                        else : 
-                            pass
-                        # current interaction is of segment type
-                        if (nstr>0):
-                            nseg_points = self.L.Gs[nstr].keys()
-                            th = np.array([self.L.Gs.pos[nseg_points[0]],
-                                           self.L.Gs.pos[nseg_points[1]]])
-                        else:
-                            th = self.L.Gs.pos[nstr]
-                            th = np.array([th,th])
-
-                        # current interaction is of point type (diffraction)
-                        # apply current chain of symmetries
                         #
-                        # th   is the current segment tail-head coordinates
-                        # tahe is a list of well mirrored tail-head coordinates
-                        
-                            #tahe.append(a)
-                        #if ((visited[0]==(104,23,17)) and (visited[1]==(1,17))):
-                        #    print("th (avant mirror)",th)
-                        ik = 1
-                        r = R[-ik]
+                        # Detect situations of connected segments
                         #
-                        # mirroring th until the previous point  
-                        # 
-                        th_mirror = copy.copy(th)
-                        while np.any(r[0]!=np.eye(2)):     
-                            th_mirror = np.einsum('ki,ij->kj',th_mirror,r[0])+r[1]
-                            ik = ik + 1
-                            r  = R[-ik]
+                        # [(60, 2, 8), (61, 8, 11), (15, 11), (61, 11, 8), (60 ,8, 2), (44, 2, 7)]
+                        # if visited == [(60, 2, 8), (61, 8, 11), (15, 11), (61, 11, 8), (60 ,8, 2), (44, 2, 7)]:
+                        #     print '\n',visited
+                        #     import ipdb
+                        #     ipdb.set_trace()
 
-                        # if at least 2 interactions
-                        # or previous point is a diffraction 
+                        connected = False
+                        if (pta0==pta_).all():
+                            apex = pta0
+                            connected = True
+                            v0=phe0-apex
+                            v_=phe_-apex
+                        elif (pta0==phe_).all():
+                            apex = pta0
+                            connected = True
+                            v0=phe0-apex
+                            v_=pta_-apex
+                        elif (phe0==pta_).all():
+                            apex = phe0
+                            connected = True
+                            v0=pta0-apex
+                            v_=phe_-apex
+                        elif (phe0==phe_).all():
+                            apex = phe0    
+                            connected = True
+                            v0=pta0-apex
+                            v_=pta_-apex
+
+                        if not connected:
+                            if not (geu.ccw(pta0,phe0,phe_) ^
+                                    geu.ccw(phe0,phe_,pta_) ):
+                                vr = (pta0,phe_)
+                                vl = (phe0,pta_)
+                            else:  # twisted case
+                                vr = (pta0,pta_)
+                                vl = (phe0,phe_)
+
+                            # cone dot product 
+                            # print vr
+                            # print vl
+                            vr_n = (vr[1]-vr[0])/np.linalg.norm(vr[1]-vr[0])
+                            vl_n = (vl[1]-vl[0])/np.linalg.norm(vl[1]-vl[0])
+                            
+                        
+                            vrdotvl = np.dot(vr_n,vl_n)
+                            # cone angle 
+                            angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.0))
+                            #angle_cone = np.arccos(vrdotvl)
+                            # prepare lines and seg argument for intersection checking
+                            if angle_cone!=0:
+                                linel = (vl[0],vl[1]-vl[0])
+                                liner = (vr[0],vr[1]-vr[0])
+                                # from origin mirrored segment to be tested 
+                                seg   = (th_mirror[0],th_mirror[1])
+
+                                # apex calculation 
+                                a0u = np.dot(pta0,vr_n)
+                                a0v = np.dot(pta0,vl_n)
+                                b0u = np.dot(phe0,vr_n)
+                                b0v = np.dot(phe0,vl_n)
+                                #import warnings
+                                #warnings.filterwarnings("error")
+                                kb  = ((b0v-a0v)-vrdotvl*(b0u-a0u))/(vrdotvl*vrdotvl-1)
+                                apex = phe0 + kb*vl_n
+
+                            #if ((visited[0]==(104,23,17)) and (visited[1]==(1,17))):
+                            #    print(visited)
+                            #    print("th",th)
+                            #    print("tahe",tahe)
+                            #    print("ta_,he_",pta_,phe_)
+                            #    print("vr,vl",vr_n,vl_n)
+                            #    print('angle cone',angle_cone)
+                            #    print(apex)
 
-                        if (len(tahe)<2) or (len(visited[-2])==1) or (len(visited[-1])==1):
-                            ratio = 1.0 
                         else:
-                            # Determine the origin of the cone 
-                            # either the transmitter (ilast =0) 
-                            # or the last diffraction point (ilast=udiff[-1] ) 
-                            udiff = [ k for k in range(len(visited)) if len(visited[k])==1 ]
-                            if udiff==[]:
-                                ilast = 0
-                            else:
-                                ilast=udiff[-1]
-
-                            pta0 = tahe[ilast][0]   # tail first segment  (last difraction)
-                            phe0 = tahe[ilast][1]   # head first segment
 
-                            pta_ = tahe[-1][0]  # tail last segment
-                            phe_ = tahe[-1][1]  # head last segment 
-
-                            #
-                            # Calculates the left and right vector of the cone 
-                            #
-                            #  vl left vector 
-                            #  vr right vector 
-                            #
-                            #
-                            # Detect situations of connected segments
-                            #
-                            # [(60, 2, 8), (61, 8, 11), (15, 11), (61, 11, 8), (60 ,8, 2), (44, 2, 7)]
-                            # if visited == [(60, 2, 8), (61, 8, 11), (15, 11), (61, 11, 8), (60 ,8, 2), (44, 2, 7)]:
-                            #     print '\n',visited
-                            #     import ipdb
-                            #     ipdb.set_trace()
-
-                            connected = False
-                            if (pta0==pta_).all():
-                                apex = pta0
-                                connected = True
-                                v0=phe0-apex
-                                v_=phe_-apex
-                            elif (pta0==phe_).all():
-                                apex = pta0
-                                connected = True
-                                v0=phe0-apex
-                                v_=pta_-apex
-                            elif (phe0==pta_).all():
-                                apex = phe0
-                                connected = True
-                                v0=pta0-apex
-                                v_=phe_-apex
-                            elif (phe0==phe_).all():
-                                apex = phe0    
-                                connected = True
-                                v0=pta0-apex
-                                v_=pta_-apex
-
-                            if not connected:
-                                if not (geu.ccw(pta0,phe0,phe_) ^
-                                        geu.ccw(phe0,phe_,pta_) ):
-                                    vr = (pta0,phe_)
-                                    vl = (phe0,pta_)
-                                else:  # twisted case
-                                    vr = (pta0,pta_)
-                                    vl = (phe0,phe_)
-
-                                # cone dot product 
-                                # print vr
-                                # print vl
-                                vr_n = (vr[1]-vr[0])/np.linalg.norm(vr[1]-vr[0])
-                                vl_n = (vl[1]-vl[0])/np.linalg.norm(vl[1]-vl[0])
-                                
-                            
-                                vrdotvl = np.dot(vr_n,vl_n)
-                                # cone angle 
-                                angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.0))
-                                #angle_cone = np.arccos(vrdotvl)
-                                # prepare lines and seg argument for intersection checking
-                                if angle_cone!=0:
-                                    linel = (vl[0],vl[1]-vl[0])
-                                    liner = (vr[0],vr[1]-vr[0])
-                                    # from origin mirrored segment to be tested 
-                                    seg   = (th_mirror[0],th_mirror[1])
-
-                                    # apex calculation 
-                                    a0u = np.dot(pta0,vr_n)
-                                    a0v = np.dot(pta0,vl_n)
-                                    b0u = np.dot(phe0,vr_n)
-                                    b0v = np.dot(phe0,vl_n)
-                                    #import warnings
-                                    #warnings.filterwarnings("error")
-                                    try:
-                                        kb  = ((b0v-a0v)-vrdotvl*(b0u-a0u))/(vrdotvl*vrdotvl-1)
-                                    except:
-                                        pdb.set_trace()
-                                    apex = phe0 + kb*vl_n
-
-                                #if ((visited[0]==(104,23,17)) and (visited[1]==(1,17))):
-                                #    print(visited)
-                                #    print("th",th)
-                                #    print("tahe",tahe)
-                                #    print("ta_,he_",pta_,phe_)
-                                #    print("vr,vl",vr_n,vl_n)
-                                #    print('angle cone',angle_cone)
-                                #    print(apex)
+                            v0n  = v0/np.linalg.norm(v0)
+                            v_n  = v_/np.linalg.norm(v_)
 
+                            # import ipdb
+                            # ipdb.set_trace()
+                            sign = np.sign(np.cross(v_n,v0n))
+                            if sign>0:    
+                                vr_n = -v0n
+                                vl_n = v_n
                             else:
+                                vr_n = v_n
+                                vl_n = -v0n
+                            # vr_n = (vr[1]-vr[0])/np.sqrt(np.sum((vr[1]-vr[0])*(vr[1]-vr[0]),axis=0))
+                            # vl_n = (vl[1]-vl[0])/np.sqrt(np.sum((vl[1]-vl[0])*(vl[1]-vl[0]),axis=0))
+                            vrdotvl = np.dot(vr_n,vl_n)
+                            # cone angle 
+                            angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.))
+                            
 
-                                v0n  = v0/np.linalg.norm(v0)
-                                v_n  = v_/np.linalg.norm(v_)
-
-                                # import ipdb
-                                # ipdb.set_trace()
-                                sign = np.sign(np.cross(v_n,v0n))
-                                if sign>0:    
-                                    vr_n = -v0n
-                                    vl_n = v_n
-                                else:
-                                    vr_n = v_n
-                                    vl_n = -v0n
-                                # vr_n = (vr[1]-vr[0])/np.sqrt(np.sum((vr[1]-vr[0])*(vr[1]-vr[0]),axis=0))
-                                # vl_n = (vl[1]-vl[0])/np.sqrt(np.sum((vl[1]-vl[0])*(vl[1]-vl[0]),axis=0))
-                                vrdotvl = np.dot(vr_n,vl_n)
-                                # cone angle 
-                                angle_cone = np.arccos(np.maximum(np.minimum(vrdotvl,1.0),-1.))
-                                
-
-                            al = np.arctan2(vl_n[1],vl_n[0])
-                            ar = np.arctan2(vr_n[1],vr_n[0])
-
-                            #
-                            # On connecte l'apex du cone courant aux extrémités du segment courant mirroré
-                            #
-                            # Dans certaines circonstances par example un cone emanant d'un point colinéaire 
-                            # avec le segment d'arrivé" (-4) (6,4) le point -4 est aligné avec le segment 6
-                            # l'ouverture du cone est nul => arret. Cela pourrait être géré dans Gi en interdisant 
-                            # la visibilité (-4) (6,4) 
-                            # 
-                            if angle_cone ==0:
-                                ratio = 0
-                            else:    
-                                if np.allclose(th_mirror[0],apex) or np.allclose(th_mirror[1],apex):
-                                    ratio = 1.
-                                else:
-                                    wseg0 = th_mirror[0] - apex
-                                    wseg1 = th_mirror[1] - apex
-                                    mod_wseg0 = np.sqrt(np.sum(wseg0*wseg0,axis=0))
-                                    mod_wseg1 = np.sqrt(np.sum(wseg1*wseg1,axis=0))
-
-                                    if np.isclose(mod_wseg0,0):
-                                        #bvisu = True 
-                                        #pdb.set_trace()#
-                                        pass
-                                    if np.isclose(mod_wseg1,0):
-                                        #bvisu = True 
-                                        #pdb.set_trace()#
-                                        pass
-                                    #wseg0_n = wseg0/mod_wseg0
-                                    #wseg1_n = wseg1/mod_wseg1
-                                    wseg0_n = wseg0/np.linalg.norm(wseg0)
-                                    wseg1_n = wseg1/np.linalg.norm(wseg1)
-                                    aseg0 = np.arctan2(wseg0_n[1],wseg0_n[0])
-                                    aseg1 = np.arctan2(wseg1_n[1],wseg1_n[0])
-                                    
-                                    # if al==aseg0 or al==aseg1 or ar==aseg0 or ar==aseg1:
-                                    #     ratio = 1
-                                        #print "toto"
-                                    # else:
-                                    I = geu.angle_intersection2(al,ar,aseg0,aseg1)
-                                    ratio = I/angle_cone
-                                    #if ratio>=1:
-                                    #    pdb.set_trace()
-
-                                # if connected:
-                                #     print "ratio :",ratio
-                                
+                        al = np.arctan2(vl_n[1],vl_n[0])
+                        ar = np.arctan2(vr_n[1],vr_n[0])
 
-                            #if visited == [(104, 23, 17), (1, 17), (53, 17)]:
-                            if (bvisu):
-                                fig ,ax = self.L.showG('s',aw=1,labels=0)
-                                #
-                                # magenta : start of the cone
-                                # cyan    :
-                                # yellow  : last interaction
-                                #
-                                ax = geu.linet(ax,pta0,phe0,al=1,color='magenta',linewidth=3)
-                                ax = geu.linet(ax,pta_,phe_,al=1,color='cyan',linewidth=3)
-                                ax = geu.linet(ax,np.array(self.L.Gs.pos[nseg_points[0]]),np.array(self.L.Gs.pos[nseg_points[1]]),al=1,color='yellow',linewidth=4)
-                                # ax = geu.linet(ax,vr[0],vr[1],al=1,color='red',linewidth=3)
-                                # ax = geu.linet(ax,vl[0],vl[1],al=1,color='blue',linewidth=3)
-                                ax = geu.linet(ax,seg[0],seg[1],al=1,color='k',linewidth=3)
-                                ax = geu.linet(ax,th_mirror[0,:],th_mirror[1,:],al=1,color='green',linewidth=3)
-                                nx.draw_networkx_labels(self.L.Gi,
-                                        self.L.Gi.pos,labels={x:str(x) for x in visited},
-                                        ax=ax,fontsize=18)
-                                plt.title(str(visited)+'  '+str(ratio))
-                                ax.plot(apex[0],apex[1],'or')
-                                plt.axis('auto')
-                                pdb.set_trace()
-                            #if visited == [(104, 23, 17), (1, 17), (53, 17), (108, 17, 18)]:
-                            # if visited == [(104, 23, 17), (1, 17), (53, 17)]:
-                            if (1==0):
-                                fig ,ax = self.L.showG('s',aw=1,labels=0)
-                                ax = geu.linet(ax,pta0,phe0,al=1,color='magenta',linewidth=3)
-                                ax = geu.linet(ax,pta_,phe_,al=1,color='cyan',linewidth=3)
-
-                                ax = geu.linet(ax,np.array(self.L.Gs.pos[pts[0]]),np.array(self.L.Gs.pos[pts[1]]),al=1,color='yellow',linewidth=4)
-                                ax = geu.linet(ax,vr[0],vr[1],al=1,color='red',linewidth=3)
-                                ax = geu.linet(ax,vl[0],vl[1],al=1,color='blue',linewidth=3)
-                                #ax = geu.linet(ax,seg[0],seg[1],al=1,color='k',linewidth=3)
-                                ax = geu.linet(ax,th[0,:],th[1,:],al=1,color='green',linewidth=3)
-                                plt.title(str(visited)+'  '+str(ratio))
-                                ax.plot(apex[0],apex[1],'or')
-                                plt.axis('auto')
-                                plt.show()
-                    #else:
-                    #    th = self.L.Gs.pos[nstr]
-                    #    th = np.array([th,th])
-                    #    ratio = 1
-                        if ratio > self.threshold:
-                            #
-                            # Update sequence of mirrored points
-                            if nstr<0:
-                                tahe.append(th)
+                        #
+                        # On connecte l'apex du cone courant aux extrémités du segment courant mirroré
+                        #
+                        # Dans certaines circonstances par example un cone emanant d'un point colinéaire 
+                        # avec le segment d'arrivé" (-4) (6,4) le point -4 est aligné avec le segment 6
+                        # l'ouverture du cone est nul => arret. Cela pourrait être géré dans Gi en interdisant 
+                        # la visibilité (-4) (6,4) 
+                        # 
+                        if angle_cone ==0:
+                            ratio = 0
+                        else:    
+                            if np.allclose(th_mirror[0],apex) or np.allclose(th_mirror[1],apex):
+                                ratio = 1.
                             else:
-                                tahe.append(th_mirror)
-                            
-                            # 
-                            # Check if the target has been reached
-                            # sequence is valid and last interaction is in the list of targets   
-                            #if (interaction in lit) or (interaction[-1]==self.target):
-                            if (interaction in lit):
-                                # idea here is to produce signature without any airwalls
-                                # lawp_tmp is a mask where 0 mean no air wall and 1 = airwall
-                                # anstr does not contains airwalls
-                                # lawp_tmp = [0]+lawp
-                                # lll = [x[0] for ix,x in enumerate(visited) if lawp_tmp[ix]==1]
-                                # print([self.L.Gs.node[x]['name'] for x in lll])
-                            
-                                #anstr = np.array([x[0] for ix,x in enumerate(visited) 
-                                #                                  if ((lawp[ix]!=1) or (x[0] in self.L.name['AIR']) or (x in (lit+lis)))] )
-                                #typ  = np.array([len(x) for ix,x in enumerate(visited) 
-                                #                                  if ((lawp[ix]!=1) or (x[0] in self.L.name['AIR']) or (x in (lit+lis)))] )
-                                #sig = np.array([anstr,typ])
-                                #sighash = hash(str(sig))
+                                wseg0 = th_mirror[0] - apex
+                                wseg1 = th_mirror[1] - apex
+                                mod_wseg0 = np.sqrt(np.sum(wseg0*wseg0,axis=0))
+                                mod_wseg1 = np.sqrt(np.sum(wseg1*wseg1,axis=0))
+
+                                if np.isclose(mod_wseg0,0):
+                                    #bvisu = True 
+                                    #pdb.set_trace()#
+                                    pass
+                                if np.isclose(mod_wseg1,0):
+                                    #bvisu = True 
+                                    #pdb.set_trace()#
+                                    pass
+                                #wseg0_n = wseg0/mod_wseg0
+                                #wseg1_n = wseg1/mod_wseg1
+                                wseg0_n = wseg0/np.linalg.norm(wseg0)
+                                wseg1_n = wseg1/np.linalg.norm(wseg1)
+                                aseg0 = np.arctan2(wseg0_n[1],wseg0_n[0])
+                                aseg1 = np.arctan2(wseg1_n[1],wseg1_n[0])
                                 
+                                # if al==aseg0 or al==aseg1 or ar==aseg0 or ar==aseg1:
+                                #     ratio = 1
+                                    #print "toto"
+                                # else:
+                                I = geu.angle_intersection2(al,ar,aseg0,aseg1)
+                                ratio = I/angle_cone
+                                #if ratio>=1:
+                                #    pdb.set_trace()
+
+                            # if connected:
+                            #     print "ratio :",ratio
+                            
 
-                                # if len(anstr) == 2:
-                                #     if (anstr == np.array([323,351])).all():
-                                #         import ipdb
-                                #         ipdb.set_trace()
-                                anstr = np.array([x[0] for x in visited ])
-                                typ  = np.array([len(x) for x in visited])
-                                sig = np.array([anstr,typ])
-                                sighash = hash(str(sig))
-                                if sighash not in lhash:
-                                    lhash.append(sighash)
-                                    try:
-                                        self[len(typ)] = np.vstack((self[len(typ)],sig))
-                                        self.ratio[len(typ)] = np.append(self.ratio[len(typ)],ratio)
-                                    except:
-                                        self[len(typ)] = np.vstack((sig))
-                                        self.ratio[len(typ)] = np.array([ratio])
-                                # print ('added',visited)
-                                    cptsig +=1
-
-                                if animation:
-                                    Nf = nx.draw_networkx_nodes(Gi,pos=Gi.pos,
-                                            nodelist=visited,labels={},
-                                            node_color='b',
-                                            node_size=40,
-                                            ax=ax,fig=fig)
-                                    Ef = nx.draw_networkx_edges(Gi,pos=Gi.pos,
-                                            edgelist=edge,labels={},
-                                            width=0.1,arrows=False,
-                                            ax=ax,fig=fig)
-                                    cpt=cpt+1
-                                    plt.savefig('./figure/' +str(us) +'_' + str(cpt) +'.png')
-                                    try:
-                                        ax.collections.remove(Nf)
-                                    except:
-                                        pass
-                                    try:
-                                        ax.collections.remove(Ef)
-                                    except:
-                                        pass
-
-                            outint = Gi[visited[-2]][interaction]['output'].keys()
+                        #if visited == [(104, 23, 17), (1, 17), (53, 17)]:
+                        if (bvisu):
+                            fig ,ax = self.L.showG('s',aw=1,labels=0)
                             #
-                            # proint not used 
+                            # magenta : start of the cone
+                            # cyan    :
+                            # yellow  : last interaction
                             #
-                            proint = Gi[visited[-2]][interaction]['output'].values()
-                            nexti  = [it for it in outint ]
-                            stack.append(iter(nexti))
-                        # 1590 ratio <= threshold
+                            ax = geu.linet(ax,pta0,phe0,al=1,color='magenta',linewidth=3)
+                            ax = geu.linet(ax,pta_,phe_,al=1,color='cyan',linewidth=3)
+                            ax = geu.linet(ax,np.array(self.L.Gs.pos[nseg_points[0]]),np.array(self.L.Gs.pos[nseg_points[1]]),al=1,color='yellow',linewidth=4)
+                            # ax = geu.linet(ax,vr[0],vr[1],al=1,color='red',linewidth=3)
+                            # ax = geu.linet(ax,vl[0],vl[1],al=1,color='blue',linewidth=3)
+                            ax = geu.linet(ax,seg[0],seg[1],al=1,color='k',linewidth=3)
+                            ax = geu.linet(ax,th_mirror[0,:],th_mirror[1,:],al=1,color='green',linewidth=3)
+                            nx.draw_networkx_labels(self.L.Gi,
+                                    self.L.Gi.pos,labels={x:str(x) for x in visited},
+                                    ax=ax,fontsize=18)
+                            plt.title(str(visited)+'  '+str(ratio))
+                            ax.plot(apex[0],apex[1],'or')
+                            plt.axis('auto')
+                            plt.show()
+                        #if visited == [(104, 23, 17), (1, 17), (53, 17), (108, 17, 18)]:
+                        # if visited == [(104, 23, 17), (1, 17), (53, 17)]:
+                        if (1==0):
+                            fig ,ax = self.L.showG('s',aw=1,labels=0)
+                            ax = geu.linet(ax,pta0,phe0,al=1,color='magenta',linewidth=3)
+                            ax = geu.linet(ax,pta_,phe_,al=1,color='cyan',linewidth=3)
+
+                            ax = geu.linet(ax,np.array(self.L.Gs.pos[pts[0]]),np.array(self.L.Gs.pos[pts[1]]),al=1,color='yellow',linewidth=4)
+                            ax = geu.linet(ax,vr[0],vr[1],al=1,color='red',linewidth=3)
+                            ax = geu.linet(ax,vl[0],vl[1],al=1,color='blue',linewidth=3)
+                            #ax = geu.linet(ax,seg[0],seg[1],al=1,color='k',linewidth=3)
+                            ax = geu.linet(ax,th[0,:],th[1,:],al=1,color='green',linewidth=3)
+                            plt.title(str(visited)+'  '+str(ratio))
+                            ax.plot(apex[0],apex[1],'or')
+                            plt.axis('auto')
+                            plt.show()
+                #else:
+                #    th = self.L.Gs.pos[nstr]
+                #    th = np.array([th,th])
+                #    ratio = 1
+                    if ratio > self.threshold:
+                        #
+                        # Update sequence of mirrored points
+                        if nstr<0:
+                            tahe.append(th)
                         else:
-                            if len(visited)>1:
-                                if ((len(visited[-2])==2) or len(visited[-2])==1):
-                                    R.pop()
-                            last = visited.pop()
-                            lawp.pop()
-                    # 1389 condR and condT and condD
+                            tahe.append(th_mirror)
+                        
+                        # 
+                        # Check if the target has been reached
+                        # sequence is valid and last interaction is in the list of targets   
+                        #if (interaction in lit) or (interaction[-1]==self.target):
+                        if (interaction in lit):
+                            # idea here is to produce signature without any airwalls
+                            # lawp_tmp is a mask where 0 mean no air wall and 1 = airwall
+                            # anstr does not contains airwalls
+                            # lawp_tmp = [0]+lawp
+                            # lll = [x[0] for ix,x in enumerate(visited) if lawp_tmp[ix]==1]
+                            # print([self.L.Gs.node[x]['name'] for x in lll])
+                        
+                            #anstr = np.array([x[0] for ix,x in enumerate(visited) 
+                            #                                  if ((lawp[ix]!=1) or (x[0] in self.L.name['AIR']) or (x in (lit+lis)))] )
+                            #typ  = np.array([len(x) for ix,x in enumerate(visited) 
+                            #                                  if ((lawp[ix]!=1) or (x[0] in self.L.name['AIR']) or (x in (lit+lis)))] )
+                            #sig = np.array([anstr,typ])
+                            #sighash = hash(str(sig))
+                            
+
+                            # if len(anstr) == 2:
+                            #     if (anstr == np.array([323,351])).all():
+                            #         import ipdb
+                            #         ipdb.set_trace()
+                            anstr = np.array([x[0] for x in visited ])
+                            typ  = np.array([len(x) for x in visited])
+                            sig = np.array([anstr,typ])
+                            sighash = hash(str(sig))
+                            if sighash not in lhash:
+                                lhash.append(sighash)
+                                lsig.append((0,sig,ratio))
+                            # print ('added',visited)
+
+                            if animation:
+                                Nf = nx.draw_networkx_nodes(Gi,pos=Gi.pos,
+                                        nodelist=visited,labels={},
+                                        node_color='b',
+                                        node_size=40,
+                                        ax=ax,fig=fig)
+                                Ef = nx.draw_networkx_edges(Gi,pos=Gi.pos,
+                                        edgelist=edge,labels={},
+                                        width=0.1,arrows=False,
+                                        ax=ax,fig=fig)
+                                cpt=cpt+1
+                                plt.savefig('./figure/' +str(us) +'_' + str(cpt) +'.png')
+                                try:
+                                    ax.collections.remove(Nf)
+                                except:
+                                    pass
+                                try:
+                                    ax.collections.remove(Ef)
+                                except:
+                                    pass
+
+                        outint = Gi[visited[-2]][interaction]['output'].keys()
+                        #
+                        # proint not used 
+                        #
+                        proint = Gi[visited[-2]][interaction]['output'].values()
+                        nexti  = [it for it in outint ]
+                        stack.append(iter(nexti))
+                    # 1590 ratio <= threshold
                     else:
-                        pass
-                # 1388 cond1 and cond2 and cond3  
-                else:
-                    # if at least 2 interactions 
-                    # and antepenultiem is a reflexion  
-                    if len(visited)>1:
-                        if ((len(visited[-2])==2) or len(visited[-2])==1):
-                            R.pop()
-                    last = visited.pop()
-                    #
-                    # Poping 
-                    #      tahe 
-                    #      lawp
-                    #      stack
-                    tahe.pop()
-                    try:
+                        if len(visited)>1:
+                            if ((len(visited[-2])==2) or len(visited[-2])==1):
+                                R.pop()
+                        last = visited.pop()
                         lawp.pop()
-                    except:
-                        pass
-                    stack.pop()
-                    #stack.pop()
+                # 1389 condR and condT and condD
+                else:
+                    pass
+            # 1388 cond1 and cond2 and cond3  
+            else:
+                # if at least 2 interactions 
+                # and antepenultiem is a reflexion  
+                if len(visited)>1:
+                    if ((len(visited[-2])==2) or len(visited[-2])==1):
+                        R.pop()
+                last = visited.pop()
+                #
+                # Poping 
+                #      tahe 
+                #      lawp
+                #      stack
+                tahe.pop()
+                try:
+                    lawp.pop()
+                except:
+                    pass
+                stack.pop()
+                #stack.pop()
+
+        return lsig,nexp
 
 
             
              
 
+    def _sigsource_csr(self,s,blit,nD,nR,nT,bt,diffraction=True,targets=[]):
+        """ explore the tree rooted on one source interaction using L.Gicsr
+
+        Parameters
+        ----------
+
+        s : int
+            index of the source interaction in L.Gicsr
+        blit : np.array (N x Nt)
+            boolean mask of the interactions seen from each target cycle
+        nD : int
+            maximum number of diffractions
+        nR : int
+            maximum number of reflections
+        nT : int
+            maximum number of transmissions
+        bt : boolean
+            allow to visit already visited nodes
+        diffraction : boolean
+            if False diffraction interactions are skipped
+        targets : list
+            target cycles (Nt), default [self.target]
+
+        Returns
+        -------
+
+        lsig : list
+            list of tuple (itarget,sig,ratio) in order of discovery
+            itarget is the index of the target in targets
+        nexp : int
+            number of explored interactions
+
+        Notes
+        -----
+
+        This is the same exploration as Signatures._sigsource, interactions
+        are integer indices and the successors of an interaction are read
+        from the output edges of the CSR arrays of the layout.
+
+        A single exploration serves all the target cycles, a sequence is
+        stored for each target whose interaction list contains its last
+        interaction.
+
+        See Also
+        --------
+
+        pylayers.gis.layout.Layout.buildGicsr
+        pylayers.antprop.signature.Signatures._sigsource
+
+        """
+        G = self.L.Gicsr
+        inter = G['inter']
+        typ = G['typ']
+        th = G['th']
+        air = G['air']
+        indptr = G['indptr']
+        indices = G['indices']
+        oindptr = G['oindptr']
+        oedge = G['oedge']
+
+        if len(targets)==0:
+            targets = [self.target]
+        bhit = blit.any(axis=1)
+
+        I2 = np.eye(2)
+        lsig = []
+        lhash = set([])
+        nexp = 0
+
+        for it,target in enumerate(targets):
+            if blit[s,it] or (inter[s,typ[s]-1]==target):
+                lsig.append((it,np.array([[inter[s,0]],[typ[s]]]),1.))
+
+        # visited interactions and corresponding mirrored tail head
+        visited = [s]
+        tahe = [th[s]]
+        # (S,v) mirroring chain
+        R = [(I2,np.array([0,0]))]
+        # number of D,R,T in visited
+        cnt = [0,0,0,0]
+        cnt[typ[s]] += 1
+        # airwall flags (only a transmission can start on an airwall)
+        lawp = [int(air[s] and typ[s]==3)]
+        nair = lawp[0]
+        # stack of iterators over edges
+        stack = [iter(range(indptr[s],indptr[s+1]))]
+        while stack:
+            e = next(stack[-1], None)
+            if e is None:
+                cond = False
+            else:
+                i = indices[e]
+                ti = typ[i]
+                if (not diffraction) and (ti==1):
+                    continue
+                cond = ((bt or (i not in visited)) and
+                        (len(visited) <= (self.cutoff + nair)))
+            if cond:
+                if ((ti==1) and (cnt[1]==nD)) or \
+                   ((ti==2) and (cnt[2]==nR)) or \
+                   ((ti==3) and (cnt[3]==nT)):
+                    continue
+                tprev = typ[visited[-1]]
+                visited.append(i)
+                nexp += 1
+                cnt[ti] += 1
+                lawp.append(int(air[i]))
+                nair += lawp[-1]
+                if tprev == 1:
+                    R.append((I2,np.array([0,0])))
+                elif tprev == 2:
+                    R.append(geu.axmat(th[visited[-2]][0],th[visited[-2]][1]))
+
+                # mirroring th until the previous point
+                ik = 1
+                r = R[-ik]
+                th_mirror = th[i]
+                while np.any(r[0]!=I2):
+                    th_mirror = np.einsum('ki,ij->kj',th_mirror,r[0])+r[1]
+                    ik = ik + 1
+                    r = R[-ik]
+
+                if (len(tahe)<2) or (tprev==1) or (ti==1):
+                    ratio = 1.0
+                else:
+                    # origin of the cone : first interaction or last diffraction
+                    ilast = 0
+                    for k in range(len(visited)-1,-1,-1):
+                        if typ[visited[k]]==1:
+                            ilast = k
+                            break
+                    ratio = coneratio(tahe[ilast],tahe[-1],th_mirror)
+
+                if ratio > self.threshold:
+                    if inter[i,0]<0:
+                        tahe.append(th[i])
+                    else:
+                        tahe.append(th_mirror)
+                    if bhit[i]:
+                        anstr = inter[visited,0].astype(int)
+                        atyp = typ[visited].astype(int)
+                        sig = np.array([anstr,atyp])
+                        sighash = hash(str(sig))
+                        for it in np.where(blit[i])[0]:
+                            if (it,sighash) not in lhash:
+                                lhash.add((it,sighash))
+                                lsig.append((it,sig,ratio))
+                    stack.append(iter(oedge[oindptr[e]:oindptr[e+1]]))
+                else:
+                    if tprev in (1,2):
+                        R.pop()
+                    visited.pop()
+                    cnt[ti] -= 1
+                    nair -= lawp.pop()
+            else:
+                if len(visited)>1:
+                    if typ[visited[-2]] in (1,2):
+                        R.pop()
+                i = visited.pop()
+                cnt[typ[i]] -= 1
+                tahe.pop()
+                if len(lawp)>0:
+                    nair -= lawp.pop()
+                stack.pop()
+
+        return lsig,nexp
+
     def plot_cones(self,L,i=0,s=0,fig=[],ax=[],figsize=(10,10)):
         """ display cones of an unfolded signature
 
@@ -3605,6 +4194,235 @@ class Signature(object):
 
 
 
+class SigStore(PyLayers):
+    """ content addressed store of Signatures
+
+    Attributes
+    ----------
+
+    filename : string
+        long filename of the hdf5 store
+
+    Notes
+    -----
+
+    All the signatures are stored in a single hdf5 file (default
+    <PyProject>/output/Signatures.h5). Each entry is a group named by
+    its key, the md5 of
+
+        + the content hash of the layout (Layout.geomhash)
+        + the source and target cycles
+        + the parameters of Signatures.run (cutoff, threshold, nD, nR, nT,
+          bt, diffraction)
+
+    Hence a modification of the layout or of a run parameter yields a new
+    key and a stale entry can never be returned. The groups of the file are
+    the index : a lookup is a single access by name.
+
+    Writers hold an exclusive lock on <filename>.lock, readers a shared one,
+    so that several processes can read the store at the same time during a
+    sweep.
+
+    Store layout
+
+    Signatures.h5
+        |
+        |/<key>/sig/<k>   signatures with k interactions (2 nsig x k)
+        |      /ratio/<k> cone ratios (nsig)
+        |      attrs : L, source, target, cutoff, threshold, nD, nR, nT
+
+    Examples
+    --------
+
+    >>> from pylayers.gis.layout import *
+    >>> from pylayers.antprop.signature import *
+    >>> L = Layout('defstr.ini')
+    >>> L.build()
+    >>> S = SigStore()
+    >>> Si = Signatures(L,1,2,cutoff=2)
+    >>> key = S.key(L,1,2,cutoff=2)
+    >>> if not S.get(key,Si):
+    ...     Si.run(cutoff=2)
+    ...     S.put(key,Si)
+
+    """
+    # run parameters entering the key and their defaults (Signatures.run)
+    params = (('cutoff',2),
+              ('threshold',0.1),
+              ('nD',1),
+              ('nR',10),
+              ('nT',10),
+              ('bt',True),
+              ('diffraction',True))
+
+    def __init__(self,_filename='Signatures.h5'):
+        self.filename = pyu.getlong(_filename,pstruc['DIRLNK'])
+
+    def __repr__(self):
+        s = 'SigStore : ' + self.filename + '\n'
+        s = s + str(len(self)) + ' entries'
+        return s
+
+    def __len__(self):
+        if not os.path.isfile(self.filename):
+            return 0
+        with self._lock(shared=True):
+            with h5py.File(self.filename,'r') as f:
+                return len(f.keys())
+
+    def __contains__(self,key):
+        if not os.path.isfile(self.filename):
+            return False
+        with self._lock(shared=True):
+            with h5py.File(self.filename,'r') as f:
+                return key in f
+
+    @contextlib.contextmanager
+    def _lock(self,shared=False):
+        """ inter process lock on the store
+        """
+        if fcntl is None:
+            yield
+            return
+        fd = open(self.filename+'.lock','a')
+        try:
+            if shared:
+                fcntl.flock(fd,fcntl.LOCK_SH)
+            else:
+                fcntl.flock(fd,fcntl.LOCK_EX)
+            yield
+        finally:
+            fcntl.flock(fd,fcntl.LOCK_UN)
+            fd.close()
+
+    def key(self,L,source,target,Lhash='',**kwargs):
+        """ key of a signature computation
+
+        Parameters
+        ----------
+
+        L : Layout
+        source : int
+            source cycle
+        target : int
+            target cycle
+        Lhash : string
+            layout content hash, L._geomhash (hash at the last build or
+            load of L) or L.geomhash() if ''
+        kwargs :
+            parameters of Signatures.run
+
+        Returns
+        -------
+
+        key : string
+
+        """
+        if Lhash == '':
+            Lhash = getattr(L,'_geomhash','') or L.geomhash()
+        lp = [ (k,kwargs.get(k,v)) for k,v in self.params ]
+        # threshold is rounded as in the Links h5 file
+        lp = [ (k,np.round(v,decimals=4)) if k=='threshold' else (k,v)
+               for k,v in lp ]
+        s = repr((Lhash,int(source),int(target),[(k,str(v)) for k,v in lp]))
+        return hashlib.md5(s.encode('utf-8')).hexdigest()
+
+    def get(self,key,Si):
+        """ load signatures of key into Si
+
+        Parameters
+        ----------
+
+        key : string
+        Si : Signatures
+            updated in place
+
+        Returns
+        -------
+
+        boolean : True if key is in the store
+
+        """
+        if not os.path.isfile(self.filename):
+            return False
+        with self._lock(shared=True):
+            with h5py.File(self.filename,'r') as fh5:
+                if key not in fh5:
+                    return False
+                f = fh5[key]
+                for k in f['sig'].keys():
+                    Si[eval(k)] = f['sig'][k][:]
+                    Si.ratio[eval(k)] = f['ratio'][k][:]
+                Si.cutoff = f.attrs['cutoff']
+                Si.threshold = f.attrs['threshold']
+        return True
+
+    def put(self,key,Si,**kwargs):
+        """ store the signatures Si under key
+
+        Parameters
+        ----------
+
+        key : string
+        Si : Signatures
+        kwargs :
+            parameters of Signatures.run (stored as attributes)
+
+        """
+        with self._lock():
+            with h5py.File(self.filename,'a') as fh5:
+                if key in fh5:
+                    return
+                f = fh5.create_group(key)
+                f.attrs['L'] = Si.L._filename
+                f.attrs['source'] = Si.source
+                f.attrs['target'] = Si.target
+                f.attrs['cutoff'] = Si.cutoff
+                f.attrs['threshold'] = Si.threshold
+                for k,v in self.params:
+                    if k not in ('cutoff','threshold'):
+                        f.attrs[k] = kwargs.get(k,v)
+                f.create_group('sig')
+                f.create_group('ratio')
+                for k in Si.keys():
+                    f['sig'].create_dataset(str(k),data=Si[k])
+                    f['ratio'].create_dataset(str(k),data=Si.ratio[k])
+
+    def delete(self,key):
+        """ remove an entry of the store
+        """
+        with self._lock():
+            with h5py.File(self.filename,'a') as fh5:
+                if key in fh5:
+                    del fh5[key]
+
+
+def _sigsource_func(args):
+    """ worker function of Signatures.run in parallel mode
+
+    Parameters
+    ----------
+
+    args : tuple | int
+        (us,s) index and source interaction or index of the source
+        interaction in L.Gicsr
+
+    Notes
+    -----
+
+    The Signatures object and the graph of interactions are read from the
+    module global _Si_run which is set before the pool is forked.
+
+    """
+    Si = _Si_run[0]
+    bcsr = _Si_run[1]
+    ctx = _Si_run[2:]
+    if bcsr:
+        return Si._sigsource_csr(args,*ctx)
+    else:
+        us,s = args
+        return Si._sigsource(us,s,*ctx)
+
 
 if __name__ == "__main__":
     plt.ion()
@@ -83,6 +83,8 @@ Slab Class
     Slab.info
     Slab.conv
     Slab.ev
+    Slab.lut
+    Slab.evallut
     Slab.filter
     Slab.excess_grdelay
     Slab.tocolor
@@ -1580,6 +1582,117 @@ class Slab(Interface,dict):
 
         self['evaluated'] = True
 
+    def lut(self, fGHz=np.array([1.0]), nth=181, compensate=False, RT='RT'):
+        """ build (or get from cache) the lookup table of the Slab
+
+        Parameters
+        ----------
+
+        fGHz : np.array
+            frequency GHz
+        nth : int
+            number of incidence angles of the table
+        compensate : boolean
+        RT : string
+
+        Returns
+        -------
+
+        lut : dict
+            'th' : (nth) incidence angles (uniform from 0 to thmax)
+            'R' / 'T' : (nf x nth x 2 x 2)
+
+        Notes
+        -----
+
+        The tables are cached in self._lut, one entry per (RT,compensate,nth)
+        holding one table per frequency point, so that the chunks of a band
+        (see Rays.eval nfc) or several bands share the same entry. Only the
+        frequencies missing from the entry are computed, with Slab.eval,
+        after which the state of the Slab (self.R, self.T, self.theta, ...)
+        is restored. An entry is dropped when the slab layers (materials,
+        thickness) change. thmax is slightly less than pi/2 (NaN at grazing
+        incidence, see MatInterface).
+
+        See Also
+        --------
+
+        pylayers.antprop.slab.Slab.evallut
+
+        """
+        if not isinstance(fGHz, np.ndarray):
+            fGHz = np.array([fGHz])
+        if not hasattr(self,'_lut'):
+            self._lut = {}
+        fp = str(self['lthick'])+str([sorted(m.items()) for m in self['lmat']])
+        key = (RT,compensate,nth)
+        entry = self._lut.get(key)
+        if (entry is None) or (entry['fp'] != fp):
+            entry = {'fp':fp,
+                     'th':np.linspace(0, np.pi/2 - 1e-4, nth),
+                     'f':{}}
+            self._lut[key] = entry
+        th = entry['th']
+        df = entry['f']
+        fnew = np.array([f for f in np.unique(fGHz) if f not in df])
+        if len(fnew) > 0:
+            # Slab.eval changes the state of the Slab, which is restored
+            dstate = dict(self.__dict__)
+            evaluated = self.get('evaluated', False)
+            self.eval(fGHz=fnew, theta=th, compensate=compensate, RT=RT)
+            dtab = {x: getattr(self, x) for x in RT}
+            self.__dict__.clear()
+            self.__dict__.update(dstate)
+            self['evaluated'] = evaluated
+            for k, f in enumerate(fnew):
+                df[f] = {x: dtab[x][k] for x in RT}
+        lut = {'th':th}
+        for x in RT:
+            lut[x] = np.array([df[f][x] for f in fGHz])
+        return(lut)
+
+    def evallut(self, fGHz=np.array([1.0]), theta=np.array([0.]), nth=181, compensate=False, RT='R'):
+        """ evaluation of the Slab by interpolation in its lookup table
+
+        Parameters
+        ----------
+
+        fGHz : np.array
+            frequency GHz
+        theta : np.array
+            incidence angle (from normal) radians
+        nth : int
+            number of incidence angles of the table
+        compensate : boolean
+        RT : string
+            'R' or 'T'
+
+        Returns
+        -------
+
+        C : np.array (nf x nt x 2 x 2)
+            R or T coefficients, as self.R / self.T after Slab.eval
+
+        Notes
+        -----
+
+        The coefficients are linearly interpolated along theta on the
+        uniform grid of Slab.lut, theta is clipped to [0,thmax].
+        Unlike Slab.eval, the state of the Slab (self.R, self.theta, ...)
+        is not modified.
+
+        """
+        lut = self.lut(fGHz=fGHz, nth=nth, compensate=compensate, RT=RT)
+        tab = lut[RT]
+        th = lut['th']
+        if not isinstance(theta, np.ndarray):
+            theta = np.array([theta])
+        x = np.clip(np.real(theta), 0, th[-1])/(th[1]-th[0])
+        k = np.minimum(x.astype(int), nth-2)
+        w = (x-k)[None,:,None,None]
+        C = (1-w)*tab[:,k,:,:] + w*tab[:,k+1,:,:]
+        return(C)
+
     def filter(self,win,theta=0):
         """ filtering waveform
 
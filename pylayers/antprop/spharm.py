@@ -90,11 +90,15 @@ Utility Functions
      indexssh
      indexvsh
      index_vsh
+     Legendre
      AFLegendre3
      AFLegendre2
      AFLegendre
+     AFLegendrec
      VW2
      VW
+     VWgrid
+     VWsynth
      VW0
      plotVW
 
@@ -106,6 +110,8 @@ import os
 import re
 import sys
 import pdb
+import hashlib
+import collections
 import numpy as np
 import scipy as sp
 import scipy.special as special
@@ -121,6 +127,11 @@ from scipy import sparse
 from matplotlib import rc
 from matplotlib import cm
 
+# cache of the normalized associated Legendre functions (see AFLegendrec)
+# least recently used first, limited to _Pcachemax bytes
+_Pcache = collections.OrderedDict()
+_Pcachemax = 2**28
+
 def indexssh(L,mirror=True):
     """ create [l,m] indexation from Lmax
 
@@ -1690,6 +1701,81 @@ class VSHCoeff(object):
         self.Cr.put3(i, i3)
         self.Ci.put3(i, i3)
 
+def Legendre(L, M, x, P=[]):
+    """ normalized associated Legendre functions by stable recurrence
+
+    Parameters
+    ----------
+
+    L : int
+        max order  (theta)
+    M : int
+        max degree (phi)
+    x : np.array (nx)
+        function argument
+    P : np.array (M+3 , L+1 , nx)
+        preallocated buffer (optional)
+
+    Returns
+    -------
+
+    P : ndarray (M+3 , L+1 , nx)
+        P[m+1,l,:] = :math:`\\bar{P}_{l}^{(m)}(x)` for m in [-1,M+1]
+        with :math:`\\bar{P}_{l}^{(-1)}=-\\bar{P}_{l}^{(1)}`.
+        P[0:M+1] and P[2:M+3] are the (m-1) and (m+1) terms of VW.
+
+    Notes
+    -----
+
+    .. math::
+
+        \\bar{P}_{m}^{(m)} = -\\sqrt{\\frac{2m+1}{2m}} \\sqrt{1-x^2} \\bar{P}_{m-1}^{(m-1)}
+
+        \\bar{P}_{m+1}^{(m)} = \\sqrt{2m+3} x \\bar{P}_{m}^{(m)}
+
+        \\bar{P}_{l}^{(m)} = a_{lm} ( x \\bar{P}_{l-1}^{(m)} - b_{lm} \\bar{P}_{l-2}^{(m)} )
+
+    with :math:`a_{lm}=\\sqrt{\\frac{4l^2-1}{l^2-m^2}}` and
+    :math:`b_{lm}=\\sqrt{\\frac{(l-1)^2-m^2}{4(l-1)^2-1}}`, starting from
+    :math:`\\bar{P}_{0}^{(0)}=\\sqrt{1/2}`.
+
+    The recurrence runs along l for all m and all x at once. It never
+    forms the factorial ratio of the normalization and is stable at
+    large orders. The Condon-Shortley phase is included as in
+    scipy.special.lpmv.
+
+    Examples
+    --------
+
+    >>> P = Legendre(5,4,np.array([0,0.5,1]))
+
+    """
+    x = np.asarray(x,dtype=float).ravel()
+    nx = len(x)
+    if type(P) == list:
+        P = np.zeros((M + 3, L + 1, nx))
+    else:
+        P[...] = 0
+    # m > L functions are zero
+    Mm = min(M + 1, L)
+    s = np.sqrt(np.maximum(1 - x*x, 0))
+
+    P[1, 0] = np.sqrt(0.5)
+    for m in range(1, Mm + 1):
+        P[m + 1, m] = -np.sqrt((2*m + 1.)/(2*m)) * s * P[m, m - 1]
+    for m in range(0, min(Mm, L - 1) + 1):
+        P[m + 1, m + 1] = np.sqrt(2*m + 3.) * x * P[m + 1, m]
+    for l in range(2, L + 1):
+        # degrees with l >= m+2
+        n = min(l - 2, Mm) + 1
+        m = np.arange(n)
+        a = np.sqrt((4.*l*l - 1)/(l*l - m*m))[:, None]
+        b = np.sqrt(((l - 1.)**2 - m*m)/(4.*(l - 1)**2 - 1))[:, None]
+        P[1:n + 1, l] = a * (x[None, :] * P[1:n + 1, l - 1] - b * P[1:n + 1, l - 2])
+
+    P[0] = -P[2]
+    return P
+
 def AFLegendre3(L, M, x):
     """ calculate Pmm1l and Pmp1l
 
@@ -1744,40 +1830,14 @@ def AFLegendre3(L, M, x):
     VW
 
     """
-    PML = []
-    nx = len(x)
-
+    P = Legendre(L, M, x)
+    # the m=0 term of Pmm1l is only filled for M >= L
     if M < L:
-        MM = np.arange(M + 2).reshape(M+2,1,1)
-        LL = np.arange(L + 1).reshape(1,L+1,1)
-    else:
-        MM = np.arange(M + 1).reshape(M+1,1,1)
-        LL = np.arange(L + 1).reshape(1,L+1,1)
-
-    x  = x.reshape(1,1,nx)
-
-    #
-    # Warning : this is a dangerous factorial ratio
-    # surprinsingly it works well
-    #
-    C1 = np.sqrt((LL + 0.5) * factorial(LL - MM) / factorial(LL + MM))
-    Pml = special.lpmv(MM,LL,x)*C1
-
-    Pml = np.swapaxes(Pml,0,2)
-    Pml = np.swapaxes(Pml,1,2)
-
-    if M < L:
-        Pmp1l = Pml[:, 1::1, :]
-    else:
-        Pmp1l = np.zeros((nx, M + 1, L + 1))
-        Pmp1l[:, 0:-1, :] = Pml[:, 1::1, :]
-
-    Pmm1l = np.zeros((nx, M + 1, L + 1))
-    if M < L:
-        Pmm1l[:, 1::1, :] = Pml[:, 0:-2, :]
-    else:
-        Pmm1l[:, 1::1, :] = Pml[:, 0:-1, :]
-        Pmm1l[:, 0, :] = -Pml[:, 1, :]
+        P[0] = 0
+    # (nx , M+3 , L+1) view
+    P = np.rollaxis(P, 2)
+    Pmm1l = P[:, 0:M + 1, :]
+    Pmp1l = P[:, 2:M + 3, :]
 
     return Pmm1l, Pmp1l
 
@@ -1829,10 +1889,15 @@ def AFLegendre2(L, M, x):
 
     L has to be greater or equal than M
 
+    This is the reference implementation, point by point with
+    scipy.special.lpmn (see examples/ex_AFLegendre.py). AFLegendre and
+    AFLegendre3 use the Legendre recurrence.
+
     See Also
     --------
 
     VW
+    Legendre
 
     """
     PML = []
@@ -1921,44 +1986,60 @@ def AFLegendre(N, M, x):
     VW
 
     """
-    PMN = []
-    nx = len(x)
+    P = Legendre(N, M, x)
+    # the m=0 term of Pmm1n is only filled for M >= N
     if M < N:
-        MM = np.outer(np.arange(M + 2), np.ones(N + 1))
-        NN = np.outer(np.ones(M + 2), np.arange(N + 1))
-    else:
-        MM = np.outer(np.arange(M + 1), np.ones(N + 1))
-        NN = np.outer(np.ones(M + 1), np.arange(N + 1))
-    #
-    # Warning : this is a dangerous factorial ratio
-    # surprinsingly it works well
-    #
-    C1 = np.sqrt((NN + 0.5) * factorial(NN - MM) / factorial(NN + MM))
-    del MM
-    del NN
-    for i in range(nx):
-        if M < N:
-            pmn = special.lpmn(M + 1, N, x[i])[0]
-        else:
-            pmn = special.lpmn(M, N, x[i])[0]
-        pmn = pmn * C1
-        PMN.append(pmn)
+        P[0] = 0
+    # (nx , M+3 , N+1) view
+    P = np.rollaxis(P, 2)
+    Pmm1n = P[:, 0:M + 1, :]
+    Pmp1n = P[:, 2:M + 3, :]
 
-    Pmn = np.array(PMN)
-    if M < N:
-        Pmp1n = Pmn[:, 1::1, :]
-    else:
-        Pmp1n = np.zeros((nx, M + 1, N + 1))
-        Pmp1n[:, 0:-1, :] = Pmn[:, 1::1, :]
+    return Pmm1n, Pmp1n
 
-    Pmm1n = np.zeros((nx, M + 1, N + 1))
-    if M < N:
-        Pmm1n[:, 1::1, :] = Pmn[:, 0:-2, :]
-    else:
-        Pmm1n[:, 1::1, :] = Pmn[:, 0:-1, :]
-        Pmm1n[:, 0, :] = -Pmn[:, 1, :]
+def AFLegendrec(L, M, x, f=AFLegendre):
+    """ cached calculation of Pmm1l and Pmp1l
 
-    return Pmm1n, Pmp1n
+    Parameters
+    ----------
+
+    L : int
+        max order  (theta)
+    M : int
+        max degree (phi)
+    x : np.array
+        function argument
+    f : function
+        AFLegendre | AFLegendre3
+
+    Returns
+    -------
+
+    Pmm1l, Pmp1l : read only arrays (see f)
+
+    Notes
+    -----
+
+    The Legendre functions only depend on (L, M) and on the directions.
+    They are kept in a least recently used cache so that evaluating
+    again an antenna on the same directions (pattern grid, same rays at
+    an other frequency or time step) does not recompute them.
+
+    """
+    x = np.ascontiguousarray(x,dtype=float)
+    key = (f.__name__, L, M, len(x), hashlib.md5(x.tostring()).hexdigest())
+    if key in _Pcache:
+        P = _Pcache.pop(key)
+    else:
+        P = f(L, M, x)
+        for p in P:
+            p.flags.writeable = False
+    _Pcache[key] = P
+    nbytes = sum([p.nbytes for v in _Pcache.values() for p in v])
+    while (nbytes > _Pcachemax) and (len(_Pcache) > 1):
+        v = _Pcache.popitem(last=False)[1]
+        nbytes = nbytes - sum([p.nbytes for p in v])
+    return P
 
 def VW2(l, m, x, phi, Pmm1l, Pmp1l):
     """ evaluate vector Spherical Harmonics basis functions
@@ -2061,10 +2142,8 @@ def VW(l, m, theta ,phi):
     L = np.max(l)
     M = np.max(m)
 
-    # dirty fix
-    index = np.where(abs(theta-np.pi/2)<1e-5)[0]
-    if len(index)>0:
-        theta[index]=np.pi/2-0.01
+    # dirty fix (the input array is left unchanged)
+    theta = np.where(abs(theta-np.pi/2)<1e-5,np.pi/2-0.01,theta)
     x = -np.cos(theta)
 
     # The - sign is necessary to get the good reconstruction
@@ -2073,7 +2152,7 @@ def VW(l, m, theta ,phi):
 
     #Pmm1l, Pmp1l = AFLegendre(L, M, x)
 
-    Pmm1l, Pmp1l = AFLegendre(L, L, x)
+    Pmm1l, Pmp1l = AFLegendrec(L, L, x)
 
     K   = len(l)
     Nr  = len(x)  
@@ -2104,6 +2183,89 @@ def VW(l, m, theta ,phi):
 
     return V, W
 
+def VWgrid(l, m, theta, phi):
+    """ vector Spherical Harmonics basis functions on a (theta,phi) grid
+
+    Parameters
+    ----------
+
+    l    : ndarray (1 x K)
+    m    : ndarray (1 x K)
+    theta : np.array (Nt)
+    phi   : np.array (Np)
+
+    Returns
+    -------
+
+    V  : ndarray (Nt*Np , K)
+    W  : ndarray (Nt*Np , K)
+
+    Notes
+    -----
+
+    Same result as VW on np.kron(theta,ones(Np)), np.kron(ones(Nt),phi)
+    but the Legendre functions are only evaluated on the Nt values of
+    theta, the phi dependency being the separable term exp(1j m phi).
+
+    See Also
+    --------
+
+    VW
+
+    """
+    Nt = len(theta)
+    Np = len(phi)
+    K = len(l)
+    Vt, Wt = VW(l, m, theta, np.zeros(Nt))
+    Ephi = np.exp(1j*m.reshape(1,K)*phi.reshape(Np,1))
+    V = (Vt[:,None,:]*Ephi[None,:,:]).reshape(Nt*Np,K)
+    W = (Wt[:,None,:]*Ephi[None,:,:]).reshape(Nt*Np,K)
+    return V, W
+
+def VWsynth(Br, Bi, Cr, Ci, V, W):
+    """ pattern synthesis from vsh coefficients and basis functions
+
+    Parameters
+    ----------
+
+    Br, Bi, Cr, Ci : ndarray (Nf x K)
+        vsh coefficients
+    V, W : ndarray (Ndir x K)
+        basis functions (VW, VW2 or VWgrid)
+
+    Returns
+    -------
+
+    Fth, Fph : ndarray (Nf x Ndir)
+
+    Notes
+    -----
+
+    .. math::
+
+        F_{\theta} = B_r \Re V - B_i \Im V + C_i \Re W + C_r \Im W
+
+        F_{\phi} = -C_r \Re V + C_i \Im V + B_i \Re W + B_r \Im W
+
+    The 8 products are gathered into a single real matrix product
+    (4 Nf x 4K) (4K x Ndir) : the rows are the real and imaginary parts
+    of the coefficients of Fth and Fph, the columns the real and
+    imaginary parts of V and W.
+
+    """
+    Nf = Br.shape[0]
+    # basis (4K x Ndir)
+    B = np.vstack((np.real(V.T),np.imag(V.T),np.real(W.T),np.imag(W.T)))
+    # coefficients (2Nf x 4K)
+    C = np.vstack((np.hstack((Br,-Bi,Ci,Cr)),
+                   np.hstack((-Cr,Ci,Bi,Br))))
+    if np.iscomplexobj(C):
+        F = np.dot(np.vstack((np.real(C),np.imag(C))),B)
+        F = F[:2*Nf] + 1j*F[2*Nf:]
+    else:
+        F = np.dot(C,B)
+    return F[:Nf], F[Nf:]
+
 def VW0(n, m, x, phi, Pmm1n, Pmp1n):
     """ evaluate vector Spherical Harmonics basis functions
 
@@ -0,0 +1,74 @@
+from pylayers.antprop.aarray import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+fGHz = np.array([27.,28.,29.])
+N = [4,3,2]
+dm = [0.005,0.006,0.004]
+Na = np.prod(N)
+Nb = 3
+th = np.linspace(0,np.pi,11)
+ph = np.linspace(0,2*np.pi,13)
+# rotated basis of the array axes
+a = np.pi/5
+T = np.array([[np.cos(a),-np.sin(a),0],[np.sin(a),np.cos(a),0],[0,0,1]])
+np.random.seed(0)
+
+def afdense(p,w,th,ph,fGHz):
+    """ array factor with the Nd x Na x Nf phase array
+    """
+    sx = np.sin(th[:,None])*np.cos(ph[None,:])
+    sy = np.sin(th[:,None])*np.sin(ph[None,:])
+    sz = np.cos(th[:,None])*np.ones(len(ph))[None,:]
+    s = np.vstack((sx.ravel(),sy.ravel(),sz.ravel())).T
+    k = 2*np.pi*fGHz/0.3
+    E = np.exp(1j*k[None,None,:]*np.dot(s,p)[:,:,None])
+    F = np.einsum('baf,daf->dbf',w,E)
+    return F.reshape(len(th),len(ph),w.shape[0],len(fGHz))
+
+def randw(*sh):
+    return np.random.randn(*sh) + 1j*np.random.randn(*sh)
+
+class Tesaarray(TestCase):
+    def test_afsep(self):
+        print "testing afsep and afchunk versus the dense array factor"
+        A = ULArray(N=N,dm=dm,T=T)
+        A.fGHz = fGHz
+        w = randw(Nb,Na,len(fGHz))
+        Fd = afdense(A.p,w,th,ph,fGHz)
+        assert_(A.separable)
+        Fs = A.arrayfactor(w=w,th=th,ph=ph,grid=True,chunk=17)
+        assert_almost_equal(Fs,Fd)
+        A.separable = False
+        Fc = A.arrayfactor(w=w,th=th,ph=ph,grid=True,chunk=17)
+        assert_almost_equal(Fc,Fd)
+
+    def test_afsep_axis(self):
+        print "testing afsep with per axis weights"
+        A = ULArray(N=N,dm=dm,T=T)
+        A.fGHz = fGHz
+        lw = [randw(Nb,n,len(fGHz)) for n in N]
+        w = (lw[0][:,:,None,None,:]*
+             lw[1][:,None,:,None,:]*
+             lw[2][:,None,None,:,:]).reshape(Nb,Na,len(fGHz))
+        Fd = afdense(A.p,w,th,ph,fGHz)
+        Fs = A.arrayfactor(w=lw,th=th,ph=ph,grid=True)
+        assert_almost_equal(Fs,Fd)
+
+    def test_afchunk_directions(self):
+        print "testing afchunk on a list of directions"
+        p = np.random.rand(3,7)*0.02
+        w = randw(Nb,7,1)
+        thd = np.random.rand(20)*np.pi
+        phd = np.random.rand(20)*2*np.pi
+        s = np.vstack((np.sin(thd)*np.cos(phd),
+                       np.sin(thd)*np.sin(phd),
+                       np.cos(thd))).T
+        F = afchunk(p,w,s,fGHz,chunk=3)
+        k = 2*np.pi*fGHz/0.3
+        E = np.exp(1j*k[None,None,:]*np.dot(s,p)[:,:,None])
+        Fd = np.einsum('ba,daf->dbf',w[:,:,0],E)
+        assert_almost_equal(F,Fd)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,46 @@
+from pylayers.antprop.channel import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+BWGHz = 2
+Nf = 1000
+nray = 200
+# time step and duration of the impulse response (ns)
+dtns = 1./BWGHz
+np.random.seed(0)
+
+def tchannel(tau):
+    y = (np.random.randn(len(tau),2,3,1) +
+         1j*np.random.randn(len(tau),2,3,1))
+    return Tchannel(x=np.array([4.]),y=y,tau=tau)
+
+class Tescir(TestCase):
+    def test_nufft(self):
+        print "testing getcir nufft versus dense"
+        tau = (Nf-1)*dtns*np.random.rand(nray)
+        H = tchannel(tau)
+        cd = H.getcir(BWGHz=BWGHz,Nf=Nf,method='dense')
+        cn = H.getcir(BWGHz=BWGHz,Nf=Nf,method='nufft')
+        assert_almost_equal(cn.x,cd.x)
+        assert_almost_equal(cn.y,cd.y,decimal=9)
+
+    def test_dense_chunk(self):
+        print "testing getcir dense by chunks of rays"
+        tau = (Nf-1)*dtns*np.random.rand(nray)
+        H = tchannel(tau)
+        cd = H.getcir(BWGHz=BWGHz,Nf=Nf,method='dense')
+        cc = H.getcir(BWGHz=BWGHz,Nf=Nf,method='dense',chunk=7)
+        assert_almost_equal(cc.y,cd.y)
+
+    def test_bin(self):
+        print "testing getcir bin versus dense on the time grid"
+        # delays multiple of the time step of the response
+        df = BWGHz/(Nf-1.)
+        tau = np.random.randint(0,Nf,nray)/(Nf*df)
+        H = tchannel(tau)
+        cd = H.getcir(BWGHz=BWGHz,Nf=Nf,method='dense')
+        cb = H.getcir(BWGHz=BWGHz,Nf=Nf,method='bin')
+        assert_almost_equal(cb.y,cd.y,decimal=9)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,58 @@
+from pylayers.antprop.coverage import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+# baseline : sequential evaluation with the maps of every access point
+C = Coverage('coverage.ini')
+C.cover()
+lmaps = ['CmWo','CmWp','Lwo','Lwp','Edo','Edp','freespace']
+dref = dict([ (k,getattr(C,k).copy()) for k in lmaps +
+              ['snro','snrp','sinro','sinrp','bestsvo','bestsvp'] ])
+
+def reductions(pol):
+    """ reductions over the access points from the full maps
+    """
+    CmW = dref['CmW'+pol]
+    nf,ng,na = CmW.shape
+    uf,ug = np.mgrid[0:nf,0:ng]
+    ib = np.argmax(CmW,axis=2)
+    d = {}
+    d['CmWtot'+pol] = np.sum(CmW,axis=2)
+    d['CmWbest'+pol] = np.max(CmW,axis=2)
+    d['CmWsec'+pol] = np.sort(CmW,axis=2)[:,:,-2]
+    d['ibest'+pol] = ib
+    d['snrbest'+pol] = dref['snr'+pol][uf,ug,ib]
+    d['sinrbest'+pol] = dref['sinr'+pol][uf,ug,ib]
+    return d
+
+class Tescover(TestCase):
+    def test_reductions(self):
+        print "testing Coverage.cover running reductions versus full maps"
+        assert_(C.na > 1)
+        for pol in ['o','p']:
+            d = reductions(pol)
+            for k in d:
+                assert_almost_equal(getattr(C,k),d[k])
+
+    def test_parallel(self):
+        print "testing Coverage.cover parallel versus sequential"
+        C2 = Coverage('coverage.ini')
+        C2.cover(nproc=2)
+        for k in dref:
+            assert_almost_equal(getattr(C2,k),dref[k])
+        C3 = Coverage('coverage.ini')
+        C3.cover(nproc=2,maps=False)
+        for k in lmaps:
+            if k not in ['CmWo','CmWp']:
+                assert_(not hasattr(C3,k))
+        for pol in ['o','p']:
+            d = reductions(pol)
+            for k in d:
+                assert_almost_equal(getattr(C3,k),d[k])
+            # best server maps with a single access point axis
+            assert_almost_equal(getattr(C3,'CmW'+pol)[:,:,0],d['CmWbest'+pol])
+            assert_almost_equal(getattr(C3,'sinr'+pol)[:,:,0],d['sinrbest'+pol])
+            assert_equal(getattr(C3,'bestsv'+pol)[:,:,0],d['ibest'+pol]+1)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,125 @@
+from pylayers.antprop.spharm import *
+import pylayers.antprop.spharm as sph
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+x = np.linspace(-1,1,101)
+lm = indexssh(6,mirror=False).astype(int)
+l = lm[:,0]
+m = lm[:,1]
+
+class Teslegendre(TestCase):
+    def test_recurrence(self):
+        print "testing Legendre recurrence versus AFLegendre2 (lpmn)"
+        for (L,M) in [(10,10),(20,5),(30,29)]:
+            Pmm1l, Pmp1l = AFLegendre2(L,M,x)
+            P, Q = AFLegendre3(L,M,x)
+            assert_almost_equal(P,Pmm1l,decimal=10)
+            assert_almost_equal(Q,Pmp1l,decimal=10)
+            P, Q = AFLegendre(L,M,x)
+            assert_almost_equal(P,Pmm1l,decimal=10)
+            assert_almost_equal(Q,Pmp1l,decimal=10)
+
+    def test_buffer(self):
+        print "testing Legendre with a preallocated buffer"
+        L, M = 12, 8
+        P = Legendre(L,M,x)
+        B = np.ones((M+3,L+1,len(x)))
+        PB = Legendre(L,M,x,P=B)
+        assert_(PB is B)
+        assert_equal(PB,P)
+
+    def test_large_order(self):
+        print "testing Legendre at large orders"
+        L = 200
+        P = Legendre(L,L,x)
+        assert_(np.all(np.isfinite(P)))
+        # orthonormality of the m=0 functions (Gauss-Legendre quadrature)
+        xg, wg = np.polynomial.legendre.leggauss(L+1)
+        Pg = Legendre(L,0,xg)[1]
+        G = np.dot(Pg*wg[None,:],Pg.T)
+        assert_almost_equal(G,np.eye(L+1),decimal=10)
+
+    def test_vwgrid(self):
+        print "testing VWgrid versus VW on the grid directions"
+        theta = np.hstack((np.linspace(0.05,np.pi-0.05,9),np.pi/2))
+        phi = np.linspace(0,2*np.pi,12,endpoint=False)
+        th = theta.copy()
+        V, W = VWgrid(l,m,theta,phi)
+        Nt = len(theta)
+        Np = len(phi)
+        V2, W2 = VW(l,m,np.kron(theta,np.ones(Np)),np.kron(np.ones(Nt),phi))
+        assert_equal(V.shape,(Nt*Np,len(l)))
+        assert_almost_equal(V,V2)
+        assert_almost_equal(W,W2)
+        # the directions of the caller are left unchanged
+        assert_equal(theta,th)
+
+    def test_vwsynth(self):
+        print "testing VWsynth versus separate products"
+        np.random.seed(0)
+        K = len(l)
+        Nf = 3
+        Nd = 50
+        theta = np.pi*np.random.rand(Nd)
+        phi = 2*np.pi*np.random.rand(Nd)
+        V, W = VW(l,m,theta,phi)
+        for cplx in [False,True]:
+            lc = [ np.random.randn(Nf,K) for k in range(4) ]
+            if cplx:
+                lc = [ c + 1j*np.random.randn(Nf,K) for c in lc ]
+            Br, Bi, Cr, Ci = lc
+            Fth, Fph = VWsynth(Br,Bi,Cr,Ci,V,W)
+            Vr = np.real(V).T
+            Vi = np.imag(V).T
+            Wr = np.real(W).T
+            Wi = np.imag(W).T
+            Fth2 = (np.dot(Br,Vr) - np.dot(Bi,Vi) +
+                    np.dot(Ci,Wr) + np.dot(Cr,Wi))
+            Fph2 = (-np.dot(Cr,Vr) + np.dot(Ci,Vi) +
+                    np.dot(Bi,Wr) + np.dot(Br,Wi))
+            assert_equal(np.iscomplexobj(Fth),cplx)
+            assert_almost_equal(Fth,Fth2)
+            assert_almost_equal(Fph,Fph2)
+
+    def test_cache(self):
+        print "testing the least recently used cache of AFLegendrec"
+        L, M = 10, 10
+        lx = [ np.linspace(-1,1,101+k) for k in range(4) ]
+        cachemax = sph._Pcachemax
+        sph._Pcache.clear()
+        try:
+            P = AFLegendrec(L,M,lx[0])
+            Pr = AFLegendre(L,M,lx[0])
+            assert_almost_equal(P[0],Pr[0])
+            assert_almost_equal(P[1],Pr[1])
+            assert_(not P[0].flags.writeable)
+            assert_(AFLegendrec(L,M,lx[0].copy()) is P)
+            assert_(AFLegendrec(L,M,lx[0],f=AFLegendre3) is not P)
+            sph._Pcache.clear()
+            # room for 2 entries (of about the same size)
+            nb = sum([p.nbytes for p in AFLegendrec(L,M,lx[3])])
+            sph._Pcache.clear()
+            sph._Pcachemax = 2*nb
+            P0 = AFLegendrec(L,M,lx[0])
+            P1 = AFLegendrec(L,M,lx[1])
+            assert_equal(len(sph._Pcache),2)
+            # lx[0] is the most recently used
+            assert_(AFLegendrec(L,M,lx[0]) is P0)
+            AFLegendrec(L,M,lx[2])
+            assert_equal(len(sph._Pcache),2)
+            assert_(AFLegendrec(L,M,lx[0]) is P0)
+            assert_(AFLegendrec(L,M,lx[1]) is not P1)
+            nbytes = sum([p.nbytes for v in sph._Pcache.values() for p in v])
+            assert_(nbytes <= sph._Pcachemax)
+            # an entry larger than the limit is kept alone
+            sph._Pcachemax = 1
+            P3 = AFLegendrec(L,M,lx[3])
+            assert_equal(len(sph._Pcache),1)
+            assert_(AFLegendrec(L,M,lx[3]) is P3)
+        finally:
+            sph._Pcachemax = cachemax
+            sph._Pcache.clear()
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,37 @@
+from pylayers.gis.layout import *
+from pylayers.antprop.loss import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+L.build()
+fGHz = np.array([2.4,5.2])
+np.random.seed(0)
+N = 50
+p1 = np.vstack((L.ax[0]+(L.ax[1]-L.ax[0])*np.random.rand(N),
+                L.ax[2]+(L.ax[3]-L.ax[2])*np.random.rand(N),
+                1.2*np.ones(N)))
+p2 = np.array([(L.ax[0]+L.ax[1])/2.,(L.ax[2]+L.ax[3])/2.,1.2])
+
+class Teslosst(TestCase):
+    def test_chunk(self):
+        print "testing Losst by chunks versus link by link"
+        R = Losst(L,fGHz,p1,p2,chunk=N)
+        Rc = Losst(L,fGHz,p1,p2,chunk=7)
+        for x,xc in zip(R,Rc):
+            assert_almost_equal(x,xc)
+        for k in range(N):
+            Rk = Losst(L,fGHz,p1[:,k],p2)
+            for x,xk in zip(R,Rk):
+                assert_almost_equal(x[:,[k]],xk)
+
+    def test_dtheta(self):
+        print "testing Losst on an angle grid versus exact angles"
+        R = Losst(L,fGHz,p1,p2)
+        Rg = Losst(L,fGHz,p1,p2,dtheta=1e-3)
+        # losses (dB) and excess delays (ns)
+        for x,xg in zip(R,Rg):
+            assert_almost_equal(x,xg,decimal=1)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,190 @@
+from pylayers.simul.link import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+fGHz = np.linspace(2,11,19)
+L = Layout('defstr.ini')
+DL = DLink(L=L,fGHz=fGHz)
+DL.eval(force=True,cutoff=3,verbose=False)
+R = DL.R
+
+lC = ['Ctt','Ctp','Cpt','Cpp']
+lij = [(1,1),(1,2),(2,1),(2,2)]
+
+def chain(R,fGHz):
+    """ ray per ray evaluation of the chain product (group by group)
+    """
+    R.I.eval(fGHz)
+    nf = len(fGHz)
+    Ct = np.zeros((R.nray,nf,3,3),dtype=complex)
+    for k in R:
+        if k == 0:
+            continue
+        for ir,r in enumerate(R[k]['rayidx']):
+            Z = np.repeat(R.B0.data[r].T[None,:,:],nf,axis=0)
+            for ii in R[k]['rays'][:,ir]:
+                Z = np.einsum('fij,fjk->fik',R.I.I[:,ii,:,:],Z)
+                Z = np.einsum('ij,fjk->fik',R.B.data[ii].T,Z)
+            Ct[r] = Z/R.dis[r]
+    if R.los:
+        Ct[0] = np.eye(3)[None,:,:]/R[0]['dis'][0]
+    return Ct
+
+def pergroup(R):
+    """ interaction data and bases read group by group
+    """
+    d = {}
+    b = {}
+    b0 = {}
+    for k in R:
+        if k == 0:
+            continue
+        for ir,r in enumerate(R[k]['rayidx']):
+            b0[r] = R[k]['B'][:,:,0,ir].T
+            for i,ii in enumerate(R[k]['rays'][:,ir]):
+                d[ii] = (R[k]['sig'][1,i+1,ir],R[k]['theta'][i,ir],
+                         R[k]['si'][i,ir],R[k]['si'][i+1,ir])
+                b[ii] = R[k]['B'][:,:,i+1,ir].T
+    return d,b,b0
+
+def checkinter(R):
+    """ check the interactions filled from the flat store
+    """
+    d,b,b0 = pergroup(R)
+    n = 0
+    for I,ltyp in [(R.I.R,[2,4,5]),(R.I.T,[3])]:
+        for ii,row in zip(I.idx,I.data):
+            assert_(d[ii][0] in ltyp)
+            assert_almost_equal(row,d[ii][1:])
+            n = n + 1
+    assert_equal(n,len([ii for ii in d if d[ii][0] in [2,3,4,5]]))
+    i0 = 1 if R.los else 0
+    assert_equal(sorted(R.B.idx[i0:]),sorted(b.keys()))
+    for ii,B in zip(R.B.idx[i0:],R.B.data[i0:]):
+        assert_almost_equal(B,b[ii])
+    assert_equal(sorted(R.B0.idx[i0:]),sorted(b0.keys()))
+    for r,B in zip(R.B0.idx[i0:],R.B0.data[i0:]):
+        assert_almost_equal(B,b0[r])
+
+def assert_rays_equal(R1,R2):
+    assert_equal(sorted(R1.keys()),sorted(R2.keys()))
+    for k in R1:
+        assert_equal(sorted(R1[k].keys()),sorted(R2[k].keys()))
+        for key in R1[k]:
+            a1 = R1[k][key]
+            a2 = R2[k][key]
+            if isinstance(a1,np.ndarray) and (a1.dtype.kind in 'fc'):
+                assert_almost_equal(a1,a2)
+            else:
+                assert_equal(a1,a2)
+
+class Tesrays(TestCase):
+    def test_batched(self):
+        print "testing Rays.eval batched chain product"
+        assert_(len([k for k in R if k != 0]) > 1)
+        C = R.eval(fGHz)
+        Ct = chain(R,fGHz)
+        for c,(i,j) in zip(lC,lij):
+            assert_almost_equal(getattr(C,c).y,Ct[:,:,i,j])
+
+    def test_chunked(self):
+        print "testing Rays.eval chunked versus whole band"
+        C = R.eval(fGHz)
+        I = R.I.I
+        for nfc in [1,4,7]:
+            Cc = R.eval(fGHz,nfc=nfc)
+            for c in lC:
+                assert_almost_equal(getattr(Cc,c).y,getattr(C,c).y)
+        # arrays of a previous evaluation are left unchanged
+        assert_equal(I.shape[0],len(fGHz))
+        assert_(I is not R.I.I)
+
+    def test_workspace(self):
+        print "testing Rays.eval reuse of the work buffers"
+        C = R.eval(fGHz)
+        ws = dict(R._ws)
+        assert_equal(ws['Ct'].shape[0],R.nray)
+        for nfc in [0,4]:
+            Cc = R.eval(fGHz,nfc=nfc)
+            for k in ws:
+                assert_(R._ws[k] is ws[k])
+            for c in lC:
+                assert_almost_equal(getattr(Cc,c).y,getattr(C,c).y)
+
+    def test_lut_chunked(self):
+        print "testing Rays.eval with slab lookup tables, chunked versus whole band"
+        R.I.nthlut = 361
+        try:
+            C = R.eval(fGHz)
+            Cc = R.eval(fGHz,nfc=4)
+        finally:
+            R.I.nthlut = 0
+        for c in lC:
+            assert_almost_equal(getattr(Cc,c).y,getattr(C,c).y)
+
+    def test_evallut(self):
+        print "testing Slab.evallut versus Slab.eval"
+        sl = L.sl['WALL']
+        th = np.linspace(0,1.5,31)
+        sl.eval(fGHz=fGHz,theta=th,RT='R')
+        Rs = sl.R.copy()
+        for k0 in range(0,len(fGHz),5):
+            Rl = sl.evallut(fGHz=fGHz[k0:k0+5],theta=th,nth=3601,RT='R')
+            assert_almost_equal(Rl,Rs[k0:k0+5],decimal=3)
+        # the state of the slab is unchanged
+        assert_equal(sl.R,Rs)
+        assert_equal(sl.fGHz,fGHz)
+
+    def test_flatten(self):
+        print "testing Rays.flatten round trip"
+        lk = [ k for k in R if k != 0 ]
+        ref = {}
+        for k in lk:
+            ref[k] = dict([ (key,R[k][key].copy()) for key,dm in R._flatkeys
+                            if key in R.F ])
+        R.flatten()
+        assert_(R._isflat())
+        for k in lk:
+            for key in ref[k]:
+                assert_equal(R[k][key],ref[k][key])
+            for ir,r in enumerate(R[k]['rayidx']):
+                assert_equal(R.flat('sig',r),R[k]['sig'][:,:,ir])
+                assert_equal(R.flat('B',r),R[k]['B'][:,:,:,ir])
+                assert_equal(R.flat('dis',r),R[k]['dis'][ir])
+
+    def test_fillinter(self):
+        print "testing Rays.fillinter versus the group by group data"
+        R.fillinter(L)
+        checkinter(R)
+
+    def test_fillinter_stale(self):
+        print "testing Rays.fillinter after a change of the groups"
+        k = [ k for k in R if k != 0 ][0]
+        theta = R[k]['theta'].copy()
+        try:
+            # re-assigned array : no longer a view of the flat store
+            R[k]['theta'] = theta + 0.1
+            assert_(not R._isflat())
+            R.fillinter(L)
+            assert_(R._isflat())
+            checkinter(R)
+        finally:
+            R[k]['theta'] = theta
+            R.fillinter(L)
+        checkinter(R)
+
+    def test_parallel(self):
+        print "testing Rays.to3D and Rays.locbas serial versus parallel"
+        H = L.maxheight if L.typ == 'indoor' else 0
+        R1 = DL.r2d.to3D(L,H=H,N=1)
+        R2 = DL.r2d.to3D(L,H=H,N=1,parallel=True,nproc=2)
+        assert_rays_equal(R1,R2)
+        assert_equal(R1.nray,R2.nray)
+        R1.locbas(L)
+        R2.locbas(L,parallel=True,nproc=2)
+        assert_rays_equal(R1,R2)
+        assert_equal(R1._ray2nbi,R2._ray2nbi)
+        assert_equal(R1._luw,R2._luw)
+
+if __name__ == "__main__":
+    run_module_suite()
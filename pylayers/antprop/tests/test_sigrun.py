@@ -0,0 +1,70 @@
+from pylayers.gis.layout import *
+from pylayers.antprop.signature import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+L.build()
+
+def sigrun(source,target,**kwargs):
+    Si = Signatures(L,source,target)
+    Si.run(progress=False,**kwargs)
+    return Si
+
+def assert_sig_equal(S1,S2):
+    assert_equal(sorted(S1.keys()),sorted(S2.keys()))
+    for k in S1:
+        assert_equal(S1[k],S2[k])
+
+class Tessig(TestCase):
+    def test_csr_networkx(self):
+        print "testing Signatures.run CSR versus networkx"
+        for (source,target) in [(1,1),(1,2),(2,1)]:
+            S1 = sigrun(source,target,cutoff=3)
+            Gicsr = L.Gicsr
+            Gicsr_id = L.Gicsr_id
+            del L.Gicsr
+            del L.Gicsr_id
+            try:
+                S2 = sigrun(source,target,cutoff=3)
+            finally:
+                L.Gicsr = Gicsr
+                L.Gicsr_id = Gicsr_id
+            assert_sig_equal(S1,S2)
+
+    def test_parallel(self):
+        print "testing Signatures.run serial versus parallel"
+        for (source,target) in [(1,1),(1,2)]:
+            S1 = sigrun(source,target,cutoff=3)
+            S2 = sigrun(source,target,cutoff=3,parallel=True,nproc=2)
+            assert_sig_equal(S1,S2)
+
+    def test_run_multi(self):
+        print "testing Signatures.run_multi versus Signatures.run"
+        Si = Signatures(L,1,1)
+        dSi = Si.run_multi([1,2],cutoff=3,progress=False)
+        for target in [1,2]:
+            assert_sig_equal(dSi[target],sigrun(1,target,cutoff=3))
+
+    def test_csr_refresh(self):
+        print "testing Gicsr refresh after outputGi"
+        L.buildGi()
+        assert_(not hasattr(L,'Gicsr'))
+        L.outputGi()
+        assert_equal(len(L.Gicsr['typ']),len(L.Gi.node))
+
+    def test_csr_stale(self):
+        print "testing Signatures.run with interactions missing from Gicsr"
+        S1 = sigrun(1,2,cutoff=3)
+        # stale Gicsr : the interactions seen from the source are missing
+        lisR,lisT,lisD = L.intercy(1,typ='source')
+        L.Gicsr_id = dict([ (x,k) for x,k in L.Gicsr_id.items()
+                            if x not in lisR+lisT ])
+        S2 = sigrun(1,2,cutoff=3)
+        assert_equal(len(L.Gicsr_id),len(L.Gi.node))
+        assert_sig_equal(S1,S2)
+        Si = Signatures(L,1,2)
+        assert_raises(NameError,Si._csrid,[(0,1,2)])
+
+if __name__ == "__main__":
+    run_module_suite()
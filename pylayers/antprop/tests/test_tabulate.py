@@ -0,0 +1,75 @@
+from pylayers.antprop.antenna import *
+import os
+import tempfile
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+fGHz = np.array([2.4,5.2])
+tol = 1e-3
+np.random.seed(0)
+Nd = 500
+th = np.pi*np.random.rand(Nd)
+ph = 2*np.pi*np.random.rand(Nd)
+
+def direct(A,**kwargs):
+    A.tabulated = False
+    try:
+        F = A.eval(fGHz=fGHz,inplace=False,**kwargs)
+    finally:
+        A.tabulated = True
+    return F
+
+class Testabulate(TestCase):
+    def test_gridinterp(self):
+        print "testing gridinterp on the grid samples"
+        theta = np.linspace(0,np.pi,7)
+        phi = np.linspace(0,2*np.pi,8,endpoint=False)
+        F = np.random.randn(7,8,2) + 1j*np.random.randn(7,8,2)
+        t = np.kron(theta,np.ones(8))
+        p = np.kron(np.ones(7),phi)
+        Fi, = gridinterp(theta,phi,[F],t,p)
+        assert_almost_equal(Fi,F.reshape(56,2))
+        # periodicity in phi
+        Fi2, = gridinterp(theta,phi,[F],t,p+2*np.pi)
+        assert_almost_equal(Fi2,Fi)
+
+    def test_tabinterp(self):
+        print "testing tabulated evaluation versus direct evaluation"
+        for typ in ['Gauss','Omni']:
+            A = Antenna(typ,fGHz=fGHz)
+            err = A.tabulate(fGHz=fGHz,tol=tol,save=False)
+            assert_(err <= tol)
+            # directions
+            Ft,Fp = A.eval(th=th,ph=ph,grid=False,fGHz=fGHz,inplace=False)
+            Dt,Dp = direct(A,th=th,ph=ph,grid=False)
+            Fmax = max(np.max(np.abs(Dt)),np.max(np.abs(Dp)))
+            assert_(np.max(np.abs(Ft-Dt)) <= tol*Fmax)
+            assert_(np.max(np.abs(Fp-Dp)) <= tol*Fmax)
+            # grid
+            Ft,Fp = A.eval(nth=31,nph=45,fGHz=fGHz,inplace=False)
+            Dt,Dp = direct(A,nth=31,nph=45)
+            assert_equal(Ft.shape,Dt.shape)
+            assert_(np.max(np.abs(Ft-Dt)) <= tol*Fmax)
+            assert_(np.max(np.abs(Fp-Dp)) <= tol*Fmax)
+
+    def test_tabfile(self):
+        print "testing the table file name versus the pattern file content"
+        A = Antenna('Gauss',fGHz=fGHz)
+        fd, filename = tempfile.mkstemp(suffix='.vsh3')
+        os.write(fd,'pattern v1')
+        os.close(fd)
+        A._sourcefiles = lambda : [filename]
+        try:
+            f1 = A._tabfile(fGHz,tol)
+            assert_equal(A._tabfile(fGHz,tol),f1)
+            fd = open(filename,'w')
+            fd.write('pattern v2')
+            fd.close()
+            f2 = A._tabfile(fGHz,tol)
+            assert_(f2 != f1)
+            assert_(A._tabfile(fGHz,2*tol) != f2)
+        finally:
+            os.remove(filename)
+
+if __name__ == "__main__":
+    run_module_suite()
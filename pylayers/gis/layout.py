@@ -32,10 +32,13 @@ Layout Class
     Layout.boundary
     Layout.build
     Layout.buildGi
+    Layout._buildGicycle
+    Layout.buildGicsr
     Layout.buildGr
     Layout.buildGt
     Layout.buildGt_old
     Layout.buildGv
+    Layout._buildGvcycle
     Layout.buildGw
     Layout.check
     Layout.check2
@@ -47,6 +50,8 @@ Layout Class
     Layout._convex_hull
     Layout.cy2pt
     Layout.cycleinline
+    Layout._cypool
+    Layout._cysig
     Layout._delaunay
     Layout.del_points
     Layout.del_segment
@@ -54,20 +59,28 @@ Layout Class
     Layout.displaygui
     Layout.dumpr
     Layout.dumpw
+    Layout._readcache
+    Layout._writecache
     Layout.ed2nd
     Layout.editor
     Layout.editorTk
     Layout.edit_point
     Layout.edit_seg
     Layout.edit_segment
+    Layout.exportcore
     Layout.exportosm
     Layout.extrseg
     Layout.facet3D
     Layout.facets3D
     Layout.filterGi
+    Layout._diffarrays
+    Layout.diffcycle
+    Layout.diffindex
     Layout._find_diffractions
     Layout.find_edgelist
     Layout.g2npy
+    Layout._gssig
+    Layout.geomhash
     Layout.geomfile
     Layout.getangles
     Layout.get_diffslab
@@ -77,6 +90,7 @@ Layout Class
     Layout.have_subseg
     Layout._help
     Layout.importosm
+    Layout._importways
     Layout.importres
     Layout.importshp
     Layout.info
@@ -90,6 +104,7 @@ Layout Class
     Layout.load
     Layout.loadfur
     Layout.load_modif
+    Layout._locindex
     Layout.ls
     Layout.mask
     Layout._merge_polygons
@@ -111,6 +126,7 @@ Layout Class
     Layout.pt2ro
     Layout.ptGs2cy
     Layout.ptin
+    Layout._ptloc
     Layout.randTxRx
     Layout.room2nodes
     Layout.room2segments
@@ -122,6 +138,10 @@ Layout Class
     Layout.seginframe
     Layout.seginframe2
     Layout.seginline
+    Layout.segindex
+    Layout._segcells
+    Layout._segindex_add
+    Layout._segindex_del
     Layout.segpt
     Layout.seguv
     Layout.show
@@ -202,8 +222,13 @@ from pathos.multiprocessing import cpu_count
 
 
 # from multiprocessing import Pool
+import multiprocessing as mp
 from functools import partial
 
+# shared state of Layout.buildGv and Layout.buildGi workers
+# (see _buildGv_func and _buildGi_func)
+_L_run = None
+
 def _pickle_method(method):
 	func_name = method.im_func.__name__
 	obj = method.im_self
@@ -242,6 +267,7 @@ from pylayers.util import cone
 
 import pylayers.gis.furniture as fur
 import pylayers.gis.osmparser as osm
+import pylayers.gis.layoutcore as lco
 from pylayers.gis.selectl import SelectL
 import pylayers.util.graphutil as gph
 import pylayers.util.easygui as eag
@@ -450,6 +476,8 @@ class Layout(pro.PyLayers):
         self.filefur = _filefur
 
         self.hasboundary = False
+        # geometry version (see _geomchanged)
+        self._geomv = 0
         self.coordinates = 'cart'
         self.version = '1.1'
         self.typ = typ
@@ -599,11 +627,16 @@ class Layout(pro.PyLayers):
                         # If they are different a rebuild is needeed
                         # Otherwise all the stored graphs are loaded
                         #
-                        self.dumpr('t')
-                        # If node 0 exists : the layout has been built
+                        # (dumpr raises if the cache is out of date)
+                        try:
+                            self.dumpr('t')
+                            # If node 0 exists : the layout has been built
+                            bsame = (self._hash == self.Gt.node[0]['hash'])
+                        except:
+                            bsame = False
 
                         # If .ini file has changed rebuild
-                        if self._hash == self.Gt.node[0]['hash']:
+                        if bsame:
                             self.dumpr('stvirw')
                             self.isbuilt = True
                             bbuild = False
@@ -730,6 +763,7 @@ class Layout(pro.PyLayers):
             Ls.Np = Ls.Np + other.Np
             Ls.Ns = Ls.Ns + other.Ns
             Ls.Nss = Ls.Nss + other.Nss
+        Ls._geomchanged()
 
         return(Ls)
 
@@ -764,6 +798,7 @@ class Layout(pro.PyLayers):
 
         xy = np.vstack((x, y)).T
         Ls.Gs.pos = dict(zip(Gs.pos.keys(), tuple(xy)))
+        Ls._geomchanged()
 
         #
         # scaling z
@@ -931,6 +966,7 @@ class Layout(pro.PyLayers):
         dseg.update(dpt)
         self.Gs.adj = dseg
         self.Gs.edge = dseg
+        self._geomchanged()
 
     def check(self, level=0):
         """ Check Layout consistency
@@ -1454,6 +1490,10 @@ class Layout(pro.PyLayers):
         # self.maxheight=3.
         # calculate extremum of segments
         self.extrseg()
+        # segments changed without add_segment/del_segment
+        if (hasattr(self, '_sgrid') and
+            (len(self._sgridseg) != len(useg))):
+            del self._sgrid
 
     def importshp(self, **kwargs):
         """ import layout from shape file
@@ -1545,6 +1585,7 @@ class Layout(pro.PyLayers):
                     pos[k, 0] - Dx, pos[k, 1] - Dy, inverse=True)
 
             self.coordinates = 'latlon'
+        self._geomchanged()
 
     def importres(self,_fileres,**kwargs):
         """ import res format 
@@ -1633,6 +1674,7 @@ class Layout(pro.PyLayers):
             # last segment    
             #ns = self.add_segment(previous_node_index, starting_node_index, name='WALL', z=z1)
         #pdb.set_trace()
+        self._geomchanged()
 
     def importosm(self, **kwargs):
         """ import layout from osm file or osmapi
@@ -1665,6 +1707,7 @@ class Layout(pro.PyLayers):
         --------
 
         pylayers.gis.osmparser.osmparse
+        pylayers.gis.osmparser.buildtiles (large files)
 
         """
         defaults = {'_fileosm': '',
@@ -1720,10 +1763,108 @@ class Layout(pro.PyLayers):
         
         # 2 valid typ : 'indoor' and 'building'
 
-        _np = 0  # _ to avoid name conflict with numpy alias
-        _ns = 0
-        ns = 0
         nss = 0
+        _np = self._importways(coords.xy,
+                               [(ways.way[k].refs, ways.way[k].tags)
+                                for k in ways.way])
+
+        self.Np = _np
+        #self.Ns = _ns
+        self.Nss = nss
+        #
+        #
+        lon = array([self.Gs.pos[k][0] for k in self.Gs.pos])
+        lat = array([self.Gs.pos[k][1] for k in self.Gs.pos])
+        # bd = [lon.min(), lat.min(), lon.max(), lat.max()]
+        # lon_0 = (bd[0] + bd[2]) / 2.
+        # lat_0 = (bd[1] + bd[3]) / 2.
+
+        # pdb.set_trace()
+        # self.m = Basemap(llcrnrlon=bd[0], llcrnrlat=bd[1],
+        #                  urcrnrlon=bd[2], urcrnrlat=bd[3],
+        #                  resolution='i', projection='cass', lon_0=lon_0, lat_0=lat_0)
+        
+
+        self.m = m
+        if ((kwargs['cart']) and (self.coordinates!='cart')):
+             x, y = self.m(lon, lat)
+             self.Gs.pos = {k: (x[i], y[i]) for i, k in enumerate(self.Gs.pos)}
+             self.coordinates = 'cart'
+             self._geomchanged()
+
+        # del coords
+        # del nodes
+        # del ways
+        # del relations
+
+        #
+        # get slab and materials DataBase
+        #
+        # 1) create material database
+        # 2) load materials database
+        # 3) create slabs database
+        # 4) add materials database to slab database
+        # 5) load slabs database
+
+        mat = sb.MatDB()
+        mat.load(self.filematini)
+        self.sl = sb.SlabDB()
+        self.sl.mat = mat
+        self.sl.load(self.fileslabini)
+
+        #
+        # update self.name with existing slabs database entries
+        #
+        for k in self.sl.keys():
+            if k not in self.name:
+                self.name[k] = []
+
+        # convert graph Gs to numpy arrays for speed up post processing
+        self.g2npy()
+
+        #
+        # add boundary
+        #
+
+        self.boundary()
+
+        # save ini file
+        self.save()
+
+        #
+
+    def _importways(self, dxy, lway):
+        """ add osm points and ways to Gs
+
+        Parameters
+        ----------
+
+        dxy : dict
+            {point number (<0) : array([x,y])}
+        lway : list of tuple
+            [(refs,tags)] refs is the sequence of point numbers of a way
+            and tags its dictionnary of osm tags
+
+        Returns
+        -------
+
+        _np : int
+            number of added points
+
+        Notes
+        -----
+
+        Duplicated points (same coordinates) are merged. self.zfloor and
+        self.zceil are updated from the segments heights.
+
+        See Also
+        --------
+
+        importosm
+        pylayers.gis.osmparser.osmtiles
+
+        """
+        _np = 0  # _ to avoid name conflict with numpy alias
 
         # Reading points  (<0 index)
 
@@ -1731,10 +1872,10 @@ class Layout(pro.PyLayers):
         # duplicate nodes
         # duplicate nodes are saved in dict dup
 
-        kp = [k for k in coords.xy]
+        kp = [k for k in dxy]
 
-        x = np.array(map(lambda x: coords.xy[x][0], kp))
-        y = np.array(map(lambda x: coords.xy[x][1], kp))
+        x = np.array(map(lambda x: dxy[x][0], kp))
+        y = np.array(map(lambda x: dxy[x][1], kp))
         ux = np.argsort(x)
         x_prev = -100
         y_prev = -100
@@ -1755,18 +1896,18 @@ class Layout(pro.PyLayers):
                 u_prev = u
                 k_prev = kp[u]
 
-        for npt in coords.xy:
+        for npt in dxy:
             # if node is not duplicated add node
             if npt not in dup:
                 self.Gs.add_node(npt)
-                self.Gs.pos[npt] = tuple(coords.xy[npt])
+                self.Gs.pos[npt] = tuple(dxy[npt])
                 _np += 1
+        self._geomchanged()
 
         # Reading segments
         #
         # ways of osm
-        for k, nseg in enumerate(ways.way):
-            tahe = ways.way[nseg].refs
+        for tahe, d in lway:
             for l in range(len(tahe) - 1):
                 nta = tahe[l]
                 nhe = tahe[l + 1]
@@ -1778,8 +1919,6 @@ class Layout(pro.PyLayers):
                 if nhe in dup:
                     nhe = dup[nhe]
 
-                d = ways.way[nseg].tags
-
                 #
                 # Convert string to integer if possible
                 #
@@ -1818,80 +1957,11 @@ class Layout(pro.PyLayers):
                 else:
                     offset = 0
                 #
-                # get the common neighbor of nta and nhe if it exists
-                #
-                u1 = np.array(nx.neighbors(self.Gs, nta))
-                u2 = np.array(nx.neighbors(self.Gs, nhe))
-                inter_u1_u2 = np.intersect1d(u1, u2)
-                #
                 # Create  a new segment (iso segments are managed in add_segment)
                 #
                 ns = self.add_segment(nta, nhe, name=slab, z=z, offset=offset)
 
-        self.Np = _np
-        #self.Ns = _ns
-        self.Nss = nss
-        #
-        #
-        lon = array([self.Gs.pos[k][0] for k in self.Gs.pos])
-        lat = array([self.Gs.pos[k][1] for k in self.Gs.pos])
-        # bd = [lon.min(), lat.min(), lon.max(), lat.max()]
-        # lon_0 = (bd[0] + bd[2]) / 2.
-        # lat_0 = (bd[1] + bd[3]) / 2.
-
-        # pdb.set_trace()
-        # self.m = Basemap(llcrnrlon=bd[0], llcrnrlat=bd[1],
-        #                  urcrnrlon=bd[2], urcrnrlat=bd[3],
-        #                  resolution='i', projection='cass', lon_0=lon_0, lat_0=lat_0)
-        
-
-        self.m = m
-        if ((kwargs['cart']) and (self.coordinates!='cart')):
-             x, y = self.m(lon, lat)
-             self.Gs.pos = {k: (x[i], y[i]) for i, k in enumerate(self.Gs.pos)}
-             self.coordinates = 'cart'
-
-        # del coords
-        # del nodes
-        # del ways
-        # del relations
-
-        #
-        # get slab and materials DataBase
-        #
-        # 1) create material database
-        # 2) load materials database
-        # 3) create slabs database
-        # 4) add materials database to slab database
-        # 5) load slabs database
-
-        mat = sb.MatDB()
-        mat.load(self.filematini)
-        self.sl = sb.SlabDB()
-        self.sl.mat = mat
-        self.sl.load(self.fileslabini)
-
-        #
-        # update self.name with existing slabs database entries
-        #
-        for k in self.sl.keys():
-            if k not in self.name:
-                self.name[k] = []
-
-        # convert graph Gs to numpy arrays for speed up post processing
-        pdb.set_trace()
-        self.g2npy()
-
-        #
-        # add boundary
-        #
-
-        self.boundary()
-
-        # save ini file
-        self.save()
-
-        #
+        return _np
 
     def exportosm(self):
         """  export layout in osm file format
@@ -2498,6 +2568,7 @@ class Layout(pro.PyLayers):
             self.save()
 
         # convert graph Gs to numpy arrays for faster post processing
+        self._geomchanged()
         self.g2npy()
         #
         self._hash = hashlib.md5(open(filelay, 'rb').read()).hexdigest()
@@ -2665,6 +2736,7 @@ class Layout(pro.PyLayers):
             num = -1
         self.Gs.add_node(num)
         self.Gs.pos[num] = p
+        self._geomchanged([num])
         self.Np = self.Np + 1
         # update labels
         self.labels[num] = str(num)
@@ -2895,6 +2967,10 @@ class Layout(pro.PyLayers):
         # update shseg
         self._shseg.update({num:sh.LineString((self.Gs.pos[n1],self.Gs.pos[n2]))})
 
+        # update segment grid
+        if hasattr(self, '_sgrid'):
+            self._segindex_add(num, p1, p2)
+
         return(num)
 
     def wedge2(self, apnt):
@@ -3197,6 +3273,9 @@ class Layout(pro.PyLayers):
 
             except:
                 pass
+            # update segment grid
+            if hasattr(self, '_sgrid'):
+                self._segindex_del(e)
         if g2npy:
             self.g2npy()
 
@@ -3338,6 +3417,8 @@ class Layout(pro.PyLayers):
             pt = self.Gs.pos[k]
             self.Gs.pos[k] = (pt[0] + vec[0], pt[1] + vec[1])
 
+        self._geomchanged()
+
     def rotate(self, angle=90):
         """ rotate the layout
 
@@ -3357,6 +3438,8 @@ class Layout(pro.PyLayers):
                 array([[np.cos(a), -np.sin(a)], [np.sin(a), np.cos(a)]]), array(pt))
             self.Gs.pos[k] = (ptr[0], ptr[1])
 
+        self._geomchanged()
+
         self.g2npy()
 
     def check2(self):
@@ -3507,6 +3590,7 @@ class Layout(pro.PyLayers):
         data = eag.multenterbox(message, title, (('x', 'y')),
                             ((str(pt[0]), str(pt[1]))))
         self.Gs.pos[np] = tuple(eval(data[0]), eval(data[1]))
+        self._geomchanged([np])
 
     def chgmss(self, ns, ss_name=[], ss_z=[], ss_offset=[], g2npy=True):
         """ change multi subsegments properties
@@ -4097,7 +4181,7 @@ class Layout(pro.PyLayers):
         #
         #
         
-        seglist  = np.unique(self.seginframe2(p1[0:2], p2[0:2]))
+        seglist  = np.unique(self.seginframe2(p1[0:2], p2[0:2], line=True))
     
 
         upos = np.nonzero(seglist >= 0)[0]
@@ -4168,14 +4252,16 @@ class Layout(pro.PyLayers):
         data = np.zeros(Nseg, dtype=[
                         ('i', 'i8'), ('s', 'i8'), ('a', np.float32)])
 
+        # ubo[1] is an index in the screens of seglist[upos]
+        iseg = seglist[upos][ubo[1]]
         data['i']=ubo[0]
-        data['s']=self.tsg[ubo[1]]
+        data['s']=self.tsg[iseg]
         
         #
         # Calculate angle of incidence refered from segment normal
         #
 
-        norm = self.normal[:, ubo[1]]
+        norm = self.normal[:, iseg]
         # vector along the link
         uu = un[:, ubo[0]]
         unn = abs(np.sum(uu * norm, axis=0))
@@ -4240,7 +4326,7 @@ class Layout(pro.PyLayers):
         # 2 x N
         un = u / nu[np.newaxis, :]
 
-        seglist = self.seginframe2(p1, p2)
+        seglist = self.seginframe2(p1, p2, line=True)
         upos = np.nonzero(seglist >= 0)[0]
         uneg = np.nonzero(seglist < 0)[0]
 
@@ -4610,7 +4696,191 @@ class Layout(pro.PyLayers):
         self.min_sy = np.array(
             map(lambda x: min(pt[1, x[0]], pt[1, x[1]]), th))
 
-    def seginframe2(self, p1, p2):
+    def _geomchanged(self, lpt=None):
+        """ declare a change of the points coordinates
+
+        Parameters
+        ----------
+
+        lpt : list or None
+            points (Gs numbers) which have been moved or added,
+            None if not known
+
+        Notes
+        -----
+
+        To be called whenever Gs.pos is modified outside of add_segment and
+        del_segment (point moved or added, layout loaded). The geometry
+        version self._geomv is incremented and the point location index
+        built on a previous version is rebuilt on its next use.
+
+        If the moved points are given, the segments connected to them are
+        moved in the segment grid (_segindex_del/_segindex_add) and the
+        grid stays valid. Otherwise the grid is rebuilt on its next use.
+
+        """
+        v = getattr(self, '_geomv', 0)
+        self._geomv = v + 1
+        if not hasattr(self, '_sgrid'):
+            return
+        if (lpt is None) or (self._sgridv != v):
+            del self._sgrid
+            return
+        for npt in lpt:
+            for num in self.Gs[npt].keys():
+                if num in self._sgridseg:
+                    n1, n2 = self.Gs.node[num]['connect']
+                    self._segindex_del(num)
+                    self._segindex_add(num,
+                                       np.array(self.Gs.pos[n1]),
+                                       np.array(self.Gs.pos[n2]))
+        self._sgridv = self._geomv
+
+    def segindex(self, cell=0):
+        """ build the uniform grid index of segments
+
+        Parameters
+        ----------
+
+        cell : float
+            size of a grid cell (meters)
+            if 0 the size is chosen from the layout area and the number of
+            segments
+
+        Notes
+        -----
+
+        update the following members
+
+            `_sgrid`    : dict (ix,iy) -> list of segment numbers (Gs)
+            `_sgridseg` : dict segment number -> list of cells (ix,iy)
+            `_sgridp`   : (x0,y0,cell) grid origin and cell size
+            `_sgridv`   : geometry version of the grid (see _geomchanged)
+
+        The grid stores Gs segment numbers, it is therefore independent of
+        the numpy numbering of g2npy. It is kept up to date by add_segment,
+        del_segment and _geomchanged when the moved points are given, it
+        is rebuilt otherwise. It is used by
+        seginframe2 to restrict the bounding box tests to the segments of
+        the cells crossed by the query.
+
+        See Also
+        --------
+
+        pylayers.gis.layout.Layout.seginframe2
+
+        """
+
+        lseg = [n for n in self.Gs.node if n > 0]
+
+        if cell <= 0:
+            dx = self.ax[1] - self.ax[0]
+            dy = self.ax[3] - self.ax[2]
+            cell = np.sqrt(max(dx * dy, 1.) / max(len(lseg), 1))
+
+        self._sgridp = (self.ax[0], self.ax[2], cell)
+        self._sgridv = getattr(self, '_geomv', 0)
+        self._sgrid = {}
+        self._sgridseg = {}
+
+        for num in lseg:
+            n1, n2 = self.Gs.node[num]['connect']
+            self._segindex_add(num,
+                               np.array(self.Gs.pos[n1]),
+                               np.array(self.Gs.pos[n2]))
+
+    def _segcells(self, pa, pb, line=True):
+        """ cells of the segment grid crossed by segment pa-pb
+
+        Parameters
+        ----------
+
+        pa : np.array (2,)
+        pb : np.array (2,)
+        line : boolean (True)
+            if False all the cells of the bounding box of pa-pb are returned
+
+        Returns
+        -------
+
+        lcell : list of tuple (ix,iy)
+
+        Notes
+        -----
+
+        A cell is kept if it overlaps the segment bounding box and if the
+        supporting line of the segment crosses it (separating axis test).
+
+        """
+        x0, y0, h = self._sgridp
+
+        ix = np.floor((np.r_[pa[0], pb[0]] - x0) / h).astype(int)
+        iy = np.floor((np.r_[pa[1], pb[1]] - y0) / h).astype(int)
+
+        vx = np.arange(min(ix), max(ix) + 1)
+        vy = np.arange(min(iy), max(iy) + 1)
+        # cells of the bounding box
+        gx, gy = np.meshgrid(vx, vy)
+        gx = gx.ravel()
+        gy = gy.ravel()
+
+        v = np.array(pb[0:2]) - np.array(pa[0:2])
+        lv = np.sqrt(np.dot(v, v))
+        if line and (lv > 0) and (len(gx) > 1):
+            # unit normal to the segment
+            n = np.array([-v[1], v[0]]) / lv
+            # cell centers
+            cx = x0 + (gx + 0.5) * h
+            cy = y0 + (gy + 0.5) * h
+            d = abs(n[0] * (cx - pa[0]) + n[1] * (cy - pa[1]))
+            r = 0.5 * h * (abs(n[0]) + abs(n[1]))
+            u = d <= r * (1 + 1e-9)
+            gx = gx[u]
+            gy = gy[u]
+
+        return(zip(gx, gy))
+
+    def _segindex_add(self, num, pa, pb):
+        """ add segment num to the segment grid
+
+        Parameters
+        ----------
+
+        num : int
+            segment number
+        pa : np.array (2,)
+            tail coordinates
+        pb : np.array (2,)
+            head coordinates
+
+        """
+        # a segment is stored in all the cells of its bounding box
+        lcell = self._segcells(pa, pb, line=False)
+        for c in lcell:
+            try:
+                self._sgrid[c].append(num)
+            except:
+                self._sgrid[c] = [num]
+        self._sgridseg[num] = lcell
+
+    def _segindex_del(self, num):
+        """ remove segment num from the segment grid
+
+        Parameters
+        ----------
+
+        num : int
+            segment number
+
+        """
+        lcell = self._sgridseg.pop(num, [])
+        for c in lcell:
+            lseg = self._sgrid[c]
+            lseg.remove(num)
+            if len(lseg) == 0:
+                del self._sgrid[c]
+
+    def seginframe2(self, p1, p2, line=False):
         """ returns the seg list of a given zone defined by two points
 
             Parameters
@@ -4620,6 +4890,10 @@ class Layout(pro.PyLayers):
                 array of N 2D points
             p2 array (2 x N)
                 array of N 2D points 
+            line : boolean (False)
+                if True, only the segments of the grid cells crossed by the
+                line p1-p2 are kept. This is a superset of the segments
+                intersecting p1-p2.
 
             Returns
             -------
@@ -4627,6 +4901,12 @@ class Layout(pro.PyLayers):
             seglist
                 list of segment number inside a planar region defined by p1 an p2
 
+            Notes
+            -----
+
+            The candidate segments are taken from the segment grid
+            (see segindex) before the bounding box tests.
+
 
             Examples
             --------
@@ -4671,11 +4951,48 @@ class Layout(pro.PyLayers):
         max_y = map(lambda x: max(x[1], x[0]), zip(p1[1, :], p2[1, :]))
         min_y = map(lambda x: min(x[1], x[0]), zip(p1[1, :], p2[1, :]))
 
-        seglist = map(lambda x: np.nonzero((self.max_sx > x[0]) &
-                                           (self.min_sx < x[1]) &
-                                           (self.max_sy > x[2]) &
-                                           (self.min_sy < x[3]))[0],
-                      zip(min_x, max_x, min_y, max_y))
+        if ((not hasattr(self, '_sgrid')) or
+            (self._sgridv != getattr(self, '_geomv', 0))):
+            self.segindex()
+
+        x0, y0, h = self._sgridp
+        try:
+            Nt = len(self.tgs)
+        except:
+            Nt = 0
+
+        seglist = []
+        for k in range(len(max_x)):
+            #
+            # candidate segments (Gs numbering) from the grid cells
+            #
+            if line:
+                lcell = self._segcells(p1[:, k], p2[:, k])
+            else:
+                ix0 = int(np.floor((min_x[k] - x0) / h))
+                ix1 = int(np.floor((max_x[k] - x0) / h))
+                iy0 = int(np.floor((min_y[k] - y0) / h))
+                iy1 = int(np.floor((max_y[k] - y0) / h))
+                if (ix1 - ix0 + 1) * (iy1 - iy0 + 1) > len(self._sgrid):
+                    lcell = [c for c in self._sgrid
+                             if (ix0 <= c[0] <= ix1) and (iy0 <= c[1] <= iy1)]
+                else:
+                    lcell = [(i, j) for i in range(ix0, ix1 + 1)
+                                    for j in range(iy0, iy1 + 1)]
+            lcand = [self._sgrid[c] for c in lcell if c in self._sgrid]
+            if len(lcand) > 0:
+                cand = np.unique(np.hstack(lcand)).astype(int)
+                # segments not yet converted by g2npy are ignored
+                cand = cand[cand < Nt]
+                cand = self.tgs[cand]
+                cand = cand[cand >= 0]
+            else:
+                cand = np.array([], dtype=int)
+            u = np.nonzero((self.max_sx[cand] > min_x[k]) &
+                           (self.min_sx[cand] < max_x[k]) &
+                           (self.max_sy[cand] > min_y[k]) &
+                           (self.min_sy[cand] < max_y[k]))[0]
+            seglist.append(np.sort(cand[u]))
 
         # np.array stacking
         # -1 acts as a deliminiter (not as a segment number)
@@ -5655,7 +5972,8 @@ class Layout(pro.PyLayers):
 
         return fig, ax
 
-    def build(self, graph='tvirw',verbose=False,difftol=0.15,multi=False):
+    def build(self, graph='tvirw',verbose=False,difftol=0.15,multi=False,
+              incremental=False,nproc=0):
         """ build graphs
 
         Parameters
@@ -5671,12 +5989,26 @@ class Layout(pro.PyLayers):
         difftol : diffraction tolerance
         multi : boolean 
             enable multi processing
+        incremental : boolean
+            only the cycles, visibility and interaction edges affected by
+            the segments changed since the previous build are evaluated
+        nproc : int
+            number of processes if multi (0 : all the cores)
         
         Notes
         -----
 
         This function build all the graph associated with the Layout. 
 
+        Gt is always rebuilt. In incremental mode, the cycles of Gt whose
+        fingerprint (see _cysig) is unchanged reuse their visibility
+        graph and their interaction edges, and the edges of Gi whose
+        nodes and successors are unchanged reuse their output.
+
+        'r' and 'w' are accepted but Gr and Gw are not built here, they
+        are derived from Gt by buildGr and buildGw (full evaluation, at
+        the cost of a pass over the edges of Gt) when they are needed.
+
         Warning : by default the layout is saved (dumpw) after each build
 
         """
@@ -5684,9 +6016,26 @@ class Layout(pro.PyLayers):
         if not self.hasboundary:
             self.boundary()
 
+        # build parameter entering the content hash (geomhash)
+        self._difftol = difftol
+
+        # point location index (see _locindex)
+        self._loc = {}
+
         # to save graoh Gs
         self.lbltg.extend('s')
 
+        # segment grid index
+        self.segindex()
+
+        # Gs nodes changed since the previous build
+        gssig = self._gssig()
+        if incremental and hasattr(self,'_gssigold'):
+            self._gschanged = set([ n for n in gssig
+                                   if self._gssigold.get(n) != gssig[n] ])
+        else:
+            self._gschanged = set(gssig.keys())
+
         Buildpbar = pbar(verbose,total=5,desc='Build Layout',position=0)
 
         if verbose:
@@ -5697,16 +6046,20 @@ class Layout(pro.PyLayers):
         if verbose:
             Buildpbar.update(1)
         if 'v' in graph:
-            self.buildGv(verbose=verbose,tqdmpos=1)
+            self.buildGv(verbose=verbose,tqdmpos=1,parallel=multi,
+                         nproc=nproc,incremental=incremental)
             self.lbltg.extend('v')
         if verbose:
             Buildpbar.update(1)
         if 'i' in graph:
-            self.buildGi(verbose=verbose,tqdmpos=1)
-            if not multi:
-                self.outputGi(verbose=verbose,tqdmpos=1)
+            self.buildGi(verbose=verbose,tqdmpos=1,parallel=multi,
+                         nproc=nproc,incremental=incremental)
+            if (not multi) or incremental:
+                self.outputGi(verbose=verbose,tqdmpos=1,
+                              incremental=incremental)
             else:
                 self.outputGi_mp()
+            self._Giold = None
             self.lbltg.extend('i')
         if verbose:
             Buildpbar.update(1)
@@ -5726,17 +6079,110 @@ class Layout(pro.PyLayers):
         _hash = hashlib.md5(open(filelay, 'rb').read()).hexdigest()
         self.Gt.add_node(0, hash=_hash)
 
+        self._gssigold = gssig
+
+        # content hash of the built layout (see geomhash)
+        self._geomhash = self.geomhash()
+
         # There is a dumpw after each build
         self.dumpw()
         self.isbuilt = True
         if verbose:
             Buildpbar.update(1)
 
-    def dumpw(self):
-        """ write a dump of given Graph
-
-        Notes
-        -----
+    def geomhash(self):
+        """ content hash of the layout geometry and of its slabs
+
+        Returns
+        -------
+
+        hexdigest : string
+            md5 hexdigest
+
+        Notes
+        -----
+
+        Unlike self._hash, which is the md5 of the layout file, this hash only
+        depends on the content : points coordinates, segments connectivity,
+        heights, slab names and subsegments, and the definition (materials
+        and thicknesses) of the slabs in use, together with the layout type
+        (indoor/outdoor) and the diffraction tolerance of the last build. It
+        is independent of the file name and of the ordering of the graph
+        dictionnaries.
+
+        The hash of the layout as it was last built or loaded is kept in
+        self._geomhash (see build and dumpr).
+
+        See Also
+        --------
+
+        pylayers.antprop.signature.SigStore
+
+        """
+        m = hashlib.md5()
+        lpnt = sorted([n for n in self.Gs.node if n < 0])
+        lseg = sorted([n for n in self.Gs.node if n > 0])
+        for n in lpnt:
+            m.update(repr((n, tuple(np.round(self.Gs.pos[n], 6)))).encode('utf-8'))
+        lslab = set([])
+        for s in lseg:
+            d = self.Gs.node[s]
+            lslab.add(d.get('name', ''))
+            lslab.update(d.get('ss_name', []))
+            m.update(repr((s, tuple(sorted(self.Gs.edge[s].keys())),
+                           d.get('name', ''),
+                           tuple(np.round(d.get('z', ()), 6)),
+                           d.get('offset', 0),
+                           d.get('ss_name', []),
+                           d.get('ss_z', []))).encode('utf-8'))
+        for name in sorted(lslab):
+            if name in self.sl:
+                sl = self.sl[name]
+                m.update(repr((name, sl['lmatname'], sl['lthick'])).encode('utf-8'))
+                for mat in sl['lmatname']:
+                    if mat in self.sl.mat:
+                        dmat = self.sl.mat[mat]
+                        m.update(repr(sorted([(k, str(dmat[k])) for k in dmat])).encode('utf-8'))
+        m.update(repr((self.typ, getattr(self, '_difftol', None))).encode('utf-8'))
+        return m.hexdigest()
+
+    def _gssig(self):
+        """ geometric fingerprints of the nodes of Gs
+
+        Returns
+        -------
+
+        dsig : dict
+            point number -> coordinates
+            segment number -> coordinates of its termination points
+
+        Notes
+        -----
+
+        Used by build in incremental mode to find the nodes of Gs which
+        have changed since the previous build (see outputGi)
+
+        """
+        dsig = {}
+        for n in self.Gs.node:
+            if n < 0:
+                dsig[n] = tuple(self.Gs.pos[n])
+            elif n > 0:
+                dsig[n] = tuple([tuple(self.Gs.pos[x])
+                                 for x in self.Gs.node[n]['connect']])
+        return(dsig)
+
+    def dumpw(self, gpickle=False):
+        """ write a dump of given Graph
+
+        Parameters
+        ----------
+
+        gpickle : boolean
+            also write the graphs in the former gpickle files
+
+        Notes
+        -----
 
         't' : Gt
         'r' : Gr
@@ -5744,6 +6190,9 @@ class Layout(pro.PyLayers):
         'v' : Gv
         'i' : Gi
 
+        The graphs and the arrays of g2npy are written in the binary
+        cache layout.bin (see _writecache)
+
         """
         # create layout directory
         if os.path.splitext(self._filename)[1]=='.ini':
@@ -5754,6 +6203,11 @@ class Layout(pro.PyLayers):
 
         if not os.path.isdir(path):
             os.mkdir(path)
+
+        self._writecache(os.path.join(path, 'layout.bin'))
+        if not gpickle:
+            return
+
         for g in self.lbltg:
             try:
                 # if g in ['v','i']:
@@ -5780,6 +6234,310 @@ class Layout(pro.PyLayers):
         # write_gpickle(getattr(self,'sla'),os.path.join(path,'sla.gpickle'))
         if hasattr(self, 'm'):
             write_gpickle(getattr(self, 'm'), os.path.join(path, 'm.gpickle'))
+        if hasattr(self, 'Gicsr'):
+            dcsr = dict(self.Gicsr)
+            # geometry the CSR form has been built from (see _setGicsr)
+            if hasattr(self, '_geomhash'):
+                dcsr['geomhash'] = np.array(self._geomhash)
+            np.savez(os.path.join(path, 'Gicsr.npz'), **dcsr)
+
+    def exportcore(self, filename=''):
+        """ export the numerical core of the layout in a memory mappable file
+
+        Parameters
+        ----------
+
+        filename : string
+            full path of the core file
+            if '' : core.bin in the gpickle directory of the layout
+
+        Returns
+        -------
+
+        filename : string
+
+        Examples
+        --------
+
+        >>> from pylayers.gis.layout import *
+        >>> from pylayers.gis.layoutcore import LayoutCore
+        >>> L = Layout('defstr.ini')
+        >>> L.build()
+        >>> filecore = L.exportcore()
+        >>> C = LayoutCore(filecore)
+
+        Notes
+        -----
+
+        The core gathers pt, tahe, tsg, tgs, the segment normals, heights
+        and slab indices, the exterior polygons of the cycles and the CSR
+        form of Gi (self.Gicsr) in a single binary file. A process which
+        does not hold the Layout (a separate interpreter, another program)
+        attaches to this file with pylayers.gis.layoutcore.LayoutCore, which
+        memory maps it : nothing is unpickled and all the readers share the
+        same physical pages. The forked process pools of pylayers (build,
+        Signatures, Rays) inherit the Layout and do not read this file.
+
+        See Also
+        --------
+
+        pylayers.gis.layoutcore.LayoutCore
+
+        """
+        if filename == '':
+            if os.path.splitext(self._filename)[1]=='.ini':
+                dirname = self._filename.replace('.ini','')
+            if os.path.splitext(self._filename)[1]=='.lay':
+                dirname = self._filename.replace('.lay','')
+            path = os.path.join(pro.basename, 'struc', 'gpickle', dirname)
+            if not os.path.isdir(path):
+                os.mkdir(path)
+            filename = os.path.join(path, 'core.bin')
+
+        darray = {}
+        darray['pt'] = self.pt
+        darray['tahe'] = self.tahe
+        darray['tsg'] = self.tsg
+        darray['tgs'] = getattr(self, 'tgs', np.array([], dtype=int))
+        darray['normal'] = getattr(self, 'normal', np.zeros((3, 0)))
+
+        # segment heights and slabs
+        lslab = sorted(set([self.Gs.node[x]['name'] for x in self.tsg]))
+        dslab = {name: k for k, name in enumerate(lslab)}
+        darray['z'] = np.array([self.Gs.node[x]['z'] for x in self.tsg],
+                               dtype=float).reshape(-1, 2).T
+        darray['slab'] = np.array([dslab[self.Gs.node[x]['name']]
+                                   for x in self.tsg], dtype=np.int32)
+
+        # cycles polygons
+        lcy = [cy for cy in self.Gt.node if 'polyg' in self.Gt.node[cy]]
+        lcy = sorted(lcy)
+        lpoly = [np.array(self.Gt.node[cy]['polyg'].exterior.coords)[:, 0:2].T
+                 for cy in lcy]
+        darray['cynum'] = np.array(lcy, dtype=int)
+        darray['cyoff'] = np.hstack(([0], np.cumsum([p.shape[1] for p in lpoly]))).astype(int)
+        if len(lpoly) > 0:
+            darray['cypt'] = np.hstack(lpoly)
+        else:
+            darray['cypt'] = np.zeros((2, 0))
+        darray['cyindoor'] = np.array([self.Gt.node[cy].get('indoor', False)
+                                       for cy in lcy], dtype=bool)
+
+        # CSR form of Gi
+        if hasattr(self, 'Gi') and not hasattr(self, 'Gicsr'):
+            self.buildGicsr()
+        if hasattr(self, 'Gicsr'):
+            for k in self.Gicsr:
+                darray['Gi_' + k] = self.Gicsr[k]
+
+        info = {'hash': self.geomhash(),
+                'slabnames': lslab,
+                'filename': self._filename}
+        lco.writecore(filename, darray, info)
+        return(filename)
+
+    def _writecache(self, filename):
+        """ write the binary cache of the layout
+
+        Parameters
+        ----------
+
+        filename : string
+            full path of the cache file
+
+        Notes
+        -----
+
+        The cache is a layoutcore file (see pylayers.gis.layoutcore)
+        containing
+
+            the graphs of self.lbltg converted in arrays
+            the arrays of g2npy (prefix 'np.')
+            Gicsr (prefix 'Gi_csr.')
+            ddiff, lnss, dca, m and the scalars of g2npy (pickled 'extra')
+
+        The header holds the md5 of the layout file (Gt node 0 hash),
+        compared with self._hash at loading.
+
+        """
+        darray = {}
+        dmeta = {}
+        for g in set(self.lbltg):
+            if hasattr(self, 'G' + g):
+                dmeta[g] = lco.graph2arrays(getattr(self, 'G' + g),
+                                            'G' + g + '.', darray)
+
+        #
+        # g2npy
+        #
+        extra = {}
+        for k in ['pt', 'tahe', 'tsg', 'tgs', 'normal', 'upnt',
+                  'max_sx', 'min_sx', 'max_sy', 'min_sy']:
+            if hasattr(self, k):
+                darray['np.' + k] = np.asarray(getattr(self, k))
+        for k in ['s2pu', 's2pc', 'sgsg']:
+            if hasattr(self, k):
+                M = getattr(self, k).tocsr()
+                darray['np.' + k + '.data'] = M.data
+                darray['np.' + k + '.indices'] = M.indices
+                darray['np.' + k + '.indptr'] = M.indptr
+                extra[k] = M.shape
+        for k in ['Np', 'Ns', 'pg', 'lsss', 'degree', 'maxheight']:
+            if hasattr(self, k):
+                extra[k] = getattr(self, k)
+
+        for k in ['ddiff', 'lnss', 'dca', 'm', '_difftol']:
+            if hasattr(self, k):
+                extra[k] = getattr(self, k)
+        darray['extra'] = lco.obj2array(extra)
+
+        if hasattr(self, 'Gicsr'):
+            for k in self.Gicsr:
+                darray['Gi_csr.' + k] = self.Gicsr[k]
+
+        try:
+            _hash = self.Gt.node[0]['hash']
+        except:
+            _hash = ''
+        info = {'format': 'layout',
+                'hash': _hash,
+                'filename': self._filename,
+                'graphs': dmeta}
+        lco.writecore(filename, darray, info)
+
+    def _readcache(self, filename, graphs='stvirw'):
+        """ read the binary cache of the layout
+
+        Parameters
+        ----------
+
+        filename : string
+            full path of the cache file
+        graphs : string
+            graphs to be read
+
+        Returns
+        -------
+
+        boolean : False if the cache is missing, not readable or written
+            from another version of the layout file (md5 of the file
+            different from self._hash), the layout is then left unchanged
+
+        See Also
+        --------
+
+        pylayers.gis.layout.Layout._writecache
+
+        """
+        if not os.path.isfile(filename):
+            return False
+        try:
+            header, darray = lco.readcore(filename)
+        except:
+            return False
+        if header.get('format') != 'layout':
+            return False
+        # the layout file has changed since the cache was written
+        if header['hash'] != getattr(self, '_hash', header['hash']):
+            logging.warning(filename + ' does not match ' + self._filename)
+            return False
+        self._geomchanged()
+
+        extra = lco.array2obj(darray['extra'])
+        dmeta = header['graphs']
+        for g in graphs:
+            if g in dmeta:
+                if dmeta[g].get('directed', False):
+                    G = nx.DiGraph()
+                else:
+                    G = nx.Graph()
+                G = lco.arrays2graph(dmeta[g], 'G' + g + '.', darray, G)
+                setattr(self, 'G' + g, G)
+                self.lbltg.extend(g)
+            else:
+                print("Warning Unable to read graph G"+g)
+
+        if 's' in graphs:
+            lseg = [x for x in self.Gs.node if x > 0]
+            for name in self.name:
+                self.name[name] = [
+                    x for x in lseg if self.Gs.node[x]['name'] == name]
+            if 'np.pt' in darray:
+                # arrays of g2npy
+                for k in ['pt', 'tahe', 'tsg', 'tgs', 'normal', 'upnt',
+                          'max_sx', 'min_sx', 'max_sy', 'min_sy']:
+                    if 'np.' + k in darray:
+                        setattr(self, k, np.array(darray['np.' + k]))
+                for k in ['s2pu', 's2pc', 'sgsg']:
+                    if k in extra:
+                        M = sparse.csr_matrix((np.array(darray['np.' + k + '.data']),
+                                               np.array(darray['np.' + k + '.indices']),
+                                               np.array(darray['np.' + k + '.indptr'])),
+                                              shape=extra[k])
+                        if k == 'sgsg':
+                            M = M.tolil()
+                        setattr(self, k, M)
+                for k in ['Np', 'Ns', 'pg', 'lsss', 'degree', 'maxheight']:
+                    if k in extra:
+                        setattr(self, k, extra[k])
+                for k in ['AIR', '_AIR']:
+                    if k not in self.name:
+                        self.name[k] = []
+            else:
+                self.g2npy()
+            self.ddiff = extra.get('ddiff', {})
+            if hasattr(self, 'diffpt'):
+                del self.diffpt
+            self.lnss = extra.get('lnss', [])
+
+        if 'dca' in extra:
+            self.dca = extra['dca']
+        if 'm' in extra:
+            self.m = extra['m']
+        if '_difftol' in extra:
+            self._difftol = extra['_difftol']
+
+        self._geomhash = self.geomhash()
+
+        # frozen CSR form of Gi
+        if ('i' in graphs) and hasattr(self, 'Gi'):
+            lcsr = [k for k in darray if k.startswith('Gi_csr.')]
+            self._setGicsr({k[7:]: darray[k] for k in lcsr})
+        return True
+
+    def _setGicsr(self, dcsr):
+        """ set the frozen CSR form of Gi from stored arrays
+
+        Parameters
+        ----------
+
+        dcsr : dict
+            arrays of Gicsr (see buildGicsr), with an optional 'geomhash'
+            entry (geometry hash of the build the arrays come from)
+
+        Notes
+        -----
+
+        The arrays are used only if their interactions are the nodes of
+        self.Gi in the same order and, when the geometry hash is stored,
+        if it is the one of the current layout (self._geomhash).
+        Otherwise Gicsr is rebuilt from Gi.
+
+        """
+        lno = self.Gi.nodes()
+        ok = ('typ' in dcsr) and ('inter' in dcsr)
+        if ok and ('geomhash' in dcsr):
+            ok = str(dcsr['geomhash']) == self._geomhash
+        if ok:
+            inter = dcsr['inter'].tolist()
+            typ = dcsr['typ'].tolist()
+            ok = [tuple(n[:t]) for n, t in zip(inter, typ)] == map(tuple, lno)
+        if ok:
+            self.Gicsr = {k: dcsr[k] for k in dcsr if k != 'geomhash'}
+            self.Gicsr_id = {n: k for k, n in enumerate(lno)}
+        else:
+            logging.info('Gicsr out of date, rebuilt from Gi')
+            self.buildGicsr()
 
     def dumpr(self, graphs='stvirw'):
         """ read of given graphs
@@ -5798,12 +6556,28 @@ class Layout(pro.PyLayers):
         .gpickle files are store under the struc directory of the project
         specified by the $BASENAME environment variable
 
+        The binary cache layout.bin (see _writecache) is read first,
+        gpickle files are read only if it is missing. An exception is raised
+        if the cache exists but can not be used (e.g. the layout file has
+        changed since the last build), the layout has then to be rebuilt.
+
         """
         if os.path.splitext(self._filename)[1]=='.ini':
             dirname = self._filename.replace('.ini','')
         if os.path.splitext(self._filename)[1]=='.lay':
             dirname = self._filename.replace('.lay','')
         path = os.path.join(pro.basename, 'struc', 'gpickle', dirname)
+
+        # point location index (see _locindex)
+        self._loc = {}
+
+        filecache = os.path.join(path, 'layout.bin')
+        if self._readcache(filecache, graphs):
+            return
+        if os.path.isfile(filecache):
+            raise NameError('Layout.dumpr : ' + filecache +
+                            ' is out of date, rebuild the layout')
+        self._geomchanged()
         for g in graphs:
             try:
                 # if g in ['v','i']:
@@ -5839,6 +6613,8 @@ class Layout(pro.PyLayers):
                 setattr(self, 'ddiff', ddiff)
             else:
                 self.ddiff={}
+            if hasattr(self, 'diffpt'):
+                del self.diffpt
 
             filelnss = os.path.join(path, 'lnss.gpickle')
             if os.path.isfile(filelnss):
@@ -5856,6 +6632,19 @@ class Layout(pro.PyLayers):
         if os.path.isfile(filem):
             setattr(self, 'm', read_gpickle(filem))
 
+        self._geomhash = self.geomhash()
+
+        # frozen CSR form of Gi (rebuilt if missing or out of date)
+        if ('i' in graphs) and hasattr(self, 'Gi'):
+            filecsr = os.path.join(path, 'Gicsr.npz')
+            if os.path.isfile(filecsr):
+                fcsr = np.load(filecsr)
+                dcsr = {k: fcsr[k] for k in fcsr.files}
+                fcsr.close()
+                self._setGicsr(dcsr)
+            else:
+                self.buildGicsr()
+
     def polysh2geu(self, poly):
         """ transform sh.Polygon into geu.Polygon
         """
@@ -6286,6 +7075,9 @@ class Layout(pro.PyLayers):
         Gtpbar = pbar(verbose,total=100., desc ='BuildGt',position=tqdmpos)
         pbartmp = pbar(verbose,total=100., desc ='Triangulation',leave=True,position=tqdmpos+1)
 
+        # point location index (see _locindex)
+        self._loc = {}
+
         T, map_vertices = self._triangle()
 
         if verbose:
@@ -7558,7 +8350,8 @@ class Layout(pro.PyLayers):
         return polys
 
 
-    def buildGv(self, show=False,verbose=False,tqdmpos=0):
+    def buildGv(self, show=False,verbose=False,tqdmpos=0,
+                parallel=False,nproc=0,incremental=False):
         """ build visibility graph
 
         Parameters
@@ -7568,6 +8361,13 @@ class Layout(pro.PyLayers):
             default False
         verbose : boolean 
         tqdmpos : progressbar
+        parallel : boolean
+            evaluate the cycles in a pool of forked processes
+        nproc : int
+            number of processes (0 : all the cores)
+        incremental : boolean
+            only the cycles whose fingerprint (see _cysig) has changed
+            since the previous buildGv are evaluated
 
         Examples
         --------
@@ -7583,181 +8383,326 @@ class Layout(pro.PyLayers):
 
         This method exploits cycles convexity.
 
+        The visibility graph of each cycle is built by _buildGvcycle and
+        stored in self.dGv. self.Gv is the union of those graphs.
+
         """
         if not hasattr(self,'ddiff'):
             self.ddiff={}
+        self._diffarrays()
         Gvpbar = pbar(verbose,total=100., desc ='build Gv',position=tqdmpos)
 
-        self.Gv = nx.Graph()
+        dsig = self._cysig()
+
         #
-        # loop over convex cycles (nodes of Gt)
+        # cycles to be evaluated
         #
-        self.dGv = {}  # dict of Gv graph
+        if (incremental and hasattr(self,'dGv') and
+            hasattr(self,'_cysigGv')):
+            dGv = { cy : self.dGv[cy] for cy in dsig
+                    if ((self._cysigGv.get(cy) == dsig[cy]) and
+                        (cy in self.dGv)) }
+        else:
+            dGv = {}
+        lcy = [ cy for cy in dsig if cy not in dGv ]
 
-        cpt = 1./(len(self.Gt.node) + 1.)
-        
+        if parallel and (len(lcy) > 1):
+            dGv.update(self._cypool(_buildGv_func,lcy,nproc))
+        else:
+            cpt = 100./(len(lcy) + 1.)
+            for icycle in lcy:
+                if verbose:
+                    Gvpbar.update(cpt)
+                dGv[icycle] = self._buildGvcycle(icycle)
+
+        #
+        # Graph Gv composition
+        #
+        self.Gv = nx.Graph()
+        # loop over convex cycles (nodes of Gt)
         for icycle in self.Gt.node:
-            if verbose:
-                Gvpbar.update(100.*cpt)
-            if icycle != 0:
-                #if self.indoor or not self.Gt.node[icycle]['indoor']:
-                    #print(icycle)
-                #    pass
-                #
-                #  If indoor or outdoor all visibility are calculated
-                #  If outdoor only visibility between iso = 'AIR' and '_AIR' are calculated 
-                # 
-                #if self.indoor or not self.Gt.node[icycle]['indoor']:
-                polyg = self.Gt.node[icycle]['polyg']
+            if icycle in dGv:
+                self.Gv.add_edges_from(dGv[icycle].edges())
 
-                # plt.show(polyg.plot(fig=plt.gcf(),ax=plt.gca())
-                
-                # take a single segment between 2 points 
-                
-                vnodes = polyg.vnodes
+        self.dGv = dGv  # dict of Gv graph
+        self._cysigGv = dsig
 
-                # list of index of points in vodes
-                unodes = np.where(vnodes<0)[0]
-                
-                # list of position of an incomplete list of segments 
-                # used rule : after a point there is always a segment 
-                useg = np.mod(unodes+1,len(vnodes))
-                
-                # list of points 
-                #npt  = filter(lambda x: x < 0, vnodes)
-                npt = [ x for x in vnodes if x <0 ]
-                
-                nseg_full = [x for x in vnodes if x > 0]
-                # nseg : incomplete list of segments
-                #
-                # if mode outdoor and cycle is indoor only 
-                # the part above the building (AIR and _AIR) is considered
-                if ((self.typ=='outdoor') and (self.Gt.node[icycle]['indoor'])):
-                    nseg = [ x for x in nseg_full if ((self.Gs.node[x]['name']=='AIR') or (self.Gs.node[x]['name']=='_AIR') ) ]
-                else:
-                    nseg = vnodes[useg]
+    def _buildGvcycle(self, icycle):
+        """ visibility graph of a single cycle
 
-                
-                # # nseg_full : full list of segments
-                # #nseg_full = filter(lambda x: x > 0, vnodes)
+        Parameters
+        ----------
 
-                # # keep only airwalls without iso single (_AIR)
-                # nseg_single = filter(lambda x: len(self.Gs.node[x]['iso'])==0, nseg)
+        icycle : int
+            cycle number (> 0)
 
-                # lair1 = self.name['AIR'] 
-                # lair2 = self.name['_AIR']
-                # lair  = lair1 + lair2
+        Returns
+        -------
 
-                # # list of airwalls in nseg_single
+        Gv : nx.Graph
 
-                # airwalls = filter(lambda x: x in lair, nseg_single)
+        See Also
+        --------
 
-                # diffraction points 
+        pylayers.gis.layout.Layout.buildGv
 
-                ndiff = [x for x in npt if x in self.ddiff.keys()]
-                #
-                # Create a graph
-                #
+        """
+        #if self.indoor or not self.Gt.node[icycle]['indoor']:
+            #print(icycle)
+        #    pass
+        #
+        #  If indoor or outdoor all visibility are calculated
+        #  If outdoor only visibility between iso = 'AIR' and '_AIR' are calculated 
+        # 
+        #if self.indoor or not self.Gt.node[icycle]['indoor']:
+        polyg = self.Gt.node[icycle]['polyg']
 
-                Gv = nx.Graph()
-                #
-                # in convex case :
+        # plt.show(polyg.plot(fig=plt.gcf(),ax=plt.gca())
+
+        # take a single segment between 2 points 
+
+        vnodes = polyg.vnodes
+
+        # list of index of points in vodes
+        unodes = np.where(vnodes<0)[0]
+
+        # list of position of an incomplete list of segments 
+        # used rule : after a point there is always a segment 
+        useg = np.mod(unodes+1,len(vnodes))
+
+        # list of points 
+        #npt  = filter(lambda x: x < 0, vnodes)
+        npt = [ x for x in vnodes if x <0 ]
+
+        nseg_full = [x for x in vnodes if x > 0]
+        # nseg : incomplete list of segments
+        #
+        # if mode outdoor and cycle is indoor only 
+        # the part above the building (AIR and _AIR) is considered
+        if ((self.typ=='outdoor') and (self.Gt.node[icycle]['indoor'])):
+            nseg = [ x for x in nseg_full if ((self.Gs.node[x]['name']=='AIR') or (self.Gs.node[x]['name']=='_AIR') ) ]
+        else:
+            nseg = vnodes[useg]
+
+
+        # # nseg_full : full list of segments
+        # #nseg_full = filter(lambda x: x > 0, vnodes)
+
+        # # keep only airwalls without iso single (_AIR)
+        # nseg_single = filter(lambda x: len(self.Gs.node[x]['iso'])==0, nseg)
+
+        # lair1 = self.name['AIR'] 
+        # lair2 = self.name['_AIR']
+        # lair  = lair1 + lair2
+
+        # # list of airwalls in nseg_single
+
+        # airwalls = filter(lambda x: x in lair, nseg_single)
+
+        # diffraction points 
+
+        ndiff = [x for x in npt if self.diffindex(x) >= 0]
+        #
+        # Create a graph
+        #
+
+        Gv = nx.Graph()
+        #
+        # in convex case :
+        #
+        #    i)  every non aligned segments see each other
+        #
+        for nk in combinations(nseg, 2):
+            nk0 = self.tgs[nk[0]]
+            nk1 = self.tgs[nk[1]]
+            tahe0 = self.tahe[:, nk0]
+            tahe1 = self.tahe[:, nk1]
+
+            pta0 = self.pt[:, tahe0[0]]
+            phe0 = self.pt[:, tahe0[1]]
+            pta1 = self.pt[:, tahe1[0]]
+            phe1 = self.pt[:, tahe1[1]]
+
+            aligned = geu.is_aligned4(pta0,phe0,pta1,phe1)
+            # A0 = np.vstack((pta0, phe0, pta1))
+            # A0 = np.hstack((A0, np.ones((3, 1))))
+
+            # A1 = np.vstack((pta0, phe0, phe1))
+            # A1 = np.hstack((A1, np.ones((3, 1))))
+
+            # d0 = np.linalg.det(A0)
+            # d1 = np.linalg.det(A1)
+
+            #if not ((abs(d0) < 1e-1) & (abs(d1) < 1e-1)):
+            if not aligned:
+                if ((0 not in self.Gs.node[nk[0]]['ncycles']) and
+                    (0 not in self.Gs.node[nk[1]]['ncycles'])):
+                    # get the iso segments of both nk[0] and nk[1]
+                    if ((self.typ=='indoor') or (not self.Gt.node[icycle]['indoor'])):
+                        l0 = [nk[0]]+self.Gs.node[nk[0]]['iso']
+                        l1 = [nk[1]]+self.Gs.node[nk[1]]['iso']
+                    else:
+                        l0 = [nk[0]]
+                        l1 = [nk[1]]
+
+                    for vlink in product(l0,l1):
+                        #printicycle,vlink[0],vlink[1]
+                        Gv.add_edge(vlink[0], vlink[1])
+
+        #
+        # Handle diffraction points
+        #
+        #    ii) all non adjascent valid diffraction points see each other
+        #    iii) all valid diffraction points see segments non aligned
+        #    with adjascent segments
+        #
+        #if diffraction:
+        #
+        # diffraction only if indoor or outdoor cycle if outdoor
+        # 
+        if ((self.typ=='indoor') or (not self.Gt.node[icycle]['indoor'])):
+            lDcy = self.diffcycle(icycle)
+            ndiffvalid = [ x for x in ndiff if x in lDcy]
+
+                # non adjascent segment of vnodes see valid diffraction
+                # points
+            for idiff in ndiffvalid:
                 #
-                #    i)  every non aligned segments see each other
+                # segments voisins du point de diffraction valide
                 #
-                for nk in combinations(nseg, 2):
-                    nk0 = self.tgs[nk[0]]
-                    nk1 = self.tgs[nk[1]]
-                    tahe0 = self.tahe[:, nk0]
-                    tahe1 = self.tahe[:, nk1]
-
-                    pta0 = self.pt[:, tahe0[0]]
-                    phe0 = self.pt[:, tahe0[1]]
-                    pta1 = self.pt[:, tahe1[0]]
-                    phe1 = self.pt[:, tahe1[1]]
-
-                    aligned = geu.is_aligned4(pta0,phe0,pta1,phe1)
-                    # A0 = np.vstack((pta0, phe0, pta1))
-                    # A0 = np.hstack((A0, np.ones((3, 1))))
-
-                    # A1 = np.vstack((pta0, phe0, phe1))
-                    # A1 = np.hstack((A1, np.ones((3, 1))))
-
-                    # d0 = np.linalg.det(A0)
-                    # d1 = np.linalg.det(A1)
-
-                    #if not ((abs(d0) < 1e-1) & (abs(d1) < 1e-1)):
-                    if not aligned:
-                        if ((0 not in self.Gs.node[nk[0]]['ncycles']) and
-                            (0 not in self.Gs.node[nk[1]]['ncycles'])):
-                            # get the iso segments of both nk[0] and nk[1]
-                            if ((self.typ=='indoor') or (not self.Gt.node[icycle]['indoor'])):
-                                l0 = [nk[0]]+self.Gs.node[nk[0]]['iso']
-                                l1 = [nk[1]]+self.Gs.node[nk[1]]['iso']
-                            else:
-                                l0 = [nk[0]]
-                                l1 = [nk[1]]
-
-                            for vlink in product(l0,l1):
-                                #printicycle,vlink[0],vlink[1]
-                                Gv.add_edge(vlink[0], vlink[1])
+                nsneigh = [x for x in 
+                           nx.neighbors(self.Gs, idiff) 
+                           if x in nseg_full]
+                # segvalid : not adjascent segment
+                seen_from_neighbors = []
 
                 #
-                # Handle diffraction points
+                # point to point
                 #
-                #    ii) all non adjascent valid diffraction points see each other
-                #    iii) all valid diffraction points see segments non aligned
-                #    with adjascent segments
+                for npoint in ndiffvalid:
+                    if npoint != idiff:
+                        Gv.add_edge(idiff, npoint)
+
                 #
-                #if diffraction:
+                # All the neighbors segment in visibility which are not connected to cycle 0
+                # and which are not neighbrs of the point idiff
                 #
-                # diffraction only if indoor or outdoor cycle if outdoor
-                # 
-                if ((self.typ=='indoor') or (not self.Gt.node[icycle]['indoor'])):
-                    ndiffvalid = [ x for x in ndiff if icycle in self.ddiff[x][0]]
+                for x in nsneigh:
+                    neighbx = [ y for y in nx.neighbors(Gv, x) 
+                                if 0 not in self.Gs.node[y]['ncycles'] 
+                                and y not in nsneigh]
+                    seen_from_neighbors += neighbx
 
-                        # non adjascent segment of vnodes see valid diffraction
-                        # points
-                    for idiff in ndiffvalid:
-                        #
-                        # segments voisins du point de diffraction valide
-                        #
-                        nsneigh = [x for x in 
-                                   nx.neighbors(self.Gs, idiff) 
-                                   if x in nseg_full]
-                        # segvalid : not adjascent segment
-                        seen_from_neighbors = []
+                for ns in seen_from_neighbors:
+                    Gv.add_edge(idiff, ns)
 
-                        #
-                        # point to point
-                        #
-                        for npoint in ndiffvalid:
-                            if npoint != idiff:
-                                Gv.add_edge(idiff, npoint)
+        return(Gv)
 
-                        #
-                        # All the neighbors segment in visibility which are not connected to cycle 0
-                        # and which are not neighbrs of the point idiff
-                        #
-                        for x in nsneigh:
-                            neighbx = [ y for y in nx.neighbors(Gv, x) 
-                                        if 0 not in self.Gs.node[y]['ncycles'] 
-                                        and y not in nsneigh]
-                            seen_from_neighbors += neighbx
+    def _cysig(self):
+        """ fingerprints of the cycles of Gt
+
+        Returns
+        -------
 
-                        for ns in seen_from_neighbors:
-                            Gv.add_edge(idiff, ns)
+        dsig : dict
+            cycle number (!= 0) -> md5 hexdigest
 
-                #
-                # Graph Gv composition
-                #
+        Notes
+        -----
+
+        The fingerprint of a cycle gathers everything the visibility and
+        interaction graphs of this cycle depend on : its nodes, the
+        coordinates, names, iso segments and cycles of its segments, its
+        diffraction points and its indoor status. A cycle whose
+        fingerprint is unchanged does not need to be evaluated again
+        (incremental build).
+
+        """
+        dsig = {}
+        for cy in self.Gt.node:
+            if cy != 0:
+                vnodes = self.Gt.node[cy]['polyg'].vnodes
+                l = [self.typ, self.Gt.node[cy].get('indoor', False),
+                     tuple(vnodes)]
+                for n in vnodes:
+                    if n > 0:
+                        d = self.Gs.node[n]
+                        l.append((n, d['name'], tuple(d['iso']),
+                                  tuple(d['ncycles']),
+                                  tuple(self.Gs.pos[d['connect'][0]]),
+                                  tuple(self.Gs.pos[d['connect'][1]])))
+                        for i in d['iso']:
+                            l.append((i, self.Gs.node[i]['name'],
+                                      tuple(self.Gs.node[i]['ncycles'])))
+                    else:
+                        l.append((n, tuple(self.Gs.pos[n]),
+                                  repr(self.ddiff.get(n))))
+                dsig[cy] = hashlib.md5(repr(l).encode('utf-8')).hexdigest()
+        return(dsig)
 
-                self.Gv = nx.compose(self.Gv, Gv)
-                self.dGv[icycle] = Gv
+    def _cypool(self, func, lcy, nproc=0):
+        """ evaluate a per cycle function in a pool of forked processes
 
-    def buildGi(self,verbose=False,tqdmpos=0):
+        Parameters
+        ----------
+
+        func : module function
+            worker (_buildGv_func | _buildGi_func)
+        lcy : list
+            cycle numbers
+        nproc : int
+            number of processes (0 : all the cores)
+
+        Returns
+        -------
+
+        dres : dict
+            cycle number -> result of the worker
+
+        Notes
+        -----
+
+        The layout is shared with the workers through the module global
+        _L_run, set before the pool is forked, the graphs are therefore
+        not copied to the workers.
+
+        """
+        global _L_run
+        if nproc == 0:
+            nproc = cpu_count()
+        chunk = max(1,int(np.ceil(len(lcy)/(4.*nproc))))
+        largs = [ lcy[k:k+chunk] for k in range(0,len(lcy),chunk) ]
+        _L_run = self
+        pool = mp.Pool(min(nproc,len(largs)))
+        try:
+            lres = pool.map(func,largs,chunksize=1)
+        finally:
+            pool.close()
+            pool.join()
+            _L_run = None
+        dres = {}
+        for res in lres:
+            dres.update(res)
+        return(dres)
+
+    def buildGi(self,verbose=False,tqdmpos=0,
+                parallel=False,nproc=0,incremental=False):
         """ build graph of interactions
 
+        Parameters
+        ----------
+
+        verbose : boolean
+        tqdmpos : progressbar
+        parallel : boolean
+            evaluate the cycles in a pool of forked processes
+        nproc : int
+            number of processes (0 : all the cores)
+        incremental : boolean
+            the interactions edges of a cycle are reused if its fingerprint
+            and its visibility edges are unchanged since the previous
+            buildGi. The previous Gi is kept in self._Giold for outputGi.
+
         Notes
         -----
 
@@ -7772,12 +8717,19 @@ class Layout(pro.PyLayers):
 
         Gi is an oriented Graph (DiGraph) 
 
+        The interaction edges of each cycle are built by _buildGicycle.
+
         """
 
         Gipbar = pbar(verbose,total=100., desc ='Build Gi',position=tqdmpos)
         if verbose:
             Gipbar.update(0.)
 
+        if incremental and hasattr(self,'Gi'):
+            self._Giold = self.Gi
+        else:
+            self._Giold = None
+
         self.Gi = nx.DiGraph()
         self.Gi.pos = {}
         
@@ -7849,148 +8801,53 @@ class Layout(pro.PyLayers):
         #     calculates vnodes of cycles
         #     for all node of vnodes
         #
-        iprint = 0 
         if verbose :
             Gipbar.update(33.)
 
-        cpt = 100./(len(self.Gt.node)+1)
-        pbartmp = pbar(verbose,total=100., desc ='Create Gi nodes',position=tqdmpos+1)
-
-
+        #
+        # key of the interactions of a cycle : cycle fingerprint and
+        # visibility edges between the nodes of the cycle
+        #
+        dsig = getattr(self,'_cysigGv',{})
+        if dsig == {}:
+            dsig = self._cysig()
+        dkey = {}
         for cy in self.Gt.node:
-            if verbose:
-                pbartmp.update(cpt)
-            # for all >0 convex cycles
             if cy > 0:
                 vnodes = self.Gt.node[cy]['polyg'].vnodes
-                npt = []
-                #
-                # find all diffraction points involved in the cycle cy 
-                #
-                for x in vnodes:
-                    if x < 0:
-                        if self.ddiff.has_key(x):
-                            for y in self.ddiff[x][0]:
-                                if y == cy:
-                                    npt.append(x)
-                
-                nseg = [ k for k in vnodes if k>0 ]
-                # all segments and diffraction points of the cycle
-                vnodes = nseg + npt
-
-                for nstr in vnodes:
-
-                    if nstr in self.Gv.nodes():
-                        # list 1 of interactions
-                        
-                        li1 = []
-                        if nstr > 0:
-                            # output cycle 
-                            # cy -> cyo1 
-                            cyo1 = self.Gs.node[nstr]['ncycles']
-                            cyo1 = [ x for x in cyo1 if x!= cy] [0]
-                            #cyo1 = filter(lambda x: x != cy, cyo1)[0]
-
-                            # R , Tin , Tout
-                            if cyo1 > 0:
-                                if (nstr, cy) in self.Gi.nodes():
-                                    li1.append((nstr, cy))  # R 
-                                if (nstr, cy, cyo1) in self.Gi.nodes():
-                                    li1.append((nstr, cy, cyo1)) # T cy -> cyo1 
-                                if (nstr, cyo1, cy) in self.Gi.nodes():
-                                    li1.append((nstr, cyo1, cy)) # T : cyo1 -> cy 
-                                # if (nstr,cy) in self.Gi.nodes():
-                                #     li1 = [(nstr,cy),(nstr,cy,cyo1),(nstr,cyo1,cy)]
-                                # else:# no reflection on airwall
-                                #     li1 = [(nstr,cyo1,cy)]
-                            else:
-                                if (nstr, cy) in self.Gi.nodes():
-                                    li1 = [(nstr, cy)]
-                                # else:
-                                #     li1 =[]
-                        else:
-                            # D
-                            li1 = [(nstr,)]
-                        # list of cycle entities in visibility of nstr
-                        lneighb = nx.neighbors(self.Gv, nstr)
-                        #if (self.Gs.node[nstr]['name']=='AIR') or (
-                        #        self.Gs.node[nstr]['name']=='_AIR'):
-                        #    lneighcy = lneighb
-                        #else:
-                        # list of cycle entities in visibility of nstr in the same cycle 
-                        lneighcy = [ x for x in lneighb if x in vnodes ] 
-                        # lneighcy = filter(lambda x: x in vnodes, lneighb)
-
-                        for nstrb in lneighcy:
-                            if nstrb in self.Gv.nodes():
-                                li2 = []
-                                if nstrb > 0:
-                                    cyo2 = self.Gs.node[nstrb]['ncycles']
-                                    cyo2 = [ x for x in cyo2 if x!= cy] [0]
-                                    #cyo2 = filter(lambda x: x != cy, cyo2)[0]
-                                    if cyo2 > 0:
-                                        if (nstrb, cy) in self.Gi.nodes():
-                                            li2.append((nstrb, cy))
-                                        if (nstrb, cy, cyo2) in self.Gi.nodes():
-                                            li2.append((nstrb, cy, cyo2))
-                                        if (nstrb, cyo2, cy) in self.Gi.nodes():
-                                            li2.append((nstrb, cyo2, cy))
-                                        # if (nstrb,cy) in self.Gi.nodes():
-                                        #     li2 = [(nstrb,cy),(nstrb,cy,cyo2),(nstrb,cyo2,cy)]
-                                        # else: #no reflection on airwall
-                                        #     li2 = [(nstrb,cy,cyo2),(nstrb,cyo2,cy)]
-                                    else:
-                                        if (nstrb, cy) in self.Gi.nodes():
-                                            li2 = [(nstrb, cy)]
-                                else:
-                                    li2 = [(nstrb,)]
-
-                                # if cy==4:
-                                #     printnstr,nstrb
-                                #if iprint:
-                                #     print("li1",li1)
-                                #     print("li2",li2)
-                                #if cy == 91:
-                                #    print("     ",li2)
-                                
-                                for i1 in li1:
-                                    for i2 in li2:
-                                        if (i1[0] != i2[0]):
-                                            if ((len(i1) == 2) & (len(i2) == 2)):
-                                                # print"RR"
-                                                self.Gi.add_edge(i1, i2)
-                                                self.Gi.add_edge(i2, i1)
-                                            if ((len(i1) == 2) & (len(i2) == 3)):
-                                                # print"RT"
-                                                if i1[1] == i2[1]:
-                                                    self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 3) & (len(i2) == 2)):
-                                                # print"TR"
-                                                if i1[2] == i2[1]:
-                                                    self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 3) & (len(i2) == 3)):
-                                                # print"TT"
-                                                if i1[2] == i2[1]:
-                                                    self.Gi.add_edge(i1, i2)
-                                                if i2[2] == i1[1]:
-                                                    self.Gi.add_edge(i2, i1)
-                                            if ((len(i1) == 1) & (len(i2) == 3)):
-                                                # print"DT"
-                                                if i2[1] == cy:
-                                                    self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 3) & (len(i2) == 1)):
-                                                # print"TD"
-                                                if i1[2] == cy:
-                                                    self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 1) & (len(i2) == 2)):
-                                                # print"DR"
-                                                self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 2) & (len(i2) == 1)):
-                                                # print"RD"
-                                                self.Gi.add_edge(i1, i2)
-                                            if ((len(i1) == 1) & (len(i2) == 1)):
-                                                # print"DD"
-                                                self.Gi.add_edge(i1, i2)
+                svn = set(vnodes)
+                lvis = [ (n,tuple(sorted([ x for x in self.Gv[n] if x in svn ])))
+                         for n in vnodes if n in self.Gv.node ]
+                dkey[cy] = (dsig.get(cy),tuple(lvis))
+
+        if (incremental and hasattr(self,'_dGi') and
+            hasattr(self,'_keyGi')):
+            dGi = { cy : self._dGi[cy] for cy in dkey
+                    if ((self._keyGi.get(cy) == dkey[cy]) and
+                        (cy in self._dGi)) }
+        else:
+            dGi = {}
+        lcy = [ cy for cy in dkey if cy not in dGi ]
+
+        if parallel and (len(lcy) > 1):
+            dGi.update(self._cypool(_buildGi_func,lcy,nproc))
+        else:
+            cpt = 100./(len(lcy)+1)
+            pbartmp = pbar(verbose,total=100., desc ='Create Gi nodes',position=tqdmpos+1)
+            for cy in lcy:
+                if verbose:
+                    pbartmp.update(cpt)
+                dGi[cy] = self._buildGicycle(cy)
+
+        npt = []
+        for cy in self.Gt.node:
+            if cy in dGi:
+                ledges, npt = dGi[cy]
+                self.Gi.add_edges_from(ledges)
+
+        self._dGi = dGi
+        self._keyGi = dkey
+
         if verbose :
             Gipbar.update(66.)
         # updating the list of interactions of a given cycle
@@ -7999,6 +8856,7 @@ class Layout(pro.PyLayers):
                        desc ='update interraction list',
                        leave=False,
                        position=tqdmpos+1)
+        cpt = 100./(len(self.Gt.node)+1)
         for c in self.Gt.node:
             if verbose:
                 pbartmp.update(cpt)
@@ -8041,6 +8899,159 @@ class Layout(pro.PyLayers):
         self.Gi_A = nx.adjacency_matrix(self.Gi)
         #store list of nodes of Gi ( for keeping order)
         self.Gi_no = self.Gi.nodes()
+        # the CSR form of Gi is obsolete until outputGi rebuilds it
+        self.__dict__.pop('Gicsr', None)
+        self.__dict__.pop('Gicsr_id', None)
+
+    def _buildGicycle(self, cy):
+        """ interactions edges of a single cycle
+
+        Parameters
+        ----------
+
+        cy : int
+            cycle number (> 0)
+
+        Returns
+        -------
+
+        ledges : list
+            list of edges (i1,i2) of Gi
+        npt : list
+            diffraction points of the cycle
+
+        Notes
+        -----
+
+        The nodes of Gi have to be created before (see buildGi)
+
+        """
+        ledges = []
+        vnodes = self.Gt.node[cy]['polyg'].vnodes
+        #
+        # find all diffraction points involved in the cycle cy 
+        #
+        npt = vnodes[np.in1d(vnodes, self.diffcycle(cy))].tolist()
+
+        nseg = [ k for k in vnodes if k>0 ]
+        # all segments and diffraction points of the cycle
+        vnodes = nseg + npt
+
+        for nstr in vnodes:
+
+            if nstr in self.Gv.node:
+                # list 1 of interactions
+
+                li1 = []
+                if nstr > 0:
+                    # output cycle 
+                    # cy -> cyo1 
+                    cyo1 = self.Gs.node[nstr]['ncycles']
+                    cyo1 = [ x for x in cyo1 if x!= cy] [0]
+                    #cyo1 = filter(lambda x: x != cy, cyo1)[0]
+
+                    # R , Tin , Tout
+                    if cyo1 > 0:
+                        if (nstr, cy) in self.Gi.node:
+                            li1.append((nstr, cy))  # R 
+                        if (nstr, cy, cyo1) in self.Gi.node:
+                            li1.append((nstr, cy, cyo1)) # T cy -> cyo1 
+                        if (nstr, cyo1, cy) in self.Gi.node:
+                            li1.append((nstr, cyo1, cy)) # T : cyo1 -> cy 
+                        # if (nstr,cy) in self.Gi.node:
+                        #     li1 = [(nstr,cy),(nstr,cy,cyo1),(nstr,cyo1,cy)]
+                        # else:# no reflection on airwall
+                        #     li1 = [(nstr,cyo1,cy)]
+                    else:
+                        if (nstr, cy) in self.Gi.node:
+                            li1 = [(nstr, cy)]
+                        # else:
+                        #     li1 =[]
+                else:
+                    # D
+                    li1 = [(nstr,)]
+                # list of cycle entities in visibility of nstr
+                lneighb = nx.neighbors(self.Gv, nstr)
+                #if (self.Gs.node[nstr]['name']=='AIR') or (
+                #        self.Gs.node[nstr]['name']=='_AIR'):
+                #    lneighcy = lneighb
+                #else:
+                # list of cycle entities in visibility of nstr in the same cycle 
+                lneighcy = [ x for x in lneighb if x in vnodes ] 
+                # lneighcy = filter(lambda x: x in vnodes, lneighb)
+
+                for nstrb in lneighcy:
+                    if nstrb in self.Gv.node:
+                        li2 = []
+                        if nstrb > 0:
+                            cyo2 = self.Gs.node[nstrb]['ncycles']
+                            cyo2 = [ x for x in cyo2 if x!= cy] [0]
+                            #cyo2 = filter(lambda x: x != cy, cyo2)[0]
+                            if cyo2 > 0:
+                                if (nstrb, cy) in self.Gi.node:
+                                    li2.append((nstrb, cy))
+                                if (nstrb, cy, cyo2) in self.Gi.node:
+                                    li2.append((nstrb, cy, cyo2))
+                                if (nstrb, cyo2, cy) in self.Gi.node:
+                                    li2.append((nstrb, cyo2, cy))
+                                # if (nstrb,cy) in self.Gi.node:
+                                #     li2 = [(nstrb,cy),(nstrb,cy,cyo2),(nstrb,cyo2,cy)]
+                                # else: #no reflection on airwall
+                                #     li2 = [(nstrb,cy,cyo2),(nstrb,cyo2,cy)]
+                            else:
+                                if (nstrb, cy) in self.Gi.node:
+                                    li2 = [(nstrb, cy)]
+                        else:
+                            li2 = [(nstrb,)]
+
+                        # if cy==4:
+                        #     printnstr,nstrb
+                        #if iprint:
+                        #     print("li1",li1)
+                        #     print("li2",li2)
+                        #if cy == 91:
+                        #    print("     ",li2)
+
+                        for i1 in li1:
+                            for i2 in li2:
+                                if (i1[0] != i2[0]):
+                                    if ((len(i1) == 2) & (len(i2) == 2)):
+                                        # print"RR"
+                                        ledges.append((i1, i2))
+                                        ledges.append((i2, i1))
+                                    if ((len(i1) == 2) & (len(i2) == 3)):
+                                        # print"RT"
+                                        if i1[1] == i2[1]:
+                                            ledges.append((i1, i2))
+                                    if ((len(i1) == 3) & (len(i2) == 2)):
+                                        # print"TR"
+                                        if i1[2] == i2[1]:
+                                            ledges.append((i1, i2))
+                                    if ((len(i1) == 3) & (len(i2) == 3)):
+                                        # print"TT"
+                                        if i1[2] == i2[1]:
+                                            ledges.append((i1, i2))
+                                        if i2[2] == i1[1]:
+                                            ledges.append((i2, i1))
+                                    if ((len(i1) == 1) & (len(i2) == 3)):
+                                        # print"DT"
+                                        if i2[1] == cy:
+                                            ledges.append((i1, i2))
+                                    if ((len(i1) == 3) & (len(i2) == 1)):
+                                        # print"TD"
+                                        if i1[2] == cy:
+                                            ledges.append((i1, i2))
+                                    if ((len(i1) == 1) & (len(i2) == 2)):
+                                        # print"DR"
+                                        ledges.append((i1, i2))
+                                    if ((len(i1) == 2) & (len(i2) == 1)):
+                                        # print"RD"
+                                        ledges.append((i1, i2))
+                                    if ((len(i1) == 1) & (len(i2) == 1)):
+                                        # print"DD"
+                                        ledges.append((i1, i2))
+
+        return(ledges, npt)
 
     def filterGi(self, situ='outdoor'):
         """ filter Gi to manage indoor/outdoor situations
@@ -8070,16 +9081,22 @@ class Layout(pro.PyLayers):
 
         self.Gi = rGi
         self.Gi.pos = rGi.pos
+        self.buildGicsr()
 
 
 
-    def outputGi(self,verbose=False,tqdmpos=0.):
+    def outputGi(self,verbose=False,tqdmpos=0.,incremental=False):
         """ filter output of Gi edges
 
         Parameters
         ----------
 
         L : Layout
+        incremental : boolean
+            reuse the output of the edges of the previous Gi
+            (self._Giold) when the edge, the successors of its second
+            interaction and the segments or points involved are unchanged
+            (see build)
 
         Notes
         -----
@@ -8103,6 +9120,12 @@ class Layout(pro.PyLayers):
         assert('Gi' in self.__dict__)
 
         oGipbar=pbar(verbose,total=100.,leave=False,desc='OutputGi',position=tqdmpos)
+
+        Gio = getattr(self,'_Giold',None)
+        if not incremental:
+            Gio = None
+        dchanged = getattr(self,'_gschanged',set([]))
+
         # loop over all edges of Gi
         Nedges = len(self.Gi.edges())
         cpt = 100./Nedges
@@ -8121,6 +9144,18 @@ class Layout(pro.PyLayers):
             nstr0 = i0[0]
             nstr1 = i1[0]
 
+            # incremental : output of the previous Gi
+            if (Gio is not None) and Gio.has_edge(i0, i1):
+                dold = Gio.edge[i0][i1]
+                lsucc = self.Gi.succ[i1].keys()
+                if (('output' in dold) and
+                    (set(lsucc) == set(Gio.succ[i1].keys())) and
+                    (nstr0 not in dchanged) and
+                    (nstr1 not in dchanged) and
+                    (not any([x[0] in dchanged for x in lsucc]))):
+                    self.Gi.add_edge(i0, i1, output=dold['output'])
+                    continue
+
             # list of authorized outputs. Initialized void
             output = []
 
@@ -8274,6 +9309,7 @@ class Layout(pro.PyLayers):
                 dintprob = {k: v for k, v in zip(output, probint)}
             self.Gi.add_edge(i0, i1, output=dintprob)
 
+        self.buildGicsr()
 
     def outputGi_new(self,verbose=False,tqdmpos=0.):
         """ filter output of Gi edges
@@ -8540,6 +9576,7 @@ class Layout(pro.PyLayers):
             except:
                 pass
 
+        self.buildGicsr()
 
     def outputGi_mp(self):
         """ filter output of Gi edges
@@ -8614,6 +9651,7 @@ class Layout(pro.PyLayers):
         Z = zip(e)
         res = pool.map(outputGi_func,Z)
         self.Gi.add_edges_from(res)
+        self.buildGicsr()
 
 
 
@@ -8815,6 +9853,102 @@ class Layout(pro.PyLayers):
 
         
 
+    def buildGicsr(self):
+        """ build a frozen array (CSR) representation of Gi
+
+        Notes
+        -----
+
+        Interactions are numbered from 0 to N-1 in the order of Gi.nodes().
+        The graph is stored in the dictionnary self.Gicsr of numpy arrays
+
+        'inter'   : (N x 3) int32  interaction tuple padded with 0
+        'typ'     : (N)     int8   1 : D , 2 : R , 3 : T (tuple length)
+        'th'      : (N x 2 x 2)    tail head coordinates of the interaction
+                                   (point repeated twice for D)
+        'air'     : (N)     bool   interaction on an airwall
+        'indptr'  : (N+1)   int32  edges of node k are indptr[k]:indptr[k+1]
+        'indices' : (E)     int32  target node of each edge
+        'oindptr' : (E+1)   int32  outputs of edge e are oindptr[e]:oindptr[e+1]
+        'oedge'   : (M)     int32  output edge (interaction i1 -> i2)
+        'oweight' : (M)     float32 output probability
+
+        The 'output' dictionnaries of edge (i0,i1) are stored as the list of
+        edges (i1,i2), this allows the signature search to walk from edge
+        to edge without any dictionnary lookup.
+
+        The ordering of neighbors and outputs is the one of Gi, hence a
+        search on Gicsr visits the interactions in the same order as a
+        search on Gi.
+
+        See Also
+        --------
+
+        pylayers.antprop.signature.Signatures.run
+
+        """
+        assert('Gi' in self.__dict__)
+
+        lno = self.Gi.nodes()
+        N = len(lno)
+        dno = {n: k for k, n in enumerate(lno)}
+
+        inter = np.zeros((N, 3), dtype=np.int32)
+        typ = np.zeros(N, dtype=np.int8)
+        th = np.zeros((N, 2, 2))
+        air = np.zeros(N, dtype=bool)
+        lair = self.name['AIR'] + self.name['_AIR']
+        for k, n in enumerate(lno):
+            inter[k, :len(n)] = n
+            typ[k] = len(n)
+            if n[0] > 0:
+                pts = self.Gs[n[0]].keys()
+                th[k] = np.array([self.Gs.pos[pts[0]], self.Gs.pos[pts[1]]])
+                air[k] = n[0] in lair
+            else:
+                th[k] = np.array([self.Gs.pos[n[0]], self.Gs.pos[n[0]]])
+
+        # adjacency
+        indptr = np.zeros(N + 1, dtype=np.int32)
+        lindices = []
+        dedge = {}
+        for k, n in enumerate(lno):
+            for n1 in self.Gi[n]:
+                dedge[(k, dno[n1])] = len(lindices)
+                lindices.append(dno[n1])
+            indptr[k + 1] = len(lindices)
+        indices = np.array(lindices, dtype=np.int32)
+
+        # outputs of edges
+        E = len(indices)
+        oindptr = np.zeros(E + 1, dtype=np.int32)
+        loedge = []
+        loweight = []
+        e = 0
+        for k, n in enumerate(lno):
+            for n1 in self.Gi[n]:
+                k1 = dno[n1]
+                output = self.Gi[n][n1].get('output', {})
+                for n2, w in output.items():
+                    # an output may refer to an interaction removed from Gi
+                    e2 = dedge.get((k1, dno.get(n2)))
+                    if e2 is not None:
+                        loedge.append(e2)
+                        loweight.append(w)
+                e = e + 1
+                oindptr[e] = len(loedge)
+
+        self.Gicsr = {'inter': inter,
+                      'typ': typ,
+                      'th': th,
+                      'air': air,
+                      'indptr': indptr,
+                      'indices': indices,
+                      'oindptr': oindptr,
+                      'oedge': np.array(loedge, dtype=np.int32),
+                      'oweight': np.array(loweight, dtype=np.float32)}
+        self.Gicsr_id = dno
+
     def intercy(self, ncy, typ='source'):
         """ return the list of interactions seen from a cycle
 
@@ -8864,12 +9998,8 @@ class Layout(pro.PyLayers):
 
         vnodes = self.Gt.node[ncy]['polyg'].vnodes
         vpoints = filter(lambda x: x < 0, vnodes)
-        lD = []
-        for x in vpoints:
-            if self.ddiff.has_key(x):
-                for y in self.ddiff[x][0]:
-                    if y == ncy:
-                        lD.append((x,))
+        lDcy = self.diffcycle(ncy)
+        lD = [(x,) for x in vpoints if x in lDcy]
         # indoor = self.Gt.node[ncy]['indoor']
         # if indoor:
         #     lD = map(lambda y : (y,),filter(lambda x : x in
@@ -9696,10 +10826,14 @@ class Layout(pro.PyLayers):
         Parameters
         ----------
         pt : point (ndarray)
+            (2,) or (3,) for a single point
+            (2 x N) or (3 x N) for N points
 
         Returns
         -------
         ncy : cycle number
+            for N points : array (N,) of cycle numbers (-1 if the point is
+            not in any cycle)
 
         Notes
         -----
@@ -9709,21 +10843,18 @@ class Layout(pro.PyLayers):
         --------
 
         Layout.cy2pt
+        Layout._ptloc
 
         """
 
-        ptsh = sh.Point(pt[0], pt[1])
-        cycle_exists = False
+        pt = np.array(pt)
+        if pt.ndim > 1:
+            return(self._ptloc(pt, 't'))
 
-        for ncy in self.Gt.node.keys():
-            if ncy > 0:
-                criter1 = self.Gt.node[ncy]['polyg'].touches(ptsh)
-                criter2 = self.Gt.node[ncy]['polyg'].contains(ptsh)
-                if (criter1 or criter2):
-                    cycle_exists = True
-                    return(ncy)
-        if not cycle_exists:
+        ncy = self._ptloc(pt[:, None], 't')[0]
+        if ncy < 0:
             raise NameError(str(pt) + " is not in any cycle")
+        return(ncy)
 
     def cy2pt(self, cy=0, h=1.2):
         """return a point into a given cycle
@@ -9762,10 +10893,14 @@ class Layout(pro.PyLayers):
         Parameters
         ----------
         pt : point (ndarray)
+            (2,) or (3,) for a single point
+            (2 x N) or (3 x N) for N points
 
         Returns
         -------
         nr : Room number
+            for N points : array (N,) of room numbers (-1 if the point is
+            not in any room)
 
         Notes
         -----
@@ -9773,15 +10908,173 @@ class Layout(pro.PyLayers):
 
         """
 
-        ptsh = sh.Point(pt[0], pt[1])
-        ptshinroom = False
-        for nr in self.Gr.node.keys():
-            if self.Gr.node[nr]['polyg'].contains(ptsh)\
-                    or self.Gr.node[nr]['polyg'].touches(ptsh):
-                ptshinroom = True
-                return(nr)
-        if not ptshinroom:
+        pt = np.array(pt)
+        if pt.ndim > 1:
+            return(self._ptloc(pt, 'r'))
+
+        nr = self._ptloc(pt[:, None], 'r')[0]
+        if nr < 0:
             raise NameError(str(pt) + " is not in any room")
+        return(nr)
+
+    def _locindex(self, gname='t', cell=0):
+        """ build the point location index of the cycles (or rooms)
+
+        Parameters
+        ----------
+
+        gname : string
+            't' : cycles of Gt (cycle 0 is excluded)
+            'r' : rooms of Gr
+        cell : float
+            size of a grid cell (meters)
+            if 0 the size is chosen from the layout area and the number of
+            polygons
+
+        Returns
+        -------
+
+        loc : dict
+            'key'   : geometry version (see _geomchanged)
+            'p'     : (x0,y0,cell) grid origin and cell size
+            'grid'  : dict (ix,iy) -> sorted list of polygon numbers
+            'rings' : dict polygon number -> list of rings (Nv x 2)
+
+        Notes
+        -----
+
+        The index is stored in self._loc[gname] and rebuilt when the points
+        have been moved since it was built. self._loc is cleared when the
+        graphs are built (build, buildGt, buildGr) or read (dumpr).
+
+        """
+        G = getattr(self, 'G' + gname)
+        if not hasattr(self, '_loc'):
+            self._loc = {}
+
+        key = getattr(self, '_geomv', 0)
+        if (gname in self._loc) and (self._loc[gname]['key'] == key):
+            return(self._loc[gname])
+
+        if gname == 't':
+            lpoly = [n for n in G.node if n > 0]
+        else:
+            lpoly = G.node.keys()
+        lpoly = sorted([n for n in lpoly if 'polyg' in G.node[n]])
+
+        if cell <= 0:
+            dx = self.ax[1] - self.ax[0]
+            dy = self.ax[3] - self.ax[2]
+            cell = np.sqrt(max(dx * dy, 1.) / max(len(lpoly), 1))
+
+        x0 = self.ax[0]
+        y0 = self.ax[2]
+        grid = {}
+        rings = {}
+        for n in lpoly:
+            P = G.node[n]['polyg']
+            lr = [np.array(P.exterior.coords)[:, 0:2]]
+            lr.extend([np.array(r.coords)[:, 0:2] for r in P.interiors])
+            rings[n] = lr
+            xmin, ymin, xmax, ymax = P.bounds
+            ix0 = int(np.floor((xmin - x0) / cell))
+            ix1 = int(np.floor((xmax - x0) / cell))
+            iy0 = int(np.floor((ymin - y0) / cell))
+            iy1 = int(np.floor((ymax - y0) / cell))
+            for c in product(range(ix0, ix1 + 1), range(iy0, iy1 + 1)):
+                try:
+                    grid[c].append(n)
+                except:
+                    grid[c] = [n]
+
+        self._loc[gname] = {'key': key,
+                            'p': (x0, y0, cell),
+                            'grid': grid,
+                            'rings': rings}
+        return(self._loc[gname])
+
+    def _ptloc(self, pt, gname='t', tol=1e-9):
+        """ vectorized point location in cycles (or rooms)
+
+        Parameters
+        ----------
+
+        pt : np.array (2 x N) or (3 x N)
+        gname : string
+            't' : cycles of Gt
+            'r' : rooms of Gr
+        tol : float
+            distance to the boundary below which a point is considered
+            inside the polygon
+
+        Returns
+        -------
+
+        npoly : np.array (N,)
+            polygon number, -1 if the point is in no polygon
+
+        Notes
+        -----
+
+        The candidate polygons of a point are those whose bounding box
+        overlaps the grid cell of the point (see _locindex). Candidates
+        are tested with an even-odd crossing test, a point on the
+        boundary is inside (contains or touches).
+
+        """
+        loc = self._locindex(gname)
+        x0, y0, h = loc['p']
+        grid = loc['grid']
+
+        x = pt[0, :]
+        y = pt[1, :]
+        Npt = len(x)
+        npoly = -np.ones(Npt, dtype=int)
+
+        ix = np.floor((x - x0) / h).astype(int)
+        iy = np.floor((y - y0) / h).astype(int)
+        # group points by grid cell
+        ucell, inv = np.unique(ix + 1j * iy, return_inverse=True)
+
+        for kc, c in enumerate(ucell):
+            cell = (int(c.real), int(c.imag))
+            if cell not in grid:
+                continue
+            # points of the cell not yet located
+            upt = np.where(inv == kc)[0]
+            for n in grid[cell]:
+                if len(upt) == 0:
+                    break
+                xp = x[upt][:, None]
+                yp = y[upt][:, None]
+                inside = np.zeros(len(upt), dtype=bool)
+                onbound = np.zeros(len(upt), dtype=bool)
+                for r in loc['rings'][n]:
+                    # edges i -> j of the ring
+                    xi = r[:-1, 0][None, :]
+                    yi = r[:-1, 1][None, :]
+                    xj = r[1:, 0][None, :]
+                    yj = r[1:, 1][None, :]
+                    dy = yj - yi
+                    dy[dy == 0] = np.inf
+                    cross = (((yi > yp) != (yj > yp)) &
+                             (xp < (xj - xi) * (yp - yi) / dy + xi))
+                    inside = inside ^ (np.sum(cross, axis=1) % 2 == 1)
+                    # distance to the edges
+                    ex = xj - xi
+                    ey = yj - yi
+                    l2 = ex * ex + ey * ey
+                    l2[l2 == 0] = 1
+                    t = np.clip(((xp - xi) * ex + (yp - yi) * ey) / l2, 0, 1)
+                    dx = xp - (xi + t * ex)
+                    dd = yp - (yi + t * ey)
+                    d2 = np.min(dx * dx + dd * dd, axis=1)
+                    onbound = onbound | (d2 <= tol * tol)
+                uin = inside | onbound
+                npoly[upt[uin]] = n
+                upt = upt[~uin]
+
+        return(npoly)
 
     def seg2ro(self, seg):
         """ return room number of a point
@@ -9883,32 +11176,139 @@ class Layout(pro.PyLayers):
             [[443, 529], [444, 530]]
             [['WALL', 'WALL'], ['AIR', 'AIR']]
 
+            See Also
+            --------
+
+            _diffarrays
+
         """
-        assert(npt in self.ddiff), logging.error('npt not a diffraction point')
-        lcy = self.ddiff[npt][0]
-        ls = []
-        llz = len(lz)
-        dz_seg= {z:[] for z in range(llz)}
-        dz_sl= {z:[] for z in range(llz)}
-
-        for cy in lcy: 
-            vn = set(self.Gt.node[cy]['polyg'].vnodes)   
-            lneig_pt = set(nx.neighbors(self.Gs,npt))
-            lseg = lneig_pt.intersection(vn)
-            lseg_valid = [ x for x in lseg if self.Gs.node[x]['name']!='_AIR']
-
-            for x in lseg_valid:
-                zsup = lz >self.Gs.node[x]['z'][0]
-                zinf = lz <=self.Gs.node[x]['z'][1]
-                z    = zsup & zinf 
-                uz = np.where(z)[0]
-                # fill dz_seg at the correct height with a lseg_valid 
-                # and simulnaneously 
-                # fill dz_sl at the correct height with correspondong slab
-                [(dz_seg[i].append(x),dz_sl[i].append(self.Gs.node[x]['name']))
-                                                                    for i in uz]
-
-        return dz_seg.values(),dz_sl.values()
+        idx = self.diffindex(npt)
+        assert(idx >= 0), logging.error('npt not a diffraction point')
+        i0 = self.diffsego[idx]
+        i1 = self.diffsego[idx+1]
+        seg = self.diffseg[i0:i1]
+        sl = self.diffsegsl[i0:i1]
+        zw = self.diffsegz[:, i0:i1]
+        lz = np.asarray(lz)
+        # (len(lz) x number of wedge segments)
+        uz = ((lz[:, None] > zw[0][None, :]) &
+              (lz[:, None] <= zw[1][None, :]))
+
+        dz_seg = [seg[u].tolist() for u in uz]
+        dz_sl = [sl[u].tolist() for u in uz]
+
+        return dz_seg,dz_sl
+
+    def _diffarrays(self):
+        """ store the diffraction points of self.ddiff as arrays
+
+        Notes
+        -----
+
+        diffpt    : (Nd) sorted diffraction point numbers
+        diffang   : (Nd) wedge angle
+        diffcyo   : (Nd+1) offsets in diffcy
+        diffcy    : cycles of the diffraction points
+        diffcypt  : diffraction point of each entry of diffcy
+        diffface  : (Nd x 2) the 2 non air segments bounding the wedge
+                    (the same segment twice for a half-plane, -1 when the
+                    point has no non air segment)
+        diffsego  : (Nd+1) offsets in diffseg
+        diffseg   : non _AIR segments connected to the point in each of
+                    its cycles (used by get_diffslab)
+        diffsegz  : (2 x len(diffseg)) zmin and zmax of diffseg
+        diffsegsl : slab names of diffseg
+
+        Those arrays are consumed by buildGv, buildGi and Rays.eval. They
+        are built by _find_diffractions or on first use after a reload of
+        self.ddiff.
+
+        """
+        lpt = sorted(self.ddiff.keys())
+        lcy = [list(self.ddiff[k][0]) for k in lpt]
+        ncy = np.array([len(x) for x in lcy], dtype=int)
+
+        self.diffpt = np.array(lpt, dtype=int)
+        self.diffang = np.array([self.ddiff[k][1] for k in lpt])
+        self.diffcyo = np.hstack((0, np.cumsum(ncy))).astype(int)
+        self.diffcy = np.array(sum(lcy, []), dtype=int)
+        self.diffcypt = np.repeat(self.diffpt, ncy)
+
+        lair = self.name.get('AIR', []) + self.name.get('_AIR', [])
+        lface = []
+        lseg = []
+        nseg = []
+        for k, cyk in zip(lpt, lcy):
+            neigh = nx.neighbors(self.Gs, k)
+            face = [x for x in neigh if x not in lair]
+            # flat angle : diffraction by a single segment (e.g door limit)
+            lface.append((face + face + [-1, -1])[:2])
+            lw = []
+            for cy in cyk:
+                vn = set(self.Gt.node[cy]['polyg'].vnodes)
+                lseg_cy = set(neigh).intersection(vn)
+                lw.extend([x for x in lseg_cy
+                           if self.Gs.node[x]['name'] != '_AIR'])
+            nseg.append(len(lw))
+            lseg.extend(lw)
+
+        self.diffface = np.array(lface, dtype=int).reshape(-1, 2)
+        self.diffsego = np.hstack((0, np.cumsum(nseg))).astype(int)
+        self.diffseg = np.array(lseg, dtype=int)
+        self.diffsegz = np.array([self.Gs.node[x]['z'] for x in lseg],
+                                 dtype=float).reshape(-1, 2).T
+        self.diffsegsl = np.array([self.Gs.node[x]['name'] for x in lseg],
+                                  dtype=object)
+
+    def diffindex(self, npt):
+        """ index of diffraction points in the diffraction arrays
+
+        Parameters
+        ----------
+
+        npt : int or array of int
+            point numbers (nodes of Gs)
+
+        Returns
+        -------
+
+        idx : int or array of int
+            index in self.diffpt, -1 if the point is not a diffraction point
+
+        """
+        if not hasattr(self, 'diffpt'):
+            self._diffarrays()
+        scalar = np.isscalar(npt)
+        npt = np.atleast_1d(npt)
+        if len(self.diffpt) == 0:
+            idx = -np.ones(len(npt), dtype=int)
+        else:
+            idx = np.searchsorted(self.diffpt, npt)
+            idx = np.minimum(idx, len(self.diffpt) - 1)
+            idx[self.diffpt[idx] != npt] = -1
+        if scalar:
+            return idx[0]
+        return idx
+
+    def diffcycle(self, cy):
+        """ diffraction points which diffract toward cycle cy
+
+        Parameters
+        ----------
+
+        cy : int
+            cycle number
+
+        Returns
+        -------
+
+        npt : array of int
+            point numbers
+
+        """
+        if not hasattr(self, 'diffpt'):
+            self._diffarrays()
+        return self.diffcypt[self.diffcy == cy]
 
     def _find_diffractions(self, difftol=0.01,verbose = False,tqdmkwargs={}):
         """ find diffractions points of the Layout
@@ -9924,105 +11324,93 @@ class Layout(pro.PyLayers):
         -------
 
         Update self.ddiff {nseg : ([ncy1,ncy2],wedge_angle)}
+        and the diffraction arrays (see _diffarrays)
 
-        """
-        # dangles = self.get_Gt_angles()
-        #
-        # Problem here point number are converted into float64
+        Notes
+        -----
 
+        The angles of all the cycles are evaluated in a single pass
+        (geu.get_pols_angles). Degree 1 points shared by less than 3 cycles
+        are half-planes. Only the points shared by more than 2 cycles go
+        through the sector grouping.
+
+        """
         if tqdmkwargs=={}:
             tqdmkwargs={'total':100.,
                         'desc':'find_diffractions'}
 
-        dangles = {cy: np.array(geu.get_pol_angles(self.Gt.node[cy]['polyg']))
-                   for cy in self.Gt.nodes() if cy != 0}
+        lcy = [cy for cy in self.Gt.nodes() if cy != 0]
+        upt, ang, icy = geu.get_pols_angles(
+            [self.Gt.node[cy]['polyg'] for cy in lcy])
+        acy = np.array(lcy, dtype=int)[icy]
+        # (cycle,point) -> angle of the point inside the cycle
+        dangles = dict(zip(zip(acy.tolist(), upt.tolist()), ang))
 
         #
         # The candidate points for being diffraction points have degree 1 or 2
         # A point diffracts toward one or several cycles
         #
-        #ldiff = list(np.hstack((self.degree[1],self.degree[2])).astype('int'))
-        lpnt = [x for x in self.Gs.node if (x < 0 and x not in self.degree[0])]
+        lpnt = np.array([x for x in self.Gs.node if x < 0], dtype=int)
+        lpnt = lpnt[~np.in1d(lpnt, self.degree[0])]
+        ncyk = np.array([len(self.Gs.node[x]['ncycles']) for x in lpnt],
+                        dtype=int)
 
         self.ddiff = {}
-        
+
+        # diffraction by half-plane
+        uhp = (ncyk <= 2) & np.in1d(lpnt, self.degree[1])
+        for k in lpnt[uhp].tolist():
+            self.ddiff[k] = (self.Gs.node[k]['ncycles'], 2 * np.pi)
+
+        lmul = lpnt[ncyk > 2].tolist()
         if verbose :
-            cpt = 1./(len(lpnt)+1)
+            cpt = 1./(len(lmul)+1)
             pbar = tqdm.tqdm(tqdmkwargs)
-        for k in lpnt:
+        for k in lmul:
             if verbose :
                 pbar.update(100.*cpt)
             # list of cycles associated with point k
             lcyk = self.Gs.node[k]['ncycles']
-            if len(lcyk) > 2:
-                # Subgraph of connected cycles around k
-                Gtk = nx.subgraph(self.Gt, lcyk)
-                # ordered list of connections between cycles
-                try:
-                    lccyk = nx.find_cycle(Gtk)
-                except:
-                    pdb.set_trace()
-
-                # list of segment neighbours
-                neigh = self.Gs[k].keys()
-                # sega : list of air segment in neighors
-                sega = [n for n in neigh if
-                        (self.Gs.node[n]['name'] == 'AIR' or
-                         self.Gs.node[n]['name'] == '_AIR')]
-
-                sega_iso = [n for n in sega if len(self.Gs.node[n]['iso']) > 0]
-                sega_eff = list(set(sega).difference(set(sega_iso)))
-                nsector = len(neigh) - len(sega)
+            # Subgraph of connected cycles around k
+            Gtk = nx.subgraph(self.Gt, lcyk)
+            # ordered list of connections between cycles
+            lccyk = nx.find_cycle(Gtk)
+
+            # list of segment neighbours
+            neigh = self.Gs[k].keys()
+            # sega : list of air segment in neighors
+            sega = [n for n in neigh if
+                    (self.Gs.node[n]['name'] == 'AIR' or
+                     self.Gs.node[n]['name'] == '_AIR')]
+
+            sega_iso = [n for n in sega if len(self.Gs.node[n]['iso']) > 0]
+            sega_eff = list(set(sega).difference(set(sega_iso)))
+            nsector = len(neigh) - len(sega)
+
+            dsector = {i: [] for i in range(nsector)}
+            #
+            # team building algo
+            #
+            ct = 0
+            for ccy in lccyk:
+
+                segsep = self.Gt[ccy[0]][ccy[1]]['segment']
+                # filter only segments connected to point k (neigh)
+                lvseg = [x for x in segsep if x in neigh]
+                if len(lvseg) == 1 and (lvseg[0] in sega_eff):  # same sector
+                    dsector[ct].append(ccy[1])
+                else:  # change sector
+                    ct = (ct + 1) % nsector
+                    dsector[ct].append(ccy[1])
+
+            dagtot = {s: sum([dangles[(cy, k)] for cy in dsector[s]])
+                      for s in range(nsector)}
+            for s in range(nsector):
+                if dagtot[s] > (np.pi + difftol):
+                    self.ddiff[k] = (dsector[s], dagtot[s])
+                    break
 
-                dsector = {i: [] for i in range(nsector)}
-                #
-                # team building algo
-                #
-                ct = 0
-                # if k ==-44:
-                #     pdb.set_trace()
-                for ccy in lccyk:
-
-                    #segsep = self.Gt[ccy[0]][ccy[1]]['segment'][0]
-                    segsep = self.Gt[ccy[0]][ccy[1]]['segment']
-                    # filter only segments connected to point k (neigh)
-                    lvseg = [x for x in segsep if x in neigh]
-                    if len(lvseg) == 1 and (lvseg[0] in sega_eff):  # same sector
-                        dsector[ct].append(ccy[1])
-                    else:  # change sector
-                        ct = (ct + 1) % nsector
-                        dsector[ct].append(ccy[1])
-
-                    # typslab = self.Gs.node[segsep]['name']
-                    # if (typslab=='AIR' or typslab=='_AIR'): # same sector
-                        # dsector[ct].append(ccy[1])
-                    # else: # change sector
-                        # ct=(ct+1)%nsector
-                        # dsector[ct].append(ccy[1])
-                        # lcy2.append(ccy[1])
-                        # lcy1,lcy2 = lcy2,lcy1
-
-                dagtot = {s: 0 for s in range(nsector)}
-                save = []
-                for s in dsector:
-                    for cy in dsector[s]:
-                        da = dangles[cy]
-                        u = np.where(da[0, :].astype('int') == k)[0][0]
-                        save.append((cy, da[1, u]))
-                        dagtot[s] = dagtot[s] + da[1, u]
-                for s in dagtot:
-                    if dagtot[s] > (np.pi + difftol):
-                        self.ddiff[k] = (dsector[s], dagtot[s])
-                        break
-
-                # if agtot1 > (np.pi+tol):
-                #     self.ddiff[k]=(lcy1,agtot1)
-                # elif 2*np.pi-agtot1 > (np.pi+tol):
-                #     self.ddiff[k]=(lcy2,2*np.pi-agtot1)
-            else:
-                # diffraction by half-plane detected
-                if k in self.degree[1]:
-                    self.ddiff[k] = (lcyk, 2 * np.pi)
+        self._diffarrays()
 
 
     def buildGr(self):
@@ -10041,6 +11429,7 @@ class Layout(pro.PyLayers):
 
         """
 
+        self._loc = {}
         self.Gr = copy.deepcopy(self.Gt)
         self.Gr.remove_node(0)
         self.Gr.remove_edges_from(self.Gt.edges())
@@ -11819,6 +13208,44 @@ def outputGi_func(args):
     return (i0,i1, {'output':dintprob})
     # self.Gi.add_edge(i0, i1, output=dintprob)
 
+def _buildGv_func(lcy):
+    """ worker function of Layout.buildGv in parallel mode
+
+    Parameters
+    ----------
+
+    lcy : list
+        chunk of cycles
+
+    Notes
+    -----
+
+    The Layout is read from the module global _L_run which is set before
+    the pool is forked.
+
+    """
+    L = _L_run
+    return({ cy : L._buildGvcycle(cy) for cy in lcy })
+
+def _buildGi_func(lcy):
+    """ worker function of Layout.buildGi in parallel mode
+
+    Parameters
+    ----------
+
+    lcy : list
+        chunk of cycles
+
+    Notes
+    -----
+
+    The Layout (with the nodes of Gi) is read from the module global
+    _L_run which is set before the pool is forked.
+
+    """
+    L = _L_run
+    return({ cy : L._buildGicycle(cy) for cy in lcy })
+
 
 if __name__ == "__main__":
     plt.ion()
@@ -0,0 +1,566 @@
+# -*- coding: utf-8 -*-
+"""
+.. currentmodule:: pylayers.gis.layoutcore
+
+This module handles the read only numerical core of a Layout and the
+binary cache of the Layout graphs.
+
+The core of a built Layout (points, segments, normals, slabs, cycle polygons
+and CSR form of Gi) is written in a single binary file (Layout.exportcore)
+which a process not holding the Layout (a separate interpreter, another
+program) attaches to with np.memmap (LayoutCore). The arrays are shared
+through the page cache of the system : attaching does not copy nor unpickle
+anything. The process pools of pylayers are forked and inherit the Layout
+itself, they do not read the core file.
+
+The same file format is used for the binary cache of the Layout graphs
+(Layout._writecache / Layout._readcache).
+
+File format
+-----------
+
+    magic     : 8 bytes  'PYLCORE\\0'
+    version   : uint32
+    lenheader : uint32
+    header    : json (lenheader bytes)
+    data      : arrays aligned on 64 bytes
+
+The json header contains the index of the arrays ('arrays' :
+name -> (dtype,shape,offset)) and a few informations ('hash' : content hash
+of the layout, 'slabnames', 'filename').
+
+Graphs
+------
+
+graph2arrays converts a networkx graph into arrays : nodes (int or tuple
+of int) are stored as padded integer keys, edges as pairs of node indices
+and each node or edge attribute with the most compact of the following
+encodings
+
+    'bool' | 'int' | 'float' : one value per item
+    'str'   : index in a string table stored in the header
+    'seq'   : ragged sequences of numbers (offsets + values)
+    'ndict' : dictionnaries node -> number (outputs of Gi edges)
+    'pickle' : any other attribute (pickled list of values)
+
+.. autosummary::
+    :toctree: generated/
+
+    writecore
+    readcore
+    graph2arrays
+    arrays2graph
+    obj2array
+    array2obj
+    LayoutCore.__init__
+    LayoutCore.__repr__
+    LayoutCore.seg2pts
+    LayoutCore.cypolygon
+
+"""
+import os
+import sys
+import json
+import numbers
+import numpy as np
+if sys.version_info.major==2:
+    import cPickle as pickle
+else:
+    import pickle
+
+MAGIC = b'PYLCORE\x00'
+VERSION = 1
+ALIGN = 64
+
+
+def writecore(filename, darray, info={}):
+    """ write a dictionnary of arrays in a core file
+
+    Parameters
+    ----------
+
+    filename : string
+        full path of the core file
+    darray : dict
+        name -> np.ndarray
+    info : dict
+        json serializable informations stored in the header
+
+    Notes
+    -----
+
+    The file is written in a temporary file which is then renamed over
+    filename. On POSIX systems the rename is atomic : a reader opening the
+    file during the writing sees either the previous or the new core, and a
+    reader which has already mapped the previous core keeps it.
+
+    """
+    lname = sorted(darray.keys())
+    larr = [np.ascontiguousarray(darray[k]) for k in lname]
+
+    # offsets relative to the beginning of the data block
+    dindex = {}
+    offset = 0
+    for name, arr in zip(lname, larr):
+        offset = int(np.ceil(offset / float(ALIGN))) * ALIGN
+        dindex[name] = (arr.dtype.str, list(arr.shape), offset)
+        offset = offset + arr.nbytes
+
+    header = dict(info)
+    header['arrays'] = dindex
+    bheader = json.dumps(header).encode('utf-8')
+    start = len(MAGIC) + 8 + len(bheader)
+    start = int(np.ceil(start / float(ALIGN))) * ALIGN
+    bheader = bheader + b' ' * (start - len(MAGIC) - 8 - len(bheader))
+
+    filetmp = filename + '.tmp'
+    fd = open(filetmp, 'wb')
+    try:
+        fd.write(MAGIC)
+        fd.write(np.array([VERSION, len(bheader)], dtype='<u4').tobytes())
+        fd.write(bheader)
+        pos = 0
+        for name, arr in zip(lname, larr):
+            off = dindex[name][2]
+            fd.write(b'\x00' * (off - pos))
+            fd.write(arr.tobytes())
+            pos = off + arr.nbytes
+    finally:
+        fd.close()
+    # os.rename does not replace an existing file on Windows
+    if (os.name == 'nt') and os.path.isfile(filename):
+        os.remove(filename)
+    os.rename(filetmp, filename)
+
+
+def readcore(filename):
+    """ read the header of a core file and memory map its arrays
+
+    Parameters
+    ----------
+
+    filename : string
+        full path of the core file
+
+    Returns
+    -------
+
+    header : dict
+    darray : dict
+        name -> read only np.ndarray (view on the memory map)
+
+    """
+    fd = open(filename, 'rb')
+    try:
+        magic = fd.read(len(MAGIC))
+        if magic != MAGIC:
+            raise IOError(filename + ' is not a layout core file')
+        version, lenheader = [int(x) for x in
+                              np.frombuffer(fd.read(8), dtype='<u4')]
+        if version != VERSION:
+            raise IOError('layout core version ' + str(version) +
+                          ' not supported')
+        header = json.loads(fd.read(lenheader).decode('utf-8'))
+    finally:
+        fd.close()
+
+    start = len(MAGIC) + 8 + lenheader
+    mm = np.memmap(filename, dtype=np.uint8, mode='r')
+    darray = {}
+    for name, (dtype, shape, offset) in header['arrays'].items():
+        darray[str(name)] = np.ndarray(shape=tuple(shape),
+                                       dtype=np.dtype(str(dtype)),
+                                       buffer=mm, offset=start + offset)
+    return(header, darray)
+
+
+def obj2array(obj):
+    """ pickle a python object in a uint8 array """
+    return(np.frombuffer(pickle.dumps(obj, 2), dtype=np.uint8))
+
+
+def array2obj(arr):
+    """ unpickle a python object from a uint8 array (see obj2array) """
+    return(pickle.loads(arr.tobytes()))
+
+
+def _isint(x):
+    return(isinstance(x, numbers.Integral))
+
+
+def _iskey(n):
+    """ check if n is a valid node key (int or tuple of int) """
+    if isinstance(n, tuple):
+        return(all([_isint(x) for x in n]))
+    return(_isint(n))
+
+
+def _encodekeys(lnode):
+    """ encode a list of node keys in a padded integer array
+
+    Returns
+    -------
+
+    key  : (N x K) int64
+    lkey : (N,) int8   tuple length, 0 for an int
+
+    """
+    K = max([len(n) for n in lnode if isinstance(n, tuple)] + [1])
+    key = np.zeros((len(lnode), K), dtype=np.int64)
+    lkey = np.zeros(len(lnode), dtype=np.int8)
+    for k, n in enumerate(lnode):
+        if isinstance(n, tuple):
+            key[k, :len(n)] = n
+            lkey[k] = len(n)
+        else:
+            key[k, 0] = n
+    return(key, lkey)
+
+
+def _decodekeys(key, lkey):
+    return([tuple(r[:l]) if l > 0 else r[0]
+            for r, l in zip(key.tolist(), lkey.tolist())])
+
+
+def _encodevalues(lval, name, darray):
+    """ encode a list of attribute values
+
+    Parameters
+    ----------
+
+    lval : list
+        values
+    name : string
+        prefix of the arrays in darray
+    darray : dict
+        arrays (updated)
+
+    Returns
+    -------
+
+    meta : dict
+        json serializable description of the encoding
+
+    """
+    if all([isinstance(v, (bool, np.bool_)) for v in lval]):
+        darray[name + 'v'] = np.array(lval, dtype=bool)
+        return({'kind': 'bool'})
+    if all([_isint(v) for v in lval]):
+        darray[name + 'v'] = np.array(lval, dtype=np.int64)
+        return({'kind': 'int'})
+    if all([isinstance(v, numbers.Real) for v in lval]):
+        darray[name + 'v'] = np.array(lval, dtype=float)
+        return({'kind': 'float'})
+    if all([isinstance(v, str) for v in lval]):
+        try:
+            lstr = sorted(set(lval))
+            dstr = {v: k for k, v in enumerate(lstr)}
+            darray[name + 'v'] = np.array([dstr[v] for v in lval],
+                                          dtype=np.int32)
+            return({'kind': 'str',
+                    'table': [v.decode('utf-8') if isinstance(v, bytes)
+                              else v for v in lstr],
+                    'bytes': sys.version_info.major == 2})
+        except:
+            pass
+    # sequences of numbers
+    for cont, typ in (('list', list), ('tuple', tuple), ('array', np.ndarray)):
+        if all([isinstance(v, typ) for v in lval]):
+            if ((cont == 'array') and
+                    not all([np.ndim(v) == 1 for v in lval])):
+                break
+            lflat = [x for v in lval for x in v]
+            if not all([isinstance(x, numbers.Real) and
+                        not isinstance(x, (bool, np.bool_))
+                        for x in lflat]):
+                break
+            if all([_isint(x) for x in lflat]):
+                dtype = np.int64
+            else:
+                dtype = float
+            darray[name + 'o'] = np.hstack(([0], np.cumsum([len(v) for v in lval]))).astype(np.int64)
+            darray[name + 'v'] = np.array(lflat, dtype=dtype)
+            return({'kind': 'seq', 'cont': cont})
+    # dictionnaries node -> number
+    if all([isinstance(v, dict) for v in lval]):
+        litems = [(a, b) for v in lval for a, b in v.items()]
+        if all([_iskey(a) and isinstance(b, numbers.Real) for a, b in litems]):
+            key, lkey = _encodekeys([a for a, b in litems])
+            darray[name + 'o'] = np.hstack(([0], np.cumsum([len(v) for v in lval]))).astype(np.int64)
+            darray[name + 'k'] = key
+            darray[name + 'l'] = lkey
+            darray[name + 'v'] = np.array([b for a, b in litems], dtype=float)
+            return({'kind': 'ndict'})
+    # fallback
+    darray[name + 'p'] = obj2array(lval)
+    return({'kind': 'pickle'})
+
+
+def _decodevalues(meta, name, darray):
+    """ decode a list of attribute values (see _encodevalues) """
+    kind = meta['kind']
+    if kind in ('bool', 'int', 'float'):
+        return(darray[name + 'v'].tolist())
+    if kind == 'str':
+        if meta['bytes']:
+            table = [v.encode('utf-8') for v in meta['table']]
+        else:
+            table = meta['table']
+        return([table[k] for k in darray[name + 'v'].tolist()])
+    if kind == 'seq':
+        o = darray[name + 'o'].tolist()
+        v = darray[name + 'v']
+        if meta['cont'] == 'array':
+            v = np.array(v)
+            return([v[o[k]:o[k + 1]] for k in range(len(o) - 1)])
+        v = v.tolist()
+        if meta['cont'] == 'tuple':
+            return([tuple(v[o[k]:o[k + 1]]) for k in range(len(o) - 1)])
+        return([v[o[k]:o[k + 1]] for k in range(len(o) - 1)])
+    if kind == 'ndict':
+        o = darray[name + 'o'].tolist()
+        lk = _decodekeys(darray[name + 'k'], darray[name + 'l'])
+        v = darray[name + 'v'].tolist()
+        return([dict(zip(lk[o[k]:o[k + 1]], v[o[k]:o[k + 1]]))
+                for k in range(len(o) - 1)])
+    return(array2obj(darray[name + 'p']))
+
+
+def _encodeattr(ldict, name, darray):
+    """ encode the attributes of a list of dictionnaries
+
+    Returns
+    -------
+
+    meta : dict
+        attribute name -> encoding description
+
+    """
+    lattr = set([a for d in ldict for a in d])
+    meta = {}
+    for a in lattr:
+        u = np.array([a in d for d in ldict], dtype=bool)
+        na = name + a + '.'
+        darray[na + 'm'] = u
+        meta[a] = _encodevalues([d[a] for d in ldict if a in d], na, darray)
+    return(meta)
+
+
+def _decodeattr(meta, N, name, darray):
+    ldict = [{} for k in range(N)]
+    for a in meta:
+        na = name + a + '.'
+        u = np.where(darray[na + 'm'])[0].tolist()
+        lval = _decodevalues(meta[a], na, darray)
+        a = str(a)
+        for k, v in zip(u, lval):
+            ldict[k][a] = v
+    return(ldict)
+
+
+def graph2arrays(G, name, darray):
+    """ convert a networkx graph into arrays
+
+    Parameters
+    ----------
+
+    G : networkx Graph or DiGraph
+    name : string
+        prefix of the arrays in darray
+    darray : dict
+        arrays (updated)
+
+    Returns
+    -------
+
+    meta : dict
+        json serializable description of the graph
+
+    Notes
+    -----
+
+    The node positions G.pos, if any, are stored as well. A graph whose
+    nodes are not int or tuple of int, or whose attribute names are not
+    strings, is pickled.
+
+    """
+    lnode = G.nodes()
+    ledge = G.edges()
+    lnattr = [G.node[n] for n in lnode]
+    leattr = [G.edge[a][b] for a, b in ledge]
+    valid = all([_iskey(n) for n in lnode])
+    valid = valid and all([isinstance(a, str) for d in lnattr for a in d])
+    valid = valid and all([isinstance(a, str) for d in leattr for a in d])
+    valid = valid and (G.graph == {})
+    if not valid:
+        darray[name + 'p'] = obj2array(G)
+        return({'kind': 'pickle'})
+
+    key, lkey = _encodekeys(lnode)
+    darray[name + 'key'] = key
+    darray[name + 'lkey'] = lkey
+    dno = {n: k for k, n in enumerate(lnode)}
+    darray[name + 'edge'] = np.array([[dno[a], dno[b]] for a, b in ledge],
+                                     dtype=np.int64).reshape(-1, 2)
+
+    meta = {'kind': 'graph', 'directed': G.is_directed()}
+    meta['node'] = _encodeattr(lnattr, name + 'n.', darray)
+    meta['edge'] = _encodeattr(leattr, name + 'e.', darray)
+    if hasattr(G, 'pos'):
+        meta['pos'] = _encodeattr([{'pos': G.pos[n]} if n in G.pos else {}
+                                   for n in lnode], name + 'p.', darray)
+    return(meta)
+
+
+def arrays2graph(meta, name, darray, G):
+    """ rebuild a networkx graph from arrays (see graph2arrays)
+
+    Parameters
+    ----------
+
+    meta : dict
+        description of the graph
+    name : string
+        prefix of the arrays in darray
+    darray : dict
+        arrays
+    G : networkx graph
+        void graph of the right class (Graph or DiGraph)
+
+    Returns
+    -------
+
+    G : networkx graph
+
+    """
+    if meta['kind'] == 'pickle':
+        return(array2obj(darray[name + 'p']))
+
+    lnode = _decodekeys(darray[name + 'key'], darray[name + 'lkey'])
+    N = len(lnode)
+    lnattr = _decodeattr(meta['node'], N, name + 'n.', darray)
+    G.add_nodes_from(zip(lnode, lnattr))
+
+    edge = darray[name + 'edge'].tolist()
+    leattr = _decodeattr(meta['edge'], len(edge), name + 'e.', darray)
+    G.add_edges_from([(lnode[a], lnode[b], d)
+                      for (a, b), d in zip(edge, leattr)])
+
+    if 'pos' in meta:
+        lpos = _decodeattr(meta['pos'], N, name + 'p.', darray)
+        G.pos = {n: d['pos'] for n, d in zip(lnode, lpos) if 'pos' in d}
+    return(G)
+
+
+class LayoutCore(object):
+    """ read only numerical core of a Layout
+
+    Attributes
+    ----------
+
+    pt      : (2 x Np) points coordinates
+    tahe    : (2 x Ns) segment tail head (index in pt)
+    tsg     : (Ns,) segment index -> Gs segment number
+    tgs     : Gs segment number -> segment index
+    normal  : (3 x Ns) segment normals
+    z       : (2 x Ns) segment zmin zmax
+    slab    : (Ns,) index of the segment slab in slabnames
+    slabnames : list of slab names
+    cynum   : (Nc,) cycle numbers
+    cyoff   : (Nc+1,) vertices of cycle k are cypt[:,cyoff[k]:cyoff[k+1]]
+    cypt    : (2 x Nv) exterior vertices of the cycles polygons
+    cyindoor : (Nc,) indoor cycles
+    Gicsr   : dict, CSR form of Gi (see Layout.buildGicsr)
+    hash    : content hash of the layout (Layout.geomhash)
+
+    Notes
+    -----
+
+    All the arrays are read only views on a single memory map. This is
+    meant for processes which do not hold the Layout, the forked workers of
+    pylayers inherit the Layout and do not need it.
+
+    See Also
+    --------
+
+    pylayers.gis.layout.Layout.exportcore
+
+    """
+
+    def __init__(self, filename):
+        """ attach to a core file
+
+        Parameters
+        ----------
+
+        filename : string
+            full path of the core file
+
+        """
+        header, darray = readcore(filename)
+        self.filename = filename
+        self.hash = header.get('hash', '')
+        self.slabnames = header.get('slabnames', [])
+
+        self.Gicsr = {}
+        for name, arr in darray.items():
+            if name.startswith('Gi_'):
+                self.Gicsr[name[3:]] = arr
+            else:
+                setattr(self, name, arr)
+
+    def __repr__(self):
+        st = 'LayoutCore : ' + self.filename + '\n'
+        st = st + 'hash : ' + self.hash + '\n'
+        st = st + 'Np : ' + str(self.pt.shape[1]) + '\n'
+        st = st + 'Ns : ' + str(self.tahe.shape[1]) + '\n'
+        st = st + 'Nc : ' + str(len(self.cynum)) + '\n'
+        if 'typ' in self.Gicsr:
+            st = st + 'Ni : ' + str(len(self.Gicsr['typ'])) + '\n'
+        return(st)
+
+    def seg2pts(self, aseg):
+        """ convert segments numbers to tail and head coordinates
+
+        Parameters
+        ----------
+
+        aseg : np.array (,Ns) of Gs segment numbers
+
+        Returns
+        -------
+
+        pth : np.array (4 x Ns)
+
+        See Also
+        --------
+
+        pylayers.gis.layout.Layout.seg2pts
+
+        """
+        aseg = np.array(aseg).ravel()
+        iseg = self.tgs[aseg]
+        pth = np.vstack((self.pt[:, self.tahe[0, iseg]],
+                         self.pt[:, self.tahe[1, iseg]]))
+        return(pth)
+
+    def cypolygon(self, cy):
+        """ exterior vertices of a cycle polygon
+
+        Parameters
+        ----------
+
+        cy : int
+            cycle number
+
+        Returns
+        -------
+
+        p : np.array (2 x Nv)
+
+        """
+        k = np.where(self.cynum == cy)[0]
+        if len(k) == 0:
+            raise NameError("cycle " + str(cy) + " not in layout core")
+        k = k[0]
+        return(self.cypt[:, self.cyoff[k]:self.cyoff[k + 1]])
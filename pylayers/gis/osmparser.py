@@ -23,8 +23,15 @@ except:
     print "Warning : imposm seems not to be installed"
 import networkx as nx
 import numpy as np
+import multiprocessing as mp
+import json
+from itertools import chain
+from xml.etree.cElementTree import iterparse
 import pdb
 
+# tiles shared with the forked workers of buildtiles
+_T_run = None
+
 # classes that handle the OSM data file format.
 class Way(object):
     """  
@@ -629,10 +636,103 @@ class FloorPlan(nx.DiGraph):
         return fig,ax
 #
 #  Functions
+#     bdgtags
 #     osmparse
 #     getbdg
+#     osmtiles
+#     tilelayout
+#     waylayout
+#     buildtiles
 #
 #
+def _tagnum(s):
+    """ numerical value of an osm tag
+
+    Parameters
+    ----------
+
+    s : string
+        tag value e.g. '12', '12.5 m', '3;4'
+
+    Returns
+    -------
+
+    v : float
+        the value or the largest value of a list
+
+    Notes
+    -----
+
+    Raise a ValueError if the tag does not contain any number
+
+    """
+    lv = []
+    for x in s.replace(';',',').split(','):
+        x = x.strip()
+        if x.endswith('m'):
+            x = x[:-1].strip()
+        try:
+            lv.append(float(x))
+        except ValueError:
+            pass
+    if lv == []:
+        raise ValueError('osm tag '+repr(s)+' is not a number')
+    return max(lv)
+
+def bdgtags(tags,level_height=3.45):
+    """ get slab name and height of a building from its osm tags
+
+    Parameters
+    ----------
+
+    tags : dict
+        osm tags of the building way
+    level_height : float
+        height of a building level (meters)
+
+    Returns
+    -------
+
+    d : dict
+        {'name' : slab name, 'z' : (0,height)}
+
+    Notes
+    -----
+
+    The height is taken from 'height' or 'building:height', or else from
+    the number of levels ('building:levels' or 'levels', 2 if it is not
+    a number). It is 12 meters if none of these tags is a number.
+
+    """
+    d = {}
+    # material 
+    if tags.has_key('material'):
+        d['name']=tags['material']
+    elif tags.has_key('building:material'):
+        d['name']=tags['building:material']
+    else:
+        d['name']='WALL'
+    # height 
+    z = None
+    for k in ['height','building:height']:
+        if (z is None) and tags.has_key(k):
+            try:
+                z = _tagnum(tags[k])
+            except ValueError:
+                pass
+    for k in ['building:levels','levels']:
+        if (z is None) and tags.has_key(k):
+            try:
+                nb_levels = int(_tagnum(tags[k]))
+            except ValueError:
+                nb_levels = 2
+            z = nb_levels*level_height
+    if z is None:
+        z = 12
+    d['z']=(0,z)
+    return d
+
+
 def getosm(address='Rennes',latlon=0,dist_m=400,cart=False):
     """ get osm region from osmapi
 
@@ -688,37 +788,7 @@ def getosm(address='Rennes',latlon=0,dist_m=400,cart=False):
     coords.filter(lexcluded)
     dpoly={}
     for iw in ways.w:
-        ways.way[iw].tags = {}
-        # material 
-        if ways.w[iw][1].has_key('material'):
-            ways.way[iw].tags['name']=ways.w[iw][1]['material']
-        elif ways.w[iw][1].has_key('building:material'):
-            ways.way[iw].tags['name']=ways.w[iw][1]['building:material']
-        else:
-            ways.way[iw].tags['name']='WALL'
-        # height 
-        if ways.w[iw][1].has_key('height'):
-            ways.way[iw].tags['z']=(0,eval(ways.w[iw][1]['height']))
-        elif ways.w[iw][1].has_key('building:height'):
-            ways.way[iw].tags['z']=(0,eval(ways.w[iw][1]['building:height']))
-        elif ways.w[iw][1].has_key('building:levels'):
-            nb_levels = eval(ways.w[iw][1]['building:levels'])
-            if type(nb_levels)!=int:
-                try:
-                    nb_levels=max(nb_levels)
-                except:
-                    nb_levels=2
-            ways.way[iw].tags['z']=(0,nb_levels*level_height)
-        elif ways.w[iw][1].has_key('levels'):
-            nb_levels = eval(ways.w[iw][1]['levels'])
-            if type(nb_levels)!=int:
-                try:
-                    nb_levels=max(nb_levels)
-                except:
-                    nb_levels=2
-            ways.way[iw].tags['z']=(0,nb_levels*level_height)
-        else:
-            ways.way[iw].tags['z']=(0,12)
+        ways.way[iw].tags = bdgtags(ways.w[iw][1],level_height=level_height)
                           
         ptpoly=[coords.xy[x] for x in ways.w[iw][0]]
         dpoly[iw]=geu.Polygon(ptpoly,vnodes=ways.w[iw][0])
@@ -928,3 +998,476 @@ def buildingsparse(filename):
             bdg.build(typ='relation',eid=bid)
     return bdg,m
 
+
+def osmstream(filename,coords_callback=None,ways_callback=None,
+              relations_callback=None,chunk=4096):
+    """ stream the coordinates, the ways and/or the relations of an osm file
+
+    Parameters
+    ----------
+
+    filename : string
+        .osm (xml) or .pbf file
+    coords_callback : function
+        called with lists of (osmid,lon,lat)
+    ways_callback : function
+        called with lists of (osmid,tags,refs)
+    relations_callback : function
+        called with lists of (osmid,tags,members), members is a list of
+        (ref,type,role)
+    chunk : int
+        number of elements passed to a callback at once
+
+    Notes
+    -----
+
+    The callbacks have the signature of the imposm ones, the .pbf files are
+    parsed by imposm. The xml elements are released as soon as they
+    are read so the whole document is never held in memory.
+
+    """
+    if os.path.splitext(filename)[1] == '.pbf':
+        parser = OSMParser(concurrency=4,
+                           coords_callback=coords_callback,
+                           ways_callback=ways_callback,
+                           relations_callback=relations_callback)
+        parser.parse(filename)
+        return
+
+    lcoords = []
+    lways = []
+    lrels = []
+    context = iterparse(filename, events=('start', 'end'))
+    event, root = next(context)
+    for event, elem in context:
+        if event != 'end':
+            continue
+        if elem.tag == 'node':
+            if coords_callback is not None:
+                lcoords.append((int(elem.get('id')),
+                                float(elem.get('lon')),
+                                float(elem.get('lat'))))
+                if len(lcoords) == chunk:
+                    coords_callback(lcoords)
+                    lcoords = []
+            root.clear()
+        elif elem.tag == 'way':
+            if ways_callback is not None:
+                refs = [int(x.get('ref')) for x in elem.iter('nd')]
+                tags = dict([(x.get('k'), x.get('v')) for x in elem.iter('tag')])
+                lways.append((int(elem.get('id')), tags, refs))
+                if len(lways) == chunk:
+                    ways_callback(lways)
+                    lways = []
+            root.clear()
+        elif elem.tag == 'relation':
+            if relations_callback is not None:
+                members = [(int(x.get('ref')), x.get('type'), x.get('role'))
+                           for x in elem.iter('member')]
+                tags = dict([(x.get('k'), x.get('v')) for x in elem.iter('tag')])
+                lrels.append((int(elem.get('id')), tags, members))
+                if len(lrels) == chunk:
+                    relations_callback(lrels)
+                    lrels = []
+            root.clear()
+
+    if (coords_callback is not None) and (len(lcoords) > 0):
+        coords_callback(lcoords)
+    if (ways_callback is not None) and (len(lways) > 0):
+        ways_callback(lways)
+    if (relations_callback is not None) and (len(lrels) > 0):
+        relations_callback(lrels)
+
+
+def osmtiles(_filename,tilesize=500.,margin=50.,level_height=3.45,verbose=False):
+    """ partition the buildings of an osm file into square tiles
+
+    Parameters
+    ----------
+
+    _filename : string
+        .osm or .pbf file
+    tilesize : float
+        side of a tile (meters)
+    margin : float
+        a building is also copied in the tiles which are closer than
+        margin from its bounding box (halo)
+    level_height : float
+    verbose : boolean
+
+    Returns
+    -------
+
+    tiles : dict
+        'm'       : Basemap converter common to all the tiles
+        'x','y'   : cartesian coordinates of the building nodes
+        'osmnode' : osm ids of the building nodes (sorted)
+        'wid'     : osm ids of the buildings
+        'wref'    : node index (in 'osmnode') of the building contours
+        'wo'      : offsets of the contours in 'wref'
+        'tags'    : slab name and height of the buildings (see bdgtags)
+        'wbox'    : (4 x Nw) xmin,ymin,xmax,ymax of the buildings
+        'tile'    : {(ix,iy) : {'own' : array, 'halo' : array}} building
+                    index owned by a tile (centroid inside the tile) and
+                    building index of the halo
+        'mpoly'   : osm ids of the multipolygon building relations
+
+    Notes
+    -----
+
+    The file is streamed twice. The first pass keeps only the building
+    ways, the second one keeps only the coordinates of their nodes.
+
+    Only the buildings drawn as closed ways are imported. The buildings
+    drawn as multipolygon relations (courtyards, building parts) are
+    ignored, a warning gives their number and their ids are returned in
+    'mpoly'.
+
+    See Also
+    --------
+
+    osmstream
+    buildtiles
+
+    """
+    if (('/' in _filename) or ('//' in _filename)):
+        filename = _filename
+    else:
+        filename = pyu.getlong(_filename,pstruc['DIROSM'])
+
+    lwid = []
+    lrefs = []
+    ltags = []
+
+    lmpoly = []
+
+    def ways_callback(ways):
+        for osmid, tags, refs in ways:
+            if ('building' in tags) and (len(refs) > 2):
+                lwid.append(osmid)
+                lrefs.append(refs)
+                ltags.append(bdgtags(tags,level_height=level_height))
+
+    def relations_callback(relations):
+        for osmid, tags, members in relations:
+            if ((tags.get('type') == 'multipolygon') and
+                (('building' in tags) or ('building:part' in tags))):
+                lmpoly.append(osmid)
+
+    if verbose:
+        print "streaming ways"
+    osmstream(filename,ways_callback=ways_callback,
+              relations_callback=relations_callback)
+    if len(lmpoly) > 0:
+        print "Warning : ",len(lmpoly),"multipolygon building relations are ignored"
+
+    nref = np.array([len(x) for x in lrefs],dtype=int)
+    aref = np.fromiter(chain.from_iterable(lrefs),dtype=np.int64,
+                       count=nref.sum())
+    del lrefs[:]
+    uref = np.unique(aref)
+    lon = np.zeros(len(uref))
+    lat = np.zeros(len(uref))
+    found = np.zeros(len(uref),dtype=bool)
+
+    def coords_callback(coords):
+        if len(coords)==0:
+            return
+        c = np.array(coords)
+        ids = c[:,0].astype(np.int64)
+        ip = np.minimum(np.searchsorted(uref,ids),len(uref)-1)
+        hit = uref[ip]==ids
+        lon[ip[hit]] = c[hit,1]
+        lat[ip[hit]] = c[hit,2]
+        found[ip[hit]] = True
+
+    if len(uref) > 0:
+        if verbose:
+            print "streaming coords of",len(uref),"nodes"
+        osmstream(filename,coords_callback=coords_callback)
+
+    # building index of each node of aref and validity of the buildings
+    wo = np.hstack((0,np.cumsum(nref))).astype(int)
+    wref = np.searchsorted(uref,aref)
+    iw = np.repeat(np.arange(len(nref)),nref)
+    valid = np.ones(len(nref),dtype=bool)
+    valid[iw[~found[wref]]] = False
+
+    tiles = {'tilesize':tilesize,'margin':margin,'tile':{},
+             'mpoly':np.array(lmpoly,dtype=np.int64)}
+    uf = np.where(found)[0]
+    if len(uf)==0:
+        tiles['m'] = None
+        return tiles
+
+    # common Cassini projection (see Coords.cartesian)
+    bd = np.array([lon[uf].min(),lat[uf].min(),lon[uf].max(),lat[uf].max()])
+    lon_0 = (bd[0]+bd[2])/2.
+    lat_0 = (bd[1]+bd[3])/2.
+    m = Basemap(llcrnrlon=bd[0], llcrnrlat=bd[1],
+                urcrnrlon=bd[2], urcrnrlat=bd[3],
+                resolution='i', projection='cass', lon_0=lon_0, lat_0=lat_0)
+    x, y = m(lon,lat)
+    x = np.array(x)
+    y = np.array(y)
+
+    # bounding box and centroid of the buildings
+    xw = x[wref]
+    yw = y[wref]
+    wbox = np.vstack((np.minimum.reduceat(xw,wo[:-1]),
+                      np.minimum.reduceat(yw,wo[:-1]),
+                      np.maximum.reduceat(xw,wo[:-1]),
+                      np.maximum.reduceat(yw,wo[:-1])))
+    cx = np.add.reduceat(xw,wo[:-1])/nref
+    cy = np.add.reduceat(yw,wo[:-1])/nref
+
+    ix = np.floor(cx/tilesize).astype(int)
+    iy = np.floor(cy/tilesize).astype(int)
+    # range of tiles reached by the halo of each building
+    ix0 = np.floor((wbox[0]-margin)/tilesize).astype(int)
+    iy0 = np.floor((wbox[1]-margin)/tilesize).astype(int)
+    ix1 = np.floor((wbox[2]+margin)/tilesize).astype(int)
+    iy1 = np.floor((wbox[3]+margin)/tilesize).astype(int)
+
+    downs = {}
+    dhalo = {}
+    for k in np.where(valid)[0]:
+        key = (int(ix[k]),int(iy[k]))
+        downs.setdefault(key,[]).append(k)
+        for kx in range(ix0[k],ix1[k]+1):
+            for ky in range(iy0[k],iy1[k]+1):
+                if (kx,ky)!=key:
+                    dhalo.setdefault((kx,ky),[]).append(k)
+
+    for key in downs:
+        tiles['tile'][key] = {'own':np.array(downs[key],dtype=int),
+                              'halo':np.array(dhalo.get(key,[]),dtype=int)}
+
+    tiles['m'] = m
+    tiles['x'] = x
+    tiles['y'] = y
+    tiles['osmnode'] = uref
+    tiles['wid'] = np.array(lwid)
+    tiles['wref'] = wref
+    tiles['wo'] = wo
+    tiles['iw'] = iw
+    tiles['tags'] = ltags
+    tiles['wbox'] = wbox
+    tiles['owner'] = np.vstack((ix,iy))
+
+    if verbose:
+        print len(tiles['tile']),"tiles",valid.sum(),"buildings"
+
+    return tiles
+
+
+def tilelayout(tiles,key,name='tile',build=False):
+    """ create, save and optionally build the Layout of a tile
+
+    Parameters
+    ----------
+
+    tiles : dict
+        output of osmtiles
+    key : tuple
+        (ix,iy) tile index
+    name : string
+        prefix of the .lay files
+    build : boolean
+        build and dump the graphs of the tile
+
+    Returns
+    -------
+
+    meta : dict
+        stitching metadata of the tile
+
+    Notes
+    -----
+
+    Points of a tile Layout are numbered -1..-Np. 'osmnode' gives the osm
+    id of each of them so that tiles can be stitched back together. The
+    halo buildings are part of the tile Layout, 'halo' gives their owner.
+
+    """
+    tilesize = tiles['tilesize']
+    lw = np.hstack((tiles['tile'][key]['own'],tiles['tile'][key]['halo']))
+    wo = tiles['wo']
+    # node index of the tile and local point numbers
+    lnidx = [tiles['wref'][wo[k]:wo[k+1]] for k in lw]
+    unidx, inv = np.unique(np.hstack(lnidx),return_inverse=True)
+    dxy = {-(i+1):np.array([tiles['x'][u],tiles['y'][u]])
+           for i,u in enumerate(unidx)}
+    lway = []
+    io = 0
+    for k, ln in zip(lw,lnidx):
+        refs = (-(inv[io:io+len(ln)]+1)).tolist()
+        io = io + len(ln)
+        lway.append((refs,dict(tiles['tags'][k])))
+
+    L = waylayout(name+'_'+str(key[0])+'_'+str(key[1])+'.lay',dxy,lway,
+                  m=tiles['m'],build=build)
+
+    nown = len(tiles['tile'][key]['own'])
+    owner = tiles['owner'][:,lw[nown:]]
+    meta = {'file':L._filename,
+            'index':[int(key[0]),int(key[1])],
+            'bbox':[key[0]*tilesize,key[1]*tilesize,
+                    (key[0]+1)*tilesize,(key[1]+1)*tilesize],
+            'extent':[float(tiles['wbox'][0,lw].min()),
+                      float(tiles['wbox'][1,lw].min()),
+                      float(tiles['wbox'][2,lw].max()),
+                      float(tiles['wbox'][3,lw].max())],
+            'own':tiles['wid'][lw[:nown]].tolist(),
+            'halo':[[int(w),str(o[0])+'_'+str(o[1])] for w,o in
+                    zip(tiles['wid'][lw[nown:]],owner.T)],
+            'osmnode':tiles['osmnode'][unidx].tolist(),
+            'Np':int(L.Np),
+            'Ns':int(L.Ns)}
+    return meta
+
+
+def waylayout(filename,dxy,lway,m=None,build=False):
+    """ create and save an outdoor Layout from points and ways
+
+    Parameters
+    ----------
+
+    filename : string
+        .lay file name
+    dxy : dict
+        {point number (<0) : array([x,y])}
+    lway : list
+        [(refs,tags)]
+    m : Basemap
+        converter of the cartesian coordinates
+    build : boolean
+        build and dump the graphs
+
+    Returns
+    -------
+
+    L : Layout
+
+    See Also
+    --------
+
+    pylayers.gis.layout.Layout._importways
+
+    """
+    # Layout imports this module
+    from pylayers.gis.layout import Layout
+
+    L = Layout(typ='outdoor')
+    L._filename = filename
+    L.coordinates = 'cart'
+    L.zceil = -1e10
+    L.zfloor = 1e10
+    L.Np = L._importways(dxy,lway)
+    if m is not None:
+        L.m = m
+    for k in L.sl.keys():
+        if k not in L.name:
+            L.name[k] = []
+    L.g2npy()
+    L.boundary()
+    L.subseg()
+    L.updateshseg()
+    L.save()
+    if build:
+        L.build()
+        L.lbltg.append('s')
+        L.dumpw()
+    return L
+
+
+def buildtiles(_filename,tilesize=500.,margin=50.,build=False,nproc=0,verbose=False):
+    """ import a large osm file as a set of tile Layouts
+
+    Parameters
+    ----------
+
+    _filename : string
+        .osm or .pbf file
+    tilesize : float
+        side of a tile (meters)
+    margin : float
+        halo width (meters)
+    build : boolean
+        build and dump the graphs of each tile
+    nproc : int
+        number of processes (0 : sequential, -1 : all the cpu)
+    verbose : boolean
+
+    Returns
+    -------
+
+    meta : dict
+        stitching metadata, also saved in <name>_tiles.json in the
+        layout directory ('mpoly' : ignored multipolygon buildings)
+
+    Examples
+    --------
+
+    >>> from pylayers.gis.osmparser import *
+    >>> meta = buildtiles('district.osm',tilesize=400,nproc=4) # doctest: +SKIP
+
+    See Also
+    --------
+
+    osmtiles
+    tilelayout
+
+    """
+    global _T_run
+
+    name = os.path.splitext(os.path.basename(_filename))[0]
+    tiles = osmtiles(_filename,tilesize=tilesize,margin=margin,verbose=verbose)
+    tiles['name'] = name
+    lkey = sorted(tiles['tile'].keys())
+
+    if nproc < 0:
+        nproc = mp.cpu_count()
+    if (nproc > 1) and (len(lkey) > 1):
+        # workers are forked and inherit the tiles
+        _T_run = (tiles,build)
+        pool = mp.Pool(min(nproc,len(lkey)))
+        try:
+            lmeta = pool.map(_tile_func,lkey,chunksize=1)
+        finally:
+            pool.close()
+            pool.join()
+            _T_run = None
+    else:
+        lmeta = [tilelayout(tiles,key,name=name,build=build) for key in lkey]
+
+    skey = [str(key[0])+'_'+str(key[1]) for key in lkey]
+    for meta in lmeta:
+        ix, iy = meta['index']
+        meta['neighbors'] = [str(ix+dx)+'_'+str(iy+dy)
+                             for dx in [-1,0,1] for dy in [-1,0,1]
+                             if ((dx,dy)!=(0,0)) and
+                             (str(ix+dx)+'_'+str(iy+dy) in skey)]
+
+    meta = {'version':1,
+            'source':os.path.basename(_filename),
+            'tilesize':tilesize,
+            'margin':margin,
+            'mpoly':tiles['mpoly'].tolist(),
+            'tiles':dict(zip(skey,lmeta))}
+    if tiles['m'] is not None:
+        m = tiles['m']
+        meta['latlon'] = [m.llcrnrlon,m.llcrnrlat,m.urcrnrlon,m.urcrnrlat]
+
+    filemeta = pyu.getlong(name+'_tiles.json',pstruc['DIRLAY'])
+    fd = open(filemeta,'w')
+    json.dump(meta,fd,indent=1)
+    fd.close()
+    return meta
+
+
+def _tile_func(key):
+    """ worker of buildtiles (the tiles are in _T_run)
+    """
+    tiles, build = _T_run
+    return tilelayout(tiles,key,name=tiles['name'],build=build)
@@ -0,0 +1,128 @@
+from pylayers.gis.layout import *
+import pylayers.util.geomutil as geu
+import networkx as nx
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+L.build()
+
+def find_diffractions(L,difftol):
+    """ diffraction points found cycle per cycle and point per point
+    (former Layout._find_diffractions)
+    """
+    dangles = {cy: np.array(geu.get_pol_angles(L.Gt.node[cy]['polyg']))
+               for cy in L.Gt.nodes() if cy != 0}
+    lpnt = [x for x in L.Gs.node if (x < 0 and x not in L.degree[0])]
+    ddiff = {}
+    for k in lpnt:
+        lcyk = L.Gs.node[k]['ncycles']
+        if len(lcyk) > 2:
+            Gtk = nx.subgraph(L.Gt, lcyk)
+            lccyk = nx.find_cycle(Gtk)
+            neigh = L.Gs[k].keys()
+            sega = [n for n in neigh if L.Gs.node[n]['name'] in ['AIR','_AIR']]
+            sega_iso = [n for n in sega if len(L.Gs.node[n]['iso']) > 0]
+            sega_eff = list(set(sega).difference(set(sega_iso)))
+            nsector = len(neigh) - len(sega)
+            dsector = {i: [] for i in range(nsector)}
+            ct = 0
+            for ccy in lccyk:
+                segsep = L.Gt[ccy[0]][ccy[1]]['segment']
+                lvseg = [x for x in segsep if x in neigh]
+                if len(lvseg) == 1 and (lvseg[0] in sega_eff):
+                    dsector[ct].append(ccy[1])
+                else:
+                    ct = (ct + 1) % nsector
+                    dsector[ct].append(ccy[1])
+            dagtot = {s: 0 for s in range(nsector)}
+            for s in dsector:
+                for cy in dsector[s]:
+                    da = dangles[cy]
+                    u = np.where(da[0, :].astype('int') == k)[0][0]
+                    dagtot[s] = dagtot[s] + da[1, u]
+            for s in dagtot:
+                if dagtot[s] > (np.pi + difftol):
+                    ddiff[k] = (dsector[s], dagtot[s])
+                    break
+        else:
+            if k in L.degree[1]:
+                ddiff[k] = (lcyk, 2 * np.pi)
+    return ddiff
+
+def diffslab(L,npt,lz):
+    """ segments and slabs of a diffraction point per height
+    (former Layout.get_diffslab)
+    """
+    dz_seg = {z:[] for z in range(len(lz))}
+    dz_sl = {z:[] for z in range(len(lz))}
+    for cy in L.ddiff[npt][0]:
+        vn = set(L.Gt.node[cy]['polyg'].vnodes)
+        lseg = set(nx.neighbors(L.Gs,npt)).intersection(vn)
+        for x in [ x for x in lseg if L.Gs.node[x]['name'] != '_AIR']:
+            z = (lz > L.Gs.node[x]['z'][0]) & (lz <= L.Gs.node[x]['z'][1])
+            for i in np.where(z)[0]:
+                dz_seg[i].append(x)
+                dz_sl[i].append(L.Gs.node[x]['name'])
+    return dz_seg.values(),dz_sl.values()
+
+def diffface(L,npt):
+    """ wedge faces of a diffraction point (former Rays.eval)
+    """
+    lair = L.name.get('AIR',[]) + L.name.get('_AIR',[])
+    aseg = [ x for x in nx.neighbors(L.Gs,npt) if x not in lair ]
+    if len(aseg) == 1:
+        aseg.extend(aseg)
+    return aseg[:2]
+
+class Tesdiffarrays(TestCase):
+    def test_find_diffractions(self):
+        print "testing _find_diffractions versus point per point search"
+        ddiff = find_diffractions(L,L._difftol)
+        assert_equal(sorted(L.ddiff.keys()),sorted(ddiff.keys()))
+        for k in ddiff:
+            assert_equal(sorted(L.ddiff[k][0]),sorted(ddiff[k][0]))
+            assert_almost_equal(L.ddiff[k][1],ddiff[k][1])
+
+    def test_diffindex(self):
+        print "testing diffindex and diffcycle"
+        lpt = sorted(L.ddiff.keys())
+        assert_equal(L.diffindex(np.array(lpt)),np.arange(len(lpt)))
+        for k,npt in enumerate(lpt):
+            assert_equal(L.diffindex(npt),k)
+            assert_almost_equal(L.diffang[k],L.ddiff[npt][1])
+            assert_equal(L.diffface[k],diffface(L,npt))
+        lnodiff = [ n for n in L.Gs.node if (n < 0) and (n not in L.ddiff) ]
+        lnodiff = lnodiff + [max(L.Gs.node.keys())+1]
+        assert_equal(L.diffindex(np.array(lnodiff)),-np.ones(len(lnodiff)))
+        for cy in L.Gt.node:
+            ref = [ npt for npt in L.ddiff if cy in L.ddiff[npt][0] ]
+            assert_equal(sorted(L.diffcycle(cy)),sorted(ref))
+
+    def test_get_diffslab(self):
+        print "testing get_diffslab versus per segment loop"
+        lz = np.linspace(-0.5,4,19)
+        for npt in L.ddiff:
+            s1,sl1 = L.get_diffslab(npt,lz)
+            s2,sl2 = diffslab(L,npt,lz)
+            assert_equal(len(s1),len(lz))
+            assert_equal([sorted(x) for x in s1],[sorted(x) for x in s2])
+            assert_equal([sorted(x) for x in sl1],[sorted(x) for x in sl2])
+
+    def test_noface(self):
+        print "testing diffface of a point without non air segment"
+        npt = sorted(L.ddiff.keys())[0]
+        neigh = nx.neighbors(L.Gs,npt)
+        face = L.diffface.copy()
+        lair = L.name.get('AIR',[])
+        try:
+            L.name['AIR'] = lair + neigh
+            L._diffarrays()
+            assert_equal(L.diffface[L.diffindex(npt)],[-1,-1])
+        finally:
+            L.name['AIR'] = lair
+            L._diffarrays()
+        assert_equal(L.diffface,face)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,72 @@
+from pylayers.gis.layout import *
+from pylayers.util.project import *
+import pylayers.util.pyutil as pyu
+import shutil
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+# copy of defstr, the edited layouts are saved (dumpw) under their own name
+_filename = 'defstr_build.ini'
+shutil.copy(pyu.getlong('defstr.ini',pstruc['DIRLAY']),
+            pyu.getlong(_filename,pstruc['DIRLAY']))
+
+def layout():
+    L = Layout(_filename)
+    L.build()
+    return L
+
+def edit(L):
+    """ move by 1 cm one termination point of a segment
+    """
+    lseg = sorted([ s for s in L.Gs.node if (s > 0) and
+                    (L.Gs.node[s]['name'] not in ['AIR','_AIR']) ])
+    npt = L.Gs.node[lseg[len(lseg)/2]]['connect'][0]
+    x,y = L.Gs.pos[npt]
+    L.Gs.pos[npt] = (x+0.01,y)
+    L._geomchanged([npt])
+    L.g2npy()
+
+def edges(G):
+    if G.is_directed():
+        return sorted(G.edges())
+    return sorted([ tuple(sorted(e)) for e in G.edges() ])
+
+def assert_build_equal(L1,L2):
+    for g in 'tvi':
+        G1 = getattr(L1,'G'+g)
+        G2 = getattr(L2,'G'+g)
+        assert_equal(sorted(G1.nodes()),sorted(G2.nodes()))
+        assert_equal(edges(G1),edges(G2))
+    for (i0,i1) in L1.Gi.edges():
+        o1 = L1.Gi[i0][i1].get('output',{})
+        o2 = L2.Gi[i0][i1].get('output',{})
+        assert_equal(sorted(o1.keys()),sorted(o2.keys()))
+        for i2 in o1:
+            assert_almost_equal(o1[i2],o2[i2])
+
+class Tesbuild(TestCase):
+    def test_incremental(self):
+        print "testing incremental build versus full build after an edit"
+        L1 = layout()
+        edit(L1)
+        L1.build(incremental=True)
+        L2 = layout()
+        edit(L2)
+        L2.build()
+        assert_build_equal(L1,L2)
+
+    def test_parallel(self):
+        print "testing parallel build versus serial build"
+        L1 = layout()
+        L2 = Layout(_filename)
+        L2.build(multi=True,nproc=2)
+        assert_build_equal(L1,L2)
+        # after an edit, full and incremental
+        edit(L1)
+        L1.build()
+        edit(L2)
+        L2.build(multi=True,nproc=2,incremental=True)
+        assert_build_equal(L1,L2)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,64 @@
+from pylayers.gis.layout import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+L.build()
+
+class Tescache(TestCase):
+    def test_roundtrip(self):
+        print "testing layout.bin round trip"
+        L2 = Layout('defstr.ini',bgraphs=False,bcheck=False)
+        L2.dumpr()
+        for g in 'stvi':
+            G1 = getattr(L,'G'+g)
+            G2 = getattr(L2,'G'+g)
+            assert_equal(sorted(G1.nodes()),sorted(G2.nodes()))
+            assert_equal(sorted(map(sorted,G1.edges())),sorted(map(sorted,G2.edges())))
+        for n in L.Gs.pos:
+            assert_almost_equal(L.Gs.pos[n],L2.Gs.pos[n])
+        for e in L.Gi.edges():
+            assert_equal(L.Gi.edge[e[0]][e[1]].get('output',{}),
+                         L2.Gi.edge[e[0]][e[1]].get('output',{}))
+        for k in ['pt','tahe','tsg','normal']:
+            assert_almost_equal(getattr(L,k),getattr(L2,k))
+        for k in L.Gicsr:
+            assert_equal(L.Gicsr[k],L2.Gicsr[k])
+        assert_equal(L.Gicsr_id,L2.Gicsr_id)
+        assert_equal(L._geomhash,L2._geomhash)
+
+    def test_outdated(self):
+        print "testing layout.bin written from another version of the layout file"
+        L2 = Layout('defstr.ini',bgraphs=False,bcheck=False)
+        L2._hash = 'x' + L2._hash[1:]
+        assert_raises(NameError,L2.dumpr)
+
+    def test_gicsr_stale(self):
+        print "testing stored Gicsr arrays which do not match Gi"
+        ref = dict(L.Gicsr)
+        try:
+            # same number of interactions, other order
+            d = dict(ref)
+            d['inter'] = ref['inter'][::-1].copy()
+            d['typ'] = ref['typ'][::-1].copy()
+            d['oweight'] = 0*ref['oweight']
+            L._setGicsr(d)
+            assert_equal(L.Gicsr['oweight'],ref['oweight'])
+            # built from another geometry
+            d = dict(ref)
+            d['oweight'] = 0*ref['oweight']
+            d['geomhash'] = np.array('x'*32)
+            L._setGicsr(d)
+            assert_equal(L.Gicsr['oweight'],ref['oweight'])
+            # up to date
+            d['geomhash'] = np.array(L._geomhash)
+            L._setGicsr(d)
+            assert_equal(L.Gicsr['oweight'],d['oweight'])
+            assert_(not 'geomhash' in L.Gicsr)
+        finally:
+            L.buildGicsr()
+        for k in ref:
+            assert_equal(L.Gicsr[k],ref[k])
+
+if __name__ == "__main__":
+    run_module_suite()
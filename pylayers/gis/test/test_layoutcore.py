@@ -0,0 +1,128 @@
+from pylayers.gis.layout import *
+from pylayers.gis.layoutcore import *
+import networkx as nx
+import os
+import tempfile
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+dirname = tempfile.mkdtemp()
+
+def darrays():
+    np.random.seed(0)
+    d = {}
+    d['b'] = np.random.rand(7) > 0.5
+    d['i8'] = np.arange(-5,6,dtype=np.int8)
+    d['i'] = np.random.randint(0,100,(3,5))
+    d['f'] = np.random.rand(2,3,4)
+    d['c'] = np.random.rand(5) + 1j*np.random.rand(5)
+    d['t'] = np.random.rand(4,6).T
+    d['e'] = np.zeros((2,0))
+    return d
+
+def assert_graph_equal(G1,G2):
+    assert_equal(G1.is_directed(),G2.is_directed())
+    assert_equal(sorted(G1.nodes()),sorted(G2.nodes()))
+    for n in G1.node:
+        assert_equal(G1.node[n],G2.node[n])
+    assert_equal(sorted(G1.edges()),sorted(G2.edges()))
+    for a,b in G1.edges():
+        assert_equal(G1.edge[a][b],G2.edge[a][b])
+    if hasattr(G1,'pos'):
+        assert_equal(G1.pos,G2.pos)
+
+class Teslayoutcore(TestCase):
+    def test_writeread(self):
+        print "testing writecore readcore round trip"
+        filename = os.path.join(dirname,'core.bin')
+        d = darrays()
+        writecore(filename,d,{'hash':'abc','slabnames':['WALL']})
+        header,d2 = readcore(filename)
+        assert_equal(header['hash'],'abc')
+        assert_equal(header['slabnames'],['WALL'])
+        assert_equal(sorted(d2.keys()),sorted(d.keys()))
+        for k in d:
+            assert_equal(d2[k].dtype,d[k].dtype)
+            assert_equal(d2[k].shape,d[k].shape)
+            assert_equal(d2[k],d[k])
+            assert_(not d2[k].flags.writeable)
+            assert_equal(header['arrays'][k][2] % ALIGN,0)
+        assert_(not os.path.isfile(filename+'.tmp'))
+        # rewrite over an existing file, the mapped arrays are kept
+        d3 = {'f':2*d['f']}
+        writecore(filename,d3)
+        assert_equal(d2['f'],d['f'])
+        header,d4 = readcore(filename)
+        assert_equal(d4.keys(),['f'])
+        assert_equal(d4['f'],d3['f'])
+        assert_(not os.path.isfile(filename+'.tmp'))
+        # not a core file
+        fd = open(filename,'wb')
+        fd.write(b'not a core file')
+        fd.close()
+        assert_raises(IOError,readcore,filename)
+
+    def test_graph(self):
+        print "testing graph2arrays arrays2graph round trip"
+        G = nx.DiGraph()
+        G.add_node(1,name='WALL',z=(0.,3.),iso=[])
+        G.add_node(-2,name='DOOR',z=(0.,2.),iso=[3,4])
+        G.add_node((1,2),name='WALL',z=(0.,3.),iso=[5])
+        G.add_node((1,2,3),transition=True)
+        G.add_edge(1,(1,2),output={(1,2,3):0.5,-2:1.},flag=1)
+        G.add_edge((1,2),(1,2,3),output={},flag=0,obj=set([1]))
+        G.pos = {1:(0.,1.),-2:(2.,3.)}
+        filename = os.path.join(dirname,'graph.bin')
+        darray = {}
+        meta = graph2arrays(G,'G.',darray)
+        assert_equal(meta['kind'],'graph')
+        writecore(filename,darray,{'meta':meta})
+        header,darray2 = readcore(filename)
+        G2 = arrays2graph(header['meta'],'G.',darray2,nx.DiGraph())
+        assert_graph_equal(G,G2)
+        # graph with invalid node keys is pickled
+        H = nx.Graph()
+        H.add_edge('a','b',w=1)
+        darray = {}
+        meta = graph2arrays(H,'H.',darray)
+        assert_equal(meta['kind'],'pickle')
+        assert_graph_equal(H,arrays2graph(meta,'H.',darray,nx.Graph()))
+
+    def test_layout(self):
+        print "testing graph2arrays on defstr graphs"
+        L = Layout('defstr.ini')
+        L.build()
+        for g in ['s','i']:
+            G = getattr(L,'G'+g)
+            darray = {}
+            meta = graph2arrays(G,'G'+g+'.',darray)
+            G2 = arrays2graph(meta,'G'+g+'.',darray,G.__class__())
+            assert_equal(sorted(G.nodes()),sorted(G2.nodes()))
+            assert_equal(sorted(G.edges()),sorted(G2.edges()))
+            for a,b in G.edges():
+                assert_equal(sorted(G.edge[a][b].keys()),
+                             sorted(G2.edge[a][b].keys()))
+
+    def test_exportcore(self):
+        print "testing exportcore versus LayoutCore"
+        L = Layout('defstr.ini')
+        L.build()
+        filename = L.exportcore(os.path.join(dirname,'defstr_core.bin'))
+        C = LayoutCore(filename)
+        assert_equal(C.hash,L.geomhash())
+        assert_equal(C.pt,L.pt)
+        assert_equal(C.tahe,L.tahe)
+        assert_equal(C.tsg,L.tsg)
+        assert_equal(sorted(C.Gicsr.keys()),sorted(L.Gicsr.keys()))
+        for k in L.Gicsr:
+            assert_equal(C.Gicsr[k],L.Gicsr[k])
+        aseg = L.tsg
+        assert_equal(C.seg2pts(aseg),L.seg2pts(aseg))
+        for cy in L.Gt.node:
+            if 'polyg' in L.Gt.node[cy]:
+                p = np.array(L.Gt.node[cy]['polyg'].exterior.coords)[:,0:2].T
+                assert_equal(C.cypolygon(cy),p)
+        assert_raises(NameError,C.cypolygon,max(L.Gt.node.keys())+1)
+
+if __name__ == "__main__":
+    run_module_suite()
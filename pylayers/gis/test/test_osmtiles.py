@@ -0,0 +1,144 @@
+from pylayers.gis.osmparser import *
+import os
+import json
+import tempfile
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+#
+# small fixture : 3 buildings (2 close to each other, 1 at 300 m),
+# a road and a multipolygon building relation
+#
+dnode = {}
+def square(n0,lat,lon):
+    for k,(dlat,dlon) in enumerate([(0,0),(0,2e-4),(1e-4,2e-4),(1e-4,0)]):
+        dnode[n0+k] = (lon+dlon,lat+dlat)
+    return [n0,n0+1,n0+2,n0+3,n0]
+
+dway = {}
+dway[101] = (square(1,48.1100,-1.6400),{'building':'yes','height':'12.5 m'})
+dway[102] = (square(5,48.1100,-1.6396),{'building':'yes',
+                                          'height':"__import__('os').getcwd()",
+                                          'building:levels':'3'})
+dway[103] = (square(9,48.1130,-1.6400),{'building':'house','height':'10;15'})
+dnode[13] = (-1.6402,48.1099)
+dnode[14] = (-1.6390,48.1099)
+dway[104] = ([13,14],{'highway':'residential'})
+dz = {101:12.5,102:3*3.45,103:15.}
+
+def fixture(filename):
+    fd = open(filename,'w')
+    fd.write('<?xml version="1.0" encoding="UTF-8"?>\n')
+    fd.write('<osm version="0.6">\n')
+    for n in sorted(dnode):
+        fd.write('<node id="%d" lon="%.7f" lat="%.7f"/>\n' % ((n,)+dnode[n]))
+    for w in sorted(dway):
+        fd.write('<way id="%d">\n' % w)
+        for n in dway[w][0]:
+            fd.write('<nd ref="%d"/>\n' % n)
+        for k,v in dway[w][1].items():
+            fd.write('<tag k="%s" v="%s"/>\n' % (k,v.replace('"','&quot;')))
+        fd.write('</way>\n')
+    fd.write('<relation id="200">\n<member type="way" ref="101" role="outer"/>\n')
+    fd.write('<tag k="type" v="multipolygon"/>\n<tag k="building" v="yes"/>\n')
+    fd.write('</relation>\n</osm>\n')
+    fd.close()
+
+dirname = tempfile.mkdtemp()
+filename = os.path.join(dirname,'tfixture.osm')
+fixture(filename)
+tilesize = 100.
+margin = 50.
+
+class Tesosmtiles(TestCase):
+    def test_bdgtags(self):
+        print "testing bdgtags on osm tag strings"
+        for w in dway:
+            if 'building' in dway[w][1]:
+                d = bdgtags(dway[w][1])
+                assert_equal(d['name'],'WALL')
+                assert_almost_equal(d['z'],(0,dz[w]))
+        d = bdgtags({'building':'yes','building:levels':'a few'})
+        assert_almost_equal(d['z'],(0,2*3.45))
+        d = bdgtags({'building':'yes'})
+        assert_almost_equal(d['z'],(0,12))
+
+    def test_osmstream(self):
+        print "testing osmstream by chunks"
+        for chunk in [1,3,4096]:
+            lc = []
+            lw = []
+            lr = []
+            osmstream(filename,
+                      coords_callback=lambda x: lc.extend(x),
+                      ways_callback=lambda x: lw.extend(x),
+                      relations_callback=lambda x: lr.extend(x),
+                      chunk=chunk)
+            assert_equal([c[0] for c in lc],sorted(dnode.keys()))
+            for c in lc:
+                assert_almost_equal(c[1:],dnode[c[0]])
+            assert_equal([w[0] for w in lw],sorted(dway.keys()))
+            for w in lw:
+                assert_equal(w[2],dway[w[0]][0])
+                assert_equal(w[1],dway[w[0]][1])
+            assert_equal(lr,[(200,{'type':'multipolygon','building':'yes'},
+                              [(101,'way','outer')])])
+
+    def test_osmtiles(self):
+        print "testing osmtiles partition"
+        tiles = osmtiles(filename,tilesize=tilesize,margin=margin)
+        assert_equal(tiles['mpoly'],[200])
+        assert_equal(sorted(tiles['wid']),[101,102,103])
+        for k,w in enumerate(tiles['wid']):
+            assert_almost_equal(tiles['tags'][k]['z'],(0,dz[w]))
+        # coordinates of the nodes
+        m = tiles['m']
+        for u,n in enumerate(tiles['osmnode']):
+            x,y = m(*dnode[n])
+            assert_almost_equal((tiles['x'][u],tiles['y'][u]),(x,y))
+        # ownership and halo versus brute force
+        wo = tiles['wo']
+        lown = []
+        for k in range(len(tiles['wid'])):
+            ln = tiles['wref'][wo[k]:wo[k+1]]
+            xw = tiles['x'][ln]
+            yw = tiles['y'][ln]
+            key = (int(np.floor(np.mean(xw)/tilesize)),
+                   int(np.floor(np.mean(yw)/tilesize)))
+            assert_(k in tiles['tile'][key]['own'])
+            lown.append(k)
+            for t in tiles['tile']:
+                near = ((np.floor((xw.min()-margin)/tilesize) <= t[0] <=
+                         np.floor((xw.max()+margin)/tilesize)) and
+                        (np.floor((yw.min()-margin)/tilesize) <= t[1] <=
+                         np.floor((yw.max()+margin)/tilesize)))
+                assert_equal(k in tiles['tile'][t]['halo'],near and (t != key))
+        assert_equal(sorted(np.hstack([tiles['tile'][t]['own']
+                                       for t in tiles['tile']])),sorted(lown))
+        assert_(len(tiles['tile']) > 1)
+
+    def test_buildtiles(self):
+        print "testing buildtiles sequential versus parallel"
+        meta = buildtiles(filename,tilesize=tilesize,margin=margin)
+        tiles = osmtiles(filename,tilesize=tilesize,margin=margin)
+        assert_equal(sorted(meta['tiles'].keys()),
+                     sorted([str(t[0])+'_'+str(t[1]) for t in tiles['tile']]))
+        assert_equal(meta['mpoly'],[200])
+        for t in tiles['tile']:
+            mt = meta['tiles'][str(t[0])+'_'+str(t[1])]
+            own = tiles['tile'][t]['own']
+            halo = tiles['tile'][t]['halo']
+            assert_equal(mt['own'],tiles['wid'][own].tolist())
+            assert_equal([h[0] for h in mt['halo']],tiles['wid'][halo].tolist())
+            # 4 distinct corners per building
+            assert_equal(len(mt['osmnode']),4*(len(own)+len(halo)))
+            assert_equal(mt['Np'],len(mt['osmnode']))
+        filemeta = pyu.getlong('tfixture_tiles.json',pstruc['DIRLAY'])
+        fd = open(filemeta)
+        assert_equal(json.load(fd),json.loads(json.dumps(meta)))
+        fd.close()
+        metap = buildtiles(filename,tilesize=tilesize,margin=margin,nproc=2)
+        assert_equal(metap,meta)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,102 @@
+from pylayers.gis.layout import *
+import shapely.geometry as sh
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+L.build()
+if not hasattr(L,'Gr'):
+    L.buildGr()
+np.random.seed(0)
+N = 500
+
+def randpt(L,N):
+    dx = L.ax[1]-L.ax[0]
+    dy = L.ax[3]-L.ax[2]
+    return np.vstack((L.ax[0]-0.1*dx+1.2*dx*np.random.rand(N),
+                      L.ax[2]-0.1*dy+1.2*dy*np.random.rand(N)))
+
+def brute(L,pt,gname):
+    """ polygons containing or touching each point (former shapely loop)
+    """
+    G = getattr(L,'G'+gname)
+    lpoly = [ n for n in G.node if ((gname != 't') or (n > 0))
+              and ('polyg' in G.node[n]) ]
+    lloc = []
+    for k in range(pt.shape[1]):
+        ptsh = sh.Point(pt[0,k],pt[1,k])
+        lloc.append([ n for n in lpoly if G.node[n]['polyg'].touches(ptsh)
+                      or G.node[n]['polyg'].contains(ptsh) ])
+    return lloc
+
+def boundpt(L):
+    """ vertices and segment middles of the cycles
+    """
+    lpt = []
+    for n in L.Gt.node:
+        if (n > 0) and ('polyg' in L.Gt.node[n]):
+            v = np.array(L.Gt.node[n]['polyg'].exterior.coords)[:,0:2]
+            lpt.append(v[:-1])
+            lpt.append((v[:-1]+v[1:])/2.)
+    return np.vstack(lpt).T
+
+def assert_loc(npoly,lloc):
+    for n,l in zip(npoly,lloc):
+        if l == []:
+            assert_equal(n,-1)
+        else:
+            assert_(n in l)
+
+class Tesptloc(TestCase):
+    def test_pt2cy(self):
+        print "testing pt2cy versus shapely loop"
+        pt = randpt(L,N)
+        lloc = brute(L,pt,'t')
+        assert_(len([l for l in lloc if l != []]) > 0)
+        assert_loc(L.pt2cy(pt),lloc)
+        # 3D points
+        assert_loc(L.pt2cy(np.vstack((pt,np.ones(N)))),lloc)
+        # single points
+        for k in range(20):
+            if lloc[k] == []:
+                assert_raises(NameError,L.pt2cy,pt[:,k])
+            else:
+                assert_(L.pt2cy(pt[:,k]) in lloc[k])
+
+    def test_boundary(self):
+        print "testing pt2cy on the cycle boundaries"
+        pt = boundpt(L)
+        lloc = brute(L,pt,'t')
+        npoly = L.pt2cy(pt)
+        assert_loc(npoly,lloc)
+        assert_((npoly >= 0).all())
+
+    def test_cell(self):
+        print "testing _ptloc versus the size of the grid cells"
+        pt = np.hstack((randpt(L,N),boundpt(L)))
+        lloc = brute(L,pt,'t')
+        try:
+            for cell in [0.1,1.,100.]:
+                L._loc = {}
+                loc = L._locindex('t',cell=cell)
+                assert_equal(loc['p'][2],cell)
+                # every polygon is in the cells covering its bounding box
+                for n,lr in loc['rings'].items():
+                    xmin,ymin = np.min(lr[0],axis=0)
+                    xmax,ymax = np.max(lr[0],axis=0)
+                    for x,y in [(xmin,ymin),(xmax,ymax)]:
+                        c = (int(np.floor((x-loc['p'][0])/cell)),
+                             int(np.floor((y-loc['p'][1])/cell)))
+                        assert_(n in loc['grid'][c])
+                assert_loc(L._ptloc(pt,'t'),lloc)
+        finally:
+            L._loc = {}
+
+    def test_pt2ro(self):
+        print "testing pt2ro versus shapely loop"
+        pt = randpt(L,N)
+        lloc = brute(L,pt,'r')
+        assert_loc(L.pt2ro(pt),lloc)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -0,0 +1,107 @@
+from pylayers.gis.layout import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+L = Layout('defstr.ini')
+np.random.seed(0)
+N = 200
+
+def randpt(L,N):
+    return np.vstack((L.ax[0]+(L.ax[1]-L.ax[0])*np.random.rand(N),
+                      L.ax[2]+(L.ax[3]-L.ax[2])*np.random.rand(N)))
+
+def bbox(L,p1,p2):
+    """ brute force bounding box test (former seginframe2)
+    """
+    return np.nonzero((L.max_sx > min(p1[0],p2[0])) &
+                      (L.min_sx < max(p1[0],p2[0])) &
+                      (L.max_sy > min(p1[1],p2[1])) &
+                      (L.min_sy < max(p1[1],p2[1])))[0]
+
+def cross(L,p1,p2):
+    """ brute force segment intersection with p1-p2
+    """
+    pa = L.pt[:,L.tahe[0]]
+    pb = L.pt[:,L.tahe[1]]
+    def side(a,b,c):
+        return (b[0]-a[0])*(c[1]-a[1]) - (b[1]-a[1])*(c[0]-a[0])
+    u = ((side(pa,pb,p1[:,None])*side(pa,pb,p2[:,None]) < 0) &
+         (side(p1[:,None],p2[:,None],pa)*side(p1[:,None],p2[:,None],pb) < 0))
+    return np.nonzero(u)[0]
+
+def grid(L):
+    """ segment grid rebuilt from Gs with the same origin and cell
+    """
+    d = {}
+    for num in L.Gs.node:
+        if num > 0:
+            n1,n2 = L.Gs.node[num]['connect']
+            for c in L._segcells(np.array(L.Gs.pos[n1]),
+                                 np.array(L.Gs.pos[n2]),line=False):
+                d.setdefault(c,[]).append(num)
+    return dict([ (c,sorted(d[c])) for c in d ])
+
+def assert_grid(L):
+    assert_equal(L._sgridv,L._geomv)
+    assert_equal(dict([ (c,sorted(L._sgrid[c])) for c in L._sgrid ]),grid(L))
+
+class Tessegindex(TestCase):
+    def test_seginframe2(self):
+        print "testing seginframe2 versus brute force"
+        p1 = randpt(L,N)
+        p2 = randpt(L,N)
+        for k in range(N):
+            s = L.seginframe2(p1[:,k],p2[:,k])
+            assert_equal(s,bbox(L,p1[:,k],p2[:,k]))
+            sl = L.seginframe2(p1[:,k],p2[:,k],line=True)
+            assert_(set(cross(L,p1[:,k],p2[:,k])) <= set(sl))
+            assert_(set(sl) <= set(s))
+        # several zones at once
+        s = L.seginframe2(p1[:,:3],p2[:,:3])
+        ref = np.hstack((bbox(L,p1[:,0],p2[:,0]),[-1],
+                         bbox(L,p1[:,1],p2[:,1]),[-1],
+                         bbox(L,p1[:,2],p2[:,2])))
+        assert_equal(s,ref)
+
+    def test_segindex(self):
+        print "testing the segment grid versus the segments of Gs"
+        L.segindex()
+        assert_grid(L)
+
+    def test_edit(self):
+        print "testing the segment grid after point edits"
+        L.segindex()
+        sgridp = L._sgridp
+        # free point : the grid is kept
+        npt = L.add_fnod((L.ax[0],L.ax[2]))
+        assert_(hasattr(L,'_sgrid'))
+        assert_grid(L)
+        L.del_points([npt])
+        # moved point : the segments of the point are moved in the grid
+        lseg = sorted([ s for s in L.Gs.node if s > 0 ])
+        npt = L.Gs.node[lseg[len(lseg)/2]]['connect'][0]
+        x,y = L.Gs.pos[npt]
+        try:
+            L.Gs.pos[npt] = (x+0.5,y+0.5)
+            L._geomchanged([npt])
+            L.g2npy()
+            assert_equal(L._sgridp,sgridp)
+            assert_grid(L)
+            p1 = randpt(L,N)
+            p2 = randpt(L,N)
+            for k in range(N):
+                assert_equal(L.seginframe2(p1[:,k],p2[:,k]),
+                             bbox(L,p1[:,k],p2[:,k]))
+        finally:
+            L.Gs.pos[npt] = (x,y)
+            L._geomchanged([npt])
+            L.g2npy()
+        assert_grid(L)
+        # unknown change : the grid is rebuilt on its next use
+        L._geomchanged()
+        assert_(not hasattr(L,'_sgrid'))
+        L.seginframe2(p1[:,0],p2[:,0])
+        assert_grid(L)
+
+if __name__ == "__main__":
+    run_module_suite()
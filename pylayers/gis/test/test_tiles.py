@@ -0,0 +1,117 @@
+from pylayers.gis.tiles import *
+import pylayers.gis.osmparser as osm
+from pylayers.simul.link import DLink
+import os
+import json
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+#
+# 2 x 2 tiles of 100 m with one building (20 m square) each
+#
+name = 'ttiles'
+tilesize = 100.
+margin = 10.
+meta = {'version':1,'tilesize':tilesize,'margin':margin,'tiles':{}}
+for k,(ix,iy) in enumerate([(0,0),(1,0),(0,1),(1,1)]):
+    x0 = ix*tilesize + 40
+    y0 = iy*tilesize + 40
+    dxy = {-1:np.array([x0,y0]),-2:np.array([x0+20,y0]),
+           -3:np.array([x0+20,y0+20]),-4:np.array([x0,y0+20])}
+    lway = [([-1,-2,-3,-4,-1],{'name':'WALL','z':(0,10)})]
+    key = str(ix)+'_'+str(iy)
+    L = osm.waylayout(name+'_'+key+'.lay',dxy,lway)
+    meta['tiles'][key] = {'file':L._filename,
+                          'index':[ix,iy],
+                          'bbox':[ix*tilesize,iy*tilesize,
+                                  (ix+1)*tilesize,(iy+1)*tilesize],
+                          'osmnode':[1000*(k+1)+i for i in range(4)],
+                          'Np':4}
+fd = open(pyu.getlong(name+'_tiles.json',pstruc['DIRLAY']),'w')
+json.dump(meta,fd)
+fd.close()
+
+def nseg(L):
+    return len([ s for s in L.Gs.node if (s > 0) and
+                 (L.Gs.node[s]['name'] not in ['AIR','_AIR']) ])
+
+class Testiles(TestCase):
+    def test_cover(self):
+        print "testing TiledLayout.cover versus brute force"
+        T = TiledLayout(name+'_tiles.json')
+        assert_equal(T.cover(np.array([30,30]),np.array([70,60])),['0_0'])
+        assert_equal(T.cover(np.array([30,30]),np.array([170,60])),['0_0','1_0'])
+        assert_equal(T.cover(np.array([30,30]),np.array([170,160])),
+                     ['0_0','0_1','1_0','1_1'])
+        # margin reaching the next tile
+        assert_equal(T.cover(np.array([30,30]),np.array([95,60])),['0_0','1_0'])
+        np.random.seed(0)
+        for a,b in zip(200*np.random.rand(50,2),200*np.random.rand(50,2)):
+            ref = [ key for key in sorted(meta['tiles'])
+                    if ((meta['tiles'][key]['bbox'][0] <= max(a[0],b[0])+margin) and
+                        (meta['tiles'][key]['bbox'][2] >= min(a[0],b[0])-margin) and
+                        (meta['tiles'][key]['bbox'][1] <= max(a[1],b[1])+margin) and
+                        (meta['tiles'][key]['bbox'][3] >= min(a[1],b[1])-margin)) ]
+            assert_equal(sorted(T.cover(a,b)),ref)
+
+    def test_merge(self):
+        print "testing TiledLayout.merge"
+        T = TiledLayout(name+'_tiles.json',maxtiles=8)
+        f1 = T.merge(['0_0','1_0'])
+        assert_equal(T.merge(['1_0','0_0']),f1)
+        Lm = T.layout(np.array([30,30]),np.array([170,60]))
+        assert_equal(Lm._filename,f1)
+        assert_equal(Lm.Np,8)
+        assert_equal(nseg(Lm),8)
+        assert_(T.layout(np.array([30,30]),np.array([170,60])) is Lm)
+        # edit of a tile file : new merged Layout
+        filetile = pyu.getlong(meta['tiles']['1_0']['file'],pstruc['DIRLAY'])
+        content = open(filetile).read()
+        try:
+            fd = open(filetile,'a')
+            fd.write('\n')
+            fd.close()
+            f2 = T.merge(['0_0','1_0'])
+            assert_(f2 != f1)
+            Lm2 = T.layout(np.array([30,30]),np.array([170,60]))
+            assert_equal(Lm2._filename,f2)
+            assert_(Lm2 is not Lm)
+        finally:
+            fd = open(filetile,'w')
+            fd.write(content)
+            fd.close()
+
+    def test_lru(self):
+        print "testing TiledLayout least recently used eviction"
+        T = TiledLayout(name+'_tiles.json',maxtiles=2)
+        L00 = T.tile('0_0')
+        L10 = T.tile('1_0')
+        assert_equal(T.cache.keys(),['0_0','1_0'])
+        assert_(T.tile('0_0') is L00)
+        assert_equal(T.cache.keys(),['1_0','0_0'])
+        T.tile('0_1')
+        assert_equal(T.cache.keys(),['0_0','0_1'])
+        # an evicted tile is read again from the disk
+        L10b = T.tile('1_0')
+        assert_(L10b is not L10)
+        assert_equal(sorted(L10b.Gs.nodes()),sorted(L10.Gs.nodes()))
+        assert_equal(T.cache.keys(),['0_1','1_0'])
+        T.evict(1)
+        assert_equal(T.cache.keys(),['1_0'])
+
+    def test_dlink(self):
+        print "testing DLink.L with a TiledLayout"
+        T = TiledLayout(name+'_tiles.json')
+        DL = DLink(L=T)
+        assert_(DL._T is T)
+        assert_(isinstance(DL.L,Layout))
+        L11 = T.tile('1_1')
+        DL.L = L11
+        assert_(not hasattr(DL,'_T'))
+        assert_(DL.L is L11)
+        DL.L = T
+        assert_(DL._T is T)
+        assert_(isinstance(DL.L,Layout))
+
+if __name__ == "__main__":
+    run_module_suite()
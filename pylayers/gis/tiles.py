@@ -0,0 +1,313 @@
+# -*- coding: utf-8 -*-
+"""
+.. currentmodule:: pylayers.gis.tiles
+
+This module handles city scale layouts split into tiles.
+
+The tiles are produced by pylayers.gis.osmparser.buildtiles, which writes one
+.lay file per tile and a <name>_tiles.json file of stitching metadata. A
+TiledLayout keeps the graphs of the tiles on disk and only holds in memory
+the Layouts requested by the links, loading (or building) them on demand
+and evicting the least recently used ones.
+
+For a link between a and b, TiledLayout.layout returns the tile Layout when
+the region of the link fits inside a single tile. Otherwise the tiles are
+stitched into a merged Layout which is built once, dumped and then reused
+like a tile. The returned object is a plain Layout which can be handed to
+Signatures, Rays or DLink.
+
+.. autosummary::
+    :toctree: generated/
+
+    TiledLayout.__init__
+    TiledLayout.__repr__
+    TiledLayout.cover
+    TiledLayout.tile
+    TiledLayout.layout
+    TiledLayout.merge
+    TiledLayout.evict
+
+"""
+import os
+import json
+import hashlib
+import collections
+import numpy as np
+import pylayers.util.pyutil as pyu
+from pylayers.util.project import *
+from pylayers.gis.layout import Layout
+import pylayers.gis.osmparser as osm
+
+
+class TiledLayout(object):
+    """ Layout split into tiles with on demand loading
+
+    Attributes
+    ----------
+
+    meta : dict
+        stitching metadata (see osmparser.buildtiles)
+    maxtiles : int
+        maximum number of Layouts held in memory
+    margin : float
+        propagation margin around a link (meters)
+    cache : OrderedDict
+        Layouts in memory, least recently used first
+
+    """
+    def __init__(self,_filemeta,maxtiles=4,margin=[]):
+        """ object constructor
+
+        Parameters
+        ----------
+
+        _filemeta : string
+            <name>_tiles.json file in the layout directory
+        maxtiles : int
+            maximum number of Layouts (tiles or merged views) in memory
+        margin : float
+            propagation margin around a link. Default is the halo width
+            of the tiles
+
+        """
+        if (('/' in _filemeta) or ('//' in _filemeta)):
+            filemeta = _filemeta
+        else:
+            filemeta = pyu.getlong(_filemeta,pstruc['DIRLAY'])
+        fd = open(filemeta,'r')
+        self.meta = json.load(fd)
+        fd.close()
+        self._filename = os.path.basename(filemeta)
+        self.name = self._filename.replace('_tiles.json','')
+        self.maxtiles = maxtiles
+        if margin == []:
+            margin = self.meta['margin']
+        self.margin = margin
+        self.cache = collections.OrderedDict()
+
+        lkey = sorted(self.meta['tiles'].keys())
+        self._keys = lkey
+        # (4 x Ntiles) xmin,ymin,xmax,ymax
+        self._bbox = np.array([self.meta['tiles'][k]['bbox'] for k in lkey]).T
+
+    def __repr__(self):
+        st = 'TiledLayout : ' + self._filename + '\n'
+        st = st + 'tiles : ' + str(len(self._keys)) + '\n'
+        st = st + 'tilesize : ' + str(self.meta['tilesize']) + ' m\n'
+        st = st + 'margin : ' + str(self.margin) + ' m\n'
+        st = st + 'in memory (' + str(len(self.cache)) + '/' + \
+            str(self.maxtiles) + ') : ' + str(self.cache.keys()) + '\n'
+        return(st)
+
+    def cover(self,a,b,margin=[]):
+        """ tiles covering the region of a link
+
+        Parameters
+        ----------
+
+        a : np.array
+            position of a (at least x,y)
+        b : np.array
+            position of b
+        margin : float
+            propagation margin (default self.margin)
+
+        Returns
+        -------
+
+        lkey : list of string
+            keys of the tiles ('ix_iy') sorted
+
+        """
+        if margin == []:
+            margin = self.margin
+        xmin = min(a[0],b[0]) - margin
+        xmax = max(a[0],b[0]) + margin
+        ymin = min(a[1],b[1]) - margin
+        ymax = max(a[1],b[1]) + margin
+        bb = self._bbox
+        u = np.where((bb[0] <= xmax) & (bb[2] >= xmin) &
+                     (bb[1] <= ymax) & (bb[3] >= ymin))[0]
+        return [self._keys[k] for k in u]
+
+    def _get(self,key,filename):
+        """ get a Layout from the cache or from the disk
+
+        Parameters
+        ----------
+
+        key : string
+            cache key ('ix_iy' for a tile, file name for a merged view)
+        filename : string
+            .lay file
+
+        """
+        if key in self.cache:
+            # most recently used goes at the end
+            L = self.cache.pop(key)
+        else:
+            L = Layout(filename,bgraphs=False,bcheck=False)
+            try:
+                L.dumpr()
+            except:
+                L.build()
+                L.dumpw()
+        self.cache[key] = L
+        self.evict()
+        return L
+
+    def tile(self,key):
+        """ Layout of a tile
+
+        Parameters
+        ----------
+
+        key : string
+            'ix_iy'
+
+        Returns
+        -------
+
+        L : Layout
+            with its graphs loaded or built
+
+        """
+        return self._get(key,str(self.meta['tiles'][key]['file']))
+
+    def evict(self,nkeep=[]):
+        """ remove the least recently used Layouts from memory
+
+        Parameters
+        ----------
+
+        nkeep : int
+            number of Layouts kept (default self.maxtiles)
+
+        Notes
+        -----
+
+        The graphs of an evicted Layout are on disk (dumpw) and are read
+        again by the next request.
+
+        """
+        if nkeep == []:
+            nkeep = self.maxtiles
+        while len(self.cache) > max(nkeep,1):
+            self.cache.popitem(last=False)
+
+    def merge(self,lkey):
+        """ stitch several tiles into a single Layout
+
+        Parameters
+        ----------
+
+        lkey : list of string
+            tile keys
+
+        Returns
+        -------
+
+        filename : string
+            .lay file of the merged Layout
+
+        Notes
+        -----
+
+        The tiles are stitched with the osm ids of their points ('osmnode'
+        in the metadata). Segments which appear in several tiles (halo
+        buildings) are only kept once. The merged Layout is saved and
+        its graphs are built on first use, later requests only read
+        them. Its file name is derived from the tile keys and from the
+        content of the tile files, a tile modified since the merge gives
+        a new merged Layout.
+
+        """
+        lkey = sorted(lkey)
+        hm = hashlib.md5()
+        for key in lkey:
+            filetile = pyu.getlong(str(self.meta['tiles'][key]['file']),pstruc['DIRLAY'])
+            hm.update(key + '/')
+            fd = open(filetile,'rb')
+            hm.update(fd.read())
+            fd.close()
+        h = hm.hexdigest()[:8]
+        filename = self.name + '_m' + h + '.lay'
+        if os.path.exists(pyu.getlong(filename,pstruc['DIRLAY'])):
+            return filename
+
+        dxy = {}
+        dseg = {}
+        m = None
+        for key in lkey:
+            mt = self.meta['tiles'][key]
+            osmnode = mt['osmnode']
+            Np = len(osmnode)
+            if key in self.cache:
+                Lt = self.cache[key]
+            else:
+                Lt = Layout(str(mt['file']),bgraphs=False,bcheck=False)
+            if m is None:
+                m = getattr(Lt,'m',None)
+            for s in Lt.Gs.node:
+                if s <= 0:
+                    continue
+                d = Lt.Gs.node[s]
+                if d['name'] in ['AIR','_AIR']:
+                    continue
+                n1, n2 = d['connect'][0], d['connect'][1]
+                # boundary points are not osm nodes
+                if (-n1 > Np) or (-n2 > Np):
+                    continue
+                o1 = osmnode[-n1-1]
+                o2 = osmnode[-n2-1]
+                dxy[o1] = Lt.Gs.pos[n1]
+                dxy[o2] = Lt.Gs.pos[n2]
+                ks = (min(o1,o2),max(o1,o2),d['name'],tuple(d['z']))
+                if ks not in dseg:
+                    dseg[ks] = (o1,o2,d.get('offset',0))
+
+        # osm id -> point number of the merged Layout
+        lo = sorted(dxy.keys())
+        dnum = {o:-(k+1) for k,o in enumerate(lo)}
+        dxyn = {dnum[o]:np.array(dxy[o]) for o in lo}
+        lway = [([dnum[v[0]],dnum[v[1]]],
+                 {'name':ks[2],'z':ks[3],'offset':v[2]})
+                for ks,v in dseg.items()]
+        osm.waylayout(filename,dxyn,lway,m=m,build=False)
+        return filename
+
+    def layout(self,a,b,margin=[]):
+        """ Layout of the region of a link
+
+        Parameters
+        ----------
+
+        a : np.array
+        b : np.array
+        margin : float
+            propagation margin (default self.margin)
+
+        Returns
+        -------
+
+        L : Layout
+            tile Layout if the region fits inside a single tile, merged
+            Layout of the covering tiles otherwise
+
+        Examples
+        --------
+
+        >>> from pylayers.gis.tiles import *
+        >>> T = TiledLayout('district_tiles.json',maxtiles=4) # doctest: +SKIP
+        >>> L = T.layout(np.array([120,40,1.5]),np.array([410,80,1.5])) # doctest: +SKIP
+
+        """
+        lkey = self.cover(a,b,margin=margin)
+        if len(lkey) == 0:
+            raise NameError('link region is outside of the tiles')
+        if len(lkey) == 1:
+            return self.tile(lkey[0])
+        # the merged view is cached under its file name, which changes
+        # with the content of the tiles (see merge)
+        filename = self.merge(lkey)
+        return self._get(filename,filename)
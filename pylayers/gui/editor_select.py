@@ -528,6 +528,7 @@ class SelectL2(object):
                 x=self.gridx[np.where(x<=self.gridx)[0][0]]
                 y=self.gridy[np.where(y<=self.gridy)[0][0]]
             self.L.Gs.pos[self.nsel]=(x,y)
+            self.L._geomchanged([self.nsel])
             segs = self.L.Gs[self.nsel]
             for s in segs:
                 n1,n2=self.L.Gs[s].keys()
@@ -1021,6 +1022,7 @@ class SelectL2(object):
                     self.L.Gs.pos[nd]=(mtp[0],y)
                 if ind ==1:
                     self.L.Gs.pos[nd]=(x,mtp[1])
+            self.L._geomchanged(ndlist)
             plt.axis('tight')
             self.fig,self.ax = self.show(self.fig,self.ax,clear=True)
             self.update_state()
@@ -1075,6 +1077,7 @@ class SelectL2(object):
                                   )
         for n in self.L.Gs.pos:
             self.L.Gs.pos[n]=(self.L.Gs.pos[n][0],self.L.Gs.pos[n][1]*vscale)
+        self.L._geomchanged()
         plt.axis('tight')
         self.fig,self.ax = self.show(self.fig,self.ax,clear=True)
         self.update_state()
@@ -1633,6 +1636,7 @@ class SelectL2(object):
         if self.evt == 'v':
             for n in self.L.Gs.pos:
                 self.L.Gs.pos[n]=(self.L.Gs.pos[n][0],-self.L.Gs.pos[n][1])
+            self.L._geomchanged()
             self.update_state()
             return
         #
@@ -71,6 +71,7 @@ DLink init
     DLink.__init__
     DLink.__repr__
     DLink.reset_config
+    DLink._tileview
     DLink.check_grpname
 
 
@@ -123,11 +124,12 @@ import pylayers.util.pyutil as pyu
 from pylayers.simul.radionode import RadioNode
 # Handle Layout
 from pylayers.gis.layout import Layout
+from pylayers.gis.tiles import TiledLayout
 # Handle Antenna
 from pylayers.antprop.antenna import Antenna
 
 # Handle Signature
-from pylayers.antprop.signature import Signatures,Signature
+from pylayers.antprop.signature import Signatures,Signature,SigStore
 # Handle Rays
 from pylayers.antprop.rays import Rays
 # Handle VectChannel and ScalChannel
@@ -229,7 +231,8 @@ class DLink(Link):
     ----------
 
         L : Layout
-            Layout to be used
+            Layout to be used. With a TiledLayout, L is the Layout of the
+            tiles covering the link and follows the positions a and b
         Aa : Antenna
             Antenna of device dev_a
         Ab : Antenna
@@ -323,7 +326,7 @@ class DLink(Link):
 
 
             Signature identifier (si_ID#N):
-                ca_cb_cutoff_th
+                ca_cb_cutoff_th_Lhash
 
             Ray identifier (ray_ID#N):
                 cutoff_th_ua_ub
@@ -339,6 +342,8 @@ class DLink(Link):
             cb : cycle number of b
             cutoff : signature.run cutoff
             th : signature.run threshold * 100
+            Lhash : 8 first digits of the layout content hash (Layout.geomhash),
+                    signature groups written without it are not reused
             ua : indice of a position in 'p_map' position dataset
             ub : indice of a position in 'p_map' position dataset
             uf : indice of freq position in 'f_map' frequency dataset
@@ -428,6 +433,13 @@ class DLink(Link):
         if self.Ab==[]:
             self.Ab=Antenna(typ='Omni',fGHz=self.fGHz)
         
+        if isinstance(self._L,TiledLayout):
+            self._T = self._L
+            if (len(self._a)>0) and (len(self._b)>0):
+                self._L = self._T.layout(self._a,self._b)
+            else:
+                self._L = self._T.tile(self._T._keys[0])
+
         if isinstance(self._L,str):
             self._Lname = self._L
             self._L = Layout(self._Lname,bgraphs=True,bcheck=False)
@@ -562,6 +574,13 @@ class DLink(Link):
     def wav(self):
         return self._wav
 
+    @property
+    def Lhash(self):
+        # content hash of the layout at its last build or load
+        if not hasattr(self._L,'_geomhash'):
+            self._L._geomhash = self._L.geomhash()
+        return self._L._geomhash
+
     @L.setter
     def L(self,L):
         # change layout and build/load
@@ -569,12 +588,22 @@ class DLink(Link):
         if hasattr(self,'_maya_fig') and self._maya_fig._is_running:
             mlab.clf()
             plotfig=True
-        if isinstance(L,str):
-            self._L = Layout(L,bgraphs=False,bcheck=False)
-            self._Lname = L
-        elif isinstance(L,Layout):
-            self._L = L
-            self._Lname = L._filename
+        if isinstance(L,TiledLayout):
+            self._T = L
+            if (len(getattr(self,'_a',[]))>0) and (len(getattr(self,'_b',[]))>0):
+                self._L = L.layout(self._a,self._b)
+            else:
+                self._L = L.tile(L._keys[0])
+            self._Lname = self._L._filename
+        else:
+            # the Layout no longer follows the positions
+            self.__dict__.pop('_T',None)
+            if isinstance(L,str):
+                self._L = Layout(L,bgraphs=False,bcheck=False)
+                self._Lname = L
+            elif isinstance(L,Layout):
+                self._L = L
+                self._Lname = L._filename
 
         self.reset_config()
 
@@ -593,6 +622,8 @@ class DLink(Link):
 
     @a.setter
     def a(self,position):
+        if hasattr(self,'_T') and (len(self._b)>0):
+            self._tileview(position,self._b)
         if not self.L.ptin(position):
             if position[0]<self.L.ax[0]:
                 position[0]=self.L.ax[0]
@@ -617,6 +648,8 @@ class DLink(Link):
 
     @b.setter
     def b(self,position):
+        if hasattr(self,'_T') and (len(self._a)>0):
+            self._tileview(self._a,position)
         if not self.L.ptin(position):
             if position[0]<self.L.ax[0]:
                 position[0]=self.L.ax[0]
@@ -1033,6 +1066,38 @@ class DLink(Link):
             pass
 
 
+    def _tileview(self,a,b):
+        """ select the Layout of a TiledLayout which covers the link a-b
+
+        Parameters
+        ----------
+
+        a : np.array
+        b : np.array
+
+        Notes
+        -----
+
+        Contrary to reset_config the positions are kept. Only the Layout,
+        the cycles of a and b, the h5 file and the link results are
+        changed.
+
+        """
+        L = self._T.layout(a,b)
+        if L is self._L:
+            return
+        self._L = L
+        self._Lname = L._filename
+        self._ca = L.pt2cy(a)
+        self._cb = L.pt2cy(b)
+        self.filename = 'Links_' + str(self.save_idx) + '_' + self._Lname + '.h5'
+        filenameh5 = pyu.getlong(self.filename,pstruc['DIRLNK'])
+        if not os.path.exists(filenameh5) :
+            self.save_init(filenameh5)
+        for k in ['Si','R','C','H']:
+            if hasattr(self,k):
+                delattr(self,k)
+
     def checkh5(self):
         """ check existence of previous simulations run with the same parameters.
 
@@ -1236,8 +1301,9 @@ class DLink(Link):
         ua_opt, ua = self.get_idx('c_map',array)
         th = str(int(np.round(self.threshold,decimals=2)*100))
 
-
-        grpname = str(self.ca) + '_' +str(self.cb) + '_' + str(self.cutoff) + '_' + th
+        # the layout content hash avoids reusing signatures
+        # of a modified layout
+        grpname = str(self.ca) + '_' +str(self.cb) + '_' + str(self.cutoff) + '_' + th + '_' + self.Lhash[:8]
         self.dexist['sig']['grpname']=grpname
 
 
@@ -1507,6 +1573,13 @@ class DLink(Link):
             version of run for signature
         si_progress: bollean ( False)
             display progression bar for signatures
+        si_parallel : boolean (False)
+            run the signature search over all the cores
+        si_store : boolean (False)
+            look for the signatures in the content addressed store
+            (SigStore) before running the search, and store them after.
+            The store is shared by all the links of DIRLNK and is locked
+            while it is written.
         diffraction : boolean (False)
             takes into consideration diffraction points
         ra_number_mirror_cf : int
@@ -1518,6 +1591,19 @@ class DLink(Link):
                 If -1 : neither ceil nor floor reflection (2D case) 
         ra_vectorized: boolean (True)
             if True used the (2015 new) vectorized approach to determine 2drays
+        ra_parallel : boolean (False)
+            run Rays.to3D and Rays.locbas over all the cores
+        ct_nfc : int (0)
+            number of frequency points evaluated at once by Rays.eval
+            (0 : whole band)
+        ct_nthlut : int (0)
+            number of incidence angles of the slab R/T lookup tables
+            (0 : direct evaluation of the slabs)
+        incremental : boolean (False)
+            if True and both termination points are still in the cycles
+            (and with the same signature parameters) of the previous
+            evaluation, the signatures are reused and only the rays, Ct
+            and H are recomputed
         progressbar: str
             None: no progress bar
             python : progress bar in ipython
@@ -1559,10 +1645,16 @@ class DLink(Link):
 
         defaults={ 'applywav':False,
                    'si_progress':True,
+                   'si_parallel':False,
+                   'si_store':False,
                    'diffraction':True,
                    'ra_vectorized':True,
+                   'ra_parallel':False,
                    'ra_ceil_H':[],
                    'ra_number_mirror_cf':1,
+                   'ct_nfc':0,
+                   'ct_nthlut':0,
+                   'incremental':False,
                    'force':[],
                    'bt':True,
                    'alg':1,
@@ -1628,49 +1720,95 @@ class DLink(Link):
         if self.verbose :
             print("Start Signatures")
         tic = time.time()
-        Si = Signatures(self.L,
-                        self.ca,
-                        self.cb,
-                        cutoff=kwargs['cutoff'],
-                        threshold = kwargs['threshold'])
-
-        if (self.dexist['sig']['exist'] and not ('sig' in kwargs['force'])):
-            self.load(Si,self.dexist['sig']['grpname'],L=self.L)
+        # signature validity : cycles of termination points, signature
+        # parameters and layout content
+        sivalid = (self.ca, self.cb,
+                   kwargs['cutoff'], kwargs['threshold'],
+                   kwargs['nD'], kwargs['nR'], kwargs['nT'],
+                   kwargs['bt'], kwargs['diffraction'], kwargs['alg'],
+                   self.Lhash)
+
+        if (kwargs['incremental'] and hasattr(self,'Si') and
+            (getattr(self,'_sivalid',()) == sivalid) and
+            not ('sig' in kwargs['force'])):
+            Si = self.Si
             if self.verbose :
-                print("load signature")
-        else :
-            ## 1 is the default signature determination algorithm
-            if kwargs['alg']==1:
-                Si.run(cutoff = kwargs['cutoff'],
-                        diffraction = kwargs['diffraction'],
-                        threshold = kwargs['threshold'],
-                        nD = kwargs['nD'],
-                        nR = kwargs['nR'],
-                        nT = kwargs['nT'],
-                        progress = kwargs['si_progress'],
-                        bt = kwargs['bt'])
-
-                if self.verbose:
-                    print("default algorithm")
-
-            if kwargs['alg']=='exp':
-                TMP = Si.run_exp(cutoff=kwargs['cutoff'],
-                         cutoffbound=kwargs['si_reverb'])
-                if self.verbose :
-                    print("experimental (ex 2015)")
+                print("reuse signatures")
+        else:
+            Si = Signatures(self.L,
+                            self.ca,
+                            self.cb,
+                            cutoff=kwargs['cutoff'],
+                            threshold = kwargs['threshold'])
+
+            # key of the signature store
+            if kwargs['si_store'] and (kwargs['alg']==1):
+                if not hasattr(self,'sigstore'):
+                    self.sigstore = SigStore()
+                sikey = self.sigstore.key(self.L,self.ca,self.cb,
+                                          Lhash = self.Lhash,
+                                          cutoff = kwargs['cutoff'],
+                                          threshold = kwargs['threshold'],
+                                          nD = kwargs['nD'],
+                                          nR = kwargs['nR'],
+                                          nT = kwargs['nT'],
+                                          bt = kwargs['bt'],
+                                          diffraction = kwargs['diffraction'])
+            else:
+                sikey = ''
 
-            if kwargs['alg']=='exp2':
-                TMP = Si.run_exp2(cutoff=kwargs['cutoff'],
-                        cutoffbound=kwargs['si_reverb'])
+            if (self.dexist['sig']['exist'] and not ('sig' in kwargs['force'])):
+                self.load(Si,self.dexist['sig']['grpname'],L=self.L)
                 if self.verbose :
-                    print("algo exp2 ( ex 20152)")
-
-        #Si.run6(diffraction=kwargs['diffraction'])
-        # save sig
+                    print("load signature")
+            else :
+                if ((sikey != '') and (not ('sig' in kwargs['force'])) and
+                    self.sigstore.get(sikey,Si)):
+                    if self.verbose :
+                        print("signature from store")
+                ## 1 is the default signature determination algorithm
+                elif kwargs['alg']==1:
+                    Si.run(cutoff = kwargs['cutoff'],
+                            diffraction = kwargs['diffraction'],
+                            threshold = kwargs['threshold'],
+                            nD = kwargs['nD'],
+                            nR = kwargs['nR'],
+                            nT = kwargs['nT'],
+                            progress = kwargs['si_progress'],
+                            parallel = kwargs['si_parallel'],
+                            bt = kwargs['bt'])
+                    if sikey != '':
+                        if 'sig' in kwargs['force']:
+                            self.sigstore.delete(sikey)
+                        self.sigstore.put(sikey,Si,
+                                          nD = kwargs['nD'],
+                                          nR = kwargs['nR'],
+                                          nT = kwargs['nT'],
+                                          bt = kwargs['bt'],
+                                          diffraction = kwargs['diffraction'])
+
+                    if self.verbose:
+                        print("default algorithm")
+
+                if kwargs['alg']=='exp':
+                    TMP = Si.run_exp(cutoff=kwargs['cutoff'],
+                             cutoffbound=kwargs['si_reverb'])
+                    if self.verbose :
+                        print("experimental (ex 2015)")
+
+                if kwargs['alg']=='exp2':
+                    TMP = Si.run_exp2(cutoff=kwargs['cutoff'],
+                            cutoffbound=kwargs['si_reverb'])
+                    if self.verbose :
+                        print("algo exp2 ( ex 20152)")
+
+            #Si.run6(diffraction=kwargs['diffraction'])
+            # save sig
             
-            self.save(Si,'sig',self.dexist['sig']['grpname'],force = kwargs['force'])
+                self.save(Si,'sig',self.dexist['sig']['grpname'],force = kwargs['force'])
 
         self.Si = Si
+        self._sivalid = sivalid
         toc = time.time()
         if self.verbose :
             print("Stop signature",toc-tic)
@@ -1727,9 +1865,10 @@ class DLink(Link):
                 ceilheight = kwargs['ra_ceil_H']
 
 
-            R = self.r2d.to3D(self.L,H=ceilheight, N=kwargs['ra_number_mirror_cf'])
+            R = self.r2d.to3D(self.L,H=ceilheight, N=kwargs['ra_number_mirror_cf'],
+                              parallel=kwargs['ra_parallel'])
 
-            R.locbas(self.L)
+            R.locbas(self.L,parallel=kwargs['ra_parallel'])
             
 
             R.fillinter(self.L)
@@ -1767,7 +1906,8 @@ class DLink(Link):
             # Find an other criteria in order to decide if the R has
             # already been evaluated
             
-            C = R.eval(self.fGHz)
+            R.I.nthlut = kwargs['ct_nthlut']
+            C = R.eval(self.fGHz,nfc=kwargs['ct_nfc'])
             # ...save Ct
             self.save(C,'Ct',self.dexist['Ct']['grpname'],force = kwargs['force'])
 
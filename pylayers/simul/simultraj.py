@@ -522,6 +522,9 @@ class Simul(PyLayers):
 
         fGHz : np.array
             frequency in GHz
+        incremental : boolean (False)
+            reuse the signatures of a link as long as its termination
+            points stay in the same cycles (see DLink.eval)
 
 
         Examples
@@ -549,14 +552,15 @@ class Simul(PyLayers):
                     'DLkwargs':{},
                     'replace_data':True,
                     'fmod':'force',
-                    'fGHz':np.array([2.45])
+                    'fGHz':np.array([2.45]),
+                    'incremental':False
                     }
 
         for k in defaults:
             if k not in kwargs:
                 kwargs[k] = defaults[k]
 
-        DLkwargs = kwargs.pop('DLkwargs')
+        DLkwargs = dict(kwargs.pop('DLkwargs'))
         links = kwargs.pop('links')
         wstd = kwargs.pop('wstd')
         OB = kwargs.pop('OB')
@@ -565,6 +569,9 @@ class Simul(PyLayers):
         I2I = kwargs.pop('I2I')
         fmod = kwargs.pop('fmod')
         self.fGHz = kwargs.pop('fGHz')
+        incremental = kwargs.pop('incremental')
+        if 'incremental' not in DLkwargs:
+            DLkwargs['incremental'] = incremental
 
         self.todo.update({'OB':OB,'B2B':B2B,'B2I':B2I,'I2I':I2I})
 
@@ -0,0 +1,90 @@
+from pylayers.simul.link import *
+import numpy as np
+from numpy.testing import ( TestCase, assert_almost_equal, assert_raises, assert_equal, assert_, run_module_suite)
+
+fGHz = np.linspace(2,11,19)
+kwargs = {'cutoff':3,'threshold':0.1,'si_progress':False}
+force = ['ray2','ray','Ct','H']
+L = Layout('defstr.ini')
+L.build()
+
+def newpt(L,p,same=True):
+    """ point at a small distance of p in the same cycle (or not)
+    """
+    cy = L.pt2cy(p)
+    for d in np.linspace(0.2,4,20):
+        for u in [(1,0),(0,1),(-1,0),(0,-1)]:
+            q = p + d*np.array([u[0],u[1],0])
+            try:
+                cq = L.pt2cy(q)
+            except:
+                continue
+            if (cq == cy) == same:
+                return q
+    raise NameError('no point found')
+
+def assert_rays_equal(R1,R2):
+    assert_equal(R1.nray,R2.nray)
+    assert_equal(sorted(R1.keys()),sorted(R2.keys()))
+    for k in R1:
+        for key in ['sig','pt','dis']:
+            if key in R1[k]:
+                assert_almost_equal(R1[k][key],R2[k][key])
+
+def assert_link_equal(DL1,DL2):
+    assert_equal(len(DL1.Si),len(DL2.Si))
+    for k in DL1.Si:
+        assert_equal(DL1.Si[k],DL2.Si[k])
+    assert_rays_equal(DL1.r2d,DL2.r2d)
+    assert_rays_equal(DL1.R,DL2.R)
+    for c in ['Ctt','Ctp','Cpt','Cpp']:
+        assert_almost_equal(getattr(DL1.C,c).y,getattr(DL2.C,c).y)
+    assert_almost_equal(DL1.H.y,DL2.H.y)
+
+def full(a,b):
+    DL = DLink(L=L,fGHz=fGHz)
+    DL.a = a
+    DL.b = b
+    DL.eval(force=True,**kwargs)
+    return DL
+
+class Tesincremental(TestCase):
+    def test_samecycle(self):
+        print "testing incremental DLink.eval versus full evaluation"
+        DL = DLink(L=L,fGHz=fGHz)
+        DL.eval(force=True,incremental=True,**kwargs)
+        Si = DL.Si
+        b = newpt(L,DL.b)
+        DL.b = b
+        DL.eval(force=force,incremental=True,**kwargs)
+        # signatures are reused
+        assert_(DL.Si is Si)
+        assert_link_equal(DL,full(DL.a,b))
+        a = newpt(L,DL.a)
+        DL.a = a
+        DL.eval(force=force,incremental=True,**kwargs)
+        assert_(DL.Si is Si)
+        assert_link_equal(DL,full(a,b))
+
+    def test_newcycle(self):
+        print "testing incremental DLink.eval after a change of cycle"
+        DL = DLink(L=L,fGHz=fGHz)
+        DL.eval(force=True,incremental=True,**kwargs)
+        Si = DL.Si
+        b = newpt(L,DL.b,same=False)
+        DL.b = b
+        DL.eval(force=force,incremental=True,**kwargs)
+        assert_(DL.Si is not Si)
+        assert_link_equal(DL,full(DL.a,b))
+        # forced signatures are not reused
+        Si = DL.Si
+        DL.eval(force=['sig']+force,incremental=True,**kwargs)
+        assert_(DL.Si is not Si)
+        # other signature parameters
+        Si = DL.Si
+        DL.eval(force=force,incremental=True,cutoff=2,threshold=0.1,
+                si_progress=False)
+        assert_(DL.Si is not Si)
+
+if __name__ == "__main__":
+    run_module_suite()
@@ -5787,6 +5787,91 @@ def get_pol_angles(poly, unit='rad', inside=True):
         return upt.astype(int), ang
 
 
+def get_pols_angles(lpoly, unit='rad', inside=True):
+    """ find angles of a list of Gt cycles in a single vectorized pass
+
+    Parameters
+    ----------
+
+    lpoly : list of polygons
+    unit : str
+        'deg' : degree values
+        'rad' : radian values
+    inside : boolean
+        see get_pol_angles
+
+    Returns
+    -------
+
+    (u,a,ip)
+    u : int (Nt)
+        point number
+    a : float (Nt)
+        associated angle to the point
+    ip : int (Nt)
+        index in lpoly of the polygon the point belongs to
+
+    Notes
+    -----
+
+    The vertices of all the polygons are concatenated and the previous and
+    next vertices are taken modulo the size of each polygon. This gives the
+    same angles as get_pol_angles applied polygon by polygon.
+
+    See Also
+    --------
+
+    get_pol_angles
+
+    """
+    lpt = []
+    lupt = []
+    for poly in lpoly:
+        pt = np.array(poly.exterior.xy)[:, :-1]
+        if hasattr(poly, 'vnodes'):
+            upt = poly.vnodes[poly.vnodes < 0]
+        else:
+            upt = np.arange(pt.shape[1])
+        # flip orientation in case of negative area
+        if SignedArea(pt) < 0:
+            upt = upt[::-1]
+            pt = pt[:, ::-1]
+        lpt.append(pt)
+        lupt.append(upt)
+
+    if len(lpt) == 0:
+        return np.array([], dtype=int), np.array([]), np.array([], dtype=int)
+
+    npt = np.array([x.shape[1] for x in lpt])
+    off = np.hstack((0, np.cumsum(npt)))[:-1]
+    pt = np.hstack(lpt)
+    upt = np.hstack(lupt).astype(int)
+    ip = np.repeat(np.arange(len(lpt)), npt)
+    # rank of the vertex in its polygon
+    k = np.arange(pt.shape[1]) - off[ip]
+    iprev = off[ip] + np.mod(k - 1, npt[ip])
+    inext = off[ip] + np.mod(k + 1, npt[ip])
+
+    v0 = pt - pt[:, iprev]
+    v1 = pt[:, inext] - pt
+    v0 = v0 / np.sqrt(np.sum(v0 * v0, axis=0))
+    v1 = v1 / np.sqrt(np.sum(v1 * v1, axis=0))
+    cross = v0[0] * v1[1] - v0[1] * v1[0]
+    dot = np.sum(v0 * v1, axis=0)
+    ang = np.arctan2(cross, dot)
+    uneg = ang < 0
+    ang[uneg] = -ang[uneg] + np.pi
+    ang[~uneg] = np.pi - ang[~uneg]
+
+    if not inside:
+        ang = 2 * np.pi - ang
+
+    if unit == 'deg':
+        return upt, ang * 180 / np.pi, ip
+    elif unit == 'rad':
+        return upt, ang, ip
+
+
 def reflection_matrix(U):
     """ 
     https://en.wikipedia.org/wiki/Transformation_matrix#Reflection